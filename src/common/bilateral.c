@@ -17,7 +17,8 @@
 */
 
 #include "common/bilateral.h"
-#include "common/darktable.h" // for CLAMPS, dt_alloc_align, dt_free_align
+#include "common/darktable.h" // for CLAMPS
+#include "develop/pixelpipe_scratch.h" // for dt_dev_pixelpipe_scratch_alloc, dt_dev_pixelpipe_scratch_free
 #include <glib.h>             // for MIN, MAX
 #include <math.h>             // for roundf
 #include <stdlib.h>           // for size_t, free, malloc, NULL
@@ -89,7 +90,8 @@ static void image_to_grid(const dt_bilateral_t *const b, const int i, const int
   *z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
 }
 
-dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
+dt_bilateral_t *dt_bilateral_init(struct dt_dev_pixelpipe_t *pipe, // pipe to take the grid from, or NULL
+                                  const int width,     // width of input image
                                   const int height,    // height of input image
                                   const float sigma_s, // spatial sigma (blur pixel coords)
                                   const float sigma_r) // range sigma (blur luma values)
@@ -109,7 +111,13 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   b->height = height;
   b->sigma_s = MAX(height / (b->size_y - 1.0f), width / (b->size_x - 1.0f));
   b->sigma_r = 100.0f / (b->size_z - 1.0f);
-  b->buf = dt_alloc_align(16, b->size_x * b->size_y * b->size_z * sizeof(float));
+  b->pipe = pipe;
+  b->buf = dt_dev_pixelpipe_scratch_alloc(pipe, b->size_x * b->size_y * b->size_z * sizeof(float));
+  if(!b->buf)
+  {
+    free(b);
+    return NULL;
+  }
 
   memset(b->buf, 0, b->size_x * b->size_y * b->size_z * sizeof(float));
 #if 0
@@ -120,6 +128,7 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   return b;
 }
 
+__DT_CLONE_TARGETS__
 void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
 {
   const int ox = 1;
@@ -164,6 +173,7 @@ void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
   }
 }
 
+__DT_CLONE_TARGETS__
 static void blur_line_z(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
                         const int size2, const int size3)
 {
@@ -201,6 +211,7 @@ static void blur_line_z(float *buf, const int offset1, const int offset2, const
   }
 }
 
+__DT_CLONE_TARGETS__
 static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
                       const int size2, const int size3)
 {
@@ -252,6 +263,7 @@ void dt_bilateral_blur(dt_bilateral_t *b)
 }
 
 
+__DT_CLONE_TARGETS__
 void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail)
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
@@ -297,6 +309,7 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
   }
 }
 
+__DT_CLONE_TARGETS__
 void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *const in, float *out,
                                   const float detail)
 {
@@ -341,7 +354,7 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
 void dt_bilateral_free(dt_bilateral_t *b)
 {
   if(!b) return;
-  dt_free_align(b->buf);
+  dt_dev_pixelpipe_scratch_free(b->pipe, b->buf);
   free(b);
 }
 
@@ -20,12 +20,15 @@
 
 #include <stddef.h> // for size_t
 
+struct dt_dev_pixelpipe_t;
+
 typedef struct dt_bilateral_t
 {
   size_t size_x, size_y, size_z;
   int width, height;
   float sigma_s, sigma_r;
   float *buf;
+  struct dt_dev_pixelpipe_t *pipe; // buf comes from its scratch pool, may be NULL
 } dt_bilateral_t;
 
 size_t dt_bilateral_memory_use(const int width,      // width of input image
@@ -48,7 +51,8 @@ size_t dt_bilateral_singlebuffer_size2(const int width,      // width of input i
                                        const float sigma_s,  // spatial sigma (blur pixel coords)
                                        const float sigma_r); // range sigma (blur luma values)
 
-dt_bilateral_t *dt_bilateral_init(const int width,      // width of input image
+dt_bilateral_t *dt_bilateral_init(struct dt_dev_pixelpipe_t *pipe, // pipe to take the grid from, or NULL
+                                  const int width,      // width of input image
                                   const int height,     // height of input image
                                   const float sigma_s,  // spatial sigma (blur pixel coords)
                                   const float sigma_r); // range sigma (blur luma values)
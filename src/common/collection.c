@@ -19,6 +19,7 @@
 #include "common/collection.h"
 #include "common/debug.h"
 #include "common/image.h"
+#include "common/image_cache.h"
 #include "common/imageio_rawspeed.h"
 #include "common/metadata.h"
 #include "common/utility.h"
@@ -42,6 +43,24 @@
 #define ORDER_BY_QUERY "ORDER BY %s"
 #define LIMIT_QUERY "LIMIT ?1, ?2"
 
+/* parameters of the query shapes. ?1 and ?2 are the limit, bound by the caller */
+#define PARAM_FILM_ID 3
+#define PARAM_RATING 4
+#define PARAM_GROUP 5
+/* the values of the collect rules, in the order get_query_string() added them */
+#define PARAM_VALUES 10
+/* keep clear of the parameter limit of older sqlite (999), more values are spliced into the text */
+#define MAX_VALUES 900
+/* prepared statements kept per collection, sort orders times grouping times the callers */
+#define MAX_STMTS 16
+
+/* a filter value of a collect rule, bound as a double if it's a number */
+typedef struct dt_collection_value_t
+{
+  gchar *text;
+  gboolean number;
+} dt_collection_value_t;
+
 static const char *comparators[] = {
   "<",  // DT_COLLECTION_RATING_COMP_LT = 0,
   "<=", // DT_COLLECTION_RATING_COMP_LEQ,
@@ -53,8 +72,13 @@ static const char *comparators[] = {
 
 /* Stores the collection query, returns 1 if changed.. */
 static int _dt_collection_store(const dt_collection_t *collection, gchar *query, gchar *query_no_group);
+/* Stores the text of the count query, returns TRUE if it changed. */
+static gboolean _dt_collection_store_count_query(const dt_collection_t *collection, gboolean no_group,
+                                                 gchar *count_query);
 /* Counts the number of images in the current collection */
 static uint32_t _dt_collection_compute_count(const dt_collection_t *collection, gboolean no_group);
+/* Refreshes both cached counts of the collection */
+static void _dt_collection_update_counts(const dt_collection_t *collection);
 /* signal handlers to update the cached count when something interesting might have happened.
  * we need 2 different since there are different kinds of signals we need to listen to. */
 static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data);
@@ -65,6 +89,128 @@ static int dt_collection_image_offset_with_collection(const dt_collection_t *col
 /* update aspect ratio for the selected images */
 static void _collection_update_aspect_ratio(const dt_collection_t *collection);
 
+static void _value_free(gpointer data)
+{
+  dt_collection_value_t *v = (dt_collection_value_t *)data;
+  g_free(v->text);
+  g_free(v);
+}
+
+static GPtrArray *_values_copy(const GPtrArray *values)
+{
+  if(!values) return NULL;
+  GPtrArray *copy = g_ptr_array_new_with_free_func(_value_free);
+  for(guint k = 0; k < values->len; k++)
+  {
+    const dt_collection_value_t *v = g_ptr_array_index(values, k);
+    dt_collection_value_t *c = g_malloc(sizeof(dt_collection_value_t));
+    c->text = g_strdup(v->text);
+    c->number = v->number;
+    g_ptr_array_add(copy, c);
+  }
+  return copy;
+}
+
+/* adds a filter value and writes its parameter to param, which is returned for use in a format */
+static const gchar *_value_add(GPtrArray *values, const gchar *text, const gboolean number, gchar param[16])
+{
+  dt_collection_value_t *v = g_malloc(sizeof(dt_collection_value_t));
+  v->text = g_strdup(text);
+  v->number = number;
+  g_ptr_array_add(values, v);
+  snprintf(param, 16, "?%u", PARAM_VALUES + values->len - 1);
+  return param;
+}
+
+/* numbers are checked by the split functions, exposures can come as 1.0/x */
+static double _value_number(const dt_collection_value_t *v)
+{
+  const gchar *slash = strchr(v->text, '/');
+  const double n = g_ascii_strtod(v->text, NULL);
+  return slash ? n / g_ascii_strtod(slash + 1, NULL) : n;
+}
+
+static int _dt_collection_rating(const dt_collection_t *collection)
+{
+  const dt_collection_filter_t rating = collection->params.rating;
+  return (rating == DT_COLLECTION_FILTER_NOT_REJECT ? DT_COLLECTION_FILTER_STAR_NO : rating) - 1;
+}
+
+static int _dt_collection_group(void)
+{
+  return darktable.gui ? darktable.gui->expanded_group_id : -1;
+}
+
+/* splices the parameters of a query shape back in, for the callers that need plain sql text. ?1 and ?2 stay */
+static gchar *_dt_collection_render(const dt_collection_t *collection, const GPtrArray *values,
+                                    const gchar *shape)
+{
+  if(!shape) return NULL;
+  GString *s = g_string_sized_new(strlen(shape));
+  gboolean quoted = FALSE;
+  for(const gchar *c = shape; *c; c++)
+  {
+    // a doubled quote inside a literal toggles twice
+    if(*c == '\'') quoted = !quoted;
+    if(quoted || *c != '?' || !g_ascii_isdigit(c[1]))
+    {
+      g_string_append_c(s, *c);
+      continue;
+    }
+    gchar *end = NULL;
+    const guint64 n = g_ascii_strtoull(c + 1, &end, 10);
+    if(n == PARAM_FILM_ID)
+      g_string_append_printf(s, "%d", collection->params.film_id);
+    else if(n == PARAM_RATING)
+      g_string_append_printf(s, "%d", _dt_collection_rating(collection));
+    else if(n == PARAM_GROUP)
+      g_string_append_printf(s, "%d", _dt_collection_group());
+    else if(n >= PARAM_VALUES && values && n - PARAM_VALUES < values->len)
+    {
+      const dt_collection_value_t *v = g_ptr_array_index(values, n - PARAM_VALUES);
+      if(v->number)
+        g_string_append(s, v->text);
+      else
+      {
+        char *literal = sqlite3_mprintf("%Q", v->text);
+        g_string_append(s, literal);
+        sqlite3_free(literal);
+      }
+    }
+    else
+      g_string_append_len(s, c, end - c);
+    c = end - 1;
+  }
+  return g_string_free(s, FALSE);
+}
+
+static void _dt_collection_bind(const dt_collection_t *collection, sqlite3_stmt *stmt)
+{
+  const int count = sqlite3_bind_parameter_count(stmt);
+  if(count >= PARAM_FILM_ID) DT_DEBUG_SQLITE3_BIND_INT(stmt, PARAM_FILM_ID, collection->params.film_id);
+  if(count >= PARAM_RATING) DT_DEBUG_SQLITE3_BIND_INT(stmt, PARAM_RATING, _dt_collection_rating(collection));
+  if(count >= PARAM_GROUP) DT_DEBUG_SQLITE3_BIND_INT(stmt, PARAM_GROUP, _dt_collection_group());
+  const GPtrArray *values = collection->values;
+  for(guint k = 0; values && k < values->len && PARAM_VALUES + (int)k <= count; k++)
+  {
+    const dt_collection_value_t *v = g_ptr_array_index(values, k);
+    if(v->number)
+      DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, PARAM_VALUES + k, _value_number(v));
+    else
+      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, PARAM_VALUES + k, v->text, -1, SQLITE_TRANSIENT);
+  }
+}
+
+/* the where part of the collect rules with the values as parameters */
+static gchar *_dt_collection_where_shape(const dt_collection_t *collection)
+{
+  gchar **parts = collection->where_shape ? collection->where_shape : collection->where_ext;
+  gchar *joined = parts ? g_strjoinv("", parts) : g_strdup("");
+  gchar *where = g_strdup_printf("(1=1%s)", joined);
+  g_free(joined);
+  return where;
+}
+
 const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
 {
   dt_collection_t *collection = g_malloc0(sizeof(dt_collection_t));
@@ -75,11 +221,18 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
     memcpy(&collection->params, &clone->params, sizeof(dt_collection_params_t));
     memcpy(&collection->store, &clone->store, sizeof(dt_collection_params_t));
     collection->where_ext = g_strdupv(clone->where_ext);
+    collection->where_shape = g_strdupv(clone->where_shape);
+    collection->values = _values_copy(clone->values);
     collection->query = g_strdup(clone->query);
     collection->query_no_group = g_strdup(clone->query_no_group);
+    collection->query_shape = g_strdup(clone->query_shape);
+    collection->query_no_group_shape = g_strdup(clone->query_no_group_shape);
     collection->clone = 1;
     collection->count = clone->count;
     collection->count_no_group = clone->count_no_group;
+    /* same params, same count queries. the statements are prepared on first use, none are shared */
+    collection->count_query[0] = g_strdup(clone->count_query[0]);
+    collection->count_query[1] = g_strdup(clone->count_query[1]);
   }
   else /* else we just initialize using the reset */
     dt_collection_reset(collection);
@@ -108,9 +261,19 @@ void dt_collection_free(const dt_collection_t *collection)
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_recount_callback_2),
                                (gpointer)collection);
 
+  for(int k = 0; k < 2; k++)
+  {
+    if(collection->count_stmt[k]) sqlite3_finalize(collection->count_stmt[k]);
+    g_free(collection->count_query[k]);
+  }
+  if(collection->stmts) g_hash_table_destroy(collection->stmts);
   g_free(collection->query);
   g_free(collection->query_no_group);
+  g_free(collection->query_shape);
+  g_free(collection->query_no_group_shape);
   g_strfreev(collection->where_ext);
+  g_strfreev(collection->where_shape);
+  if(collection->values) g_ptr_array_free(collection->values, TRUE);
   g_free((dt_collection_t *)collection);
 }
 
@@ -119,24 +282,21 @@ const dt_collection_params_t *dt_collection_params(const dt_collection_t *collec
   return &collection->params;
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+/* builds the where part of the collection query, with and without grouping, with the filter values as
+ * parameters */
+static void _dt_collection_build_where(const dt_collection_t *collection, gchar **where, gchar **where_no_group)
 {
-  uint32_t result;
-  gchar *wq, *wq_no_group, *sq, *selq_pre, *selq_post, *query, *query_no_group;
-  wq = wq_no_group = sq = selq_pre = selq_post = query = query_no_group = NULL;
+  gchar *wq = NULL, *wq_no_group = NULL;
 
-  /* build where part */
-  gchar *where_ext = dt_collection_get_extended_where(collection, -1);
+  gchar *where_ext = _dt_collection_where_shape(collection);
   if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
     int need_operator = 0;
-    dt_collection_filter_t rating = collection->params.rating;
-    if(rating == DT_COLLECTION_FILTER_NOT_REJECT) rating = DT_COLLECTION_FILTER_STAR_NO;
 
     /* add default filters */
     if(collection->params.filter_flags & COLLECTION_FILTER_FILM_ID)
     {
-      wq = dt_util_dstrcat(wq, "(film_id = %d)", collection->params.film_id);
+      wq = dt_util_dstrcat(wq, "(film_id = ?%d)", PARAM_FILM_ID);
       need_operator = 1;
     }
     // DON'T SELECT IMAGES MARKED TO BE DELETED.
@@ -145,21 +305,21 @@ int dt_collection_update(const dt_collection_t *collection)
                          DT_IMAGE_REMOVE);
 
     if(collection->params.filter_flags & COLLECTION_FILTER_CUSTOM_COMPARE)
-      wq = dt_util_dstrcat(wq, " %s (flags & 7) %s %d AND (flags & 7) != 6",
+      wq = dt_util_dstrcat(wq, " %s (flags & 7) %s ?%d AND (flags & 7) != 6",
                            (need_operator) ? "and" : ((need_operator = 1) ? "" : ""),
-                           comparators[collection->params.comparator], rating - 1);
+                           comparators[collection->params.comparator], PARAM_RATING);
     else if(collection->params.filter_flags & COLLECTION_FILTER_ATLEAST_RATING)
-      wq = dt_util_dstrcat(wq, " %s (flags & 7) >= %d AND (flags & 7) != 6",
-                           (need_operator) ? "and" : ((need_operator = 1) ? "" : ""), rating - 1);
+      wq = dt_util_dstrcat(wq, " %s (flags & 7) >= ?%d AND (flags & 7) != 6",
+                           (need_operator) ? "and" : ((need_operator = 1) ? "" : ""), PARAM_RATING);
     else if(collection->params.filter_flags & COLLECTION_FILTER_EQUAL_RATING)
-      wq = dt_util_dstrcat(wq, " %s (flags & 7) == %d",
-                           (need_operator) ? "AND" : ((need_operator = 1) ? "" : ""), rating - 1);
+      wq = dt_util_dstrcat(wq, " %s (flags & 7) == ?%d",
+                           (need_operator) ? "AND" : ((need_operator = 1) ? "" : ""), PARAM_RATING);
 
     if(collection->params.filter_flags & COLLECTION_FILTER_ALTERED)
-      wq = dt_util_dstrcat(wq, " %s id IN (SELECT imgid FROM main.history WHERE imgid=id)",
+      wq = dt_util_dstrcat(wq, " %s id IN (SELECT imgid FROM main.history)",
                            (need_operator) ? "AND" : ((need_operator = 1) ? "" : ""));
     else if(collection->params.filter_flags & COLLECTION_FILTER_UNALTERED)
-      wq = dt_util_dstrcat(wq, " %s id NOT IN (SELECT imgid FROM main.history WHERE imgid=id)",
+      wq = dt_util_dstrcat(wq, " %s id NOT IN (SELECT imgid FROM main.history)",
                            (need_operator) ? "AND" : ((need_operator = 1) ? "" : ""));
 
     /* add where ext if wanted */
@@ -177,7 +337,7 @@ int dt_collection_update(const dt_collection_t *collection)
   if(darktable.gui && darktable.gui->grouping)
   {
     /* Show the expanded group... */
-    wq = dt_util_dstrcat(wq, " AND (group_id = %d OR "
+    wq = dt_util_dstrcat(wq, " AND (group_id = ?%d OR "
                              /* ...and, in unexpanded groups, show the representative image.
                               * It's possible that the above WHERE clauses will filter out the representative
                               * image, so we have some logic here to pick the image id closest to the
@@ -187,13 +347,53 @@ int dt_collection_update(const dt_collection_t *collection)
                              "(ABS(id-group_id)*2 + CASE WHEN (id-group_id) < 0 THEN 1 ELSE 0 END) IN "
                              "(SELECT MIN(ABS(id-group_id)*2 + CASE WHEN (id-group_id) < 0 THEN 1 ELSE 0 END) "
                              "FROM main.images WHERE %s GROUP BY group_id))",
-                         darktable.gui->expanded_group_id, wq_no_group);
+                         PARAM_GROUP, wq_no_group);
 
     /* Additionally, when a group is expanded, make sure the representative image wasn't filtered out.
      * This is important, because otherwise it may be impossible to collapse the group again. */
-    wq = dt_util_dstrcat(wq, " OR (id = %d)", darktable.gui->expanded_group_id);
+    wq = dt_util_dstrcat(wq, " OR (id = ?%d)", PARAM_GROUP);
   }
 
+  *where = wq;
+  *where_no_group = wq_no_group;
+}
+
+/* builds both count queries from the where part, returns TRUE if the text of one of them changed */
+static gboolean _dt_collection_store_count_queries(const dt_collection_t *collection, const gchar *wq,
+                                                   const gchar *wq_no_group)
+{
+  gboolean count_changed = FALSE;
+  if(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT)
+  {
+    gchar *where_ext = _dt_collection_where_shape(collection);
+    count_changed |= _dt_collection_store_count_query(
+        collection, FALSE,
+        g_strdup_printf("SELECT COUNT(DISTINCT main.images.id) FROM main.images %s", where_ext));
+    count_changed |= _dt_collection_store_count_query(
+        collection, TRUE,
+        g_strdup_printf("SELECT COUNT(DISTINCT main.images.id) FROM main.images %s", where_ext));
+    g_free(where_ext);
+  }
+  else
+  {
+    count_changed |= _dt_collection_store_count_query(
+        collection, FALSE, g_strdup_printf("SELECT COUNT(DISTINCT a.id) FROM main.images AS a WHERE %s", wq));
+    count_changed |= _dt_collection_store_count_query(
+        collection, TRUE,
+        g_strdup_printf("SELECT COUNT(DISTINCT a.id) FROM main.images AS a WHERE %s", wq_no_group));
+  }
+  return count_changed;
+}
+
+int dt_collection_update(const dt_collection_t *collection)
+{
+  uint32_t result;
+  gchar *wq, *wq_no_group, *sq, *selq_pre, *selq_post, *query, *query_no_group;
+  wq = wq_no_group = sq = selq_pre = selq_post = query = query_no_group = NULL;
+
+  /* build where part */
+  _dt_collection_build_where(collection, &wq, &wq_no_group);
+
   /* build select part includes where */
   if(collection->params.sort == DT_COLLECTION_SORT_COLOR
      && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT))
@@ -234,15 +434,24 @@ int dt_collection_update(const dt_collection_t *collection)
     sq = dt_collection_get_sort_query(collection);
   }
 
-  /* store the new query */
-  query
-      = dt_util_dstrcat(query, "%s%s%s %s%s", selq_pre, wq, selq_post ? selq_post : "", sq ? sq : "",
+  /* store the new query, as shape for the statements and with the values spliced in for everyone else */
+  dt_collection_t *c = (dt_collection_t *)collection;
+  g_free(c->query_shape);
+  g_free(c->query_no_group_shape);
+  c->query_shape
+      = dt_util_dstrcat(NULL, "%s%s%s %s%s", selq_pre, wq, selq_post ? selq_post : "", sq ? sq : "",
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
-  query_no_group
-      = dt_util_dstrcat(query_no_group, "%s%s%s %s%s", selq_pre, wq_no_group, selq_post ? selq_post : "", sq ? sq : "",
+  c->query_no_group_shape
+      = dt_util_dstrcat(NULL, "%s%s%s %s%s", selq_pre, wq_no_group, selq_post ? selq_post : "", sq ? sq : "",
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
+  query = _dt_collection_render(collection, collection->values, collection->query_shape);
+  query_no_group = _dt_collection_render(collection, collection->values, collection->query_no_group_shape);
   result = _dt_collection_store(collection, query, query_no_group);
 
+  /* the count doesn't depend on the sort order or the joins needed for it, so build it from the where part
+   * only. that way changing the sort order or only the filter values leaves the count query untouched. */
+  const gboolean count_changed = _dt_collection_store_count_queries(collection, wq, wq_no_group);
+
   /* free memory used */
   g_free(sq);
   g_free(wq);
@@ -253,9 +462,9 @@ int dt_collection_update(const dt_collection_t *collection)
   g_free(query_no_group);
 
   /* update the cached count. collection isn't a real const anyway, we are writing to it in
-   * _dt_collection_store, too. */
-  ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
-  ((dt_collection_t *)collection)->count_no_group = _dt_collection_compute_count(collection, TRUE);
+   * _dt_collection_store, too. a pure change of the sort order can't change the count. */
+  if(count_changed || !collection->sort_only) _dt_collection_update_counts(collection);
+  ((dt_collection_t *)collection)->sort_only = FALSE;
   dt_collection_hint_message(collection);
 
   _collection_update_aspect_ratio(collection);
@@ -283,6 +492,40 @@ void dt_collection_reset(const dt_collection_t *collection)
   dt_collection_update_query(collection);
 }
 
+sqlite3_stmt *dt_collection_get_stmt(const dt_collection_t *collection, const gchar *prefix, const gchar *suffix,
+                                     const gboolean no_group)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  if(!c->query_shape) dt_collection_update(collection);
+  const gchar *shape = no_group ? c->query_no_group_shape : c->query_shape;
+  if(!shape || shape[0] == '\0') return NULL;
+
+  /* a sort flip or new filter values give the same text again, only new rules or sort orders get parsed */
+  gchar *text = g_strconcat(prefix ? prefix : "", " ", shape, suffix ? suffix : "", NULL);
+  sqlite3_stmt *stmt = c->stmts ? g_hash_table_lookup(c->stmts, text) : NULL;
+  if(stmt)
+    g_free(text);
+  else
+  {
+    if(!c->stmts)
+      c->stmts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)sqlite3_finalize);
+    else if(g_hash_table_size(c->stmts) >= MAX_STMTS)
+      g_hash_table_remove_all(c->stmts);
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), text, -1, &stmt, NULL);
+    if(!stmt)
+    {
+      g_free(text);
+      return NULL;
+    }
+    g_hash_table_insert(c->stmts, text, stmt);
+  }
+
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  _dt_collection_bind(collection, stmt);
+  return stmt;
+}
+
 const gchar *dt_collection_get_query(const dt_collection_t *collection)
 {
   /* ensure there is a query string for collection */
@@ -351,11 +594,19 @@ gchar *dt_collection_get_extended_where(const dt_collection_t *collection, int e
 
 void dt_collection_set_extended_where(const dt_collection_t *collection, gchar **extended_where)
 {
+  dt_collection_t *c = (dt_collection_t *)collection;
+
   /* free extended where if already exists */
-  g_strfreev(collection->where_ext);
+  g_strfreev(c->where_ext);
 
   /* set new from parameter */
-  ((dt_collection_t *)collection)->where_ext = g_strdupv(extended_where);
+  c->where_ext = g_strdupv(extended_where);
+
+  /* the values are in the text, there is nothing to bind */
+  g_strfreev(c->where_shape);
+  c->where_shape = NULL;
+  if(c->values) g_ptr_array_free(c->values, TRUE);
+  c->values = NULL;
 }
 
 void dt_collection_set_film_id(const dt_collection_t *collection, uint32_t film_id)
@@ -432,6 +683,7 @@ void dt_collection_set_sort(const dt_collection_t *collection, dt_collection_sor
 
   if(sort != DT_COLLECTION_SORT_NONE) params->sort = sort;
   if(reverse != -1) params->descending = reverse;
+  ((dt_collection_t *)collection)->sort_only = TRUE;
 
   _collection_update_aspect_ratio(collection);
 }
@@ -593,37 +845,65 @@ static int _dt_collection_store(const dt_collection_t *collection, gchar *query,
   return 1;
 }
 
-static uint32_t _dt_collection_compute_count(const dt_collection_t *collection, gboolean no_group)
+static gboolean _dt_collection_store_count_query(const dt_collection_t *collection, gboolean no_group,
+                                                 gchar *count_query)
 {
-  sqlite3_stmt *stmt = NULL;
-  uint32_t count = 1;
-  const gchar *query = no_group ? dt_collection_get_query_no_group(collection) : dt_collection_get_query(collection);
-  gchar *count_query = NULL;
+  dt_collection_t *c = (dt_collection_t *)collection;
+  const int k = no_group ? 1 : 0;
 
-  gchar *fq = g_strstr_len(query, strlen(query), "FROM");
-  if((collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  if(c->count_query[k] && !strcmp(c->count_query[k], count_query))
   {
-    gchar *where_ext = dt_collection_get_extended_where(collection, -1);
-    count_query = dt_util_dstrcat(NULL, "SELECT COUNT(DISTINCT main.images.id) FROM main.images %s", where_ext);
-    g_free(where_ext);
+    g_free(count_query);
+    return FALSE;
   }
-  else
-    count_query = dt_util_dstrcat(count_query, "SELECT COUNT(DISTINCT a.id) %s", fq);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
-  if((collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-     && !(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  /* the query changed, the statement gets prepared again on next use */
+  if(c->count_stmt[k]) sqlite3_finalize(c->count_stmt[k]);
+  c->count_stmt[k] = NULL;
+  g_free(c->count_query[k]);
+  c->count_query[k] = count_query;
+  return TRUE;
+}
+
+static uint32_t _dt_collection_compute_count(const dt_collection_t *collection, gboolean no_group)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  const int k = no_group ? 1 : 0;
+  uint32_t count = 1;
+
+  /* the count query is built together with the main query. a collection that was never updated (a clone) only
+   * gets the count queries, a full update would store queries and touch the aspect ratios as a side effect. */
+  if(!c->count_query[k])
   {
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+    gchar *wq = NULL, *wq_no_group = NULL;
+    _dt_collection_build_where(collection, &wq, &wq_no_group);
+    _dt_collection_store_count_queries(collection, wq, wq_no_group);
+    g_free(wq);
+    g_free(wq_no_group);
   }
+  if(!c->count_query[k]) return count;
 
-  if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
-  g_free(count_query);
+  if(!c->count_stmt[k])
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), c->count_query[k], -1, &c->count_stmt[k], NULL);
+  if(!c->count_stmt[k]) return count;
+
+  _dt_collection_bind(collection, c->count_stmt[k]);
+  if(sqlite3_step(c->count_stmt[k]) == SQLITE_ROW) count = sqlite3_column_int(c->count_stmt[k], 0);
+  sqlite3_reset(c->count_stmt[k]);
   return count;
 }
 
+static void _dt_collection_update_counts(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  c->count = _dt_collection_compute_count(collection, FALSE);
+  /* without grouping both queries are the same, no need to ask sqlite twice */
+  if(g_strcmp0(collection->count_query[0], collection->count_query[1]) == 0)
+    c->count_no_group = c->count;
+  else
+    c->count_no_group = _dt_collection_compute_count(collection, TRUE);
+}
+
 uint32_t dt_collection_get_count(const dt_collection_t *collection)
 {
   return collection->count;
@@ -1042,27 +1322,29 @@ gchar *dt_collection_get_makermodel(const char *exif_maker, const char *exif_mod
   return makermodel;
 }
 
-static gchar *get_query_string(const dt_collection_properties_t property, const gchar *text)
+/* the where part of one collect rule. the values from text are added to values and referenced as parameters */
+static gchar *get_query_string(const dt_collection_properties_t property, const gchar *text, GPtrArray *values)
 {
   char *escaped_text = sqlite3_mprintf("%q", text);
   gchar *query = NULL;
+  gchar p1[16], p2[16];
 
   switch(property)
   {
     case DT_COLLECTION_PROP_FILMROLL: // film roll
       if(!(escaped_text && *escaped_text))
-        query = dt_util_dstrcat(query, "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE '%s%%'))",
-                                escaped_text);
+        query = dt_util_dstrcat(query, "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE %s || '%%'))",
+                                _value_add(values, text, FALSE, p1));
       else
-        query = dt_util_dstrcat(query, "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE '%s'))",
-                                escaped_text);
+        query = dt_util_dstrcat(query, "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE %s))",
+                                _value_add(values, text, FALSE, p1));
       break;
 
     case DT_COLLECTION_PROP_FOLDERS: // folders
       query = dt_util_dstrcat(
-          query, "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE '%1$s' OR folder LIKE '%1$s"
+          query, "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE %1$s OR folder LIKE %1$s || '"
                  G_DIR_SEPARATOR_S "%%'))",
-          escaped_text);
+          _value_add(values, text, FALSE, p1));
       break;
 
     case DT_COLLECTION_PROP_COLORLABEL: // colorlabel
@@ -1088,7 +1370,7 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
     break;
 
     case DT_COLLECTION_PROP_HISTORY: // history
-      query = dt_util_dstrcat(query, "(id %s IN (SELECT imgid FROM main.history WHERE imgid=images.id)) ",
+      query = dt_util_dstrcat(query, "(id %s IN (SELECT imgid FROM main.history)) ",
                               (strcmp(escaped_text, _("altered")) == 0) ? "" : "not");
       break;
 
@@ -1113,14 +1395,15 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       if(operator && strcmp(operator, "[]") == 0)
       {
         if(number1 && number2)
-          query = dt_util_dstrcat(query, "((aspect_ratio >= %s) AND (aspect_ratio <= %s))", number1, number2);
+          query = dt_util_dstrcat(query, "((aspect_ratio >= %s) AND (aspect_ratio <= %s))",
+                                  _value_add(values, number1, TRUE, p1), _value_add(values, number2, TRUE, p2));
       }
       else if(operator && number1)
-        query = dt_util_dstrcat(query, "(aspect_ratio %s %s)", operator, number1);
+        query = dt_util_dstrcat(query, "(aspect_ratio %s %s)", operator, _value_add(values, number1, TRUE, p1));
       else if(number1)
-        query = dt_util_dstrcat(query, "(aspect_ratio = %s)", number1);
+        query = dt_util_dstrcat(query, "(aspect_ratio = %s)", _value_add(values, number1, TRUE, p1));
       else
-        query = dt_util_dstrcat(query, "(aspect_ratio LIKE '%%%s%%')", escaped_text);
+        query = dt_util_dstrcat(query, "(aspect_ratio LIKE '%%' || %s || '%%')", _value_add(values, text, FALSE, p1));
 
       g_free(operator);
       g_free(number1);
@@ -1137,11 +1420,8 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       while (element)
       {
         GList *tuple = element->data;
-        char *mk = sqlite3_mprintf("%q", tuple->data);
-        char *md = sqlite3_mprintf("%q", tuple->next->data);
-        query = dt_util_dstrcat(query, " OR (maker = '%s' AND model = '%s')", mk, md);
-        sqlite3_free(mk);
-        sqlite3_free(md);
+        query = dt_util_dstrcat(query, " OR (maker = %s AND model = %s)", _value_add(values, tuple->data, FALSE, p1),
+                                _value_add(values, tuple->next->data, FALSE, p2));
         g_free(tuple->data);
         g_free(tuple->next->data);
         g_list_free(tuple);
@@ -1152,34 +1432,39 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       break;
     case DT_COLLECTION_PROP_TAG: // tag
       query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN "
-                                     "data.tags AS b ON a.tagid = b.id WHERE name LIKE '%s'))",
-                              escaped_text);
+                                     "data.tags AS b ON a.tagid = b.id WHERE name LIKE %s))",
+                              _value_add(values, text, FALSE, p1));
       break;
 
     // TODO: How to handle images without metadata? In the moment they are not shown.
     // TODO: Autogenerate this code?
     case DT_COLLECTION_PROP_TITLE: // title
       query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_TITLE, escaped_text);
+                                     "LIKE '%%' || %s || '%%'))", DT_METADATA_XMP_DC_TITLE,
+                              _value_add(values, text, FALSE, p1));
       break;
     case DT_COLLECTION_PROP_DESCRIPTION: // description
       query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
+                                     "LIKE '%%' || %s || '%%'))", DT_METADATA_XMP_DC_DESCRIPTION,
+                              _value_add(values, text, FALSE, p1));
       break;
     case DT_COLLECTION_PROP_CREATOR: // creator
       query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_CREATOR, escaped_text);
+                                     "LIKE '%%' || %s || '%%'))", DT_METADATA_XMP_DC_CREATOR,
+                              _value_add(values, text, FALSE, p1));
       break;
     case DT_COLLECTION_PROP_PUBLISHER: // publisher
       query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
+                                     "LIKE '%%' || %s || '%%'))", DT_METADATA_XMP_DC_PUBLISHER,
+                              _value_add(values, text, FALSE, p1));
       break;
     case DT_COLLECTION_PROP_RIGHTS: // rights
       query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_RIGHTS, escaped_text);
+                                     "LIKE '%%' || %s || '%%'))", DT_METADATA_XMP_DC_RIGHTS,
+                              _value_add(values, text, FALSE, p1));
       break;
     case DT_COLLECTION_PROP_LENS: // lens
-      query = dt_util_dstrcat(query, "(lens LIKE '%%%s%%')", escaped_text);
+      query = dt_util_dstrcat(query, "(lens LIKE '%%' || %s || '%%')", _value_add(values, text, FALSE, p1));
       break;
 
     case DT_COLLECTION_PROP_FOCAL_LENGTH: // focal length
@@ -1190,14 +1475,15 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       if(operator && strcmp(operator, "[]") == 0)
       {
         if(number1 && number2)
-          query = dt_util_dstrcat(query, "((focal_length >= %s) AND (focal_length <= %s))", number1, number2);
+          query = dt_util_dstrcat(query, "((focal_length >= %s) AND (focal_length <= %s))",
+                                  _value_add(values, number1, TRUE, p1), _value_add(values, number2, TRUE, p2));
       }
       else if(operator && number1)
-        query = dt_util_dstrcat(query, "(focal_length %s %s)", operator, number1);
+        query = dt_util_dstrcat(query, "(focal_length %s %s)", operator, _value_add(values, number1, TRUE, p1));
       else if(number1)
-        query = dt_util_dstrcat(query, "(focal_length = %s)", number1);
+        query = dt_util_dstrcat(query, "(focal_length = %s)", _value_add(values, number1, TRUE, p1));
       else
-        query = dt_util_dstrcat(query, "(focal_length LIKE '%%%s%%')", escaped_text);
+        query = dt_util_dstrcat(query, "(focal_length LIKE '%%' || %s || '%%')", _value_add(values, text, FALSE, p1));
 
       g_free(operator);
       g_free(number1);
@@ -1213,14 +1499,15 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       if(operator && strcmp(operator, "[]") == 0)
       {
         if(number1 && number2)
-          query = dt_util_dstrcat(query, "((iso >= %s) AND (iso <= %s))", number1, number2);
+          query = dt_util_dstrcat(query, "((iso >= %s) AND (iso <= %s))",
+                                  _value_add(values, number1, TRUE, p1), _value_add(values, number2, TRUE, p2));
       }
       else if(operator && number1)
-        query = dt_util_dstrcat(query, "(iso %s %s)", operator, number1);
+        query = dt_util_dstrcat(query, "(iso %s %s)", operator, _value_add(values, number1, TRUE, p1));
       else if(number1)
-        query = dt_util_dstrcat(query, "(iso = %s)", number1);
+        query = dt_util_dstrcat(query, "(iso = %s)", _value_add(values, number1, TRUE, p1));
       else
-        query = dt_util_dstrcat(query, "(iso LIKE '%%%s%%')", escaped_text);
+        query = dt_util_dstrcat(query, "(iso LIKE '%%' || %s || '%%')", _value_add(values, text, FALSE, p1));
 
       g_free(operator);
       g_free(number1);
@@ -1236,15 +1523,16 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       if(operator && strcmp(operator, "[]") == 0)
       {
         if(number1 && number2)
-          query = dt_util_dstrcat(query, "((ROUND(aperture,1) >= %s) AND (ROUND(aperture,1) <= %s))", number1,
-                                  number2);
+          query = dt_util_dstrcat(query, "((ROUND(aperture,1) >= %s) AND (ROUND(aperture,1) <= %s))",
+                                  _value_add(values, number1, TRUE, p1), _value_add(values, number2, TRUE, p2));
       }
       else if(operator && number1)
-        query = dt_util_dstrcat(query, "(ROUND(aperture,1) %s %s)", operator, number1);
+        query = dt_util_dstrcat(query, "(ROUND(aperture,1) %s %s)", operator, _value_add(values, number1, TRUE, p1));
       else if(number1)
-        query = dt_util_dstrcat(query, "(ROUND(aperture,1) = %s)", number1);
+        query = dt_util_dstrcat(query, "(ROUND(aperture,1) = %s)", _value_add(values, number1, TRUE, p1));
       else
-        query = dt_util_dstrcat(query, "(ROUND(aperture,1) LIKE '%%%s%%')", escaped_text);
+        query = dt_util_dstrcat(query, "(ROUND(aperture,1) LIKE '%%' || %s || '%%')",
+                                _value_add(values, text, FALSE, p1));
 
       g_free(operator);
       g_free(number1);
@@ -1260,18 +1548,18 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       if(operator && strcmp(operator, "[]") == 0)
       {
         if(number1 && number2)
-          query = dt_util_dstrcat(query, "((exposure >= %s  - 1.0/100000) AND (exposure <= %s  + 1.0/100000))", number1,
-                                  number2);
+          query = dt_util_dstrcat(query, "((exposure >= %s  - 1.0/100000) AND (exposure <= %s  + 1.0/100000))",
+                                  _value_add(values, number1, TRUE, p1), _value_add(values, number2, TRUE, p2));
       }
       else if(operator && number1)
-        query = dt_util_dstrcat(query, "(exposure %s %s)", operator, number1);
+        query = dt_util_dstrcat(query, "(exposure %s %s)", operator, _value_add(values, number1, TRUE, p1));
       else if(number1)
         query = dt_util_dstrcat(query,
-                                "(CASE WHEN exposure < 0.4 THEN ((exposure >= %s - 1.0/100000) AND  (exposure <= %s + 1.0/100000)) "
-                                "ELSE (ROUND(exposure,2) >= %s - 1.0/100000) AND (ROUND(exposure,2) <= %s + 1.0/100000) END)",
-                                number1, number1, number1, number1);
+                                "(CASE WHEN exposure < 0.4 THEN ((exposure >= %1$s - 1.0/100000) AND  (exposure <= %1$s + 1.0/100000)) "
+                                "ELSE (ROUND(exposure,2) >= %1$s - 1.0/100000) AND (ROUND(exposure,2) <= %1$s + 1.0/100000) END)",
+                                _value_add(values, number1, TRUE, p1));
       else
-        query = dt_util_dstrcat(query, "(exposure LIKE '%%%s%%')", escaped_text);
+        query = dt_util_dstrcat(query, "(exposure LIKE '%%' || %s || '%%')", _value_add(values, text, FALSE, p1));
 
       g_free(operator);
       g_free(number1);
@@ -1280,7 +1568,7 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
     break;
 
     case DT_COLLECTION_PROP_FILENAME: // filename
-      query = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", escaped_text);
+      query = dt_util_dstrcat(query, "(filename LIKE '%%' || %s || '%%')", _value_add(values, text, FALSE, p1));
       break;
 
     case DT_COLLECTION_PROP_DAY:
@@ -1295,17 +1583,18 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       if(strcmp(operator, "[]") == 0)
       {
         if(number1 && number2)
-          query = dt_util_dstrcat(query, "((datetime_taken >= '%s') AND (datetime_taken <= '%s'))", number1,
-                                  number2);
+          query = dt_util_dstrcat(query, "((datetime_taken >= %s) AND (datetime_taken <= %s))",
+                                  _value_add(values, number1, FALSE, p1), _value_add(values, number2, FALSE, p2));
       }
       else if((strcmp(operator, "=") == 0 || strcmp(operator, "") == 0) && number1)
-        query = dt_util_dstrcat(query, "(datetime_taken LIKE '%s')", number1);
+        query = dt_util_dstrcat(query, "(datetime_taken LIKE %s)", _value_add(values, number1, FALSE, p1));
       else if(strcmp(operator, "<>") == 0 && number1)
-        query = dt_util_dstrcat(query, "(datetime_taken NOT LIKE '%s')", number1);
+        query = dt_util_dstrcat(query, "(datetime_taken NOT LIKE %s)", _value_add(values, number1, FALSE, p1));
       else if(number1)
-        query = dt_util_dstrcat(query, "(datetime_taken %s '%s')", operator, number1);
+        query = dt_util_dstrcat(query, "(datetime_taken %s %s)", operator, _value_add(values, number1, FALSE, p1));
       else
-        query = dt_util_dstrcat(query, "(datetime_taken LIKE '%%%s%%')", escaped_text);
+        query = dt_util_dstrcat(query, "(datetime_taken LIKE '%%' || %s || '%%')",
+                                _value_add(values, text, FALSE, p1));
 
       g_free(operator);
       g_free(number1);
@@ -1414,6 +1703,10 @@ void dt_collection_deserialize(char *buf)
   dt_collection_update_query(darktable.collection);
 }
 
+/* the rules are evaluated by sqlite, on the indices of library schema 18, and not on an in-memory copy of the
+   filterable columns. such a copy would only stay right if every change went through the image cache, but tags,
+   color labels, metadata, film rolls and duplicates are written with plain sql (tags.c, colorlabels.c,
+   metadata.c, film.c, image.c). the result has to end up in memory.collected_images for everything else anyway. */
 void dt_collection_update_query(const dt_collection_t *collection)
 {
   char confname[200];
@@ -1424,6 +1717,10 @@ void dt_collection_update_query(const dt_collection_t *collection)
 
   gchar **query_parts = g_new (gchar*, num_rules + 1);
   query_parts[num_rules] =  NULL;
+  GPtrArray *values = g_ptr_array_new_with_free_func(_value_free);
+
+  // the rules filter on main.images, make sure it has the ratings etc. still pending in the image cache
+  if(darktable.image_cache) dt_image_cache_flush(darktable.image_cache);
 
   for(int i = 0; i < num_rules; i++)
   {
@@ -1440,7 +1737,7 @@ void dt_collection_update_query(const dt_collection_t *collection)
       else
         query_parts[i] = g_strdup("");
     } else {
-      gchar *query = get_query_string(property, text);
+      gchar *query = get_query_string(property, text, values);
 
       query_parts[i] =  g_strdup_printf(" %s %s", conj[mode], query);
 
@@ -1450,9 +1747,23 @@ void dt_collection_update_query(const dt_collection_t *collection)
   }
 
 
-  /* set the extended where and the use of it in the query */
-  dt_collection_set_extended_where(collection, query_parts);
-  g_strfreev(query_parts);
+  /* set the extended where with the values spliced in for the callers that build their own queries. the
+   * collection binds them, unless there are too many parameters for sqlite */
+  gchar **where_ext = g_new(gchar *, num_rules + 1);
+  for(int i = 0; i <= num_rules; i++) where_ext[i] = _dt_collection_render(collection, values, query_parts[i]);
+  dt_collection_set_extended_where(collection, where_ext);
+  g_strfreev(where_ext);
+  if(values->len <= MAX_VALUES)
+  {
+    dt_collection_t *c = (dt_collection_t *)collection;
+    c->where_shape = query_parts;
+    c->values = values;
+  }
+  else
+  {
+    g_strfreev(query_parts);
+    g_ptr_array_free(values, TRUE);
+  }
   dt_collection_set_query_flags(collection,
                                 (dt_collection_get_query_flags(collection) | COLLECTION_QUERY_USE_WHERE_EXT));
 
@@ -1464,21 +1775,14 @@ void dt_collection_update_query(const dt_collection_t *collection)
   dt_collection_update(collection);
 
   // remove from selected images where not in this query.
-  sqlite3_stmt *stmt = NULL;
-  const gchar *cquery = dt_collection_get_query_no_group(collection);
-  gchar *complete_query = NULL;
-  if(cquery && cquery[0] != '\0')
+  sqlite3_stmt *stmt
+      = dt_collection_get_stmt(collection, "DELETE FROM main.selected_images WHERE imgid NOT IN (", ")", TRUE);
+  if(stmt)
   {
-    complete_query
-        = dt_util_dstrcat(complete_query, "DELETE FROM main.selected_images WHERE imgid NOT IN (%s)", cquery);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), complete_query, -1, &stmt, NULL);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    /* free allocated strings */
-    g_free(complete_query);
+    sqlite3_reset(stmt);
   }
 
   /* raise signal of collection change, only if this is an original */
@@ -1574,8 +1878,7 @@ static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_da
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
   int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection, FALSE);
-  collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
+  _dt_collection_update_counts(collection);
   if(!collection->clone)
   {
     if(old_count != collection->count) dt_collection_hint_message(collection);
@@ -1587,8 +1890,7 @@ static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpo
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
   int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection, FALSE);
-  collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
+  _dt_collection_update_counts(collection);
   if(!collection->clone)
   {
     if(old_count != collection->count) dt_collection_hint_message(collection);
@@ -1625,7 +1927,7 @@ int64_t dt_collection_get_image_position(const int32_t image_id)
 
 void dt_collection_shift_image_positions(const unsigned int length, const int64_t image_position)
 {
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
   sqlite3_stmt *stmt = NULL;
 
   // shift image positions to make some space
@@ -1639,7 +1941,7 @@ void dt_collection_shift_image_positions(const unsigned int length, const int64_
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 /* move images with drag and drop
@@ -1685,7 +1987,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     dt_collection_shift_image_positions(selected_images_length, target_image_pos);
 
     sqlite3_stmt *stmt = NULL;
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
 
     // move images to their intended positons
     int64_t new_image_pos = target_image_pos;
@@ -1707,7 +2009,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
       new_image_pos++;
     }
     sqlite3_finalize(stmt);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
   }
   else
   {
@@ -1729,7 +2031,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     sqlite3_finalize(stmt);
     sqlite3_stmt *update_stmt = NULL;
 
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
 
     // move images to last position in custom image order table
     gchar *update_query = "UPDATE main.images SET position = ?1 WHERE id = ?2";
@@ -1748,7 +2050,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     }
 
     sqlite3_finalize(update_stmt);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
   }
 }
 
@@ -20,6 +20,7 @@
 
 #include <glib.h>
 #include <inttypes.h>
+#include <sqlite3.h>
 
 typedef enum dt_collection_query_t
 {
@@ -137,7 +138,20 @@ typedef struct dt_collection_t
   int clone;
   gchar *query, *query_no_group;
   gchar **where_ext;
+  /** where_ext with the filter values replaced by parameters, and the values bound to them. NULL if the
+   * values are spliced into where_ext */
+  gchar **where_shape;
+  GPtrArray *values;
+  /** the queries with all filter values as parameters, the statements are prepared from these */
+  gchar *query_shape, *query_no_group_shape;
+  /** prepared statements on the query shapes, keyed by their text */
+  GHashTable *stmts;
   unsigned int count, count_no_group;
+  /** cached count statements and the query text they were prepared from, [0] grouped, [1] no group */
+  gchar *count_query[2];
+  sqlite3_stmt *count_stmt[2];
+  /** set when only the sort order changed since the last update, the counts can be kept */
+  gboolean sort_only;
   dt_collection_params_t params;
   dt_collection_params_t store;
 } dt_collection_t;
@@ -157,6 +171,11 @@ gchar *dt_collection_get_makermodel(const char *exif_maker, const char *exif_mod
 const gchar *dt_collection_get_query(const dt_collection_t *collection);
 /** get the generated query for collection including the images hidden in groups */
 const gchar *dt_collection_get_query_no_group(const dt_collection_t *collection);
+/** returns a statement for prefix, the (no group) query and suffix with the filter values bound. ?1 and ?2 of
+ * the limit are left to the caller. the statement is prepared once per query text and belongs to the
+ * collection, reset it after use and don't finalize it. */
+sqlite3_stmt *dt_collection_get_stmt(const dt_collection_t *collection, const gchar *prefix, const gchar *suffix,
+                                     const gboolean no_group);
 /** updates sql query for a collection. @return 1 if query changed. */
 int dt_collection_update(const dt_collection_t *collection);
 /** reset collection to default dummy selection */
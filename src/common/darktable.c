@@ -46,12 +46,14 @@
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
 #include "common/l10n.h"
+#include "common/lut3d.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
 #include "common/points.h"
 #include "common/resource_limits.h"
 #include "common/undo.h"
+#include "common/xmp_writer.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/crawler.h"
@@ -59,6 +61,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
 #include "gui/presets.h"
@@ -298,12 +301,17 @@ static void dt_codepaths_init()
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+#endif
+#if defined(DT_AVX_CODEPATHS) && defined(HAVE_BUILTIN_CPU_SUPPORTS)
+    // the clones themselves are picked by the loader, this only steers the explicit sse2/plain choices
+    darktable.codepath.AVX2 = __builtin_cpu_supports("avx2");
 #endif
   }
 
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -498,6 +506,11 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #else
                "  SSE2 optimized codepath disabled\n"
 #endif
+#ifdef DT_AVX_CODEPATHS
+               "  AVX2/AVX-512 kernel variants enabled\n"
+#else
+               "  AVX2/AVX-512 kernel variants disabled\n"
+#endif
 #ifdef _OPENMP
                "  OpenMP support enabled\n"
 #else
@@ -899,6 +912,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.image_cache = (dt_image_cache_t *)calloc(1, sizeof(dt_image_cache_t));
   dt_image_cache_init(darktable.image_cache);
 
+  darktable.xmp_writer = dt_xmp_writer_init();
+
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
@@ -1071,6 +1086,10 @@ void dt_cleanup()
     free(darktable.imageio);
     free(darktable.gui);
   }
+  dt_dev_pixelpipe_pool_cleanup(DT_DEV_PIXELPIPE_ANY);
+  // write out the sidecars still pending while the image cache and the db are around
+  dt_xmp_writer_cleanup(darktable.xmp_writer);
+  darktable.xmp_writer = NULL;
   dt_image_cache_cleanup(darktable.image_cache);
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
@@ -1082,6 +1101,7 @@ void dt_cleanup()
     dt_undo_cleanup(darktable.undo);
   }
   dt_colorspaces_cleanup(darktable.color_profiles);
+  dt_lut3d_cleanup();
   dt_conf_cleanup(darktable.conf);
   free(darktable.conf);
   dt_points_cleanup(darktable.points);
@@ -1100,6 +1120,10 @@ void dt_cleanup()
 
   dt_guides_cleanup(darktable.guides);
 
+  // the collection keeps prepared statements, finalize them before the db is closed
+  dt_collection_free(darktable.collection);
+  darktable.collection = NULL;
+
   dt_database_destroy(darktable.db);
 
   if(init_gui)
@@ -1112,9 +1136,10 @@ void dt_cleanup()
   dt_pthread_mutex_destroy(&(darktable.db_insert));
   dt_pthread_mutex_destroy(&(darktable.plugin_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
-  dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
 
+  // terminating the xmp parser still goes through the lock callback on exiv2_threadsafe
   dt_exif_cleanup();
+  dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
 }
 
 void dt_print(dt_debug_thread_t thread, const char *msg, ...)
@@ -81,6 +81,14 @@ typedef unsigned int u_int;
 #define omp_get_thread_num() 0
 #endif
 
+// hot plain c kernels which vectorize well are additionally compiled for avx2 and avx-512. the dynamic
+// loader resolves them to the best variant for the cpu, so binary packages benefit without -march=native.
+#if defined(DT_AVX_CODEPATHS) && (defined(__x86_64__) || defined(__i386__))
+#define __DT_CLONE_TARGETS__ __attribute__((target_clones("default", "avx2", "avx512f")))
+#else
+#define __DT_CLONE_TARGETS__
+#endif
+
 #ifndef _RELEASE
 #include "common/poison.h"
 #endif
@@ -191,6 +199,7 @@ typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
   unsigned int _no_intrinsics : 1;
+  unsigned int AVX2 : 1; // prefer the plain kernels where their avx2 clones beat the sse2 code
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
 
@@ -228,7 +237,8 @@ typedef struct darktable_t
   dt_pthread_mutex_t db_insert;
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
-  dt_pthread_mutex_t exiv2_threadsafe;
+  struct dt_xmp_writer_t *xmp_writer;
+  dt_pthread_mutex_t exiv2_threadsafe; // all of exiv2 before 0.27, only its xmp toolkit from then on
   char *progname;
   char *datadir;
   char *plugindir;
@@ -37,7 +37,7 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 17
+#define CURRENT_DATABASE_VERSION_LIBRARY 18
 #define CURRENT_DATABASE_VERSION_DATA 1
 
 typedef struct dt_database_t
@@ -53,6 +53,9 @@ typedef struct dt_database_t
   /* ondisk DB */
   sqlite3 *handle;
 
+  /* serializes the transactions of all threads on handle, see dt_database_start_transaction() */
+  GRecMutex transaction_lock;
+
   gchar *error_message, *error_dbfilename;
 } dt_database_t;
 
@@ -1003,6 +1006,22 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 17;
   }
+  else if(version == 17)
+  {
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    ////////////////////////////// indices for the columns used by the collect module
+    TRY_EXEC("CREATE INDEX main.images_datetime_taken_index ON images (datetime_taken)",
+             "[init] can't create index `images_datetime_taken_index' in database\n");
+    TRY_EXEC("CREATE INDEX main.images_maker_model_index ON images (maker, model)",
+             "[init] can't create index `images_maker_model_index' in database\n");
+    TRY_EXEC("CREATE INDEX main.images_lens_index ON images (lens)",
+             "[init] can't create index `images_lens_index' in database\n");
+    TRY_EXEC("CREATE INDEX main.metadata_key_index ON meta_data (key, id)",
+             "[init] can't create index `metadata_key_index' in database\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 18;
+  }
   // maybe in the future, see commented out code elsewhere
   //   else if(version == XXX)
   //   {
@@ -1126,6 +1145,10 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE INDEX main.images_film_id_index ON images (film_id)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.images_filename_index ON images (filename)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.image_position_index ON images (position)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_datetime_taken_index ON images (datetime_taken)", NULL, NULL,
+               NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_maker_model_index ON images (maker, model)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_lens_index ON images (lens)", NULL, NULL, NULL);
 
   ////////////////////////////// selected_images
   sqlite3_exec(db->handle, "CREATE TABLE main.selected_images (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
@@ -1156,6 +1179,7 @@ static void _create_library_schema(dt_database_t *db)
   ////////////////////////////// meta_data
   sqlite3_exec(db->handle, "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index ON meta_data (id, key)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.metadata_key_index ON meta_data (key, id)", NULL, NULL, NULL);
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -1584,6 +1608,7 @@ start:
 
   /* create database */
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
+  g_rec_mutex_init(&db->transaction_lock);
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
 
@@ -1890,6 +1915,7 @@ void dt_database_destroy(const dt_database_t *db)
   }
   g_free(db->dbfilename_data);
   g_free(db->dbfilename_library);
+  g_rec_mutex_clear(&((dt_database_t *)db)->transaction_lock);
   g_free((dt_database_t *)db);
 
   sqlite3_shutdown();
@@ -1900,6 +1926,27 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+void dt_database_start_transaction(const struct dt_database_t *db)
+{
+  g_rec_mutex_lock(&((dt_database_t *)db)->transaction_lock);
+  // a savepoint, so a thread can nest these
+  sqlite3_exec(db->handle, "SAVEPOINT dt_transaction", NULL, NULL, NULL);
+}
+
+void dt_database_release_transaction(const struct dt_database_t *db)
+{
+  sqlite3_exec(db->handle, "RELEASE dt_transaction", NULL, NULL, NULL);
+  g_rec_mutex_unlock(&((dt_database_t *)db)->transaction_lock);
+}
+
+void dt_database_rollback_transaction(const struct dt_database_t *db)
+{
+  // rolling back to a savepoint keeps it open, it still has to be released
+  sqlite3_exec(db->handle, "ROLLBACK TO dt_transaction", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "RELEASE dt_transaction", NULL, NULL, NULL);
+  g_rec_mutex_unlock(&((dt_database_t *)db)->transaction_lock);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
@@ -28,6 +28,14 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** starts a transaction on the shared handle, waiting for the one of any other thread to be released first.
+ *  all threads share a single connection, so a transaction running there while another thread does a plain
+ *  BEGIN or COMMIT would make one of them fail or commit the other's partial work. calls can be nested. */
+void dt_database_start_transaction(const struct dt_database_t *db);
+/** commits the transaction of the matching dt_database_start_transaction() */
+void dt_database_release_transaction(const struct dt_database_t *db);
+/** undoes everything since the matching dt_database_start_transaction() and ends it */
+void dt_database_rollback_transaction(const struct dt_database_t *db);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
@@ -18,6 +18,7 @@
 
 #include "control/control.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_scratch.h"
 #include "dwt.h"
 #if defined(__SSE__)
 #include <xmmintrin.h>
@@ -29,9 +30,9 @@
  *
 */
 
-dwt_params_t *dt_dwt_init(float *image, const int width, const int height, const int ch, const int scales,
-                          const int return_layer, const int merge_from_scale, void *user_data,
-                          const float preview_scale, const int use_sse)
+dwt_params_t *dt_dwt_init(struct dt_dev_pixelpipe_t *pipe, float *image, const int width, const int height,
+                          const int ch, const int scales, const int return_layer, const int merge_from_scale,
+                          void *user_data, const float preview_scale, const int use_sse)
 {
   dwt_params_t *p = (dwt_params_t *)malloc(sizeof(dwt_params_t));
   if(!p) return NULL;
@@ -46,6 +47,7 @@ dwt_params_t *dt_dwt_init(float *image, const int width, const int height, const
   p->user_data = user_data;
   p->preview_scale = preview_scale;
   p->use_sse = use_sse;
+  p->pipe = pipe;
 
   return p;
 }
@@ -203,10 +205,11 @@ static void dwt_add_layer_sse(float *const img, float *layers, dwt_params_t *con
 }
 #endif
 
+__DT_CLONE_TARGETS__
 static void dwt_add_layer(float *const img, float *layers, dwt_params_t *const p, const int n_scale)
 {
 #if defined(__SSE__)
-  if(p->ch == 4 && p->use_sse)
+  if(p->ch == 4 && p->use_sse && !darktable.codepath.AVX2)
   {
     dwt_add_layer_sse(img, layers, p, n_scale);
     return;
@@ -244,10 +247,11 @@ static void dwt_subtract_layer_sse(float *bl, float *bh, dwt_params_t *const p)
 }
 #endif
 
+__DT_CLONE_TARGETS__
 static void dwt_subtract_layer(float *bl, float *bh, dwt_params_t *const p)
 {
 #if defined(__SSE__)
-  if(p->ch == 4 && p->use_sse)
+  if(p->ch == 4 && p->use_sse && !darktable.codepath.AVX2)
   {
     dwt_subtract_layer_sse(bl, bh, p);
     return;
@@ -286,7 +290,7 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   /* image buffers */
   buffer[0] = img;
   /* temporary storage */
-  buffer[1] = dt_alloc_align(64, size * sizeof(float));
+  buffer[1] = dt_dev_pixelpipe_scratch_alloc(p->pipe, size * sizeof(float));
   if(buffer[1] == NULL)
   {
     printf("not enough memory for wavelet decomposition");
@@ -295,7 +299,7 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   memset(buffer[1], 0, size * sizeof(float));
 
   // setup a temp buffer
-  temp = dt_alloc_align(64, MAX(p->width, p->height) * p->ch * sizeof(float));
+  temp = dt_dev_pixelpipe_scratch_alloc(p->pipe, MAX(p->width, p->height) * p->ch * sizeof(float));
   if(temp == NULL)
   {
     printf("not enough memory for wavelet decomposition");
@@ -304,7 +308,7 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   memset(temp, 0, MAX(p->width, p->height) * p->ch * sizeof(float));
 
   // buffer to reconstruct the image
-  layers = dt_alloc_align(64, p->width * p->height * p->ch * sizeof(float));
+  layers = dt_dev_pixelpipe_scratch_alloc(p->pipe, p->width * p->height * p->ch * sizeof(float));
   if(layers == NULL)
   {
     printf("not enough memory for wavelet decomposition");
@@ -314,7 +318,7 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
 
   if(p->merge_from_scale > 0)
   {
-    merged_layers = dt_alloc_align(64, p->width * p->height * p->ch * sizeof(float));
+    merged_layers = dt_dev_pixelpipe_scratch_alloc(p->pipe, p->width * p->height * p->ch * sizeof(float));
     if(merged_layers == NULL)
     {
       printf("not enough memory for wavelet decomposition");
@@ -425,10 +429,10 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   }
 
 cleanup:
-  if(layers) dt_free_align(layers);
-  if(merged_layers) dt_free_align(merged_layers);
-  if(temp) dt_free_align(temp);
-  if(buffer[1]) dt_free_align(buffer[1]);
+  dt_dev_pixelpipe_scratch_free(p->pipe, layers);
+  dt_dev_pixelpipe_scratch_free(p->pipe, merged_layers);
+  dt_dev_pixelpipe_scratch_free(p->pipe, temp);
+  dt_dev_pixelpipe_scratch_free(p->pipe, buffer[1]);
 }
 
 #undef INDEX_WT_IMAGE
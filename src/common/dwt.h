@@ -19,6 +19,8 @@
 #ifndef DT_DEVELOP_DWT_H
 #define DT_DEVELOP_DWT_H
 
+struct dt_dev_pixelpipe_t;
+
 /* structure returned by dt_dwt_init() to be used when calling dwt_decompose() */
 typedef struct dwt_params_t
 {
@@ -32,12 +34,14 @@ typedef struct dwt_params_t
   void *user_data;
   float preview_scale;
   int use_sse;
+  struct dt_dev_pixelpipe_t *pipe;
 } dwt_params_t;
 
 /* function prototype for the layer_func on dwt_decompose() call */
 typedef void(_dwt_layer_func)(float *layer, dwt_params_t *const p, const int scale);
 
 /* returns a structure used when calling dwt_decompose(), free it with dt_dwt_free()
+ * pipe: the temporary buffers of dwt_decompose() come from its scratch pool, may be NULL
  * image: image to be decomposed and output image
  * width, height, ch: dimensions of the image
  * scales: number of scales to decompose, if > dwt_get_max_scale() the this last will be used
@@ -48,9 +52,9 @@ typedef void(_dwt_layer_func)(float *layer, dwt_params_t *const p, const int sca
  * preview_scale: image scale (zoom factor)
  * use_sse: use SSE instructions
  */
-dwt_params_t *dt_dwt_init(float *image, const int width, const int height, const int ch, const int scales,
-                          const int return_layer, const int merge_from_scale, void *user_data,
-                          const float preview_scale, const int use_sse);
+dwt_params_t *dt_dwt_init(struct dt_dev_pixelpipe_t *pipe, float *image, const int width, const int height,
+                          const int ch, const int scales, const int return_layer, const int merge_from_scale,
+                          void *user_data, const float preview_scale, const int use_sse);
 
 /* free resources used by dwt_decompose() */
 void dt_dwt_free(dwt_params_t *p);
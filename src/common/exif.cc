@@ -69,9 +69,22 @@ extern "C" {
 #include "develop/masks.h"
 }
 
+#if EXIV2_VERSION >= EXIV2_MAKE_VERSION(0,27,0)
+// since 0.27 exiv2 guards its own namespace registry, and the only thing left that must not run concurrently
+// is the shared state of the xmp toolkit underneath. exiv2 calls back into _exif_xmp_lock() whenever it touches
+// that, so readMetadata can run in parallel on all import and thumbnail threads.
+static void _exif_xmp_lock(void *data, bool lock)
+{
+  if(lock)
+    dt_pthread_mutex_lock((dt_pthread_mutex_t *)data);
+  else
+    dt_pthread_mutex_unlock((dt_pthread_mutex_t *)data);
+}
+
+#define read_metadata_threadsafe(image) image->readMetadata()
+#else
 // exiv2's readMetadata is not thread safe in 0.26. so we lock it. since readMetadata might throw an exception we
 // wrap it into some c++ magic to make sure we unlock in all cases. well, actually not magic but basic raii.
-// FIXME: check again once we rely on 0.27
 class Lock
 {
 public:
@@ -84,6 +97,7 @@ public:
   Lock lock;                                                  \
   image->readMetadata();                                      \
 }
+#endif
 
 static void _exif_import_tags(dt_image_t *img, Exiv2::XmpData::iterator &pos);
 
@@ -2187,9 +2201,9 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 
     // now add all masks that are not used for cloning. keeping them might be useful.
     // TODO: make this configurable? or remove it altogether?
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
     g_hash_table_foreach(mask_entries, add_non_clone_mask_entries_to_db, &img->id);
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
 
     // history
     int num = 0;
@@ -2212,7 +2226,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
       return 1;
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
                                 &stmt, NULL);
@@ -2321,12 +2335,12 @@ end:
 
     if(all_ok)
     {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      dt_database_release_transaction(darktable.db);
     }
     else
     {
       std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      dt_database_rollback_transaction(darktable.db);
       return 1;
     }
 
@@ -2341,19 +2355,52 @@ end:
   return 0;
 }
 
+// the database reads behind a sidecar, prepared once and shared by all images of a batch
+typedef struct dt_exif_xmp_stmts_t
+{
+  sqlite3_stmt *image, *meta_data, *color_labels, *mask, *history;
+} dt_exif_xmp_stmts_t;
+
+static void _exif_xmp_stmts_prepare(dt_exif_xmp_stmts_t *s)
+{
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT filename, flags, raw_parameters, "
+                                                             "longitude, latitude, altitude, history_end "
+                                                             "FROM main.images WHERE id = ?1",
+                              -1, &s->image, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT key, value FROM main.meta_data WHERE id = ?1",
+                              -1, &s->meta_data, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT color FROM main.color_labels WHERE imgid=?1",
+                              -1, &s->color_labels, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(
+      dt_database_get(darktable.db),
+      "SELECT imgid, formid, form, name, version, points, points_count, source FROM main.mask WHERE imgid = ?1",
+      -1, &s->mask, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(
+      dt_database_get(darktable.db),
+      "SELECT module, operation, op_params, enabled, blendop_params, "
+      "blendop_version, multi_priority, multi_name FROM main.history WHERE imgid = ?1 ORDER BY num",
+      -1, &s->history, NULL);
+}
+
+static void _exif_xmp_stmts_finalize(dt_exif_xmp_stmts_t *s)
+{
+  sqlite3_finalize(s->image);
+  sqlite3_finalize(s->meta_data);
+  sqlite3_finalize(s->color_labels);
+  sqlite3_finalize(s->mask);
+  sqlite3_finalize(s->history);
+}
+
 // helper to create an xmp data thing. throws exiv2 exceptions if stuff goes wrong.
-static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
+// the caller flushes the image cache first, so pending changes are in the db
+static void _exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid, dt_exif_xmp_stmts_t *s)
 {
   const int xmp_version = 2;
   int stars = 1, raw_params = 0, history_end = -1;
   double longitude = NAN, latitude = NAN, altitude = NAN;
   gchar *filename = NULL;
   // get stars and raw params from db
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT filename, flags, raw_parameters, "
-                                                             "longitude, latitude, altitude, history_end "
-                                                             "FROM main.images WHERE id = ?1",
-                              -1, &stmt, NULL);
+  sqlite3_stmt *stmt = s->image;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -2412,11 +2459,10 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
     xmpData["Xmp.exif.GPSAltitude"] = ele_str;
     g_free(ele_str);
   }
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
 
   // the meta data
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT key, value FROM main.meta_data WHERE id = ?1",
-                              -1, &stmt, NULL);
+  stmt = s->meta_data;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -2440,7 +2486,7 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
         break;
     }
   }
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
 
   xmpData["Xmp.darktable.xmp_version"] = xmp_version;
   xmpData["Xmp.darktable.raw_params"] = raw_params;
@@ -2478,15 +2524,14 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   std::unique_ptr<Exiv2::Value> v(Exiv2::Value::create(Exiv2::xmpSeq)); // or xmpBag or xmpAlt.
 
   /* Already initialized v = Exiv2::Value::create(Exiv2::xmpSeq); // or xmpBag or xmpAlt.*/
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT color FROM main.color_labels WHERE imgid=?1",
-                              -1, &stmt, NULL);
+  stmt = s->color_labels;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     snprintf(val, sizeof(val), "%d", sqlite3_column_int(stmt, 0));
     v->read(val);
   }
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
   if(v->count() > 0) xmpData.add(Exiv2::XmpKey("Xmp.darktable.colorlabels"), v.get());
 
   // masks:
@@ -2507,10 +2552,7 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   // reset tv
   tvm.setXmpArrayType(Exiv2::XmpValue::xaNone);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "SELECT imgid, formid, form, name, version, points, points_count, source FROM main.mask WHERE imgid = ?1",
-      -1, &stmt, NULL);
+  stmt = s->mask;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -2559,7 +2601,7 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
 
     num++;
   }
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
 
 
   // history stack:
@@ -2570,11 +2612,7 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   tv.setXmpArrayType(Exiv2::XmpValue::xaSeq);
   xmpData.add(Exiv2::XmpKey("Xmp.darktable.history"), &tv);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "SELECT module, operation, op_params, enabled, blendop_params, "
-      "blendop_version, multi_priority, multi_name FROM main.history WHERE imgid = ?1 ORDER BY num",
-      -1, &stmt, NULL);
+  stmt = s->history;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -2626,11 +2664,21 @@ static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
   else history_end = MIN(history_end, num - 1); // safeguard for some old buggy libraries
   xmpData["Xmp.darktable.history_end"] = history_end;
 
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
   g_list_free_full(tags, g_free);
   g_list_free_full(hierarchical, g_free);
 }
 
+static void dt_exif_xmp_read_data(Exiv2::XmpData &xmpData, const int imgid)
+{
+  // including changes still pending in the image cache
+  dt_image_cache_flush(darktable.image_cache);
+  dt_exif_xmp_stmts_t s;
+  _exif_xmp_stmts_prepare(&s);
+  _exif_xmp_read_data(xmpData, imgid, &s);
+  _exif_xmp_stmts_finalize(&s);
+}
+
 #if EXIV2_VERSION >= EXIV2_MAKE_VERSION(0,27,0)
 #define ERROR_CODE(a) (static_cast<Exiv2::ErrorCode>((a)))
 #else
@@ -2772,7 +2820,8 @@ int dt_exif_xmp_attach(const int imgid, const char *filename)
 }
 
 // write xmp sidecar file:
-int dt_exif_xmp_write(const int imgid, const char *filename)
+// s are the shared statements of a batch, NULL for a single write
+static int _exif_xmp_write(const int imgid, const char *filename, dt_exif_xmp_stmts_t *s)
 {
   // refuse to write sidecar for non-existent image:
   char imgfname[PATH_MAX] = { 0 };
@@ -2816,7 +2865,10 @@ int dt_exif_xmp_write(const int imgid, const char *filename)
     }
 
     // initialize xmp data:
-    dt_exif_xmp_read_data(xmpData, imgid);
+    if(s)
+      _exif_xmp_read_data(xmpData, imgid, s);
+    else
+      dt_exif_xmp_read_data(xmpData, imgid);
 
     // serialize the xmp data and output the xmp packet
     if(Exiv2::XmpParser::encode(xmpPacket, xmpData,
@@ -2863,6 +2915,31 @@ int dt_exif_xmp_write(const int imgid, const char *filename)
   }
 }
 
+int dt_exif_xmp_write(const int imgid, const char *filename)
+{
+  return _exif_xmp_write(imgid, filename, NULL);
+}
+
+void dt_exif_xmp_write_batch(const int *imgids, char *const *filenames, int *results, const int count)
+{
+  if(count <= 0) return;
+  // one flush of the image cache and one set of statements for all of them
+  dt_image_cache_flush(darktable.image_cache);
+  dt_exif_xmp_stmts_t s;
+  _exif_xmp_stmts_prepare(&s);
+  for(int k = 0; k < count; k++)
+  {
+    results[k] = _exif_xmp_write(imgids[k], filenames[k], &s);
+    // an exiv2 exception can leave a statement mid-step
+    sqlite3_reset(s.image);
+    sqlite3_reset(s.meta_data);
+    sqlite3_reset(s.color_labels);
+    sqlite3_reset(s.mask);
+    sqlite3_reset(s.history);
+  }
+  _exif_xmp_stmts_finalize(&s);
+}
+
 dt_colorspaces_color_profile_type_t dt_exif_get_color_space(const uint8_t *data, size_t size)
 {
   try
@@ -2962,7 +3039,12 @@ void dt_exif_init()
   // preface the exiv2 messages with "[exiv2] "
   Exiv2::LogMsg::setHandler(&dt_exif_log_handler);
 
+  // initialize the xmp toolkit up front, lazily doing it from the first reader is racy
+#if EXIV2_VERSION >= EXIV2_MAKE_VERSION(0,27,0)
+  Exiv2::XmpParser::initialize(_exif_xmp_lock, &darktable.exiv2_threadsafe);
+#else
   Exiv2::XmpParser::initialize();
+#endif
   // this has to stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -44,6 +44,10 @@ int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int
 /** write xmp sidecar file. */
 int dt_exif_xmp_write(const int imgid, const char *filename);
 
+/** write the xmp sidecar files of count images, filenames[k] belongs to imgids[k] and results[k] gets what
+ * dt_exif_xmp_write() would have returned. the database reads are prepared once for the whole batch. */
+void dt_exif_xmp_write_batch(const int *imgids, char *const *filenames, int *results, const int count);
+
 /** write xmp packet inside an image. */
 int dt_exif_xmp_attach(const int imgid, const char *filename);
 
@@ -24,6 +24,7 @@
 #endif
 #include "common/gaussian.h"
 #include "common/opencl.h"
+#include "develop/pixelpipe_scratch.h"
 
 #define CLAMPF(a, mn, mx) ((a) < (mn) ? (mn) : ((a) > (mx) ? (mx) : (a)))
 
@@ -113,7 +114,8 @@ size_t dt_gaussian_singlebuffer_size(const int width,    // width of input image
 }
 
 
-dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
+dt_gaussian_t *dt_gaussian_init(struct dt_dev_pixelpipe_t *pipe, // pipe to take the buffer from, or NULL
+                                const int width,    // width of input image
                                 const int height,   // height of input image
                                 const int channels, // channels per pixel
                                 const float *max,   // maximum allowed values per channel for clamping
@@ -130,6 +132,7 @@ dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
   g->sigma = sigma;
   g->order = order;
   g->buf = NULL;
+  g->pipe = pipe;
   g->max = (float *)calloc(channels, sizeof(float));
   g->min = (float *)calloc(channels, sizeof(float));
 
@@ -141,13 +144,13 @@ dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
     g->min[k] = min[k];
   }
 
-  g->buf = dt_alloc_align(64, (size_t)width * height * channels * sizeof(float));
+  g->buf = dt_dev_pixelpipe_scratch_alloc(pipe, (size_t)width * height * channels * sizeof(float));
   if(!g->buf) goto error;
 
   return g;
 
 error:
-  dt_free_align(g->buf);
+  dt_dev_pixelpipe_scratch_free(pipe, g->buf);
   free(g->max);
   free(g->min);
   free(g);
@@ -155,6 +158,7 @@ error:
 }
 
 
+__DT_CLONE_TARGETS__
 void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
 {
 
@@ -490,7 +494,7 @@ void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const o
 void dt_gaussian_free(dt_gaussian_t *g)
 {
   if(!g) return;
-  dt_free_align(g->buf);
+  dt_dev_pixelpipe_scratch_free(g->pipe, g->buf);
   free(g->min);
   free(g->max);
   free(g);
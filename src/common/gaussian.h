@@ -22,6 +22,8 @@
 #include <assert.h>
 #include <math.h>
 
+struct dt_dev_pixelpipe_t;
+
 typedef enum dt_gaussian_order_t
 {
   DT_IOP_GAUSSIAN_ZERO = 0,
@@ -38,10 +40,12 @@ typedef struct dt_gaussian_t
   float *max;
   float *min;
   float *buf;
+  struct dt_dev_pixelpipe_t *pipe; // buf comes from its scratch pool, may be NULL
 } dt_gaussian_t;
 
-dt_gaussian_t *dt_gaussian_init(const int width, const int height, const int channels, const float *max,
-                                const float *min, const float sigma, const int order);
+dt_gaussian_t *dt_gaussian_init(struct dt_dev_pixelpipe_t *pipe, const int width, const int height,
+                                const int channels, const float *max, const float *min, const float sigma,
+                                const int order);
 
 size_t dt_gaussian_memory_use(const int width, const int height, const int channels);
 
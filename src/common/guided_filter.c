@@ -30,6 +30,7 @@
 
 #include "common/guided_filter.h"
 #include "common/darktable.h"
+#include "develop/pixelpipe_scratch.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,16 +58,16 @@ typedef struct gray_image
   int width, height;
 } gray_image;
 
-// allocate space for 1-component image of size width x height
-static inline gray_image new_gray_image(int width, int height)
+// allocate space for 1-component image of size width x height, from the scratch pool of pipe if there is one
+static inline gray_image new_gray_image(struct dt_dev_pixelpipe_t *pipe, int width, int height)
 {
-  return (gray_image){ dt_alloc_align(64, sizeof(float) * width * height), width, height };
+  return (gray_image){ dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(float) * width * height), width, height };
 }
 
 // free space for 1-component image
-static inline void free_gray_image(gray_image *img_p)
+static inline void free_gray_image(struct dt_dev_pixelpipe_t *pipe, gray_image *img_p)
 {
-  dt_free_align(img_p->data);
+  dt_dev_pixelpipe_scratch_free(pipe, img_p->data);
   img_p->data = NULL;
 }
 
@@ -136,49 +137,120 @@ static inline void box_mean_1d(int N, const float *x, float *y, size_t stride_y,
   }
 }
 
+// calculate the one-dimensional moving average over a window of size 2*w+1 along the columns of img,
+// in-place. works on whole rows at a time, doing the same arithmetic per column as box_mean_1d, such
+// that the inner loops run over contiguous memory and vectorize. the last w+1 input rows are kept in
+// a ring buffer as the corresponding rows of img get overwritten. returns 0 if there is no memory for
+// the buffers, img is left alone then.
+static int box_mean_vert(struct dt_dev_pixelpipe_t *pipe, gray_image img, int w)
+{
+  const int N = img.height;
+  const int width = img.width;
+  float *const m = dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(float) * width);
+  float *const ring = dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(float) * width * (w + 1));
+  if(!m || !ring)
+  {
+    dt_dev_pixelpipe_scratch_free(pipe, ring);
+    dt_dev_pixelpipe_scratch_free(pipe, m);
+    return 0;
+  }
+#define ROW(i) (img.data + (size_t)(i) * width)
+#define SAVED(i) (ring + (size_t)((i) % (w + 1)) * width)
+  float n_box = 0.f;
+  for(int k = 0; k < width; k++) m[k] = 0.f;
+  for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++)
+  {
+    const float *x = ROW(i);
+    for(int k = 0; k < width; k++) m[k] += x[k];
+    n_box++;
+  }
+  for(int i = 0; i < N; i++)
+  {
+    float *y = ROW(i);
+    memcpy(SAVED(i), y, sizeof(float) * width);
+    for(int k = 0; k < width; k++) y[k] = m[k] / n_box;
+    if(N > 2 * w && i >= w && i < N - w - 1)
+    {
+      const float *x_in = ROW(i + w + 1);
+      const float *x_out = SAVED(i - w);
+      for(int k = 0; k < width; k++) m[k] += x_in[k] - x_out[k];
+      continue;
+    }
+    if(i - w >= 0)
+    {
+      const float *x_out = SAVED(i - w);
+      for(int k = 0; k < width; k++) m[k] -= x_out[k];
+      n_box--;
+    }
+    if(i + w + 1 < N)
+    {
+      const float *x_in = ROW(i + w + 1);
+      for(int k = 0; k < width; k++) m[k] += x_in[k];
+      n_box++;
+    }
+  }
+#undef SAVED
+#undef ROW
+  dt_dev_pixelpipe_scratch_free(pipe, ring);
+  dt_dev_pixelpipe_scratch_free(pipe, m);
+  return 1;
+}
+
+// the same as box_mean_vert, one column at a time. slower, but only needs a buffer of one column.
+static void box_mean_vert_columns(struct dt_dev_pixelpipe_t *pipe, gray_image img, int w)
+{
+  gray_image column = new_gray_image(pipe, 1, img.height);
+  if(!column.data)
+  {
+    fprintf(stderr, "[guided filter] not able to allocate a column buffer\n");
+    return;
+  }
+  for(int i0 = 0; i0 < img.width; i0++)
+  {
+    for(int i1 = 0; i1 < img.height; i1++) column.data[i1] = img.data[i0 + (size_t)i1 * img.width];
+    box_mean_1d(img.height, column.data, img.data + i0, img.width, w);
+  }
+  free_gray_image(pipe, &column);
+}
+
 // calculate the two-dimensional moving average over a box of size (2*w+1) x (2*w+1)
 // does the calculation in-place if input and ouput images are identical
 // this function is always called from a OpenMP thread, thus no parallelization
-static void box_mean(gray_image img1, gray_image img2, int w)
+static void box_mean(struct dt_dev_pixelpipe_t *pipe, gray_image img1, gray_image img2, int w)
 {
-  gray_image img2_bak;
   if(img1.data == img2.data)
   {
-    img2_bak = new_gray_image(max_i(img2.width, img2.height), 1);
+    gray_image img2_bak = new_gray_image(pipe, img2.width, 1);
     for(int i1 = 0; i1 < img2.height; i1++)
     {
       memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
       box_mean_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
     }
+    free_gray_image(pipe, &img2_bak);
   }
   else
   {
     for(int i1 = 0; i1 < img1.height; i1++)
       box_mean_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
-    img2_bak = new_gray_image(1, img2.height);
-  }
-  for(int i0 = 0; i0 < img1.width; i0++)
-  {
-    for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-    box_mean_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
   }
-  free_gray_image(&img2_bak);
+  if(!box_mean_vert(pipe, img2, w)) box_mean_vert_columns(pipe, img2, w);
 }
 
 // apply guided filter to single-component image img using the 3-components
 // image imgg as a guide
-static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, tile target, const int w,
-                                 const float eps, const float guide_weight, const float min, const float max)
+static void guided_filter_tiling(struct dt_dev_pixelpipe_t *pipe, color_image imgg, gray_image img,
+                                 gray_image img_out, tile target, const int w, const float eps,
+                                 const float guide_weight, const float min, const float max)
 {
   const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
                         max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
   const int width = source.right - source.left;
   const int height = source.upper - source.lower;
   size_t size = (size_t)width * (size_t)height;
-  gray_image imgg_mean_r = new_gray_image(width, height);
-  gray_image imgg_mean_g = new_gray_image(width, height);
-  gray_image imgg_mean_b = new_gray_image(width, height);
-  gray_image img_mean = new_gray_image(width, height);
+  gray_image imgg_mean_r = new_gray_image(pipe, width, height);
+  gray_image imgg_mean_g = new_gray_image(pipe, width, height);
+  gray_image imgg_mean_b = new_gray_image(pipe, width, height);
+  gray_image img_mean = new_gray_image(pipe, width, height);
   for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
   {
     int j = j_imgg - source.lower;
@@ -193,19 +265,19 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       img_mean.data[k] = img.data[i_imgg + (size_t)j_imgg * img.width];
     }
   }
-  box_mean(imgg_mean_r, imgg_mean_r, w);
-  box_mean(imgg_mean_g, imgg_mean_g, w);
-  box_mean(imgg_mean_b, imgg_mean_b, w);
-  box_mean(img_mean, img_mean, w);
-  gray_image cov_imgg_img_r = new_gray_image(width, height);
-  gray_image cov_imgg_img_g = new_gray_image(width, height);
-  gray_image cov_imgg_img_b = new_gray_image(width, height);
-  gray_image var_imgg_rr = new_gray_image(width, height);
-  gray_image var_imgg_gg = new_gray_image(width, height);
-  gray_image var_imgg_bb = new_gray_image(width, height);
-  gray_image var_imgg_rg = new_gray_image(width, height);
-  gray_image var_imgg_rb = new_gray_image(width, height);
-  gray_image var_imgg_gb = new_gray_image(width, height);
+  box_mean(pipe, imgg_mean_r, imgg_mean_r, w);
+  box_mean(pipe, imgg_mean_g, imgg_mean_g, w);
+  box_mean(pipe, imgg_mean_b, imgg_mean_b, w);
+  box_mean(pipe, img_mean, img_mean, w);
+  gray_image cov_imgg_img_r = new_gray_image(pipe, width, height);
+  gray_image cov_imgg_img_g = new_gray_image(pipe, width, height);
+  gray_image cov_imgg_img_b = new_gray_image(pipe, width, height);
+  gray_image var_imgg_rr = new_gray_image(pipe, width, height);
+  gray_image var_imgg_gg = new_gray_image(pipe, width, height);
+  gray_image var_imgg_bb = new_gray_image(pipe, width, height);
+  gray_image var_imgg_rg = new_gray_image(pipe, width, height);
+  gray_image var_imgg_rb = new_gray_image(pipe, width, height);
+  gray_image var_imgg_gb = new_gray_image(pipe, width, height);
   for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
   {
     int j = j_imgg - source.lower;
@@ -226,15 +298,15 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       var_imgg_bb.data[k] = pixel[2] * pixel[2];
     }
   }
-  box_mean(cov_imgg_img_r, cov_imgg_img_r, w);
-  box_mean(cov_imgg_img_g, cov_imgg_img_g, w);
-  box_mean(cov_imgg_img_b, cov_imgg_img_b, w);
-  box_mean(var_imgg_rr, var_imgg_rr, w);
-  box_mean(var_imgg_rg, var_imgg_rg, w);
-  box_mean(var_imgg_rb, var_imgg_rb, w);
-  box_mean(var_imgg_gg, var_imgg_gg, w);
-  box_mean(var_imgg_gb, var_imgg_gb, w);
-  box_mean(var_imgg_bb, var_imgg_bb, w);
+  box_mean(pipe, cov_imgg_img_r, cov_imgg_img_r, w);
+  box_mean(pipe, cov_imgg_img_g, cov_imgg_img_g, w);
+  box_mean(pipe, cov_imgg_img_b, cov_imgg_img_b, w);
+  box_mean(pipe, var_imgg_rr, var_imgg_rr, w);
+  box_mean(pipe, var_imgg_rg, var_imgg_rg, w);
+  box_mean(pipe, var_imgg_rb, var_imgg_rb, w);
+  box_mean(pipe, var_imgg_gg, var_imgg_gg, w);
+  box_mean(pipe, var_imgg_gb, var_imgg_gb, w);
+  box_mean(pipe, var_imgg_bb, var_imgg_bb, w);
   for(size_t i = 0; i < size; i++)
   {
     cov_imgg_img_r.data[i] -= imgg_mean_r.data[i] * img_mean.data[i];
@@ -247,9 +319,9 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
     var_imgg_gb.data[i] -= imgg_mean_g.data[i] * imgg_mean_b.data[i];
     var_imgg_bb.data[i] -= imgg_mean_b.data[i] * imgg_mean_b.data[i] - eps;
   }
-  gray_image a_r = new_gray_image(width, height);
-  gray_image a_g = new_gray_image(width, height);
-  gray_image a_b = new_gray_image(width, height);
+  gray_image a_r = new_gray_image(pipe, width, height);
+  gray_image a_g = new_gray_image(pipe, width, height);
+  gray_image a_b = new_gray_image(pipe, width, height);
   gray_image b = img_mean;
   for(int i1 = 0; i1 < height; i1++)
   {
@@ -297,10 +369,10 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       ++i;
     }
   }
-  box_mean(a_r, a_r, w);
-  box_mean(a_g, a_g, w);
-  box_mean(a_b, a_b, w);
-  box_mean(b, b, w);
+  box_mean(pipe, a_r, a_r, w);
+  box_mean(pipe, a_g, a_g, w);
+  box_mean(pipe, a_b, a_b, w);
+  box_mean(pipe, b, b, w);
   for(int j_imgg = target.lower; j_imgg < target.upper; j_imgg++)
   {
     // index of the left most target pixel in the current row
@@ -320,26 +392,27 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       img_out.data[i_imgg + (size_t)j_imgg * imgg.width] = res;
     }
   }
-  free_gray_image(&a_r);
-  free_gray_image(&a_g);
-  free_gray_image(&a_b);
-  free_gray_image(&var_imgg_rr);
-  free_gray_image(&var_imgg_rg);
-  free_gray_image(&var_imgg_rb);
-  free_gray_image(&var_imgg_gg);
-  free_gray_image(&var_imgg_gb);
-  free_gray_image(&var_imgg_bb);
-  free_gray_image(&cov_imgg_img_r);
-  free_gray_image(&cov_imgg_img_g);
-  free_gray_image(&cov_imgg_img_b);
-  free_gray_image(&img_mean);
-  free_gray_image(&imgg_mean_r);
-  free_gray_image(&imgg_mean_g);
-  free_gray_image(&imgg_mean_b);
+  free_gray_image(pipe, &a_r);
+  free_gray_image(pipe, &a_g);
+  free_gray_image(pipe, &a_b);
+  free_gray_image(pipe, &var_imgg_rr);
+  free_gray_image(pipe, &var_imgg_rg);
+  free_gray_image(pipe, &var_imgg_rb);
+  free_gray_image(pipe, &var_imgg_gg);
+  free_gray_image(pipe, &var_imgg_gb);
+  free_gray_image(pipe, &var_imgg_bb);
+  free_gray_image(pipe, &cov_imgg_img_r);
+  free_gray_image(pipe, &cov_imgg_img_g);
+  free_gray_image(pipe, &cov_imgg_img_b);
+  free_gray_image(pipe, &img_mean);
+  free_gray_image(pipe, &imgg_mean_r);
+  free_gray_image(pipe, &imgg_mean_g);
+  free_gray_image(pipe, &imgg_mean_b);
 }
 
 
-void guided_filter(const float *const guide, const float *const in, float *const out, const int width,
+void guided_filter(struct dt_dev_pixelpipe_t *pipe, // temporary images come from its scratch pool, may be NULL
+                   const float *const guide, const float *const in, float *const out, const int width,
                    const int height, const int ch,
                    const int w,              // window size
                    const float sqrt_eps,     // regularization parameter
@@ -363,13 +436,14 @@ void guided_filter(const float *const guide, const float *const in, float *const
     for(int i = 0; i < width; i += tile_width)
     {
       tile target = { i, min_i(i + tile_width, width), j, min_i(j + tile_width, height) };
-      guided_filter_tiling(img_guide, img_in, img_out, target, w, eps, guide_weight, min, max);
+      guided_filter_tiling(pipe, img_guide, img_in, img_out, target, w, eps, guide_weight, min, max);
     }
   }
 }
 
 #ifdef HAVE_OPENCL
-void guided_filter_cl(int devid, cl_mem guide, cl_mem in, cl_mem out, const int width, const int height,
+void guided_filter_cl(struct dt_dev_pixelpipe_t *pipe, // host copies come from its scratch pool, may be NULL
+                      int devid, cl_mem guide, cl_mem in, cl_mem out, const int width, const int height,
                       const int ch,
                       const int w,              // window size
                       const float sqrt_eps,     // regularization parameter
@@ -379,20 +453,20 @@ void guided_filter_cl(int devid, cl_mem guide, cl_mem in, cl_mem out, const int
 {
   // fall-back implementation: copy data from device memory to host memory and perform filter
   // by CPU until there is a proper OpenCL implementation
-  float *guide_host = dt_alloc_align(64, sizeof(*guide_host) * width * height * ch);
-  float *in_host = dt_alloc_align(64, sizeof(*in_host) * width * height);
-  float *out_host = dt_alloc_align(64, sizeof(*out_host) * width * height);
+  float *guide_host = dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(*guide_host) * width * height * ch);
+  float *in_host = dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(*in_host) * width * height);
+  float *out_host = dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(*out_host) * width * height);
   int err;
   err = dt_opencl_read_host_from_device(devid, guide_host, guide, width, height, ch * sizeof(float));
   if(err != CL_SUCCESS) goto error;
   err = dt_opencl_read_host_from_device(devid, in_host, in, width, height, sizeof(float));
   if(err != CL_SUCCESS) goto error;
-  guided_filter(guide_host, in_host, out_host, width, height, ch, w, sqrt_eps, guide_weight, min, max);
+  guided_filter(pipe, guide_host, in_host, out_host, width, height, ch, w, sqrt_eps, guide_weight, min, max);
   err = dt_opencl_write_host_to_device(devid, out_host, out, width, height, sizeof(float));
   if(err != CL_SUCCESS) goto error;
 error:
-  dt_free_align(guide_host);
-  dt_free_align(in_host);
-  dt_free_align(out_host);
+  dt_dev_pixelpipe_scratch_free(pipe, guide_host);
+  dt_dev_pixelpipe_scratch_free(pipe, in_host);
+  dt_dev_pixelpipe_scratch_free(pipe, out_host);
 }
 #endif
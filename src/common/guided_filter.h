@@ -21,11 +21,12 @@
 #include "common/opencl.h"
 
 struct dt_iop_roi_t;
+struct dt_dev_pixelpipe_t;
 
-void guided_filter(const float *guide, const float *in, float *out, int width, int height, int ch, int w,
-                   float sqrt_eps, float guide_weight, float min, float max);
+void guided_filter(struct dt_dev_pixelpipe_t *pipe, const float *guide, const float *in, float *out, int width,
+                   int height, int ch, int w, float sqrt_eps, float guide_weight, float min, float max);
 
 #ifdef HAVE_OPENCL
-void guided_filter_cl(int devid, cl_mem guide, cl_mem in, cl_mem out, int width, int height, int ch, int w,
-                      float sqrt_eps, float guide_weight, float min, float max);
+void guided_filter_cl(struct dt_dev_pixelpipe_t *pipe, int devid, cl_mem guide, cl_mem in, cl_mem out, int width,
+                      int height, int ch, int w, float sqrt_eps, float guide_weight, float min, float max);
 #endif
@@ -28,6 +28,8 @@
 #include "common/utility.h"
 #include "common/collection.h"
 #include "control/control.h"
+#include "control/jobs.h"
+#include "control/jobs/control_jobs.h"
 #include "develop/develop.h"
 #include "develop/blend.h"
 #include "develop/masks.h"
@@ -1077,6 +1079,14 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
   return ret_val;
 }
 
+int dt_history_copy_and_paste_on_image_db(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
+{
+  if(merge)
+    return _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+  else
+    return _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops);
+}
+
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
 {
   if(imgid == dest_imgid) return 1;
@@ -1091,11 +1101,7 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
   if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
-  int ret_val = 0;
-  if(merge)
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
-  else
-    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops);
+  const int ret_val = dt_history_copy_and_paste_on_image_db(imgid, dest_imgid, merge, ops);
 
   /* if current image in develop reload history */
   if(dt_dev_is_current_image(darktable.develop, dest_imgid))
@@ -1199,32 +1205,135 @@ char *dt_history_get_items_as_string(int32_t imgid)
   return result;
 }
 
+typedef struct dt_history_paste_job_t
+{
+  int32_t imgid;
+  gboolean merge;
+  GList *ops;
+  GList *imgs;
+} dt_history_paste_job_t;
+
+static void _history_paste_job_cleanup(void *p)
+{
+  dt_history_paste_job_t *params = (dt_history_paste_job_t *)p;
+  g_list_free(params->ops);
+  g_list_free(params->imgs);
+  free(params);
+}
+
+static int32_t _history_paste_job_run(dt_job_t *job)
+{
+  dt_history_paste_job_t *params = (dt_history_paste_job_t *)dt_control_job_get_params(job);
+  const guint total = g_list_length(params->imgs);
+  guint count = 0;
+  GList *done = NULL;
+
+  // a transaction per image. the gui waits for the one running to start its own, so keep them short.
+  for(GList *iter = params->imgs; iter && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED;
+      iter = g_list_next(iter))
+  {
+    dt_database_start_transaction(darktable.db);
+    dt_history_copy_and_paste_on_image_db(params->imgid, GPOINTER_TO_INT(iter->data), params->merge, params->ops);
+    dt_database_release_transaction(darktable.db);
+    done = g_list_prepend(done, iter->data);
+    dt_control_job_set_progress(job, (double)++count / total);
+  }
+
+  dt_control_refresh_images(done);
+  return 0;
+}
+
+// a plain overwrite of the whole stack is pure sql, done for the whole selection at once
+static void _history_copy_and_paste_on_selection_overwrite(int32_t imgid)
+{
+  static const char *const queries[]
+      = { "DELETE FROM main.history WHERE imgid IN (SELECT imgid FROM main.selected_images WHERE imgid != ?1)",
+          "DELETE FROM main.mask WHERE imgid IN (SELECT imgid FROM main.selected_images WHERE imgid != ?1)",
+          "INSERT INTO main.history "
+          "(imgid,num,module,operation,op_params,enabled,blendop_params, "
+          "blendop_version,multi_priority,multi_name) SELECT "
+          "s.imgid,h.num,h.module,h.operation,h.op_params,h.enabled,h.blendop_params, "
+          "h.blendop_version,h.multi_priority,h.multi_name "
+          "FROM main.selected_images AS s, main.history AS h WHERE h.imgid = ?1 AND s.imgid != ?1",
+          "INSERT INTO main.mask "
+          "(imgid, formid, form, name, version, points, points_count, source) SELECT "
+          "s.imgid, m.formid, m.form, m.name, m.version, m.points, m.points_count, m.source "
+          "FROM main.selected_images AS s, main.mask AS m WHERE m.imgid = ?1 AND s.imgid != ?1",
+          "UPDATE main.images SET history_end = (SELECT history_end FROM main.images WHERE id = ?1) "
+          "WHERE id IN (SELECT imgid FROM main.selected_images WHERE imgid != ?1)" };
+
+  dt_database_start_transaction(darktable.db);
+  for(size_t k = 0; k < sizeof(queries) / sizeof(queries[0]); k++)
+  {
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), queries[k], -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
+  dt_database_release_transaction(darktable.db);
+}
+
 int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList *ops)
 {
   if(imgid < 0) return 1;
 
-  int res = 0;
+  GList *imgs = NULL;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT imgid FROM main.selected_images WHERE imgid != ?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  while(sqlite3_step(stmt) == SQLITE_ROW) imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+
+  if(!imgs) return 1;
+
+  // be sure the current history is written before pasting some other history data
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  if(!merge && !ops)
   {
-    do
-    {
-      /* get imgid of selected image */
-      int32_t dest_imgid = sqlite3_column_int(stmt, 0);
+    _history_copy_and_paste_on_selection_overwrite(imgid);
 
-      /* paste history stack onto image id */
-      dt_history_copy_and_paste_on_image(imgid, dest_imgid, merge, ops);
+    for(GList *iter = imgs; iter; iter = g_list_next(iter))
+      if(dt_dev_is_current_image(darktable.develop, GPOINTER_TO_INT(iter->data)))
+      {
+        dt_dev_reload_history_items(darktable.develop);
+        dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+      }
 
-    } while(sqlite3_step(stmt) == SQLITE_ROW);
+    dt_control_refresh_images(imgs);
+    return 0;
   }
-  else
-    res = 1;
 
-  sqlite3_finalize(stmt);
-  return res;
+  // the image in the darkroom has to be reloaded on the gui thread, do that one right away
+  for(GList *iter = imgs; iter; iter = g_list_next(iter))
+    if(dt_dev_is_current_image(darktable.develop, GPOINTER_TO_INT(iter->data)))
+    {
+      dt_history_copy_and_paste_on_image(imgid, GPOINTER_TO_INT(iter->data), merge, ops);
+      imgs = g_list_delete_link(imgs, iter);
+      break;
+    }
+  if(!imgs) return 0;
+
+  // merging needs a develop per image, everything else goes to the background
+  dt_job_t *job = dt_control_job_create(&_history_paste_job_run, "%s", N_("paste history"));
+  dt_history_paste_job_t *params = job ? (dt_history_paste_job_t *)calloc(1, sizeof(dt_history_paste_job_t)) : NULL;
+  if(!params)
+  {
+    if(job) dt_control_job_dispose(job);
+    g_list_free(imgs);
+    return 1;
+  }
+  params->imgid = imgid;
+  params->merge = merge;
+  params->ops = g_list_copy(ops);
+  params->imgs = g_list_reverse(imgs);
+  dt_control_job_add_progress(job, _("paste history"), TRUE);
+  dt_control_job_set_params(job, params, _history_paste_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+  return 0;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -30,6 +30,8 @@ void dt_history_rebuild_multi_priority_merge(const int dest_imgid);
 
 /** copy history from imgid and pasts on dest_imgid, merge or overwrite... */
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops);
+/** the database side of the above only, no darkroom reload, thumbnail or xmp update. safe on worker threads. */
+int dt_history_copy_and_paste_on_image_db(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops);
 
 void dt_history_delete_on_image(int32_t imgid);
 
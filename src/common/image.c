@@ -28,6 +28,7 @@
 #include "common/imageio_rawspeed.h"
 #include "common/mipmap_cache.h"
 #include "common/tags.h"
+#include "common/xmp_writer.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/jobs.h"
@@ -357,7 +358,7 @@ void dt_image_set_location(const int32_t imgid, double lon, double lat)
   image->latitude = lat;
 
   /* store */
-  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
+  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_WRITE_BACK);
 }
 
 void dt_image_set_location_and_elevation(const int32_t imgid, double lon, double lat, double ele)
@@ -371,7 +372,7 @@ void dt_image_set_location_and_elevation(const int32_t imgid, double lon, double
   image->elevation = ele;
 
   /* store */
-  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
+  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_WRITE_BACK);
 }
 
 gboolean dt_image_get_final_size(const int32_t imgid, int *width, int *height)
@@ -438,7 +439,7 @@ void dt_image_set_flip(const int32_t imgid, const dt_image_orientation_t orienta
 
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
   // write that through to xmp:
-  dt_image_write_sidecar_file(imgid);
+  dt_xmp_writer_queue(darktable.xmp_writer, imgid);
 }
 
 dt_image_orientation_t dt_image_get_orientation(const int imgid)
@@ -588,6 +589,9 @@ int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newve
   // requested version is already present in DB, so we just return it
   if(newid != -1) return newid;
 
+  // the row gets copied from the db, so it has to be up to date
+  dt_image_cache_flush(darktable.image_cache);
+
   DT_DEBUG_SQLITE3_PREPARE_V2(
       dt_database_get(darktable.db),
       "INSERT INTO main.images "
@@ -700,6 +704,9 @@ void dt_image_remove(const int32_t imgid)
 
   if(dt_image_local_copy_reset(imgid)) return;
 
+  // a late write could bring back the sidecar the caller is about to delete
+  dt_xmp_writer_discard(darktable.xmp_writer, imgid);
+
   sqlite3_stmt *stmt;
   const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
   int old_group_id = img->group_id;
@@ -1233,6 +1240,9 @@ void dt_image_refresh_makermodel(dt_image_t *img)
 
 int32_t dt_image_move(const int32_t imgid, const int32_t filmid)
 {
+  // the sidecar moves along, it has to be up to date and nobody may write the old one after the move
+  dt_xmp_writer_flush(darktable.xmp_writer, imgid);
+
   // TODO: several places where string truncation could occur unnoticed
   int32_t result = -1;
   gchar oldimg[PATH_MAX] = { 0 };
@@ -1381,7 +1391,8 @@ int32_t dt_image_copy(const int32_t imgid, const int32_t filmid)
     {
       const int64_t new_image_position = create_next_image_position();
 
-      // update database
+      // update database, from up to date rows
+      dt_image_cache_flush(darktable.image_cache);
       DT_DEBUG_SQLITE3_PREPARE_V2(
           dt_database_get(darktable.db),
           "INSERT INTO main.images "
@@ -1675,44 +1686,79 @@ int dt_image_local_copy_reset(const int32_t imgid)
 // xmp stuff
 // *******************************************************
 
-void dt_image_write_sidecar_file(int imgid)
+// the sidecar name of imgid, FALSE if neither the original nor a local copy is there to write it for
+static gboolean _image_sidecar_filename(const int imgid, char *filename, const size_t size)
 {
-  // TODO: compute hash and don't write if not needed!
-  // write .xmp file
-  if(imgid > 0 && dt_conf_get_bool("write_sidecar_files"))
+  // FIRST: check if the original file is present
+  gboolean from_cache = FALSE;
+  dt_image_full_path(imgid, filename, size, &from_cache);
+
+  if (!g_file_test(filename, G_FILE_TEST_EXISTS))
   {
-    char filename[PATH_MAX] = { 0 };
+    // OTHERWISE: check if the local copy exists
+    from_cache = TRUE;
+    dt_image_full_path(imgid, filename, size, &from_cache);
 
-    // FIRST: check if the original file is present
-    gboolean from_cache = FALSE;
-    dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
+    //  nothing to do, the original is not accessible and there is no local copy
+    if (!from_cache) return FALSE;
+  }
 
-    if (!g_file_test(filename, G_FILE_TEST_EXISTS))
-    {
-      // OTHERWISE: check if the local copy exists
-      from_cache = TRUE;
-      dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
+  dt_image_path_append_version(imgid, filename, size);
+  g_strlcat(filename, ".xmp", size);
+  return TRUE;
+}
 
-      //  nothing to do, the original is not accessible and there is no local copy
-      if (!from_cache) return;
+void dt_image_write_sidecar_files(const GList *imgs)
+{
+  if(!imgs || !dt_conf_get_bool("write_sidecar_files")) return;
+
+  const int count = g_list_length((GList *)imgs);
+  int *ids = g_new(int, count);
+  int *results = g_new(int, count);
+  char **filenames = g_new0(char *, count);
+  int n = 0;
+  for(const GList *iter = imgs; iter; iter = g_list_next(iter))
+  {
+    const int imgid = GPOINTER_TO_INT(iter->data);
+    char filename[PATH_MAX] = { 0 };
+    if(imgid > 0 && _image_sidecar_filename(imgid, filename, sizeof(filename)))
+    {
+      ids[n] = imgid;
+      filenames[n++] = g_strdup(filename);
     }
+  }
 
-    dt_image_path_append_version(imgid, filename, sizeof(filename));
-    g_strlcat(filename, ".xmp", sizeof(filename));
+  // the database reads of all sidecars share their statements
+  dt_exif_xmp_write_batch(ids, filenames, results, n);
 
-    if(!dt_exif_xmp_write(imgid, filename))
+  // put the timestamp into db. this can't be done in exif.cc since that code gets called
+  // for the copy exporter, too
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "UPDATE main.images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1",
+                              -1, &stmt, NULL);
+  for(int k = 0; k < n; k++)
+  {
+    if(!results[k])
     {
-      // put the timestamp into db. this can't be done in exif.cc since that code gets called
-      // for the copy exporter, too
-      sqlite3_stmt *stmt;
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "UPDATE main.images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1",
-                                  -1, &stmt, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, ids[k]);
       sqlite3_step(stmt);
-      sqlite3_finalize(stmt);
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
     }
+    g_free(filenames[k]);
   }
+  sqlite3_finalize(stmt);
+
+  g_free(ids);
+  g_free(results);
+  g_free(filenames);
+}
+
+void dt_image_write_sidecar_file(int imgid)
+{
+  GList imgs = { GINT_TO_POINTER(imgid), NULL, NULL };
+  dt_image_write_sidecar_files(&imgs);
 }
 
 
@@ -1720,7 +1766,7 @@ void dt_image_synch_xmp(const int selected)
 {
   if(selected > 0)
   {
-    dt_image_write_sidecar_file(selected);
+    dt_xmp_writer_queue(darktable.xmp_writer, selected);
   }
   else if(dt_conf_get_bool("write_sidecar_files"))
   {
@@ -1730,7 +1776,7 @@ void dt_image_synch_xmp(const int selected)
     while(sqlite3_step(stmt) == SQLITE_ROW)
     {
       const int imgid = sqlite3_column_int(stmt, 0);
-      dt_image_write_sidecar_file(imgid);
+      dt_xmp_writer_queue(darktable.xmp_writer, imgid);
     }
     sqlite3_finalize(stmt);
   }
@@ -1845,7 +1891,7 @@ void dt_image_add_time_offset(const int imgid, const long int offset)
     dt_image_cache_read_release(darktable.image_cache, cimg);
     dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
     g_strlcpy(img->exif_datetime_taken, datetime, sizeof(img->exif_datetime_taken));
-    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
+    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_WRITE_BACK);
   }
   else dt_image_cache_read_release(darktable.image_cache, cimg);
 
@@ -289,7 +289,10 @@ gboolean dt_image_safe_remove(const int32_t imgid);
 /* try to sync .xmp for all local copies */
 void dt_image_local_copy_synch(void);
 // xmp functions:
+// write the sidecar now, on the calling thread
 void dt_image_write_sidecar_file(int imgid);
+void dt_image_write_sidecar_files(const GList *imgs);
+// queue the sidecar of selected (or all selected images for -1) for the background writer
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_all_xmp(const gchar *pathname);
 
@@ -21,7 +21,10 @@
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/image.h"
+#include "common/xmp_writer.h"
 #include "control/conf.h"
+#include "control/control.h"
+#include "control/jobs.h"
 #include "develop/develop.h"
 
 #include <sqlite3.h>
@@ -140,9 +143,56 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   dt_image_refresh_makermodel(img);
 }
 
+// writes img to its row in main.images. expects cache->lock to be held.
+static void _image_cache_write(dt_image_cache_t *cache, const dt_image_t *img)
+{
+  sqlite3_stmt *stmt = cache->update_stmt;
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->exif_maker, -1, SQLITE_STATIC);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, img->exif_model, -1, SQLITE_STATIC);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, img->exif_lens, -1, SQLITE_STATIC);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 6, img->exif_exposure);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, img->exif_aperture);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, img->exif_iso);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, img->exif_focal_length);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, img->exif_focus_distance);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, img->film_id);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 12, img->exif_datetime_taken, -1, SQLITE_STATIC);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 13, img->flags);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 14, img->exif_crop);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 15, img->orientation);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 16, *(uint32_t *)(&img->legacy_flip));
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 17, img->group_id);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 18, img->longitude);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 19, img->latitude);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 20, img->elevation);
+  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 21, &img->d65_color_matrix, sizeof(img->d65_color_matrix), SQLITE_STATIC);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 22, img->colorspace);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 23, img->raw_black_level);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 24, img->raw_white_point);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 25, img->id);
+  int rc = sqlite3_step(stmt);
+  if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+}
+
 void dt_image_cache_deallocate(void *data, dt_cache_entry_t *entry)
 {
+  dt_image_cache_t *cache = (dt_image_cache_t *)data;
   dt_image_t *img = (dt_image_t *)entry->data;
+
+  // last chance to get a pending write-back into the db
+  g_mutex_lock(&cache->lock);
+  const dt_image_t *dirty = g_hash_table_lookup(cache->dirty, GINT_TO_POINTER(entry->key));
+  if(dirty)
+  {
+    _image_cache_write(cache, dirty);
+    g_hash_table_remove(cache->dirty, GINT_TO_POINTER(entry->key));
+  }
+  g_mutex_unlock(&cache->lock);
+
   g_free(img->profile);
   g_free(img);
 }
@@ -161,12 +211,33 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
+  g_mutex_init(&cache->lock);
+  g_mutex_init(&cache->flush_lock);
+  cache->dirty = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  cache->flush_queued = FALSE;
+  DT_DEBUG_SQLITE3_PREPARE_V2(
+      dt_database_get(darktable.db),
+      "UPDATE main.images SET width = ?1, height = ?2, maker = ?3, model = ?4, "
+      "lens = ?5, exposure = ?6, aperture = ?7, iso = ?8, focal_length = ?9, "
+      "focus_distance = ?10, film_id = ?11, datetime_taken = ?12, flags = ?13, "
+      "crop = ?14, orientation = ?15, raw_parameters = ?16, group_id = ?17, longitude = ?18, "
+      "latitude = ?19, altitude = ?20, color_matrix = ?21, colorspace = ?22, raw_black = ?23, "
+      "raw_maximum = ?24 WHERE id = ?25",
+      -1, &cache->update_stmt, NULL);
+
   dt_print(DT_DEBUG_CACHE, "[image_cache] has %d entries\n", num);
 }
 
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
+  dt_image_cache_flush(cache);
+  // whatever is still dirty now gets written when its entry goes away
   dt_cache_cleanup(&cache->cache);
+
+  sqlite3_finalize(cache->update_stmt);
+  g_hash_table_destroy(cache->dirty);
+  g_mutex_clear(&cache->flush_lock);
+  g_mutex_clear(&cache->lock);
 }
 
 void dt_image_cache_print(dt_image_cache_t *cache)
@@ -205,59 +276,93 @@ void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
   dt_cache_release(&cache->cache, img->cache_entry);
 }
 
+void dt_image_cache_flush(dt_image_cache_t *cache)
+{
+  // the common case, every collection update ends up here: nothing to write, so don't wait for a transaction
+  g_mutex_lock(&cache->lock);
+  const gboolean dirty = g_hash_table_size(cache->dirty) > 0;
+  g_mutex_unlock(&cache->lock);
+  if(!dirty) return;
+
+  // the transaction comes first: callers holding one, like dt_image_duplicate() in a style job, end up here
+  // too, and taking them in the other order would deadlock against a concurrent flush.
+  dt_database_start_transaction(darktable.db);
+  g_mutex_lock(&cache->flush_lock);
+  // the dirty table holds the state of each entry as it was released, so entries don't need to be locked and
+  // the ones somebody is writing to right now don't get in the way. their current release is written anyway.
+  g_mutex_lock(&cache->lock);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, cache->dirty);
+  while(g_hash_table_iter_next(&iter, &key, &value)) _image_cache_write(cache, (const dt_image_t *)value);
+  g_hash_table_remove_all(cache->dirty);
+  g_mutex_unlock(&cache->lock);
+  g_mutex_unlock(&cache->flush_lock);
+  dt_database_release_transaction(darktable.db);
+}
+
+static int32_t _image_cache_flush_job_run(dt_job_t *job)
+{
+  dt_image_cache_t *cache = (dt_image_cache_t *)dt_control_job_get_params(job);
+  // anything released from now on needs another job
+  g_mutex_lock(&cache->lock);
+  cache->flush_queued = FALSE;
+  g_mutex_unlock(&cache->lock);
+
+  dt_image_cache_flush(cache);
+  // views draw straight from the db, so they might have missed the changes so far
+  if(darktable.gui) dt_control_queue_redraw_center();
+  return 0;
+}
+
 // drops the write privileges on an image struct.
 // this triggers a write-through to sql, and if the setting
 // is present, also to xmp sidecar files (safe setting).
+// in write-back mode the entry is only marked dirty and a job writes all of them in one go.
 void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_image_cache_write_mode_t mode)
 {
   if(img->id <= 0) return;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "UPDATE main.images SET width = ?1, height = ?2, maker = ?3, model = ?4, "
-      "lens = ?5, exposure = ?6, aperture = ?7, iso = ?8, focal_length = ?9, "
-      "focus_distance = ?10, film_id = ?11, datetime_taken = ?12, flags = ?13, "
-      "crop = ?14, orientation = ?15, raw_parameters = ?16, group_id = ?17, longitude = ?18, "
-      "latitude = ?19, altitude = ?20, color_matrix = ?21, colorspace = ?22, raw_black = ?23, "
-      "raw_maximum = ?24 WHERE id = ?25",
-      -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->exif_maker, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, img->exif_model, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, img->exif_lens, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 6, img->exif_exposure);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, img->exif_aperture);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, img->exif_iso);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, img->exif_focal_length);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, img->exif_focus_distance);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, img->film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 12, img->exif_datetime_taken, -1, SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 13, img->flags);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 14, img->exif_crop);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 15, img->orientation);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 16, *(uint32_t *)(&img->legacy_flip));
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 17, img->group_id);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 18, img->longitude);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 19, img->latitude);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 20, img->elevation);
-  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 21, &img->d65_color_matrix, sizeof(img->d65_color_matrix), SQLITE_STATIC);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 22, img->colorspace);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 23, img->raw_black_level);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 24, img->raw_white_point);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 25, img->id);
-  int rc = sqlite3_step(stmt);
-  if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  const int imgid = img->id;
+  gboolean queue_flush = FALSE;
+  g_mutex_lock(&cache->lock);
+  if(mode == DT_IMAGE_CACHE_WRITE_BACK)
+  {
+    // keep the released state, the flush writes it without having to lock the entry
+    dt_image_t *released = g_memdup(img, sizeof(dt_image_t));
+    released->profile = NULL;
+    released->cache_entry = NULL;
+    g_hash_table_replace(cache->dirty, GINT_TO_POINTER(imgid), released);
+    queue_flush = !cache->flush_queued;
+    cache->flush_queued = TRUE;
+  }
+  else
+  {
+    g_hash_table_remove(cache->dirty, GINT_TO_POINTER(imgid));
+    _image_cache_write(cache, img);
+  }
+  g_mutex_unlock(&cache->lock);
+
+  dt_cache_release(&cache->cache, img->cache_entry);
 
   // TODO: make this work in relaxed mode, too.
-  if(mode == DT_IMAGE_CACHE_SAFE)
+  if(mode != DT_IMAGE_CACHE_RELAXED)
   {
     // rest about sidecars:
-    // also synch dttags file:
-    dt_image_write_sidecar_file(img->id);
+    // also synch dttags file. writing it flushes pending db rows first.
+    dt_xmp_writer_queue(darktable.xmp_writer, imgid);
+  }
+
+  if(queue_flush)
+  {
+    dt_job_t *job = dt_control_job_create(&_image_cache_flush_job_run, "write back image cache");
+    if(job)
+    {
+      dt_control_job_set_params(job, cache, NULL);
+      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+    }
+    else
+      dt_image_cache_flush(cache);
   }
-  dt_cache_release(&cache->cache, img->cache_entry);
 }
 
 
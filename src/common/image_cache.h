@@ -21,9 +21,19 @@
 #include "common/cache.h"
 #include "common/image.h"
 
+#include <sqlite3.h>
+
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+
+  // write-back state: copies of the entries released with DT_IMAGE_CACHE_WRITE_BACK which are not in the db
+  // yet, by id, and the UPDATE writing them, prepared once. both are protected by lock.
+  GMutex lock;
+  GHashTable *dirty;
+  sqlite3_stmt *update_stmt;
+  gboolean flush_queued; // a flush job is waiting to run
+  GMutex flush_lock;     // serializes flushes, so the barrier also waits for one in flight
 }
 dt_image_cache_t;
 
@@ -34,7 +44,10 @@ typedef enum dt_image_cache_write_mode_t
   // always write to database and xmp
   DT_IMAGE_CACHE_SAFE = 0,
   // only write to db and do xmp only during shutdown
-  DT_IMAGE_CACHE_RELAXED = 1
+  DT_IMAGE_CACHE_RELAXED = 1,
+  // like safe, but only mark the entry dirty. it gets written to the db together with the others in one
+  // transaction by a background job, on eviction, or by dt_image_cache_flush(). meant for bulk operations.
+  DT_IMAGE_CACHE_WRITE_BACK = 2
 }
 dt_image_cache_write_mode_t;
 
@@ -63,6 +76,12 @@ void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
 // is present, also to xmp sidecar files (safe setting).
 void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_image_cache_write_mode_t mode);
 
+// barrier for write-back: returns once all entries released with DT_IMAGE_CACHE_WRITE_BACK so far are in the
+// db, as they were released. call it before reading fields of main.images that might have been changed that
+// way back from sql. changes of entries still locked for writing aren't released yet and so not covered.
+// returns right away, without touching the db, if nothing is pending.
+void dt_image_cache_flush(dt_image_cache_t *cache);
+
 // remove the image from the cache
 void dt_image_cache_remove(dt_image_cache_t *cache, const uint32_t imgid);
 
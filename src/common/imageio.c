@@ -610,18 +610,15 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     goto error_early;
   }
 
-  const int wd = img->width;
-  const int ht = img->height;
-
-
   int res = 0;
 
   dt_times_t start;
   dt_get_times(&start);
-  dt_dev_pixelpipe_t pipe;
-  res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-                         : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params));
-  if(!res)
+  // batches reuse the pipe of the previous image, with its buffers
+  dt_dev_pixelpipe_t *pipe
+      = dt_dev_pixelpipe_pool_get(thumbnail_export ? DT_DEV_PIXELPIPE_THUMBNAIL : DT_DEV_PIXELPIPE_EXPORT);
+  if(pipe && !thumbnail_export) pipe->levels = format->levels(format_params);
+  if(!pipe)
   {
     dt_control_log(
         _("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
@@ -715,19 +712,19 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     g_list_free_full(style_items, dt_style_item_free);
   }
 
-  dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_dev_pixelpipe_set_icc(pipe, icc_type, icc_filename, icc_intent);
+  dt_dev_pixelpipe_set_input(pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  dt_dev_pixelpipe_create_nodes(pipe, &dev);
+  dt_dev_pixelpipe_synch_all(pipe, &dev);
 
   if(filter)
   {
-    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
-    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(pipe, filter + 4);
+    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(pipe, filter + 5);
   }
 
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
-                                  &pipe.processed_height);
+  dt_dev_pixelpipe_get_dimensions(pipe, &dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
+                                  &pipe->processed_height);
 
   dt_show_times(&start, "[export] creating pixelpipe", NULL);
 
@@ -760,8 +757,8 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   // get only once at the beginning, in case the user changes it on the way:
   const gboolean high_quality_processing
-      = ((format_params->max_width == 0 || format_params->max_width >= pipe.processed_width)
-         && (format_params->max_height == 0 || format_params->max_height >= pipe.processed_height))
+      = ((format_params->max_width == 0 || format_params->max_width >= pipe->processed_width)
+         && (format_params->max_height == 0 || format_params->max_height >= pipe->processed_height))
             ? FALSE
             : high_quality;
 
@@ -770,12 +767,12 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   const float max_scale = ( upscale && ( width > 0 || height > 0 )) ? 100.0 : 1.0;
 
-  const double scalex = width > 0 ? fminf(width / (double)pipe.processed_width, max_scale) : max_scale;
-  const double scaley = height > 0 ? fminf(height / (double)pipe.processed_height, max_scale) : max_scale;
+  const double scalex = width > 0 ? fminf(width / (double)pipe->processed_width, max_scale) : max_scale;
+  const double scaley = height > 0 ? fminf(height / (double)pipe->processed_height, max_scale) : max_scale;
   const double scale = fminf(scalex, scaley);
 
-  const int processed_width = scale * pipe.processed_width + .5f;
-  const int processed_height = scale * pipe.processed_height + .5f;
+  const int processed_width = scale * pipe->processed_width + .5f;
+  const int processed_height = scale * pipe->processed_height + .5f;
 
   const int bpp = format->bpp(format_params);
 
@@ -786,7 +783,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
      * if high quality processing was requested, downsampling will be done
      * at the very end of the pipe (just before border and watermark)
      */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    dt_dev_pixelpipe_process_no_gamma(pipe, &dev, 0, 0, processed_width, processed_height, scale);
   }
   else
   {
@@ -797,7 +794,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     // find the finalscale module
     dt_dev_pixelpipe_iop_t *finalscale = NULL;
     {
-      GList *nodes = g_list_last(pipe.nodes);
+      GList *nodes = g_list_last(pipe->nodes);
       while(nodes)
       {
         dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
@@ -814,9 +811,9 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
     // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
     if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+      dt_dev_pixelpipe_process(pipe, &dev, 0, 0, processed_width, processed_height, scale);
     else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+      dt_dev_pixelpipe_process_no_gamma(pipe, &dev, 0, 0, processed_width, processed_height, scale);
 
     if(finalscale) finalscale->enabled = 1;
   }
@@ -824,7 +821,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                          : "[dev_process_export] pixel pipeline processing",
                 NULL);
 
-  uint8_t *outbuf = pipe.backbuf;
+  uint8_t *outbuf = pipe->backbuf;
 
   // downconversion to low-precision formats:
   if(bpp == 8)
@@ -866,7 +863,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
       }
       else
       { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
+        uint8_t *const buf8 = pipe->backbuf;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) schedule(static)
 #endif
@@ -920,7 +917,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total);
   }
 
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_pixelpipe_pool_put(pipe, TRUE);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
@@ -963,7 +960,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   return res;
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_pixelpipe_pool_put(pipe, TRUE);
 error_early:
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
@@ -871,6 +871,7 @@ float dt_interpolation_compute_sample(const struct dt_interpolation *itor, const
  * Pixel interpolation function (see usage in iop/lens.c and iop/clipping.c)
  * ------------------------------------------------------------------------*/
 
+__DT_CLONE_TARGETS__
 static void dt_interpolation_compute_pixel4c_plain(const struct dt_interpolation *itor, const float *in,
                                                    float *out, const float x, const float y, const int width,
                                                    const int height, const int linestride)
@@ -1070,7 +1071,8 @@ void dt_interpolation_compute_pixel4c(const struct dt_interpolation *itor, const
                                       const float x, const float y, const int width, const int height,
                                       const int linestride)
 {
-  if(darktable.codepath.OPENMP_SIMD)
+  // the avx2 clone of the plain path beats the sse2 one
+  if(darktable.codepath.OPENMP_SIMD || darktable.codepath.AVX2)
     return dt_interpolation_compute_pixel4c_plain(itor, in, out, x, y, width, height, linestride);
 #if defined(__SSE2__)
   else if(darktable.codepath.SSE2)
@@ -1350,6 +1352,7 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
+__DT_CLONE_TARGETS__
 static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
                                             const dt_iop_roi_t *const roi_out, const int32_t out_stride,
                                             const float *const in, const dt_iop_roi_t *const roi_in,
@@ -1678,7 +1681,8 @@ void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
                                const float *const in, const dt_iop_roi_t *const roi_in,
                                const int32_t in_stride)
 {
-  if(darktable.codepath.OPENMP_SIMD)
+  // the avx2 clone of the plain path beats the sse2 one
+  if(darktable.codepath.OPENMP_SIMD || darktable.codepath.AVX2)
     return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
 #if defined(__SSE2__)
   else if(darktable.codepath.SSE2)
@@ -0,0 +1,170 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// shared evaluation of the 0x10000 entry float look-up tables the curve modules precompute for [0, 1],
+// with the exponential extrapolation beyond. the scalar helpers keep the exact semantics the modules
+// always had and are used by basecurve, tonecurve, levels and colorin.
+//
+// dt_lut_apply_rgb() applies up to three curves to a whole row of rgba pixels and uses avx2 gathers if the
+// compiler targets it, or if the avx codepaths are built and the cpu has it. only basecurve's rgb path has
+// that shape: tonecurve and levels work on Lab with per channel special cases, colorin interpolates between
+// entries and feeds a matrix right away. without avx2 it is as fast as the per pixel loop, with avx2 about a
+// quarter faster on display-referred data, see src/tests/lut.c.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#define _LUT_AVX2 1
+#define _LUT_AVX2_TARGET
+#define _lut_have_avx2() 1
+#elif defined(__x86_64__) && defined(DT_AVX_CODEPATHS) && defined(HAVE_BUILTIN_CPU_SUPPORTS)
+#define _LUT_AVX2 1
+#define _LUT_AVX2_TARGET __attribute__((target("avx2")))
+#define _lut_have_avx2() __builtin_cpu_supports("avx2")
+#endif
+
+#if defined(_LUT_AVX2)
+#include <immintrin.h>
+#endif
+
+#define DT_LUT_SIZE 0x10000
+
+/** evaluates the exponential extrapolation f(x) = coeff[1] * (x * coeff[0])^coeff[2],
+ *  as fitted by dt_iop_estimate_exp(). */
+static inline float dt_lut_eval_exp(const float *const coeff, const float x)
+{
+  return coeff[1] * powf(x * coeff[0], coeff[2]);
+}
+
+/** nearest entry of the table for x, clamped to [0, 1]. */
+static inline float dt_lut_lookup(const float *const lut, const float x)
+{
+  const int t = (int)(x * 0x10000ul);
+  return lut[t < 0 ? 0 : (t > 0xffff ? 0xffff : t)];
+}
+
+/** linearly interpolated table lookup for x, clamped to [0, 1]. */
+static inline float dt_lut_lookup_linear(const float *const lut, const float x)
+{
+  float ft = x * (DT_LUT_SIZE - 1);
+  ft = ft > 0.0f ? (ft < DT_LUT_SIZE - 1 ? ft : DT_LUT_SIZE - 1) : 0.0f;
+  const int t = ft < DT_LUT_SIZE - 2 ? ft : DT_LUT_SIZE - 2;
+  const float f = ft - t;
+  const float l1 = lut[t];
+  const float l2 = lut[t + 1];
+  return l1 * (1.0f - f) + l2 * f;
+}
+
+/** table lookup below xmax, extrapolation from there on. */
+static inline float dt_lut_lookup_unbounded(const float *const lut, const float *const coeff, const float xmax,
+                                            const float x)
+{
+  return (x < xmax) ? dt_lut_lookup(lut, x) : dt_lut_eval_exp(coeff, x);
+}
+
+/** one curve of dt_lut_apply_rgb(). values from xmax on get extrapolated with coeff, coeff = NULL means
+ *  a plain clamping lookup. */
+typedef struct dt_lut_curve_t
+{
+  const float *lut;
+  const float *coeff;
+  float xmax;
+} dt_lut_curve_t;
+
+static inline float dt_lut_curve_eval(const dt_lut_curve_t *const curve, const float x)
+{
+  return (x < curve->xmax || !curve->coeff) ? dt_lut_lookup(curve->lut, x) : dt_lut_eval_exp(curve->coeff, x);
+}
+
+#if defined(_LUT_AVX2)
+/** two rgba pixels at a time: the curves of r, g and b are gathered relative to the table of r, alpha is
+ *  passed through. lanes which need extrapolation are fixed up one by one. */
+static inline _LUT_AVX2_TARGET void _lut_apply_rgba_avx2(const float *const in, float *const out, const size_t npixels,
+                                        const dt_lut_curve_t curves[3], const int offset_g, const int offset_b)
+{
+  const __m256i offset = _mm256_setr_epi32(0, offset_g, offset_b, 0, 0, offset_g, offset_b, 0);
+  const __m256 xmax = _mm256_setr_ps(curves[0].xmax, curves[1].xmax, curves[2].xmax, INFINITY,
+                                     curves[0].xmax, curves[1].xmax, curves[2].xmax, INFINITY);
+  const __m256 scale = _mm256_set1_ps(0x10000ul);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i last = _mm256_set1_epi32(0xffff);
+  size_t k = 0;
+  for(; k + 2 <= npixels; k += 2)
+  {
+    const __m256 x = _mm256_loadu_ps(in + 4 * k);
+    __m256i t = _mm256_cvttps_epi32(_mm256_mul_ps(x, scale));
+    t = _mm256_min_epi32(_mm256_max_epi32(t, zero), last);
+    __m256 y = _mm256_i32gather_ps(curves[0].lut, _mm256_add_epi32(t, offset), 4);
+    y = _mm256_blend_ps(y, x, 0x88);
+    // same as !(x < xmax) in the scalar code, i.e. including nan
+    const int extrapolate = _mm256_movemask_ps(_mm256_cmp_ps(x, xmax, _CMP_NLT_UQ)) & 0x77;
+    if(extrapolate)
+    {
+      // keep the input, in and out may alias
+      float xs[8] __attribute__((aligned(32)));
+      float *const o = out + 4 * k;
+      _mm256_store_ps(xs, x);
+      _mm256_storeu_ps(o, y);
+      for(int l = 0; l < 8; l += 4)
+        for(int c = 0; c < 3; c++)
+          if((extrapolate & (1 << (l + c))) && curves[c].coeff)
+            o[l + c] = dt_lut_eval_exp(curves[c].coeff, xs[l + c]);
+    }
+    else
+      _mm256_storeu_ps(out + 4 * k, y);
+  }
+  for(; k < npixels; k++)
+  {
+    for(int c = 0; c < 3; c++) out[4 * k + c] = dt_lut_curve_eval(curves + c, in[4 * k + c]);
+    out[4 * k + 3] = in[4 * k + 3];
+  }
+}
+#endif
+
+/** applies the three curves to the first three channels of npixels pixels with ch channels each. a fourth
+ *  channel is copied, further ones are left alone. in and out may be the same buffer. */
+static inline void dt_lut_apply_rgb(const float *const in, float *const out, const size_t npixels, const int ch,
+                                    const dt_lut_curve_t curves[3])
+{
+#if defined(_LUT_AVX2)
+  // the gather addresses all tables relative to the first one
+  const ptrdiff_t offset_g = curves[1].lut - curves[0].lut;
+  const ptrdiff_t offset_b = curves[2].lut - curves[0].lut;
+  if(ch == 4 && offset_g > INT32_MIN / 2 && offset_g < INT32_MAX / 2 && offset_b > INT32_MIN / 2
+     && offset_b < INT32_MAX / 2 && _lut_have_avx2())
+  {
+    _lut_apply_rgba_avx2(in, out, npixels, curves, offset_g, offset_b);
+    return;
+  }
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float *const inp = in + ch * k;
+    float *const outp = out + ch * k;
+    for(int c = 0; c < 3; c++) outp[c] = dt_lut_curve_eval(curves + c, inp[c]);
+    if(ch == 4) outp[3] = inp[3];
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
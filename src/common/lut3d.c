@@ -0,0 +1,365 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/lut3d.h"
+#include "common/darktable.h"
+#include "common/colorspaces_inline_conversions.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+// number of tables we keep around, also when no pipe uses them anymore
+#define DT_LUT3D_CACHE_SIZE 8
+// points per cell checked against the transform
+#define DT_LUT3D_PROBES 9
+
+static GMutex _cache_lock;
+// signalled when a table is done baking
+static GCond _cache_baked;
+static dt_lut3d_t *_cache[DT_LUT3D_CACHE_SIZE] = { NULL };
+static uint64_t _cache_tick = 0;
+
+uint64_t dt_lut3d_hash(uint64_t hash, const void *const data, const size_t len)
+{
+  const uint8_t *const bytes = (const uint8_t *)data;
+  if(!hash) hash = 14695981039346656037ull;
+  for(size_t k = 0; k < len; k++)
+  {
+    hash ^= bytes[k];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t dt_lut3d_hash_profile(uint64_t hash, cmsHPROFILE profile)
+{
+  cmsUInt32Number len = 0;
+  if(!profile || !cmsSaveProfileToMem(profile, NULL, &len) || !len) return 0;
+  uint8_t *buf = malloc(len);
+  if(!buf) return 0;
+  if(cmsSaveProfileToMem(profile, buf, &len))
+    hash = dt_lut3d_hash(hash, buf, len);
+  else
+    hash = 0;
+  free(buf);
+  return hash;
+}
+
+// maps a pixel to [0, 1]^3 grid coordinates, returns 0 if it is outside the domain
+static inline int _encode(const dt_lut3d_domain_t domain, const float *const in, float u[3])
+{
+  if(domain == DT_LUT3D_DOMAIN_LAB)
+  {
+    u[0] = in[0] * (1.0f / 100.0f);
+    u[1] = (in[1] + 128.0f) * (1.0f / 256.0f);
+    u[2] = (in[2] + 128.0f) * (1.0f / 256.0f);
+  }
+  else
+  {
+    u[0] = in[0];
+    u[1] = in[1];
+    u[2] = in[2];
+  }
+  // written such that nan is outside, too
+  if(!(u[0] >= 0.0f && u[0] <= 1.0f && u[1] >= 0.0f && u[1] <= 1.0f && u[2] >= 0.0f && u[2] <= 1.0f))
+    return 0;
+  if(domain == DT_LUT3D_DOMAIN_RGB)
+  {
+    // the cube root scale puts the samples where lab (and our eyes) need them
+    for(int c = 0; c < 3; c++) u[c] = u[c] > 0.0f ? cbrta_halleyf(cbrt_5f(u[c]), u[c]) : 0.0f;
+  }
+  return 1;
+}
+
+static inline void _decode(const dt_lut3d_domain_t domain, const float u[3], float *const out)
+{
+  if(domain == DT_LUT3D_DOMAIN_LAB)
+  {
+    out[0] = u[0] * 100.0f;
+    out[1] = u[1] * 256.0f - 128.0f;
+    out[2] = u[2] * 256.0f - 128.0f;
+  }
+  else
+  {
+    for(int c = 0; c < 3; c++) out[c] = u[c] * u[c] * u[c];
+  }
+}
+
+// tetrahedral interpolation of the grid cell containing u. returns 0 without touching out if the cell is
+// one the table does not approximate well enough.
+static inline int _interpolate(const dt_lut3d_t *const lut, const float u[3], float *const out)
+{
+  const size_t stride[3] = { 4, 4 * DT_LUT3D_SIZE, 4 * DT_LUT3D_SIZE * DT_LUT3D_SIZE };
+  const size_t cell_stride[3] = { 1, DT_LUT3D_SIZE - 1, (DT_LUT3D_SIZE - 1) * (DT_LUT3D_SIZE - 1) };
+  size_t base = 0, cell = 0;
+  float f[3];
+  for(int c = 0; c < 3; c++)
+  {
+    const float x = u[c] * (DT_LUT3D_SIZE - 1);
+    const int i = x < DT_LUT3D_SIZE - 2 ? (int)x : DT_LUT3D_SIZE - 2;
+    f[c] = x - i;
+    base += i * stride[c];
+    cell += i * cell_stride[c];
+  }
+  if(lut->exact[cell]) return 0;
+
+  // walk from the corner at base to the opposite one along the axes in order of decreasing fraction. written
+  // without branches, the order is all but random from one pixel to the next.
+  const float fa = fmaxf(fmaxf(f[0], f[1]), f[2]);
+  const float fc = fminf(fminf(f[0], f[1]), f[2]);
+  const float fb = f[0] + f[1] + f[2] - fa - fc;
+  const size_t sa = f[0] >= f[1] ? (f[0] >= f[2] ? stride[0] : stride[2]) : (f[1] >= f[2] ? stride[1] : stride[2]);
+  const size_t sc = f[0] < f[1] ? (f[0] < f[2] ? stride[0] : stride[2]) : (f[1] < f[2] ? stride[1] : stride[2]);
+  const float *const p0 = lut->grid + base;
+  const float *const p3 = p0 + stride[0] + stride[1] + stride[2];
+  const float *const p1 = p0 + sa;
+  const float *const p2 = p3 - sc;
+  const float w0 = 1.0f - fa, w1 = fa - fb, w2 = fb - fc, w3 = fc;
+
+#if defined(__SSE2__)
+  const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(w0), _mm_load_ps(p0)),
+                                         _mm_mul_ps(_mm_set1_ps(w1), _mm_load_ps(p1))),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w2), _mm_load_ps(p2)),
+                                         _mm_mul_ps(_mm_set1_ps(w3), _mm_load_ps(p3))));
+  float res[4] __attribute__((aligned(16)));
+  _mm_store_ps(res, r);
+  out[0] = res[0];
+  out[1] = res[1];
+  out[2] = res[2];
+#else
+  for(int k = 0; k < 3; k++) out[k] = w0 * p0[k] + w1 * p1[k] + w2 * p2[k] + w3 * p3[k];
+#endif
+  return 1;
+}
+
+void dt_lut3d_apply(const dt_lut3d_t *const lut, const float *const in, float *const out, const size_t npixels,
+                    dt_lut3d_eval_t fallback, void *data)
+{
+  // start of the current run of pixels outside the domain
+  size_t run = npixels;
+  for(size_t k = 0; k < npixels; k++)
+  {
+    float u[3];
+    if(_encode(lut->domain, in + 4 * k, u) && _interpolate(lut, u, out + 4 * k))
+    {
+      if(run < k)
+      {
+        fallback(in + 4 * run, out + 4 * run, k - run, data);
+        run = npixels;
+      }
+    }
+    else if(run == npixels)
+      run = k;
+  }
+  if(run < npixels) fallback(in + 4 * run, out + 4 * run, npixels - run, data);
+}
+
+// fills grid and exact of lut, returns 0 if there is no memory for them
+static int _bake(dt_lut3d_t *const lut, dt_lut3d_eval_t eval, void *data)
+{
+  const int n = DT_LUT3D_SIZE;
+  const dt_lut3d_domain_t domain = lut->domain;
+  const float tolerance = lut->tolerance;
+  float *grid = dt_alloc_align(64, sizeof(float) * 4 * n * n * n);
+  uint8_t *exact = calloc((size_t)(n - 1) * (n - 1) * (n - 1), sizeof(uint8_t));
+  if(!grid || !exact)
+  {
+    dt_free_align(grid);
+    free(exact);
+    return 0;
+  }
+
+  // one row of the first axis at a time, that's what the transforms like
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int row = 0; row < n * n; row++)
+  {
+    float in[4 * DT_LUT3D_SIZE], *out = grid + (size_t)4 * n * row;
+    for(int i = 0; i < n; i++)
+    {
+      const float u[3] = { i / (float)(n - 1), (row % n) / (float)(n - 1), (row / n) / (float)(n - 1) };
+      _decode(domain, u, in + 4 * i);
+      in[4 * i + 3] = 0.0f;
+    }
+    memset(out, 0, sizeof(float) * 4 * n);
+    eval(in, out, n, data);
+    for(int i = 0; i < n; i++) out[4 * i + 3] = 0.0f;
+  }
+
+  lut->grid = grid;
+  lut->exact = exact;
+
+  // probe every cell and leave those to the transform itself where the table is off by more than the
+  // tolerance, mostly where clipping puts a kink into the transform.
+  static const float probes[DT_LUT3D_PROBES][3]
+      = { { 0.5f, 0.5f, 0.5f },    { 0.2f, 0.2f, 0.2f }, { 0.8f, 0.2f, 0.2f }, { 0.2f, 0.8f, 0.2f },
+          { 0.8f, 0.8f, 0.2f },    { 0.2f, 0.2f, 0.8f }, { 0.8f, 0.2f, 0.8f }, { 0.2f, 0.8f, 0.8f },
+          { 0.8f, 0.8f, 0.8f } };
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int row = 0; row < (n - 1) * (n - 1); row++)
+  {
+    float u[4 * DT_LUT3D_PROBES * (DT_LUT3D_SIZE - 1)], in[4 * DT_LUT3D_PROBES * (DT_LUT3D_SIZE - 1)];
+    float out[4 * DT_LUT3D_PROBES * (DT_LUT3D_SIZE - 1)];
+    for(int i = 0; i < n - 1; i++)
+      for(int p = 0; p < DT_LUT3D_PROBES; p++)
+      {
+        float *const up = u + 4 * (DT_LUT3D_PROBES * i + p);
+        up[0] = (i + probes[p][0]) / (n - 1);
+        up[1] = (row % (n - 1) + probes[p][1]) / (n - 1);
+        up[2] = (row / (n - 1) + probes[p][2]) / (n - 1);
+        _decode(domain, up, in + 4 * (DT_LUT3D_PROBES * i + p));
+        in[4 * (DT_LUT3D_PROBES * i + p) + 3] = 0.0f;
+      }
+    memset(out, 0, sizeof(out));
+    eval(in, out, DT_LUT3D_PROBES * (n - 1), data);
+    for(int i = 0; i < n - 1; i++)
+      for(int p = 0; p < DT_LUT3D_PROBES; p++)
+      {
+        float approx[3];
+        const int k = DT_LUT3D_PROBES * i + p;
+        if(!_interpolate(lut, u + 4 * k, approx)) continue; // flagged already
+        for(int c = 0; c < 3; c++)
+          if(!(fabsf(approx[c] - out[4 * k + c]) <= tolerance)) exact[(size_t)(n - 1) * row + i] = 1;
+      }
+  }
+  return 1;
+}
+
+static void _free(dt_lut3d_t *lut)
+{
+  dt_free_align(lut->grid);
+  free(lut->exact);
+  free(lut);
+}
+
+// drops a reference with the cache locked, tables that didn't get a slot go with the last one
+static void _release_locked(dt_lut3d_t *lut)
+{
+  lut->refs--;
+  int cached = 0;
+  for(int k = 0; k < DT_LUT3D_CACHE_SIZE; k++) cached |= (_cache[k] == lut);
+  if(!cached && lut->refs == 0) _free(lut);
+}
+
+dt_lut3d_t *dt_lut3d_get(const uint64_t key, const dt_lut3d_domain_t domain, const float tolerance,
+                         dt_lut3d_eval_t eval, void *data)
+{
+  g_mutex_lock(&_cache_lock);
+  dt_lut3d_t *lut = NULL;
+  int slot = -1;
+  for(int k = 0; k < DT_LUT3D_CACHE_SIZE; k++)
+  {
+    if(_cache[k] && _cache[k]->key == key && _cache[k]->domain == domain
+       && _cache[k]->tolerance == tolerance)
+    {
+      lut = _cache[k];
+      break;
+    }
+    // prefer empty slots, then the least recently used table nobody holds
+    if(!_cache[k])
+    {
+      if(slot < 0 || _cache[slot]) slot = k;
+    }
+    else if(_cache[k]->refs == 0 && (slot < 0 || (_cache[slot] && _cache[k]->last_used < _cache[slot]->last_used)))
+      slot = k;
+  }
+
+  if(lut)
+  {
+    // someone else is baking it, the reference keeps it from being evicted while we wait
+    lut->refs++;
+    lut->last_used = ++_cache_tick;
+    while(lut->baking) g_cond_wait(&_cache_baked, &_cache_lock);
+    if(!lut->grid)
+    {
+      _release_locked(lut);
+      lut = NULL;
+    }
+    g_mutex_unlock(&_cache_lock);
+    return lut;
+  }
+
+  // put the table into the cache before it is baked, so pipes asking for it concurrently wait for this one
+  // instead of baking their own. the baking itself runs without the lock, tables for other keys stay available.
+  lut = calloc(1, sizeof(dt_lut3d_t));
+  if(!lut)
+  {
+    g_mutex_unlock(&_cache_lock);
+    return NULL;
+  }
+  lut->key = key;
+  lut->domain = domain;
+  lut->tolerance = tolerance;
+  lut->refs = 1;
+  lut->last_used = ++_cache_tick;
+  lut->baking = 1;
+  if(slot >= 0)
+  {
+    if(_cache[slot]) _free(_cache[slot]);
+    _cache[slot] = lut;
+  }
+  g_mutex_unlock(&_cache_lock);
+
+  const int baked = _bake(lut, eval, data);
+
+  g_mutex_lock(&_cache_lock);
+  lut->baking = 0;
+  if(!baked)
+  {
+    // out of memory, don't keep the empty table around. waiters see it has no grid and give up, too
+    for(int k = 0; k < DT_LUT3D_CACHE_SIZE; k++)
+      if(_cache[k] == lut) _cache[k] = NULL;
+    _release_locked(lut);
+    lut = NULL;
+  }
+  g_cond_broadcast(&_cache_baked);
+  g_mutex_unlock(&_cache_lock);
+  return lut;
+}
+
+void dt_lut3d_release(dt_lut3d_t *lut)
+{
+  if(!lut) return;
+  g_mutex_lock(&_cache_lock);
+  // all slots were taken when this one got baked
+  _release_locked(lut);
+  g_mutex_unlock(&_cache_lock);
+}
+
+void dt_lut3d_cleanup()
+{
+  g_mutex_lock(&_cache_lock);
+  for(int k = 0; k < DT_LUT3D_CACHE_SIZE; k++)
+  {
+    if(_cache[k]) _free(_cache[k]);
+    _cache[k] = NULL;
+  }
+  g_mutex_unlock(&_cache_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
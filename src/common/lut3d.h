@@ -0,0 +1,77 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <lcms2.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 3d look-up tables baking arbitrary (i.e. lcms2) color transforms of a bounded input domain, evaluated
+// with tetrahedral interpolation. the tables are shared between all pipes through a small cache keyed by a
+// hash of whatever went into the transform.
+
+/** samples per axis */
+#define DT_LUT3D_SIZE 33
+
+typedef enum dt_lut3d_domain_t
+{
+  DT_LUT3D_DOMAIN_RGB = 0, // rgb or xyz in [0, 1], sampled on a cube root scale
+  DT_LUT3D_DOMAIN_LAB = 1  // L in [0, 100], a and b in [-128, 128]
+} dt_lut3d_domain_t;
+
+/** the transform to be baked, also used for pixels outside the domain. works on npixels rgba floats,
+ *  only the first three channels of out are expected to be written. */
+typedef void (*dt_lut3d_eval_t)(const float *const in, float *const out, const size_t npixels, void *data);
+
+typedef struct dt_lut3d_t
+{
+  uint64_t key;
+  dt_lut3d_domain_t domain;
+  float tolerance;
+  float *grid;    // DT_LUT3D_SIZE^3 nodes of 4 floats, first channel varying fastest
+  uint8_t *exact; // per cell: the table is too far off here, use the transform
+  int refs;
+  uint64_t last_used;
+  int baking;     // grid and exact are still being filled, wait for the cache's condition
+} dt_lut3d_t;
+
+/** fnv-1a, to build the keys. */
+uint64_t dt_lut3d_hash(uint64_t hash, const void *const data, const size_t len);
+/** adds the serialized profile to the hash, returns 0 if that fails. */
+uint64_t dt_lut3d_hash_profile(uint64_t hash, cmsHPROFILE profile);
+
+/** get the table for key from the cache, baking it with eval if needed. release it when done. cells where the
+ *  interpolation deviates from eval by more than tolerance in any output channel are left to the transform. */
+dt_lut3d_t *dt_lut3d_get(const uint64_t key, const dt_lut3d_domain_t domain, const float tolerance,
+                         dt_lut3d_eval_t eval, void *data);
+void dt_lut3d_release(dt_lut3d_t *lut);
+
+/** applies the table to npixels rgba pixels, in and out may be the same. alpha of out is left alone. runs of
+ *  pixels outside the domain of the table (including nan) or in cells it can't approximate are handed to
+ *  fallback instead. */
+void dt_lut3d_apply(const dt_lut3d_t *const lut, const float *const in, float *const out, const size_t npixels,
+                    dt_lut3d_eval_t fallback, void *data);
+
+/** frees all cached tables, on shutdown. */
+void dt_lut3d_cleanup();
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -28,6 +28,7 @@
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
+#include "develop/thumbnail.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -1088,31 +1089,27 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
   dt_image_cache_read_release(darktable.image_cache, image);
 }
 
-
-// dummy functions for `export' to mipmap buffers:
-typedef struct _dummy_data_t
-{
-  dt_imageio_module_data_t head;
-  uint8_t *buf;
-} _dummy_data_t;
-
-static int _levels(dt_imageio_module_data_t *data)
+// try to generate mip from larger mip. returns 0 on success.
+static int _init_8_from_larger_mip(uint8_t *buf, uint32_t *width, uint32_t *height,
+                                   dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
+                                   const dt_mipmap_size_t size, const uint32_t wd, const uint32_t ht,
+                                   const char *filename)
 {
-  return IMAGEIO_RGB | IMAGEIO_INT8;
-}
-
-static int _bpp(dt_imageio_module_data_t *data)
-{
-  return 8;
-}
+  for(dt_mipmap_size_t k = size + 1; k <= DT_MIPMAP_7; k++)
+  {
+    dt_mipmap_buffer_t tmp;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &tmp, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+    if(tmp.buf == NULL)
+      continue;
+    dt_print(DT_DEBUG_CACHE, "[_init_8] generate mip %d for %s from level %d\n", size, filename, k);
+    *color_space = tmp.color_space;
+    // downsample
+    dt_iop_flip_and_zoom_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, ORIENTATION_NONE, width, height);
 
-static int _write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
-                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                        void *exif, int exif_len, int imgid, int num, int total)
-{
-  _dummy_data_t *d = (_dummy_data_t *)data;
-  memcpy(d->buf, in, data->width * data->height * sizeof(uint32_t));
-  return 0;
+    dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
+    return 0;
+  }
+  return 1;
 }
 
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
@@ -1137,13 +1134,19 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
   const int altered = dt_image_altered(imgid);
   int res = 1;
 
+  // darktable-generate-cache renders the largest size first, downsampling that is a lot cheaper than
+  // decoding the embedded thumbnail for every smaller size. everywhere else the embedded thumbnail stays
+  // the preferred source.
+  if(darktable.mipmap_cache->prefer_larger_mip)
+    res = _init_8_from_larger_mip(buf, width, height, color_space, imgid, size, wd, ht, filename);
+
   const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
   // the orientation for this camera is not read correctly from exiv2, so we need
   // to go the full path (as the thumbnail will be flipped the wrong way round)
   const int incompatible = !strncmp(cimg->exif_maker, "Phase One", 9);
   dt_image_cache_read_release(darktable.image_cache, cimg);
 
-  if(!altered && !dt_conf_get_bool("never_use_embedded_thumb") && !incompatible)
+  if(res && !altered && !dt_conf_get_bool("never_use_embedded_thumb") && !incompatible)
   {
     const dt_image_orientation_t orientation = dt_image_get_orientation(imgid);
 
@@ -1185,46 +1188,19 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     }
   }
 
-  if(res)
-  {
-    //try to generate mip from larger mip
-    for(dt_mipmap_size_t k = size + 1; k <= DT_MIPMAP_7; k++)
-    {
-      dt_mipmap_buffer_t tmp;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &tmp, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
-      if(tmp.buf == NULL)
-        continue;
-      dt_print(DT_DEBUG_CACHE, "[_init_8] generate mip %d for %s from level %d\n", size, filename, k);
-      *color_space = tmp.color_space;
-      // downsample
-      dt_iop_flip_and_zoom_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, ORIENTATION_NONE, width, height);
-
-      dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
-      res = 0;
-      break;
-    }
-  }
+  if(res && !darktable.mipmap_cache->prefer_larger_mip)
+    res = _init_8_from_larger_mip(buf, width, height, color_space, imgid, size, wd, ht, filename);
 
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
-    dt_imageio_module_format_t format;
-    _dummy_data_t dat;
-    format.bpp = _bpp;
-    format.write_image = _write_image;
-    format.levels = _levels;
-    dat.head.max_width = wd;
-    dat.head.max_height = ht;
-    dat.buf = buf;
-    // export with flags: ignore exif (don't load from disk), don't swap byte order, don't do hq processing,
-    // no upscaling and signal we want thumbnail export
-    res = dt_imageio_export_with_flags(imgid, "unused", &format, (dt_imageio_module_data_t *)&dat, 1, 0, 0, 0, 1,
-                                       NULL, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL, NULL, 1, 1);
+    int thumb_width = 0, thumb_height = 0;
+    res = dt_dev_thumbnail_process(imgid, buf, wd, ht, &thumb_width, &thumb_height);
     if(!res)
     {
       // might be smaller, or have a different aspect than what we got as input.
-      *width = dat.head.width;
-      *height = dat.head.height;
+      *width = thumb_width;
+      *height = thumb_height;
       *iscale = 1.0f;
       *color_space = dt_mipmap_cache_get_colorspace();
     }
@@ -99,6 +99,8 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // generate smaller mips from a larger one in the cache before trying the embedded thumbnail
+  int prefer_larger_mip;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
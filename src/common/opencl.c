@@ -1041,7 +1041,7 @@ static float dt_opencl_benchmark_cpu(const size_t width, const size_t height, co
   double start = dt_get_wtime();
 
   // prepare gaussian filter
-  g = dt_gaussian_init(width, height, 4, Labmax, Labmin, sigma, 0);
+  g = dt_gaussian_init(NULL, width, height, 4, Labmax, Labmin, sigma, 0);
   if(!g) goto error;
 
   // gaussian blur
@@ -31,8 +31,8 @@ void dt_ratings_apply_to_image(int imgid, int rating)
   if(image)
   {
     image->flags = (image->flags & ~0x7) | (0x7 & rating);
-    // synch through:
-    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
+    // synch through, batched with the other images of a bulk rating:
+    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_WRITE_BACK);
 
     dt_collection_hint_message(darktable.collection);
   }
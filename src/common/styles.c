@@ -26,6 +26,8 @@
 #include "common/imageio.h"
 #include "common/tags.h"
 #include "control/control.h"
+#include "control/jobs.h"
+#include "control/jobs/control_jobs.h"
 #include "develop/develop.h"
 
 #include "gui/accelerators.h"
@@ -469,29 +471,186 @@ gboolean dt_styles_create_from_image(const char *name, const char *description,
   return FALSE;
 }
 
-void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
+// memory.style_items is scratch space of the style being applied, one image at a time
+static GMutex _styles_apply_lock;
+
+/* the database side of applying style id to imgid (or a duplicate of it), safe to run on a worker thread.
+   returns the id of the image that got the style, -1 on failure. */
+static int32_t _styles_apply_to_image_db(const char *name, const int id, gboolean duplicate, int32_t imgid)
 {
-  gboolean selected = FALSE;
+  sqlite3_stmt *stmt;
+  int32_t newimgid;
+
+  /* check if we should make a duplicate before applying style */
+  if(duplicate)
+  {
+    newimgid = dt_image_duplicate(imgid);
+    if(newimgid == -1) return -1;
+    dt_history_copy_and_paste_on_image_db(imgid, newimgid, FALSE, NULL);
+  }
+  else
+    newimgid = imgid;
+
+  g_mutex_lock(&_styles_apply_lock);
+  /* merge onto history stack, let's find history offest in destination image */
+  /* first trim the stack to get rid of whatever is above the selected entry */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "DELETE FROM main.history WHERE imgid = ?1 AND num >= (SELECT history_end "
+                              "FROM main.images WHERE id = imgid)", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  /* in sqlite ROWID starts at 1, while our num column starts at 0 */
+  int32_t offs = -1;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT IFNULL(MAX(num), -1) FROM main.history WHERE imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW) offs = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  /* delete all items from the temp styles_items, this table is used only to get a ROWNUM of the results */
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.style_items", NULL, NULL, NULL);
+
+  /* copy history items from styles onto temp table */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "INSERT INTO memory.style_items SELECT * FROM "
+                                                             "data.style_items WHERE styleid=?1 ORDER BY "
+                                                             "num DESC",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  // rebuild multi-priority
+  if(!duplicate) dt_history_rebuild_multi_priority_merge(newimgid);
+
+  /* copy the style items into the history */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO main.history "
+                              "(imgid,num,module,operation,op_params,enabled,blendop_params,blendop_"
+                              "version,multi_priority,multi_name) SELECT "
+                              "?1,?2+rowid,module,operation,op_params,enabled,blendop_params,blendop_"
+                              "version,multi_priority,multi_name FROM memory.style_items",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offs);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  /* always make the whole stack active */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "UPDATE main.images SET history_end = (SELECT MAX(num) + 1 FROM main.history "
+                              "WHERE imgid = ?1) WHERE id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  g_mutex_unlock(&_styles_apply_lock);
+  return newimgid;
+}
+
+static void _styles_tag_images(const char *name, const GList *imgs)
+{
+  guint tagid = 0;
+  gchar ntag[512] = { 0 };
+  g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
+  if(dt_tag_new(ntag, &tagid)) dt_tag_attach_images(tagid, imgs);
+  if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach_images(tagid, imgs);
+}
 
+typedef struct dt_styles_apply_job_t
+{
+  gchar *name;
+  gboolean duplicate;
+  GList *imgs;
+} dt_styles_apply_job_t;
+
+static void _styles_apply_job_cleanup(void *p)
+{
+  dt_styles_apply_job_t *params = (dt_styles_apply_job_t *)p;
+  g_free(params->name);
+  g_list_free(params->imgs);
+  free(params);
+}
+
+static int32_t _styles_apply_job_run(dt_job_t *job)
+{
+  dt_styles_apply_job_t *params = (dt_styles_apply_job_t *)dt_control_job_get_params(job);
+  const int id = dt_styles_get_id_by_name(params->name);
+  if(id == 0) return 1;
+
+  const guint total = g_list_length(params->imgs);
+  guint count = 0;
+  GList *done = NULL;
+
+  // a transaction per image. the gui waits for the one running to start its own, so keep them short.
+  for(GList *iter = params->imgs; iter && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED;
+      iter = g_list_next(iter))
+  {
+    dt_database_start_transaction(darktable.db);
+    const int32_t newimgid = _styles_apply_to_image_db(params->name, id, params->duplicate,
+                                                       GPOINTER_TO_INT(iter->data));
+    dt_database_release_transaction(darktable.db);
+    if(newimgid > 0) done = g_list_prepend(done, GINT_TO_POINTER(newimgid));
+    dt_control_job_set_progress(job, (double)++count / total);
+  }
+
+  dt_database_start_transaction(darktable.db);
+  _styles_tag_images(params->name, done);
+  dt_database_release_transaction(darktable.db);
+
+  if(params->duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+  dt_control_refresh_images(done);
+  return 0;
+}
+
+void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
+{
   /* write current history changes so nothing gets lost, do that only in the darkroom as there is nothing to
      be
      save when in the lighttable (and it would write over current history stack) */
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
   if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
-  /* for each selected image apply style */
+  GList *imgs = NULL;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
                               -1, &stmt, NULL);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  while(sqlite3_step(stmt) == SQLITE_ROW) imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+
+  if(!imgs)
   {
-    int imgid = sqlite3_column_int(stmt, 0);
-    dt_styles_apply_to_image(name, duplicate, imgid);
-    selected = TRUE;
+    dt_control_log(_("no image selected!"));
+    return;
   }
-  sqlite3_finalize(stmt);
 
-  if(!selected) dt_control_log(_("no image selected!"));
+  /* the image in the darkroom has to be reloaded on the gui thread, do that one right away */
+  for(GList *iter = imgs; iter; iter = g_list_next(iter))
+    if(dt_dev_is_current_image(darktable.develop, GPOINTER_TO_INT(iter->data)))
+    {
+      dt_styles_apply_to_image(name, duplicate, GPOINTER_TO_INT(iter->data));
+      imgs = g_list_delete_link(imgs, iter);
+      break;
+    }
+  if(!imgs) return;
+
+  /* all the others in one transaction in the background */
+  dt_job_t *job = dt_control_job_create(&_styles_apply_job_run, "%s", N_("apply style"));
+  dt_styles_apply_job_t *params = job ? (dt_styles_apply_job_t *)calloc(1, sizeof(dt_styles_apply_job_t)) : NULL;
+  if(!params)
+  {
+    if(job) dt_control_job_dispose(job);
+    g_list_free(imgs);
+    return;
+  }
+  params->name = g_strdup(name);
+  params->duplicate = duplicate;
+  params->imgs = g_list_reverse(imgs);
+  dt_control_job_add_progress(job, _("apply style"), TRUE);
+  dt_control_job_set_params(job, params, _styles_apply_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
 }
 
 void dt_styles_create_from_selection()
@@ -514,101 +673,33 @@ void dt_styles_create_from_selection()
 
 void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgid)
 {
-  int id = 0;
-  sqlite3_stmt *stmt;
-  int32_t newimgid;
-
-  if((id = dt_styles_get_id_by_name(name)) != 0)
-  {
-    /* check if we should make a duplicate before applying style */
-    if(duplicate)
-    {
-      newimgid = dt_image_duplicate(imgid);
-      if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
-    }
-    else
-      newimgid = imgid;
-
-    /* merge onto history stack, let's find history offest in destination image */
-    /* first trim the stack to get rid of whatever is above the selected entry */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "DELETE FROM main.history WHERE imgid = ?1 AND num >= (SELECT history_end "
-                                "FROM main.images WHERE id = imgid)", -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    /* in sqlite ROWID starts at 1, while our num column starts at 0 */
-    int32_t offs = -1;
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT IFNULL(MAX(num), -1) FROM main.history WHERE imgid = ?1", -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    if(sqlite3_step(stmt) == SQLITE_ROW) offs = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-
-    /* delete all items from the temp styles_items, this table is used only to get a ROWNUM of the results */
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.style_items", NULL, NULL, NULL);
-
-    /* copy history items from styles onto temp table */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "INSERT INTO memory.style_items SELECT * FROM "
-                                                               "data.style_items WHERE styleid=?1 ORDER BY "
-                                                               "num DESC",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    // rebuild multi-priority
-    if(!duplicate) dt_history_rebuild_multi_priority_merge(newimgid);
-
-    /* copy the style items into the history */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.history "
-                                "(imgid,num,module,operation,op_params,enabled,blendop_params,blendop_"
-                                "version,multi_priority,multi_name) SELECT "
-                                "?1,?2+rowid,module,operation,op_params,enabled,blendop_params,blendop_"
-                                "version,multi_priority,multi_name FROM memory.style_items",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offs);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+  const int id = dt_styles_get_id_by_name(name);
+  if(id == 0) return;
 
-    /* always make the whole stack active */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "UPDATE main.images SET history_end = (SELECT MAX(num) + 1 FROM main.history "
-                                "WHERE imgid = ?1) WHERE id = ?1",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+  const int32_t newimgid = _styles_apply_to_image_db(name, id, duplicate, imgid);
+  if(newimgid <= 0) return;
 
-    /* add tag */
-    guint tagid = 0;
-    gchar ntag[512] = { 0 };
-    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
-    if(dt_tag_new(ntag, &tagid)) dt_tag_attach(tagid, newimgid);
-    if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach(tagid, newimgid);
+  GList imgs = { GINT_TO_POINTER(newimgid), NULL, NULL };
+  _styles_tag_images(name, &imgs);
 
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
-    {
-      dt_dev_reload_history_items(darktable.develop);
-      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
-    }
+  /* if current image in develop reload history */
+  if(dt_dev_is_current_image(darktable.develop, newimgid))
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+  }
 
-    /* update xmp file */
-    dt_image_synch_xmp(newimgid);
+  /* update xmp file */
+  dt_image_synch_xmp(newimgid);
 
-    /* remove old obsolete thumbnails */
-    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+  /* remove old obsolete thumbnails */
+  dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
 
-    /* if we have created a duplicate, reset collected images */
-    if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+  /* if we have created a duplicate, reset collected images */
+  if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
 
-    /* redraw center view to update visible mipmaps */
-    dt_control_queue_redraw_center();
-  }
+  /* redraw center view to update visible mipmaps */
+  dt_control_queue_redraw_center();
 }
 
 void dt_styles_delete_by_name(const char *name)
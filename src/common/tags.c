@@ -229,6 +229,42 @@ void dt_tag_attach(guint tagid, gint imgid)
   dt_collection_update_query(darktable.collection);
 }
 
+// ids per statement in dt_tag_attach_images(), keeps the sql text well below sqlite's limit
+#define DT_TAG_ATTACH_CHUNK 1000
+
+void dt_tag_attach_images(guint tagid, const GList *imgs)
+{
+  // one insert per chunk of images instead of one per image
+  const GList *iter = imgs;
+  while(iter)
+  {
+    GString *ids = g_string_new(NULL);
+    for(int k = 0; iter && k < DT_TAG_ATTACH_CHUNK; iter = g_list_next(iter))
+    {
+      const int imgid = GPOINTER_TO_INT(iter->data);
+      if(imgid <= 0) continue;
+      g_string_append_printf(ids, "%s%d", k++ ? "," : "", imgid);
+    }
+    if(ids->len)
+    {
+      sqlite3_stmt *stmt;
+      gchar *query = g_strdup_printf("INSERT OR REPLACE INTO main.tagged_images (imgid, tagid) "
+                                     "SELECT id, ?1 FROM main.images WHERE id IN (%s)",
+                                     ids->str);
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
+      sqlite3_step(stmt);
+      sqlite3_finalize(stmt);
+      g_free(query);
+    }
+    g_string_free(ids, TRUE);
+  }
+
+  dt_tag_update_used_tags();
+
+  dt_collection_update_query(darktable.collection);
+}
+
 void dt_tag_attach_list(GList *tags, gint imgid)
 {
   GList *child = NULL;
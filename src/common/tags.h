@@ -61,6 +61,10 @@ gboolean dt_tag_exists(const char *name, guint *tagid);
  * id to attach tag to, if < 0 selected images are used. */
 void dt_tag_attach(guint tagid, gint imgid);
 
+/** attach a tag to a list of images, updating the collection only once. \param[in] tagid id of tag to attach.
+ * \param[in] imgs list of image ids. */
+void dt_tag_attach_images(guint tagid, const GList *imgs);
+
 /** attach a list of tags on selected images. \param[in] tags a list of ids of tags. \param[in] imgid the
  * image id to attach tag to, if < 0 selected images are used. \note If tag not exists it's created.*/
 void dt_tag_attach_list(GList *tags, gint imgid);
@@ -0,0 +1,166 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/xmp_writer.h"
+#include "common/darktable.h"
+#include "common/image.h"
+#include "control/conf.h"
+
+#include <stdlib.h>
+
+// takes the images that are due out of the dirty set, all of them when stopping, and sets *next to the time the
+// next one will be due.
+static GList *_xmp_writer_take_due(dt_xmp_writer_t *w, const gint64 now, gint64 *next)
+{
+  GList *due = NULL;
+  *next = G_MAXINT64;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, w->dirty);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const gint64 when = *(gint64 *)value + DT_XMP_WRITER_DELAY;
+    if(w->quit || when <= now)
+    {
+      due = g_list_prepend(due, key);
+      g_hash_table_iter_remove(&iter);
+    }
+    else if(when < *next)
+      *next = when;
+  }
+  return due;
+}
+
+static void *_xmp_writer_run(void *arg)
+{
+  dt_xmp_writer_t *w = (dt_xmp_writer_t *)arg;
+  g_mutex_lock(&w->lock);
+  while(TRUE)
+  {
+    gint64 next;
+    GList *due = _xmp_writer_take_due(w, g_get_monotonic_time(), &next);
+    if(due)
+    {
+      w->busy = TRUE;
+      g_mutex_unlock(&w->lock);
+      dt_image_write_sidecar_files(due);
+      g_list_free(due);
+      g_mutex_lock(&w->lock);
+      w->busy = FALSE;
+      g_cond_broadcast(&w->cond);
+    }
+    else if(w->quit)
+      break;
+    else if(next == G_MAXINT64)
+      g_cond_wait(&w->cond, &w->lock);
+    else
+      g_cond_wait_until(&w->cond, &w->lock, next);
+  }
+  g_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+dt_xmp_writer_t *dt_xmp_writer_init()
+{
+  dt_xmp_writer_t *w = (dt_xmp_writer_t *)calloc(1, sizeof(dt_xmp_writer_t));
+  g_mutex_init(&w->lock);
+  g_cond_init(&w->cond);
+  w->dirty = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  if(dt_pthread_create(&w->thread, _xmp_writer_run, w))
+  {
+    // no thread, every queued image gets written right away then
+    fprintf(stderr, "[xmp_writer] could not start the sidecar writer thread\n");
+    g_hash_table_destroy(w->dirty);
+    g_cond_clear(&w->cond);
+    g_mutex_clear(&w->lock);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+void dt_xmp_writer_cleanup(dt_xmp_writer_t *w)
+{
+  if(!w) return;
+  g_mutex_lock(&w->lock);
+  w->quit = TRUE;
+  g_cond_broadcast(&w->cond);
+  g_mutex_unlock(&w->lock);
+  pthread_join(w->thread, NULL);
+
+  g_hash_table_destroy(w->dirty);
+  g_cond_clear(&w->cond);
+  g_mutex_clear(&w->lock);
+  free(w);
+}
+
+void dt_xmp_writer_queue(dt_xmp_writer_t *w, const int imgid)
+{
+  if(imgid <= 0) return;
+  if(!w)
+  {
+    dt_image_write_sidecar_file(imgid);
+    return;
+  }
+  if(!dt_conf_get_bool("write_sidecar_files")) return;
+
+  g_mutex_lock(&w->lock);
+  // keep the time it first got dirty, so that continuous editing still gets written every now and then
+  if(!g_hash_table_contains(w->dirty, GINT_TO_POINTER(imgid)))
+  {
+    gint64 *when = g_new(gint64, 1);
+    *when = g_get_monotonic_time();
+    g_hash_table_insert(w->dirty, GINT_TO_POINTER(imgid), when);
+    g_cond_signal(&w->cond);
+  }
+  g_mutex_unlock(&w->lock);
+}
+
+void dt_xmp_writer_flush(dt_xmp_writer_t *w, const int imgid)
+{
+  if(!w) return;
+  GList *imgs = NULL;
+  g_mutex_lock(&w->lock);
+  while(w->busy) g_cond_wait(&w->cond, &w->lock);
+  if(imgid > 0)
+  {
+    if(g_hash_table_remove(w->dirty, GINT_TO_POINTER(imgid))) imgs = g_list_prepend(imgs, GINT_TO_POINTER(imgid));
+  }
+  else
+  {
+    imgs = g_hash_table_get_keys(w->dirty);
+    g_hash_table_remove_all(w->dirty);
+  }
+  g_mutex_unlock(&w->lock);
+
+  dt_image_write_sidecar_files(imgs);
+  g_list_free(imgs);
+}
+
+void dt_xmp_writer_discard(dt_xmp_writer_t *w, const int imgid)
+{
+  if(!w) return;
+  g_mutex_lock(&w->lock);
+  while(w->busy) g_cond_wait(&w->cond, &w->lock);
+  g_hash_table_remove(w->dirty, GINT_TO_POINTER(imgid));
+  g_mutex_unlock(&w->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,55 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <pthread.h>
+
+// background writer for the xmp sidecar files. callers only mark images dirty, a dedicated thread writes
+// them once they had a moment to settle, so a burst of history changes to one image ends up as a single
+// write and neither the gui nor bulk operations wait for exiv2 and the disk.
+
+/** how long an image stays dirty before its sidecar gets written, in microseconds */
+#define DT_XMP_WRITER_DELAY (G_USEC_PER_SEC / 2)
+
+typedef struct dt_xmp_writer_t
+{
+  GMutex lock;
+  GCond cond;
+  GHashTable *dirty; // imgid -> monotonic time it first got dirty
+  gboolean busy;     // the thread is writing a batch right now
+  gboolean quit;
+  pthread_t thread;
+} dt_xmp_writer_t;
+
+dt_xmp_writer_t *dt_xmp_writer_init();
+/** writes everything still pending and stops the thread. */
+void dt_xmp_writer_cleanup(dt_xmp_writer_t *w);
+
+/** marks the sidecar of imgid for writing. without a writer it is written right away. */
+void dt_xmp_writer_queue(dt_xmp_writer_t *w, const int imgid);
+/** writes the pending sidecar of imgid (all of them for imgid <= 0) on the calling thread and waits for the
+ *  writer to be done with its current batch, for callers about to move or copy the files. */
+void dt_xmp_writer_flush(dt_xmp_writer_t *w, const int imgid);
+/** forgets about a pending write of imgid, for images being removed. */
+void dt_xmp_writer_discard(dt_xmp_writer_t *w, const int imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
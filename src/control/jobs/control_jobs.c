@@ -33,6 +33,7 @@
 #include "common/tags.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe.h"
 
 #include "gui/gtk.h"
 
@@ -503,6 +504,9 @@ end:
   free(d.pixels);
   free(d.weight);
 
+  // the pipes kept for the next image hold full size buffers, don't sit on them after the merge
+  dt_dev_pixelpipe_pool_cleanup(DT_DEV_PIXELPIPE_EXPORT);
+
   dt_control_queue_redraw_center();
   return 0;
 }
@@ -1102,6 +1106,9 @@ static int32_t dt_control_gpx_apply_job_run(dt_job_t *job)
 
   } while((t = g_list_next(t)) != NULL);
 
+  // the locations went to the image cache in write-back mode, get them into the db in one go
+  dt_image_cache_flush(darktable.image_cache);
+
   dt_control_log(ngettext("applied matched GPX location onto %d image", "applied matched GPX location onto %d images", cntr), cntr);
 
   g_time_zone_unref(tz_camera);
@@ -1288,6 +1295,9 @@ end:
   // all threads free their fdata
   mformat->free_params(mformat, fdata);
 
+  // the pipes kept for the next image hold full size buffers, don't sit on them after the batch
+  dt_dev_pixelpipe_pool_cleanup(DT_DEV_PIXELPIPE_EXPORT);
+
   // notify the user via the window manager
   dt_ui_notify_user();
 
@@ -1712,6 +1722,8 @@ static int32_t dt_control_time_offset_job_run(dt_job_t *job)
     dt_control_job_set_progress(job, fraction);
   } while((t = g_list_next(t)) != NULL);
 
+  dt_image_cache_flush(darktable.image_cache);
+
   dt_control_log(ngettext("added time offset to %d image", "added time offset to %d images", cntr), cntr);
 
   return 0;
@@ -1771,6 +1783,38 @@ void dt_control_time_offset(const long int offset, int imgid)
                      dt_control_time_offset_job_create(offset, imgid));
 }
 
+static int32_t dt_control_refresh_images_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  const gboolean aspect_ratio = darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO;
+  for(GList *t = params->index; t; t = g_list_next(t))
+  {
+    const int imgid = GPOINTER_TO_INT(t->data);
+    dt_image_synch_xmp(imgid);
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+    /* otherwise the aspect ratio gets recalculated along with the new mipmap */
+    if(aspect_ratio) dt_image_set_aspect_ratio(imgid);
+  }
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
+void dt_control_refresh_images(GList *imgs)
+{
+  if(!imgs) return;
+  dt_job_t *job = dt_control_job_create(&dt_control_refresh_images_job_run, "%s", N_("refresh images"));
+  dt_control_image_enumerator_t *params = job ? dt_control_image_enumerator_alloc() : NULL;
+  if(!params)
+  {
+    if(job) dt_control_job_dispose(job);
+    g_list_free(imgs);
+    return;
+  }
+  params->index = imgs;
+  dt_control_job_set_params(job, params, dt_control_image_enumerator_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
 void dt_control_write_sidecar_files()
 {
   dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
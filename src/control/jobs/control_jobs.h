@@ -31,6 +31,8 @@ void dt_control_gpx_apply(const gchar *filename, int32_t filmid, const gchar *tz
 void dt_control_time_offset(const long int offset, int imgid);
 
 void dt_control_write_sidecar_files();
+/** invalidates thumbnails and queues the sidecars of images whose history changed in bulk, takes the list. */
+void dt_control_refresh_images(GList *imgs);
 void dt_control_delete_images();
 void dt_control_duplicate_images();
 void dt_control_flip_images(const int32_t cw);
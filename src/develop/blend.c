@@ -417,6 +417,7 @@ static inline void _blend_noop(const _blend_buffer_desc_t *bd, const float *a, f
 
 
 /* generate blend mask */
+__DT_CLONE_TARGETS__
 static void _blend_make_mask(const _blend_buffer_desc_t *bd, const unsigned int blendif,
                              const float *blendif_parameters, const unsigned int mask_mode,
                              const unsigned int mask_combine, const float gopacity, const float *a,
@@ -435,6 +436,7 @@ static void _blend_make_mask(const _blend_buffer_desc_t *bd, const unsigned int
 }
 
 /* normal blend with clamping */
+__DT_CLONE_TARGETS__
 static void _blend_normal_bounded(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                                   int flag)
 {
@@ -491,6 +493,7 @@ static void _blend_normal_bounded(const _blend_buffer_desc_t *bd, const float *a
 }
 
 /* normal blend without any clamping */
+__DT_CLONE_TARGETS__
 static void _blend_normal_unbounded(const _blend_buffer_desc_t *bd, const float *a, float *b,
                                     const float *mask, int flag)
 {
@@ -545,6 +548,7 @@ static void _blend_normal_unbounded(const _blend_buffer_desc_t *bd, const float
 }
 
 /* lighten */
+__DT_CLONE_TARGETS__
 static void _blend_lighten(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                            int flag)
 {
@@ -605,6 +609,7 @@ static void _blend_lighten(const _blend_buffer_desc_t *bd, const float *a, float
 }
 
 /* darken */
+__DT_CLONE_TARGETS__
 static void _blend_darken(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                           int flag)
 {
@@ -666,6 +671,7 @@ static void _blend_darken(const _blend_buffer_desc_t *bd, const float *a, float
 }
 
 /* multiply */
+__DT_CLONE_TARGETS__
 static void _blend_multiply(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                             int flag)
 {
@@ -746,6 +752,7 @@ static void _blend_multiply(const _blend_buffer_desc_t *bd, const float *a, floa
 }
 
 /* average */
+__DT_CLONE_TARGETS__
 static void _blend_average(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                            int flag)
 {
@@ -807,6 +814,7 @@ static void _blend_average(const _blend_buffer_desc_t *bd, const float *a, float
 }
 
 /* add */
+__DT_CLONE_TARGETS__
 static void _blend_add(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask, int flag)
 {
   float max[4] = { 0 }, min[4] = { 0 };
@@ -870,6 +878,7 @@ static void _blend_add(const _blend_buffer_desc_t *bd, const float *a, float *b,
 }
 
 /* substract */
+__DT_CLONE_TARGETS__
 static void _blend_substract(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                              int flag)
 {
@@ -939,6 +948,7 @@ static void _blend_substract(const _blend_buffer_desc_t *bd, const float *a, flo
 }
 
 /* difference (deprecated) */
+__DT_CLONE_TARGETS__
 static void _blend_difference(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                               int flag)
 {
@@ -1023,6 +1033,7 @@ static void _blend_difference(const _blend_buffer_desc_t *bd, const float *a, fl
 }
 
 /* difference 2 (new) */
+__DT_CLONE_TARGETS__
 static void _blend_difference2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                                int flag)
 {
@@ -1100,6 +1111,7 @@ static void _blend_difference2(const _blend_buffer_desc_t *bd, const float *a, f
 }
 
 /* screen */
+__DT_CLONE_TARGETS__
 static void _blend_screen(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                           int flag)
 {
@@ -1201,6 +1213,7 @@ static void _blend_screen(const _blend_buffer_desc_t *bd, const float *a, float
 }
 
 /* overlay */
+__DT_CLONE_TARGETS__
 static void _blend_overlay(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                            int flag)
 {
@@ -1321,6 +1334,7 @@ static void _blend_overlay(const _blend_buffer_desc_t *bd, const float *a, float
 }
 
 /* softlight */
+__DT_CLONE_TARGETS__
 static void _blend_softlight(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                              int flag)
 {
@@ -1438,6 +1452,7 @@ static void _blend_softlight(const _blend_buffer_desc_t *bd, const float *a, flo
 }
 
 /* hardlight */
+__DT_CLONE_TARGETS__
 static void _blend_hardlight(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                              int flag)
 {
@@ -1558,6 +1573,7 @@ static void _blend_hardlight(const _blend_buffer_desc_t *bd, const float *a, flo
 }
 
 /* vividlight */
+__DT_CLONE_TARGETS__
 static void _blend_vividlight(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                               int flag)
 {
@@ -1677,6 +1693,7 @@ static void _blend_vividlight(const _blend_buffer_desc_t *bd, const float *a, fl
 }
 
 /* linearlight */
+__DT_CLONE_TARGETS__
 static void _blend_linearlight(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                                int flag)
 {
@@ -1784,6 +1801,7 @@ static void _blend_linearlight(const _blend_buffer_desc_t *bd, const float *a, f
 }
 
 /* pinlight */
+__DT_CLONE_TARGETS__
 static void _blend_pinlight(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                             int flag)
 {
@@ -1879,6 +1897,7 @@ static void _blend_pinlight(const _blend_buffer_desc_t *bd, const float *a, floa
 }
 
 /* lightness blend */
+__DT_CLONE_TARGETS__
 static void _blend_lightness(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                              int flag)
 {
@@ -1933,6 +1952,7 @@ static void _blend_lightness(const _blend_buffer_desc_t *bd, const float *a, flo
 }
 
 /* chroma blend */
+__DT_CLONE_TARGETS__
 static void _blend_chroma(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                           int flag)
 {
@@ -1994,6 +2014,7 @@ static void _blend_chroma(const _blend_buffer_desc_t *bd, const float *a, float
 }
 
 /* hue blend */
+__DT_CLONE_TARGETS__
 static void _blend_hue(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask, int flag)
 {
   float max[4] = { 0 }, min[4] = { 0 };
@@ -2060,6 +2081,7 @@ static void _blend_hue(const _blend_buffer_desc_t *bd, const float *a, float *b,
 }
 
 /* color blend; blend hue and chroma, but not lightness */
+__DT_CLONE_TARGETS__
 static void _blend_color(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask, int flag)
 {
   float max[4] = { 0 }, min[4] = { 0 };
@@ -2129,6 +2151,7 @@ static void _blend_color(const _blend_buffer_desc_t *bd, const float *a, float *
 }
 
 /* color adjustment; blend hue and chroma; take lightness from module output */
+__DT_CLONE_TARGETS__
 static void _blend_coloradjust(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                                int flag)
 {
@@ -2198,6 +2221,7 @@ static void _blend_coloradjust(const _blend_buffer_desc_t *bd, const float *a, f
 }
 
 /* inverse blend */
+__DT_CLONE_TARGETS__
 static void _blend_inverse(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                            int flag)
 {
@@ -2255,6 +2279,7 @@ static void _blend_inverse(const _blend_buffer_desc_t *bd, const float *a, float
 
 /* blend only lightness in Lab color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_Lab_lightness(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                                  int flag)
 {
@@ -2281,6 +2306,7 @@ static void _blend_Lab_lightness(const _blend_buffer_desc_t *bd, const float *a,
 
 /* blend only a-channel in Lab color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_Lab_a(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                          int flag)
 {
@@ -2307,6 +2333,7 @@ static void _blend_Lab_a(const _blend_buffer_desc_t *bd, const float *a, float *
 
 /* blend only b-channel in Lab color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_Lab_b(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                          int flag)
 {
@@ -2334,6 +2361,7 @@ static void _blend_Lab_b(const _blend_buffer_desc_t *bd, const float *a, float *
 
 /* blend only color in Lab color space without any clamping (a noop for other
  * color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_Lab_color(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                              int flag)
 {
@@ -2366,6 +2394,7 @@ static void _blend_Lab_color(const _blend_buffer_desc_t *bd, const float *a, flo
 
 /* blend only lightness in HSV color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_HSV_lightness(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                                  int flag)
 {
@@ -2395,6 +2424,7 @@ static void _blend_HSV_lightness(const _blend_buffer_desc_t *bd, const float *a,
 
 /* blend only color in HSV color space without any clamping (a noop for other
  * color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_HSV_color(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                              int flag)
 {
@@ -2434,6 +2464,7 @@ static void _blend_HSV_color(const _blend_buffer_desc_t *bd, const float *a, flo
 
 /* blend only R-channel in RGB color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_RGB_R(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                          int flag)
 {
@@ -2456,6 +2487,7 @@ static void _blend_RGB_R(const _blend_buffer_desc_t *bd, const float *a, float *
 
 /* blend only R-channel in RGB color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_RGB_G(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                          int flag)
 {
@@ -2477,6 +2509,7 @@ static void _blend_RGB_G(const _blend_buffer_desc_t *bd, const float *a, float *
 
 /* blend only R-channel in RGB color space without any clamping (a noop for
  * other color spaces) */
+__DT_CLONE_TARGETS__
 static void _blend_RGB_B(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                          int flag)
 {
@@ -2822,6 +2855,98 @@ _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
 }
 
 
+typedef struct dt_develop_blend_mask_job_t
+{
+  pthread_t thread;
+  dt_iop_module_t *module;
+  dt_dev_pixelpipe_iop_t *piece;
+  dt_masks_form_t *form;
+  dt_iop_roi_t roi;
+  float *mask;
+} dt_develop_blend_mask_job_t;
+
+static void *_blend_mask_job_run(void *arg)
+{
+  dt_develop_blend_mask_job_t *job = (dt_develop_blend_mask_job_t *)arg;
+  dt_masks_group_render_roi(job->module, job->piece, job->form, &job->roi, job->mask);
+  return NULL;
+}
+
+void dt_develop_blend_mask_prefetch(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                    const struct dt_iop_roi_t *const roi_in,
+                                    const struct dt_iop_roi_t *const roi_out)
+{
+  dt_develop_blend_mask_discard(piece);
+
+  if(self->bypass_blendif && self->dev->gui_attached && (self == self->dev->gui_module)) return;
+
+  const dt_develop_blend_params_t *const d = (const dt_develop_blend_params_t *const)piece->blendop_data;
+  if(!d) return;
+
+  const unsigned int mask_mode = d->mask_mode;
+  if(!(mask_mode & DEVELOP_MASK_ENABLED) || !(mask_mode & DEVELOP_MASK_MASK)) return;
+  if(self->flags() & IOP_FLAGS_NO_MASKS) return;
+  if(roi_in->scale != roi_out->scale) return;
+
+  // the mask is distorted by all modules up to and including this one, so a distorting
+  // module has to have finished its own work before its mask can be rendered.
+  if(self->operation_tags() & IOP_TAG_DISTORT) return;
+
+  const _Bool suppress_mask = self->suppress_mask && self->dev->gui_attached && (self == self->dev->gui_module)
+                              && (piece->pipe == self->dev->pipe) && (mask_mode & DEVELOP_MASK_BOTH);
+  if(suppress_mask) return;
+
+  dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, d->mask_id);
+  if(!form) return;
+
+  dt_develop_blend_mask_job_t *job = calloc(1, sizeof(dt_develop_blend_mask_job_t));
+  if(!job) return;
+  job->module = self;
+  job->piece = piece;
+  job->form = form;
+  job->roi = *roi_out;
+  job->mask = dt_dev_pixelpipe_scratch_alloc(piece->pipe, (size_t)roi_out->width * roi_out->height * sizeof(float));
+  if(!job->mask || dt_pthread_create(&job->thread, _blend_mask_job_run, job))
+  {
+    // no harm done, blending renders the mask itself
+    dt_dev_pixelpipe_scratch_free(piece->pipe, job->mask);
+    free(job);
+    return;
+  }
+
+  piece->mask_job = job;
+}
+
+void dt_develop_blend_mask_discard(struct dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_develop_blend_mask_job_t *job = piece->mask_job;
+  if(!job) return;
+  piece->mask_job = NULL;
+  pthread_join(job->thread, NULL);
+  dt_dev_pixelpipe_scratch_free(piece->pipe, job->mask);
+  free(job);
+}
+
+// hand over the mask rendered by dt_develop_blend_mask_prefetch(), if it matches roi_out.
+// the caller owns the returned buffer and releases it to the pipe's scratch pool.
+static float *_blend_mask_take(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi_out)
+{
+  dt_develop_blend_mask_job_t *job = piece->mask_job;
+  if(!job) return NULL;
+  piece->mask_job = NULL;
+  pthread_join(job->thread, NULL);
+
+  float *mask = job->mask;
+  if(job->roi.x != roi_out->x || job->roi.y != roi_out->y || job->roi.width != roi_out->width
+     || job->roi.height != roi_out->height || job->roi.scale != roi_out->scale)
+  {
+    dt_dev_pixelpipe_scratch_free(piece->pipe, mask);
+    mask = NULL;
+  }
+  free(job);
+  return mask;
+}
+
 void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out)
@@ -2887,8 +3012,11 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
   // get the clipped opacity value  0 - 1
   const float opacity = fminf(fmaxf(0.0f, (d->opacity / 100.0f)), 1.0f);
 
+  // the drawn mask may already have been rendered while the module was processing
+  float *const prefetched = _blend_mask_take(piece, roi_out);
+
   // allocate space for blend mask
-  float *_mask = dt_alloc_align(64, buffsize * sizeof(float));
+  float *_mask = prefetched ? prefetched : dt_dev_pixelpipe_scratch_alloc(piece->pipe, buffsize * sizeof(float));
   if(!_mask)
   {
     dt_control_log(_("could not allocate buffer for blending"));
@@ -2914,7 +3042,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+      if(!prefetched) dt_masks_group_render_roi(self, piece, form, roi_out, mask);
 
       if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
       {
@@ -2978,12 +3106,13 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
         default:
           assert(0);
       }
-      float *mask_bak = dt_alloc_align(64, sizeof(*mask_bak) * buffsize);
+      float *mask_bak = dt_dev_pixelpipe_scratch_alloc(piece->pipe, sizeof(*mask_bak) * buffsize);
       memcpy(mask_bak, mask, sizeof(*mask_bak) * buffsize);
       float *guide = d->feathering_guide == DEVELOP_MASK_GUIDE_IN ? (float *)ivoid : (float *)ovoid;
       if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN)
       {
-        float *const guide_tmp = dt_alloc_align(64, sizeof(*guide_tmp) * buffsize * ch);
+        float *const guide_tmp
+            = dt_dev_pixelpipe_scratch_alloc(piece->pipe, sizeof(*guide_tmp) * buffsize * ch);
 #ifdef _OPENMP
 #pragma omp parallel for default(none)
 #endif
@@ -2995,9 +3124,10 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
         }
         guide = guide_tmp;
       }
-      guided_filter(guide, mask_bak, mask, owidth, oheight, ch, w, sqrt_eps, guide_weight, 0.f, 1.f);
-      if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN) dt_free_align(guide);
-      dt_free_align(mask_bak);
+      guided_filter(piece->pipe, guide, mask_bak, mask, owidth, oheight, ch, w, sqrt_eps, guide_weight, 0.f, 1.f);
+      if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN)
+        dt_dev_pixelpipe_scratch_free(piece->pipe, guide);
+      dt_dev_pixelpipe_scratch_free(piece->pipe, mask_bak);
     }
     if(mask_blur)
     {
@@ -3005,7 +3135,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
       const float mmax[] = { 1.0f };
       const float mmin[] = { 0.0f };
 
-      dt_gaussian_t *g = dt_gaussian_init(owidth, oheight, 1, mmax, mmin, sigma, 0);
+      dt_gaussian_t *g = dt_gaussian_init(piece->pipe, owidth, oheight, 1, mmax, mmin, sigma, 0);
       if(g)
       {
         dt_gaussian_blur(g, mask, mask);
@@ -3073,7 +3203,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
     piece->pipe->mask_display = request_mask_display;
   }
 
-  dt_free_align(_mask);
+  dt_dev_pixelpipe_scratch_free(piece->pipe, _mask);
 }
 
 #ifdef HAVE_OPENCL
@@ -3143,8 +3273,12 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
   // get the clipped opacity value  0 - 1
   const float opacity = fminf(fmaxf(0.0f, (d->opacity / 100.0f)), 1.0f);
 
+  // the drawn mask may already have been rendered while the module was processing
+  float *const prefetched = _blend_mask_take(piece, roi_out);
+
   // allocate space for blend mask
-  float *_mask = dt_alloc_align(64, (size_t)owidth * oheight * sizeof(float));
+  float *_mask = prefetched ? prefetched
+                            : dt_dev_pixelpipe_scratch_alloc(piece->pipe, (size_t)owidth * oheight * sizeof(float));
   if(!_mask)
   {
     dt_control_log(_("could not allocate buffer for blending"));
@@ -3218,7 +3352,7 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
 
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+      if(!prefetched) dt_masks_group_render_roi(self, piece, form, roi_out, mask);
 
       if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
       {
@@ -3310,8 +3444,8 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
         err = dt_opencl_enqueue_copy_image(devid, dev_in, guide, origin_2, origin_1, region);
         if(err != CL_SUCCESS) goto error;
       }
-      guided_filter_cl(devid, guide, dev_mask_2, dev_mask_1, owidth, oheight, ch, w, sqrt_eps, guide_weight, 0.f,
-                       1.f);
+      guided_filter_cl(piece->pipe, devid, guide, dev_mask_2, dev_mask_1, owidth, oheight, ch, w, sqrt_eps,
+                       guide_weight, 0.f, 1.f);
       if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN) dt_opencl_release_mem_object(guide);
     }
     else
@@ -3411,14 +3545,14 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
     piece->pipe->mask_display = request_mask_display;
   }
 
-  dt_free_align(_mask);
+  dt_dev_pixelpipe_scratch_free(piece->pipe, _mask);
   dt_opencl_release_mem_object(dev_m);
   dt_opencl_release_mem_object(dev_mask_1);
   dt_opencl_release_mem_object(dev_tmp);
   return TRUE;
 
 error:
-  dt_free_align(_mask);
+  dt_dev_pixelpipe_scratch_free(piece->pipe, _mask);
   dt_opencl_release_mem_object(dev_m);
   dt_opencl_release_mem_object(dev_mask_1);
   dt_opencl_release_mem_object(dev_mask_2);
@@ -407,6 +407,13 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
                               const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out);
 
+/** start rendering the drawn mask of a piece in the background, so that it is ready when blending */
+void dt_develop_blend_mask_prefetch(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                    const struct dt_iop_roi_t *const roi_in,
+                                    const struct dt_iop_roi_t *const roi_out);
+/** wait for and drop a drawn mask started by dt_develop_blend_mask_prefetch() which was not consumed */
+void dt_develop_blend_mask_discard(struct dt_dev_pixelpipe_iop_t *piece);
+
 /** get blend version */
 int dt_develop_blend_version(void);
 
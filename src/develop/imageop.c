@@ -314,6 +314,7 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
     module->process_cl = NULL;
   if(!g_module_symbol(module->module, "process_tiling_cl", (gpointer) & (module->process_tiling_cl)))
     module->process_tiling_cl = darktable.opencl->inited ? default_process_tiling_cl : NULL;
+  if(!g_module_symbol(module->module, "rawstage", (gpointer) & (module->rawstage))) module->rawstage = NULL;
   if(!g_module_symbol(module->module, "distort_transform", (gpointer) & (module->distort_transform)))
     module->distort_transform = default_distort_transform;
   if(!g_module_symbol(module->module, "distort_backtransform", (gpointer) & (module->distort_backtransform)))
@@ -431,6 +432,7 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->process_sse2 = so->process_sse2;
   module->process_cl = so->process_cl;
   module->process_tiling_cl = so->process_tiling_cl;
+  module->rawstage = so->rawstage;
   module->distort_transform = so->distort_transform;
   module->distort_backtransform = so->distort_backtransform;
   module->modify_roi_in = so->modify_roi_in;
@@ -1543,6 +1545,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
     // register if module allows tiling, commit_params can overwrite this.
     if(module->flags() & IOP_FLAGS_ALLOW_TILING) piece->process_tiling_ready = 1;
 
+    // modules have to opt in to the fused raw stage for their current parameters.
+    piece->rawstage_ready = 0;
+
     module->commit_params(module, params, pipe, piece);
     for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
     piece->hash = hash;
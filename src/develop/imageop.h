@@ -44,6 +44,7 @@ struct dt_dev_pixelpipe_t;
 struct dt_dev_pixelpipe_iop_t;
 struct dt_develop_blend_params_t;
 struct dt_develop_tiling_t;
+struct dt_dev_pixelpipe_rawstage_t;
 
 /** module group */
 typedef enum dt_iop_group_t
@@ -91,7 +92,9 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_PREVIEW_NON_OPENCL
   = 1 << 8, // Preview pixelpipe of this module must not run on GPU but always on CPU
   IOP_FLAGS_NO_HISTORY_STACK = 1 << 9, // This iop will never show up in the history stack
-  IOP_FLAGS_NO_MASKS = 1 << 10         // The module doesn't support masks (used with SUPPORT_BLENDING)
+  IOP_FLAGS_NO_MASKS = 1 << 10,        // The module doesn't support masks (used with SUPPORT_BLENDING)
+  IOP_FLAGS_CACHE_FP16 = 1 << 11,      // Output may be kept in half precision by the pixelpipe cache
+  IOP_FLAGS_SKIP_IN_THUMBNAILS = 1 << 12 // No visible effect on strongly downscaled thumbnails, they may skip it
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -227,6 +230,9 @@ typedef struct dt_iop_module_so_t
   int (*process_tiling_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                            const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                            const struct dt_iop_roi_t *const roi_out, const int bpp);
+  void (*rawstage)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                   struct dt_dev_pixelpipe_rawstage_t *stage, const struct dt_iop_roi_t *const roi_in,
+                   const struct dt_iop_roi_t *const roi_out);
 
   int (*distort_transform)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, float *points,
                            size_t points_count);
@@ -435,6 +441,10 @@ typedef struct dt_iop_module_t
   int (*process_tiling_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                            const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                            const struct dt_iop_roi_t *const roi_out, const int bpp);
+  /** describes the module's step of the fused pass over the raw data, see develop/pixelpipe_rawstage.h. */
+  void (*rawstage)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                   struct dt_dev_pixelpipe_rawstage_t *stage, const struct dt_iop_roi_t *const roi_in,
+                   const struct dt_iop_roi_t *const roi_out);
 
   /** this functions are used for distort iop
    * points is an array of float {x1,y1,x2,y2,...}
@@ -1574,15 +1574,31 @@ void dt_iop_clip_and_zoom_demosaic_half_size_f_sse2(float *out, const float *con
         col = _mm_add_ps(col, _mm_mul_ps(_mm_set1_ps(1 - dy), _mm_set_ps(0.0f, p4, p2, p1)));
       }
 
-      // 2x2 blocks in the middle of sampling region
+      // 2x2 blocks in the middle of sampling region, two of them per load: the upper row of a pair
+      // is r g r g, the lower one g b g b, and they only get sorted into r g b once at the end.
+      __m128 upper = _mm_setzero_ps(), lower = _mm_setzero_ps();
       for(int j = py + 2; j <= maxj; j += 2)
-        for(int i = px + 2; i <= maxi; i += 2)
+      {
+        const float *const row0 = in + (size_t)in_stride * j;
+        const float *const row1 = row0 + in_stride;
+        int i = px + 2;
+        for(; i + 2 <= maxi; i += 4)
         {
-          p1 = in[i + in_stride * j];
-          p2 = in[i + 1 + in_stride * j] + in[i + in_stride * (j + 1)];
-          p4 = in[i + 1 + in_stride * (j + 1)];
-          col = _mm_add_ps(col, _mm_set_ps(0.0f, p4, p2, p1));
+          upper = _mm_add_ps(upper, _mm_loadu_ps(row0 + i));
+          lower = _mm_add_ps(lower, _mm_loadu_ps(row1 + i));
         }
+        for(; i <= maxi; i += 2)
+        {
+          upper = _mm_add_ps(upper, _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(row0 + i)));
+          lower = _mm_add_ps(lower, _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(row1 + i)));
+        }
+      }
+      {
+        float u[4], l[4];
+        _mm_storeu_ps(u, _mm_add_ps(upper, _mm_movehl_ps(upper, upper)));
+        _mm_storeu_ps(l, _mm_add_ps(lower, _mm_movehl_ps(lower, lower)));
+        col = _mm_add_ps(col, _mm_set_ps(0.0f, l[1], u[1] + l[0], u[0]));
+      }
 
       if(maxi == px + 2 * samples && maxj == py + 2 * samples)
       {
@@ -1694,11 +1710,19 @@ void dt_iop_clip_and_zoom_demosaic_half_size_f(float *out, const float *const in
     dt_unreachable_codepath();
 }
 
-void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *const in,
-                                                       const dt_iop_roi_t *const roi_out,
-                                                       const dt_iop_roi_t *const roi_in,
-                                                       const int32_t out_stride, const int32_t in_stride,
-                                                       const uint8_t (*const xtrans)[6])
+// the channel of every pixel in a 3x3 cell starting at any phase of the 6x6 x-trans pattern of roi_in, so the
+// inner loops need neither FCxtrans() nor its modulos: cfa[(row % 6) + j][(col % 6) + i] for 0 <= i, j < 3.
+static void _xtrans_cell_channels(int cfa[8][8], const dt_iop_roi_t *const roi_in, const uint8_t (*const xtrans)[6])
+{
+  for(int j = 0; j < 8; j++)
+    for(int i = 0; i < 8; i++) cfa[j][i] = FCxtrans(j, i, roi_in, xtrans);
+}
+
+void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_plain(float *out, const float *const in,
+                                                             const dt_iop_roi_t *const roi_out,
+                                                             const dt_iop_roi_t *const roi_in,
+                                                             const int32_t out_stride, const int32_t in_stride,
+                                                             const uint8_t (*const xtrans)[6])
 {
   const float px_footprint = 1.f / roi_out->scale;
   const int samples = MAX(1, (int)floorf(px_footprint / 3));
@@ -1711,8 +1735,11 @@ void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *
   // fractional pixel offset of top/left of pattern nor oversampling
   // by non-integer number of samples.
 
+  int cfa[8][8];
+  _xtrans_cell_channels(cfa, roi_in, xtrans);
+
 #ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out) schedule(static)
+#pragma omp parallel for default(none) shared(out, cfa) schedule(static)
 #endif
   for(int y = 0; y < roi_out->height; y++)
   {
@@ -1726,12 +1753,15 @@ void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *
       int num = 0;
       const int px = CLAMPS((int)round((x + roi_out->x - 0.5f) * px_footprint), 0, roi_in->width - 3);
       const int xmax = MIN(roi_in->width - 3, px + 3 * samples);
-      for(int yy = py; yy <= ymax; yy += 3)
-        for(int xx = px; xx <= xmax; xx += 3)
+      // cells advance by 3, which just flips between the two halves of the pattern
+      for(int yy = py, cy = py % 6; yy <= ymax; yy += 3, cy = cy < 3 ? cy + 3 : cy - 3)
+        for(int xx = px, cx = px % 6; xx <= xmax; xx += 3, cx = cx < 3 ? cx + 3 : cx - 3)
         {
           for(int j = 0; j < 3; ++j)
-            for(int i = 0; i < 3; ++i)
-              col[FCxtrans(yy + j, xx + i, roi_in, xtrans)] += in[xx + i + in_stride * (yy + j)];
+          {
+            const float *const row = in + (size_t)in_stride * (yy + j) + xx;
+            for(int i = 0; i < 3; ++i) col[cfa[cy + j][cx + i]] += row[i];
+          }
           num++;
         }
 
@@ -1743,6 +1773,84 @@ void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *
   }
 }
 
+#if defined(__SSE__)
+void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_sse2(float *out, const float *const in,
+                                                            const dt_iop_roi_t *const roi_out,
+                                                            const dt_iop_roi_t *const roi_in,
+                                                            const int32_t out_stride, const int32_t in_stride,
+                                                            const uint8_t (*const xtrans)[6])
+{
+  const float px_footprint = 1.f / roi_out->scale;
+  const int samples = MAX(1, (int)floorf(px_footprint / 3));
+
+  // same sampling as the plain version. every pixel goes into all three channels at once with a weight that
+  // is zero for the channels it doesn't have and carries the 2:5:2 normalisation of a cell for the one it has.
+  int cfa[8][8];
+  _xtrans_cell_channels(cfa, roi_in, xtrans);
+  const float norm[3] = { 1.0f / 2.0f, 1.0f / 5.0f, 1.0f / 2.0f };
+  __m128 weight[8][8];
+  for(int j = 0; j < 8; j++)
+    for(int i = 0; i < 8; i++)
+    {
+      float w[4] = { 0.0f };
+      w[cfa[j][i]] = norm[cfa[j][i]];
+      weight[j][i] = _mm_loadu_ps(w);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(out, weight) schedule(static)
+#endif
+  for(int y = 0; y < roi_out->height; y++)
+  {
+    float *outc = out + 4 * (out_stride * y);
+    const int py = CLAMPS((int)round((y + roi_out->y - 0.5f) * px_footprint), 0, roi_in->height - 3);
+    const int ymax = MIN(roi_in->height - 3, py + 3 * samples);
+
+    for(int x = 0; x < roi_out->width; x++, outc += 4)
+    {
+      __m128 col = _mm_setzero_ps();
+      int num = 0;
+      const int px = CLAMPS((int)round((x + roi_out->x - 0.5f) * px_footprint), 0, roi_in->width - 3);
+      const int xmax = MIN(roi_in->width - 3, px + 3 * samples);
+      for(int yy = py, cy = py % 6; yy <= ymax; yy += 3, cy = cy < 3 ? cy + 3 : cy - 3)
+        for(int xx = px, cx = px % 6; xx <= xmax; xx += 3, cx = cx < 3 ? cx + 3 : cx - 3)
+        {
+          for(int j = 0; j < 3; ++j)
+          {
+            const float *const row = in + (size_t)in_stride * (yy + j) + xx;
+            const __m128 *const w = weight[cy + j] + cx;
+            col = _mm_add_ps(col, _mm_mul_ps(_mm_set1_ps(row[0]), w[0]));
+            col = _mm_add_ps(col, _mm_mul_ps(_mm_set1_ps(row[1]), w[1]));
+            col = _mm_add_ps(col, _mm_mul_ps(_mm_set1_ps(row[2]), w[2]));
+          }
+          num++;
+        }
+
+      _mm_stream_ps(outc, _mm_mul_ps(col, _mm_set1_ps(1.0f / num)));
+    }
+  }
+  _mm_sfence();
+}
+#endif
+
+void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *const in,
+                                                       const dt_iop_roi_t *const roi_out,
+                                                       const dt_iop_roi_t *const roi_in,
+                                                       const int32_t out_stride, const int32_t in_stride,
+                                                       const uint8_t (*const xtrans)[6])
+{
+  if(darktable.codepath.OPENMP_SIMD)
+    return dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_plain(out, in, roi_out, roi_in, out_stride, in_stride,
+                                                                   xtrans);
+#if defined(__SSE__)
+  else if(darktable.codepath.SSE2)
+    return dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_sse2(out, in, roi_out, roi_in, out_stride, in_stride,
+                                                                  xtrans);
+#endif
+  else
+    dt_unreachable_codepath();
+}
+
 void dt_iop_RGB_to_YCbCr(const float *rgb, float *yuv)
 {
   yuv[0] = 0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2];
@@ -26,6 +26,7 @@
 #endif
 
 #include "common/image.h"    // for dt_image_t, dt_image_orientation_t
+#include "common/lut.h"      // for dt_lut_eval_exp
 #include "develop/imageop.h" // for dt_iop_roi_t
 #include <glib.h>            // for inline
 #include <math.h>            // for log, logf, powf
@@ -151,7 +152,7 @@ static inline void dt_iop_estimate_exp(const float *const x, const float *const
 /** evaluates the exp fit. */
 static inline float dt_iop_eval_exp(const float *const coeff, const float x)
 {
-  return coeff[1] * powf(x * coeff[0], coeff[2]);
+  return dt_lut_eval_exp(coeff, x);
 }
 
 /** Copy alpha channel 1:1 from input to output */
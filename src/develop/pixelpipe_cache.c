@@ -21,6 +21,9 @@
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include <stdlib.h>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -32,8 +35,101 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
+// scalar conversions, round to nearest even. see fabian giesen's public domain half <-> float code.
+static inline uint16_t _float_to_half(const float f)
+{
+  union { float f; uint32_t i; } u = { .f = f };
+  const uint32_t sign = u.i & 0x80000000u;
+  uint32_t x = u.i ^ sign;
+  uint16_t o;
+
+  if(x >= 0x47800000u)
+    o = (x > 0x7f800000u) ? 0x7e00 : 0x7c00; // nan or too large -> inf
+  else if(x < 0x38800000u)
+  {
+    // denormal or zero: let the fpu do the rounding for us
+    const union { uint32_t i; float f; } magic = { .i = 126u << 23 };
+    union { float f; uint32_t i; } d = { .i = x };
+    d.f += magic.f;
+    o = d.i - magic.i;
+  }
+  else
+  {
+    const uint32_t mant_odd = (x >> 13) & 1;
+    x += ((uint32_t)(15 - 127) << 23) + 0xfff;
+    x += mant_odd;
+    o = x >> 13;
+  }
+  return (sign >> 16) | o;
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const uint32_t shifted_exp = 0x7c00u << 13;
+  union { uint32_t i; float f; } o = { .i = (uint32_t)(h & 0x7fff) << 13 };
+  const uint32_t exp = shifted_exp & o.i;
+
+  o.i += (uint32_t)(127 - 15) << 23;
+  if(exp == shifted_exp)
+    o.i += (uint32_t)(128 - 16) << 23; // inf or nan
+  else if(exp == 0)
+  {
+    // zero or denormal: renormalize
+    const union { uint32_t i; float f; } magic = { .i = 113u << 23 };
+    o.i += 1u << 23;
+    o.f -= magic.f;
+  }
+  o.i |= (uint32_t)(h & 0x8000) << 16;
+  return o.f;
+}
+
+// not static, so src/tests/fp16_cache.c can measure them. not in the header either, the cache does the parking.
+void dt_dev_pixelpipe_cache_to_half(const float *const in, uint16_t *const out, const size_t n)
+{
+#if defined(__F16C__)
+  const size_t n4 = n & ~(size_t)3;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t k = 0; k < n4; k += 4)
+    _mm_storel_epi64((__m128i *)(out + k), _mm_cvtps_ph(_mm_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT));
+  for(size_t k = n4; k < n; k++) out[k] = _float_to_half(in[k]);
+#else
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t k = 0; k < n; k++) out[k] = _float_to_half(in[k]);
+#endif
+}
+
+void dt_dev_pixelpipe_cache_from_half(const uint16_t *const in, float *const out, const size_t n)
+{
+#if defined(__F16C__)
+  const size_t n4 = n & ~(size_t)3;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t k = 0; k < n4; k += 4)
+    _mm_storeu_ps(out + k, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(in + k))));
+  for(size_t k = n4; k < n; k++) out[k] = _half_to_float(in[k]);
+#else
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t k = 0; k < n; k++) out[k] = _half_to_float(in[k]);
+#endif
+}
+
 int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
 {
+  cache->fp16_entries = 0;
+  cache->fp16_data = NULL;
+  cache->fp16_size = cache->fp16_count = NULL;
+  cache->fp16_dsc = NULL;
+  cache->fp16_hash = NULL;
+  cache->fp16_used = NULL;
+  cache->fp16_hits = 0;
+  cache->fp16_bytes = (size_t *)calloc(entries, sizeof(size_t));
   cache->entries = entries;
   cache->data = (void **)calloc(entries, sizeof(void *));
   cache->size = (size_t *)calloc(entries, sizeof(size_t));
@@ -75,6 +171,91 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->fp16_bytes);
+  for(int k = 0; k < cache->fp16_entries; k++) dt_free_align(cache->fp16_data[k]);
+  free(cache->fp16_data);
+  free(cache->fp16_size);
+  free(cache->fp16_count);
+  free(cache->fp16_dsc);
+  free(cache->fp16_hash);
+  free(cache->fp16_used);
+  cache->fp16_entries = 0;
+}
+
+int dt_dev_pixelpipe_cache_init_fp16(dt_dev_pixelpipe_cache_t *cache, int entries)
+{
+  cache->fp16_data = (uint16_t **)calloc(entries, sizeof(uint16_t *));
+  cache->fp16_size = (size_t *)calloc(entries, sizeof(size_t));
+  cache->fp16_count = (size_t *)calloc(entries, sizeof(size_t));
+  cache->fp16_dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
+  cache->fp16_hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
+  cache->fp16_used = (int32_t *)calloc(entries, sizeof(int32_t));
+  if(!cache->fp16_data || !cache->fp16_size || !cache->fp16_count || !cache->fp16_dsc || !cache->fp16_hash
+     || !cache->fp16_used)
+  {
+    free(cache->fp16_data);
+    free(cache->fp16_size);
+    free(cache->fp16_count);
+    free(cache->fp16_dsc);
+    free(cache->fp16_hash);
+    free(cache->fp16_used);
+    cache->fp16_data = NULL;
+    cache->fp16_size = cache->fp16_count = NULL;
+    cache->fp16_dsc = NULL;
+    cache->fp16_hash = NULL;
+    cache->fp16_used = NULL;
+    return 0;
+  }
+  // buffers are allocated on demand
+  for(int k = 0; k < entries; k++) cache->fp16_hash[k] = -1;
+  cache->fp16_entries = entries;
+  return 1;
+}
+
+static int _fp16_find(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  for(int k = 0; k < cache->fp16_entries; k++)
+    if(cache->fp16_hash[k] == hash) return k;
+  return -1;
+}
+
+// keep cache line k in half precision before it gets overwritten. slot `keep' is not touched.
+static void _fp16_park(dt_dev_pixelpipe_cache_t *cache, const int k, const int keep)
+{
+  if(!cache->fp16_entries || !cache->fp16_bytes[k] || cache->hash[k] == (uint64_t)-1) return;
+  if(cache->dsc[k].datatype != TYPE_FLOAT) return;
+
+  int slot = -1, max_used = -1;
+  for(int j = 0; j < cache->fp16_entries; j++)
+  {
+    if(j == keep) continue;
+    cache->fp16_used[j]++;
+    if(cache->fp16_used[j] > max_used)
+    {
+      max_used = cache->fp16_used[j];
+      slot = j;
+    }
+  }
+  if(slot < 0) return;
+
+  const size_t n = cache->fp16_bytes[k] / sizeof(float);
+  if(cache->fp16_size[slot] < n)
+  {
+    dt_free_align(cache->fp16_data[slot]);
+    cache->fp16_data[slot] = (uint16_t *)dt_alloc_align(64, n * sizeof(uint16_t));
+    cache->fp16_size[slot] = cache->fp16_data[slot] ? n : 0;
+    if(!cache->fp16_data[slot])
+    {
+      cache->fp16_hash[slot] = -1;
+      return;
+    }
+  }
+
+  dt_dev_pixelpipe_cache_to_half((const float *)cache->data[k], cache->fp16_data[slot], n);
+  cache->fp16_count[slot] = n;
+  cache->fp16_dsc[slot] = cache->dsc[k];
+  cache->fp16_hash[slot] = cache->hash[k];
+  cache->fp16_used[slot] = 0;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -117,7 +298,7 @@ int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint
   // search for hash in cache
   for(int32_t k = 0; k < cache->entries; k++)
     if(cache->hash[k] == hash) return 1;
-  return 0;
+  return _fp16_find(cache, hash) >= 0;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -164,9 +345,15 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
 
   if(!*data || sz < size)
   {
-    // kill LRU entry
+    // maybe we still have it in half precision
+    const int fp16 = _fp16_find(cache, hash);
+    const int restore = fp16 >= 0 && cache->fp16_count[fp16] * sizeof(float) >= size;
+
+    // kill LRU entry, keep it around in half precision if allowed
     // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
     // weight);
+    _fp16_park(cache, max, restore ? fp16 : -1);
+    cache->fp16_bytes[max] = 0;
     if(cache->size[max] < size)
     {
       dt_free_align(cache->data[max]);
@@ -179,12 +366,28 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     ASAN_POISON_MEMORY_REGION(*data, sz);
     ASAN_UNPOISON_MEMORY_REGION(*data, size);
 
+    cache->hash[max] = hash;
+    cache->used[max] = weight;
+
+    // a half precision copy which can't be restored is useless, don't report it as available again
+    if(fp16 >= 0 && !(restore && *data) && cache->fp16_hash[fp16] == hash) cache->fp16_hash[fp16] = -1;
+
+    if(restore && *data)
+    {
+      dt_dev_pixelpipe_cache_from_half(cache->fp16_data[fp16], (float *)*data, size / sizeof(float));
+      cache->dsc[max] = cache->fp16_dsc[fp16];
+      *dsc = &cache->dsc[max];
+      cache->fp16_hash[fp16] = -1;
+      // it's lossy already, so it may go back to half precision later on
+      cache->fp16_bytes[max] = size;
+      cache->fp16_hits++;
+      return 0;
+    }
+
     // first, update our copy, then update the pointer to point at our copy
     cache->dsc[max] = **dsc;
     *dsc = &cache->dsc[max];
 
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
     cache->misses++;
     return 1;
   }
@@ -198,8 +401,14 @@ void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
   {
     cache->hash[k] = -1;
     cache->used[k] = 0;
+    cache->fp16_bytes[k] = 0;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  for(int k = 0; k < cache->fp16_entries; k++)
+  {
+    cache->fp16_hash[k] = -1;
+    cache->fp16_used[k] = 0;
+  }
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
@@ -220,11 +429,19 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
     if(cache->data[k] == data)
     {
       cache->hash[k] = -1;
+      cache->fp16_bytes[k] = 0;
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
   }
 }
 
+void dt_dev_pixelpipe_cache_allow_fp16(dt_dev_pixelpipe_cache_t *cache, void *data, const size_t size)
+{
+  if(!cache->fp16_entries) return;
+  for(int k = 0; k < cache->entries; k++)
+    if(cache->data[k] == data && cache->size[k] >= size) cache->fp16_bytes[k] = size;
+}
+
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++)
@@ -233,7 +450,11 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
     printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
     printf("\n");
   }
+  for(int k = 0; k < cache->fp16_entries; k++)
+    printf("pixelpipe fp16 cacheline %d used %d by %" PRIu64 "\n", k, cache->fp16_used[k], cache->fp16_hash[k]);
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+  if(cache->fp16_entries)
+    printf("of which restored from half precision: %.3f\n", cache->fp16_hits / (float)cache->queries);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -41,9 +41,20 @@ typedef struct dt_dev_pixelpipe_cache_t
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
+  // bytes of each cache line which may be kept in half precision once it gets evicted, 0 if not allowed
+  size_t *fp16_bytes;
+  // optional second level of evicted cache lines, stored as half floats
+  int32_t fp16_entries;
+  uint16_t **fp16_data;
+  size_t *fp16_size;
+  size_t *fp16_count;
+  struct dt_iop_buffer_dsc_t *fp16_dsc;
+  uint64_t *fp16_hash;
+  int32_t *fp16_used;
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  uint64_t fp16_hits;
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
@@ -52,6 +63,10 @@ typedef struct dt_dev_pixelpipe_cache_t
 int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
+/** adds a second level of entries cache lines which keep evicted float buffers in half precision.
+  \param[out] returns 0 if fail to allocate. */
+int dt_dev_pixelpipe_cache_init_fp16(dt_dev_pixelpipe_cache_t *cache, int entries);
+
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
                                      struct dt_dev_pixelpipe_t *pipe, int module);
@@ -66,7 +81,8 @@ int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const
 int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                         void **data, struct dt_iop_buffer_dsc_t **dsc, int weight);
 
-/** test availability of a cache line without destroying another, if it is not found. */
+/** test availability of a cache line without destroying another, if it is not found. a line only kept in half
+ * precision counts, but get can still fail to restore it: trust the return value of get, too. */
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
 
 /** invalidates all cachelines. */
@@ -78,6 +94,10 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** allow the first size bytes of the given cache line to be kept in half precision when it gets evicted.
+  * only has an effect if the cache was set up with dt_dev_pixelpipe_cache_init_fp16(). */
+void dt_dev_pixelpipe_cache_allow_fp16(dt_dev_pixelpipe_cache_t *cache, void *data, const size_t size);
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
@@ -62,6 +62,8 @@ typedef enum dt_pixelpipe_picker_source_t
 } dt_pixelpipe_picker_source_t;
 
 #include "develop/pixelpipe_cache.c"
+#include "develop/pixelpipe_scratch.c"
+#include "develop/pixelpipe_rawstage.c"
 
 static void get_output_format(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece,
                               dt_develop_t *dev, dt_iop_buffer_dsc_t *dsc);
@@ -118,6 +120,8 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
   int res = dt_dev_pixelpipe_init_cached(
       pipe, 0, 5);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
+  // keep as many evicted lines again in half precision, unless switched off
+  if(res && dt_conf_get_bool("pixelpipe_cache_fp16")) dt_dev_pixelpipe_cache_init_fp16(&(pipe->cache), 5);
   return res;
 }
 
@@ -127,6 +131,7 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
   int res = dt_dev_pixelpipe_init_cached(
       pipe, 0, 5);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
+  if(res && dt_conf_get_bool("pixelpipe_cache_fp16")) dt_dev_pixelpipe_cache_init_fp16(&(pipe->cache), 5);
   return res;
 }
 
@@ -139,6 +144,7 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  dt_dev_pixelpipe_scratch_init(&(pipe->scratch));
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->processing = 0;
@@ -159,6 +165,125 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   return 1;
 }
 
+// idle export and thumbnail pipes, waiting for the next image. they keep their buffers but no nodes: pieces
+// point to the modules of the dt_develop_t they were created for, which goes away with its image.
+static GMutex _pool_lock;
+static GList *_pool = NULL;
+
+// the memory an idle pipe holds on to: its cache lines and pooled scratch buffers
+static size_t _pool_pipe_bytes(dt_dev_pixelpipe_t *pipe)
+{
+  size_t bytes = 0;
+  for(int k = 0; k < pipe->cache.entries; k++) bytes += pipe->cache.size[k];
+  for(int k = 0; k < pipe->cache.fp16_entries; k++) bytes += pipe->cache.fp16_size[k] * sizeof(uint16_t);
+  return bytes + dt_dev_pixelpipe_scratch_pooled(&pipe->scratch);
+}
+
+dt_dev_pixelpipe_t *dt_dev_pixelpipe_pool_get(const dt_dev_pixelpipe_type_t type)
+{
+  dt_dev_pixelpipe_t *pipe = NULL;
+  g_mutex_lock(&_pool_lock);
+  for(GList *iter = _pool; iter; iter = g_list_next(iter))
+  {
+    if(((dt_dev_pixelpipe_t *)iter->data)->type == type)
+    {
+      pipe = (dt_dev_pixelpipe_t *)iter->data;
+      _pool = g_list_delete_link(_pool, iter);
+      break;
+    }
+  }
+  g_mutex_unlock(&_pool_lock);
+  if(pipe) return pipe;
+
+  pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
+  // two cache lines like export and thumbnail pipes always had, but sized on first use
+  if(pipe && !dt_dev_pixelpipe_init_cached(pipe, 0, 2))
+  {
+    free(pipe);
+    return NULL;
+  }
+  if(pipe) pipe->type = type;
+  return pipe;
+}
+
+void dt_dev_pixelpipe_pool_put(dt_dev_pixelpipe_t *pipe, const gboolean keep)
+{
+  if(!pipe) return;
+  dt_dev_pixelpipe_cleanup_nodes(pipe);
+  if(keep)
+  {
+    // nothing of the last image must leak into the next one
+    dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+    pipe->backbuf = NULL;
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    dt_dev_pixelpipe_cache_flush(&pipe->cache);
+    pipe->changed = DT_DEV_PIPE_UNCHANGED;
+    pipe->opencl_error = 0;
+    pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
+    dt_dev_pixelpipe_set_icc(pipe, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST);
+    if(pipe->forms)
+    {
+      g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
+      pipe->forms = NULL;
+    }
+
+    // there are never more pipes of a kind busy than worker threads, and all idle pipes together must not
+    // take more than half of what we may use for processing. a limit of 0 means no limit, as for tiling.
+    const guint max = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
+    const size_t limit = (size_t)MAX(dt_conf_get_int("host_memory_limit"), 0) * 1024 * 1024 / 2;
+    size_t bytes = _pool_pipe_bytes(pipe);
+    if(limit && bytes > limit)
+    {
+      // the scratch buffers are the cheapest to give up
+      dt_dev_pixelpipe_scratch_trim(&pipe->scratch);
+      bytes = _pool_pipe_bytes(pipe);
+    }
+    g_mutex_lock(&_pool_lock);
+    guint count = 0;
+    size_t idle = bytes;
+    for(GList *iter = _pool; iter; iter = g_list_next(iter))
+    {
+      if(((dt_dev_pixelpipe_t *)iter->data)->type == pipe->type) count++;
+      idle += _pool_pipe_bytes((dt_dev_pixelpipe_t *)iter->data);
+    }
+    if(count < max && (!limit || idle <= limit))
+    {
+      _pool = g_list_prepend(_pool, pipe);
+      pipe = NULL;
+    }
+    g_mutex_unlock(&_pool_lock);
+  }
+  if(pipe)
+  {
+    dt_dev_pixelpipe_cleanup(pipe);
+    free(pipe);
+  }
+}
+
+void dt_dev_pixelpipe_pool_cleanup(const dt_dev_pixelpipe_type_t types)
+{
+  GList *idle = NULL;
+  g_mutex_lock(&_pool_lock);
+  for(GList *iter = _pool; iter;)
+  {
+    GList *next = g_list_next(iter);
+    if(((dt_dev_pixelpipe_t *)iter->data)->type & types)
+    {
+      _pool = g_list_remove_link(_pool, iter);
+      idle = g_list_concat(iter, idle);
+    }
+    iter = next;
+  }
+  g_mutex_unlock(&_pool_lock);
+
+  for(GList *iter = idle; iter; iter = g_list_next(iter))
+  {
+    dt_dev_pixelpipe_cleanup((dt_dev_pixelpipe_t *)iter->data);
+    free(iter->data);
+  }
+  g_list_free(idle);
+}
+
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, float *input, int width, int height,
                                 float iscale)
 {
@@ -187,6 +312,7 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_dev_pixelpipe_scratch_cleanup(&(pipe->scratch));
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -213,6 +339,7 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
   {
     dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
     // printf("cleanup module `%s'\n", piece->module->name());
+    dt_develop_blend_mask_discard(piece);
     piece->module->cleanup_pipe(piece->module, pipe, piece);
     free(piece->blendop_data);
     piece->blendop_data = NULL;
@@ -264,6 +391,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
       piece->hash = 0;
       piece->process_cl_ready = 0;
       piece->process_tiling_ready = 0;
+      piece->rawstage_ready = 0;
       dt_iop_init_pipe(piece->module, pipe, piece);
       pipe->nodes = g_list_append(pipe->nodes, piece);
     }
@@ -594,7 +722,151 @@ error:
 #endif
 
 
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// longest chain of modules which can go into the fused raw stage
+#define DT_RAWSTAGE_MAX_MODULES 8
+
+// whether piece may leave its work to the fused raw stage. everything that needs to look at its own input or
+// output (blending, histograms, the color picker of the focused module) keeps it on its own.
+static int _rawstage_piece_ready(dt_develop_t *dev, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_develop_blend_params_t *const blend = (const dt_develop_blend_params_t *)piece->blendop_data;
+  return module->rawstage && piece->rawstage_ready && !(blend && (blend->mask_mode & DEVELOP_MASK_ENABLED))
+         && !(piece->request_histogram & DT_REQUEST_ON) && module != dev->gui_module;
+}
+
+// runs the module at modules together with the ones in front of it as a single pass over the raw mosaic, if
+// they all can, see develop/pixelpipe_rawstage.h. returns 1 if it did, 0 if the module has to be processed on
+// its own and -1 if processing was aborted.
+static int _process_rawstage(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                             dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out, GList *modules,
+                             GList *pieces, int pos, const uint64_t hash, const size_t bufsize)
+{
+#ifdef HAVE_OPENCL
+  // on the gpu these modules stay with their kernels
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return 0;
+#endif
+  if(pipe->mask_display || !(pipe->image.flags & DT_IMAGE_RAW) || !pipe->image.buf_dsc.filters
+     || pipe->image.buf_dsc.channels != 1)
+    return 0;
+
+  // collect the chain backwards, skipping disabled modules like dt_dev_pixelpipe_process_rec() does
+  dt_iop_module_t *chain_modules[DT_RAWSTAGE_MAX_MODULES];
+  dt_dev_pixelpipe_iop_t *chain_pieces[DT_RAWSTAGE_MAX_MODULES];
+  GList *first_module = NULL, *first_piece = NULL;
+  int first_pos = pos, count = 0;
+  for(GList *m = modules, *p = pieces; m && p && count < DT_RAWSTAGE_MAX_MODULES;
+      m = g_list_previous(m), p = g_list_previous(p), pos--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(!piece->enabled
+       || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+      continue;
+    if(!_rawstage_piece_ready(dev, module, piece)) break;
+    chain_modules[count] = module;
+    chain_pieces[count] = piece;
+    first_module = m;
+    first_piece = p;
+    first_pos = pos;
+    count++;
+  }
+  if(count < 2) return 0;
+
+  // all but the first one have to work in place
+  dt_iop_roi_t roi_in = *roi_out;
+  for(int k = 0; k < count; k++)
+  {
+    const dt_iop_roi_t roi = roi_in;
+    chain_modules[k]->modify_roi_in(chain_modules[k], chain_pieces[k], &roi, &roi_in);
+    if(k < count - 1 && memcmp(&roi, &roi_in, sizeof(dt_iop_roi_t))) return 0;
+  }
+
+  if(!dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width), MAX(roi_in.height, roi_out->height),
+                                       sizeof(float), 2.0f, dt_dev_pixelpipe_scratch_pooled(&pipe->scratch)))
+    return 0;
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in,
+                                  g_list_previous(first_module), g_list_previous(first_piece), first_pos - 1))
+    return -1;
+  // the input is in the cache now, so going the regular way costs little
+  if(cl_mem_input || !pipe->dsc.filters || input_format->channels != 1
+     || (input_format->datatype != TYPE_FLOAT && input_format->datatype != TYPE_UINT16))
+    return 0;
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return -1;
+  }
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  // the modules set up their steps and update the buffer description in pipe order, as process() would
+  dt_dev_pixelpipe_rawstage_t stage;
+  dt_dev_pixelpipe_rawstage_init(&stage);
+  dt_iop_buffer_dsc_t format = *input_format;
+  for(int k = count - 1; k >= 0; k--)
+  {
+    dt_iop_module_t *module = chain_modules[k];
+    dt_dev_pixelpipe_iop_t *piece = chain_pieces[k];
+    piece->dsc_out = piece->dsc_in = format;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+    module->rawstage(module, piece, &stage, k == count - 1 ? &roi_in : roi_out, roi_out);
+    format = piece->dsc_out = pipe->dsc;
+  }
+  **out_format = format;
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+
+  if(dt_dev_pixelpipe_rawstage_process(pipe, &stage, input, input_format->datatype == TYPE_UINT16, *output,
+                                       &roi_in, roi_out))
+  {
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return 0;
+  }
+
+  gchar *first_label = dt_history_item_get_name(chain_modules[count - 1]);
+  gchar *last_label = dt_history_item_get_name(chain_modules[0]);
+  dt_show_times(&start, "[dev_pixelpipe]", "processed `%s' to `%s' in one pass on CPU [%s]", first_label,
+                last_label, _pipe_type_to_str(pipe->type));
+  g_free(first_label);
+  g_free(last_label);
+
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  return 1;
+}
+
+#undef DT_RAWSTAGE_MAX_MODULES
+
+// whether the module can run on the cpu without tiling, the idle scratch buffers of the pipe come on top
+static int _piece_fits_host_memory(dt_dev_pixelpipe_t *pipe, const dt_iop_roi_t *roi_in,
+                                   const dt_iop_roi_t *roi_out, const unsigned bpp,
+                                   const dt_develop_tiling_t *tiling)
+{
+  return dt_tiling_piece_fits_host_memory(MAX(roi_in->width, roi_out->width), MAX(roi_in->height, roi_out->height),
+                                          bpp, tiling->factor,
+                                          tiling->overhead + dt_dev_pixelpipe_scratch_pooled(&pipe->scratch));
+}
+
 // recursive helper for process:
+// the pipe stays a chain over whole buffers and is not split into a task graph over row bands. process() of a
+// module gets all of roi_in, which for blurs, demosaicing and distorting modules reaches beyond any band of its
+// output, and the cache keeps whole buffers per module. the params of all modules are committed before the run
+// starts (dt_dev_pixelpipe_change()), so there is nothing of the next module to prepare either. threads are used
+// inside the modules (openmp, opencl, tiling), and the only work that runs next to a module is its drawn mask,
+// see dt_develop_blend_mask_prefetch().
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
                                         const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos)
@@ -631,13 +903,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     return 1;
   }
   uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_out, pipe, pos);
-  if(dt_dev_pixelpipe_cache_available(&(pipe->cache), hash))
+  // a line kept in half precision is only a hit if get could restore it, otherwise the buffer is fresh and
+  // gets computed below like any other miss
+  if(dt_dev_pixelpipe_cache_available(&(pipe->cache), hash)
+     && !dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format))
   {
     // if(module) printf("found valid buf pos %d in cache for module %s %s %lu\n", pos, module->op, pipe ==
     // dev->preview_pipe ? "[preview]" : "", hash);
 
-    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
-
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(!modules) return 0;
     // go to post-collect directly:
@@ -714,7 +987,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   }
   else
   {
-    // 3b) recurse and obtain output array in &input
+    // 3b) the first modules on the raw data might run as a single pass
+    const int fused = _process_rawstage(pipe, dev, output, out_format, roi_out, modules, pieces, pos, hash,
+                                        bufsize);
+    if(fused < 0) return 1;
+    if(fused) goto post_process_collect_info;
+
+    // 3c) recurse and obtain output array in &input
 
     // get region of interest which is needed in input
     dt_pthread_mutex_lock(&pipe->busy_mutex);
@@ -816,6 +1095,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     /* get tiling requirement of module */
     dt_develop_tiling_t tiling = { 0 };
     module->tiling_callback(module, piece, &roi_in, roi_out, &tiling);
+#ifdef HAVE_OPENCL
+    dt_develop_tiling_t tiling_cl = tiling;
+    dt_tiling_use_cl_requirements(&tiling_cl);
+#endif
 
     /* does this module involve blending? */
     if(piece->blendop_data && (dt_develop_blend_params_t *)piece->blendop_data != DEVELOP_MASK_DISABLED)
@@ -828,6 +1111,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       tiling.factor = fmax(tiling.factor, tiling_blendop.factor);
       tiling.maxbuf = fmax(tiling.maxbuf, tiling_blendop.maxbuf);
       tiling.overhead = fmax(tiling.overhead, tiling_blendop.overhead);
+#ifdef HAVE_OPENCL
+      tiling_cl.factor = fmax(tiling_cl.factor, tiling_blendop.factor);
+      tiling_cl.maxbuf = fmax(tiling_cl.maxbuf, tiling_blendop.maxbuf);
+      tiling_cl.overhead = fmax(tiling_cl.overhead, tiling_blendop.overhead);
+#endif
     }
 
     /* remark: we do not do tiling for blendop step, neither in opencl nor on cpu. if overall tiling
@@ -855,7 +1143,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       /* pre-check if there is enough space on device for non-tiled processing */
       const int fits_on_device = dt_opencl_image_fits_device(pipe->devid, MAX(roi_in.width, roi_out->width),
                                                              MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                             tiling.factor, tiling.overhead);
+                                                             tiling_cl.factor, tiling_cl.overhead);
 
       /* general remark: in case of opencl errors within modules or out-of-memory on GPU, we transparently
          fall back to the respective cpu module and continue in pixelpipe. If we encounter errors we set
@@ -970,6 +1258,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
             return 1;
           }
 
+          /* the drawn mask is rendered on the cpu while the device is busy */
+          if(success_opencl) dt_develop_blend_mask_prefetch(module, piece, &roi_in, roi_out);
+
           /* now call process_cl of module; module should emit meaningful messages in case of error */
           if(success_opencl)
           {
@@ -1109,6 +1400,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
             return 1;
           }
 
+          /* the drawn mask is rendered on the cpu while the device is busy */
+          if(success_opencl) dt_develop_blend_mask_prefetch(module, piece, &roi_in, roi_out);
+
           /* now call process_tiling_cl of module; module should emit meaningful messages in case of error */
           if(success_opencl)
           {
@@ -1315,11 +1609,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
             return 1;
           }
 
+          /* let the drawn mask render alongside, blending picks it up */
+          dt_develop_blend_mask_prefetch(module, piece, &roi_in, roi_out);
+
           /* process module on cpu. use tiling if needed and possible. */
           if(piece->process_tiling_ready
-             && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                                  MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                  tiling.factor, tiling.overhead))
+             && !_piece_fits_host_memory(pipe, &roi_in, roi_out, MAX(in_bpp, bpp), &tiling))
           {
             module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
             pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -1448,11 +1743,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           return 1;
         }
 
+        /* let the drawn mask render alongside, blending picks it up */
+        dt_develop_blend_mask_prefetch(module, piece, &roi_in, roi_out);
+
         /* process module on cpu. use tiling if needed and possible. */
         if(piece->process_tiling_ready
-           && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                                MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                tiling.factor, tiling.overhead))
+           && !_piece_fits_host_memory(pipe, &roi_in, roi_out, MAX(in_bpp, bpp), &tiling))
         {
           module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
           pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -1546,11 +1842,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         return 1;
       }
 
+      /* let the drawn mask render alongside, blending picks it up */
+      dt_develop_blend_mask_prefetch(module, piece, &roi_in, roi_out);
+
       /* process module on cpu. use tiling if needed and possible. */
       if(piece->process_tiling_ready
-         && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                              MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                              tiling.factor, tiling.overhead))
+         && !_piece_fits_host_memory(pipe, &roi_in, roi_out, MAX(in_bpp, bpp), &tiling))
       {
         module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
         pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -1631,11 +1928,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       return 1;
     }
 
+    /* let the drawn mask render alongside, blending picks it up */
+    dt_develop_blend_mask_prefetch(module, piece, &roi_in, roi_out);
+
     /* process module on cpu. use tiling if needed and possible. */
     if(piece->process_tiling_ready
-       && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                            MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                            tiling.factor, tiling.overhead))
+       && !_piece_fits_host_memory(pipe, &roi_in, roi_out, MAX(in_bpp, bpp), &tiling))
     {
       module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
       pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -1713,6 +2011,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
+    // tolerant modules allow their output to be kept in half precision when it drops out of the cache.
+    // only if the data is on the host, opencl output might not have been copied back yet.
+    if((module->flags() & IOP_FLAGS_CACHE_FP16) && *cl_mem_output == NULL)
+      dt_dev_pixelpipe_cache_allow_fp16(&(pipe->cache), *output, bufsize);
+
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(module == darktable.develop->gui_module)
     {
@@ -2312,6 +2615,10 @@ restart:
   int err = dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
                                                       pieces, pos);
 
+  // an aborted run may leave drawn masks rendering in the background, they use pipe->forms
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    dt_develop_blend_mask_discard((dt_dev_pixelpipe_iop_t *)nodes->data);
+
   // get status summary of opencl queue by checking the eventlist
   int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
 
@@ -2376,6 +2683,8 @@ restart:
   pipe->backbuf_height = height;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  if(darktable.unmuted & DT_DEBUG_MEMORY) dt_dev_pixelpipe_scratch_print(&pipe->scratch, _pipe_type_to_str(pipe->type));
+
   // printf("pixelpipe homebrew process end\n");
   pipe->processing = 0;
   return 0;
@@ -2384,6 +2693,7 @@ restart:
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  dt_dev_pixelpipe_scratch_trim(&pipe->scratch);
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in,
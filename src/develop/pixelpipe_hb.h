@@ -24,6 +24,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_scratch.h"
 
 /**
  * struct used by iop modules to connect to pixelpipe.
@@ -55,9 +56,13 @@ typedef struct dt_dev_pixelpipe_iop_t
       buf_out;                // theoretical full buffer regions of interest, as passed through modify_roi_out
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
+  int rawstage_ready;         // set this in commit_params if rawstage() can stand in for process()
 
   // the following are used  internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
+
+  // drawn mask being rendered concurrently with process(), see dt_develop_blend_mask_prefetch()
+  struct dt_develop_blend_mask_job_t *mask_job;
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -82,6 +87,8 @@ typedef struct dt_dev_pixelpipe_t
   dt_dev_pixelpipe_cache_t cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
+  // pool of temporary buffers for modules and blending
+  dt_dev_pixelpipe_scratch_t scratch;
   // input buffer
   float *input;
   // width and height of input buffer
@@ -152,6 +159,15 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
 // inits the pixelpipe with given cacheline size and number of entries.
 int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// takes an idle export or thumbnail pipe from the pool, or inits a new one. only its buffers are pooled: the
+// cache lines, scratch buffers and opencl setup. a pooled pipe comes without nodes, they hold the module
+// instances of one image's dt_develop_t, so create and synch them for each image as with a fresh pipe.
+dt_dev_pixelpipe_t *dt_dev_pixelpipe_pool_get(const dt_dev_pixelpipe_type_t type);
+// cleans up the nodes and keeps the buffers of the pipe for the next image. with !keep, if enough are idle or
+// if they would hold more than half of host_memory_limit, it's destroyed.
+void dt_dev_pixelpipe_pool_put(dt_dev_pixelpipe_t *pipe, const gboolean keep);
+// destroys the idle pipes of the given types, to give back their memory after a batch.
+void dt_dev_pixelpipe_pool_cleanup(const dt_dev_pixelpipe_type_t types);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -0,0 +1,225 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_rawstage.h"
+#include "common/darktable.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <math.h>
+#include <string.h>
+
+// rows per band when looking for hot pixels. a band and the two rows above and below it, which every band
+// computes again, stay in L2 for the usual sensor widths.
+#define DT_RAWSTAGE_BAND 32
+
+void dt_dev_pixelpipe_rawstage_init(dt_dev_pixelpipe_rawstage_t *stage)
+{
+  memset(stage, 0, sizeof(*stage));
+  for(int k = 0; k < 4; k++)
+  {
+    stage->div[k] = 1.0f;
+    stage->coeffs[k] = 1.0f;
+  }
+  stage->clip = INFINITY;
+}
+
+// black/white point, white balance and highlight clipping of row j of roi_out
+static void _rawstage_row(const dt_dev_pixelpipe_rawstage_t *const stage, const void *const ivoid,
+                          const int in_uint16, float *const out, const int j, const dt_iop_roi_t *const roi_in,
+                          const dt_iop_roi_t *const roi_out, const uint32_t filters,
+                          const uint8_t (*const xtrans)[6])
+{
+  // all factors repeat after 12 columns: 2 for the black levels and bayer, 6 for x-trans
+  float sub[12], div[12], mul[12];
+  for(int k = 0; k < 12; k++)
+  {
+    const int id = (((j + stage->by) & 1) << 1) + ((k + stage->bx) & 1);
+    const int c = (filters == 9u) ? FCxtrans(j, k, roi_out, xtrans) : FC(j + roi_out->y, k + roi_out->x, filters);
+    sub[k] = stage->sub[id];
+    div[k] = stage->div[id];
+    mul[k] = stage->coeffs[c];
+  }
+
+  const float clip = stage->clip;
+  const int width = roi_out->width;
+  const size_t offset = (size_t)roi_in->width * (j + stage->csy) + stage->csx;
+  int i = 0;
+
+  if(in_uint16)
+  {
+    const uint16_t *const in = (const uint16_t *)ivoid + offset;
+    for(; i <= width - 12; i += 12)
+    {
+#ifdef _OPENMP
+#pragma omp SIMD()
+#endif
+      for(int k = 0; k < 12; k++) out[i + k] = MIN(clip, (in[i + k] - sub[k]) / div[k] * mul[k]);
+    }
+    for(int k = 0; i < width; i++, k++) out[i] = MIN(clip, (in[i] - sub[k]) / div[k] * mul[k]);
+  }
+  else
+  {
+    const float *const in = (const float *)ivoid + offset;
+    for(; i <= width - 12; i += 12)
+    {
+#ifdef _OPENMP
+#pragma omp SIMD()
+#endif
+      for(int k = 0; k < 12; k++) out[i + k] = MIN(clip, (in[i + k] - sub[k]) / div[k] * mul[k]);
+    }
+    for(int k = 0; i < width; i++, k++) out[i] = MIN(clip, (in[i] - sub[k]) / div[k] * mul[k]);
+  }
+}
+
+// the four nearest pixels of the same color, as x and y offsets for each position in the 6x6 block
+static void _rawstage_hotpixel_offsets(int offsets[6][6][4][2], const dt_iop_roi_t *const roi_out,
+                                       const uint32_t filters, const uint8_t (*const xtrans)[6])
+{
+  static const int bayer[4][2] = { { -2, 0 }, { 0, -2 }, { 2, 0 }, { 0, 2 } };
+  static const int search[20][2] = { { -1, 0 },  { 1, 0 },  { 0, -1 }, { 0, 1 },  { -1, -1 },
+                                     { -1, 1 },  { 1, -1 }, { 1, 1 },  { -2, 0 }, { 2, 0 },
+                                     { 0, -2 },  { 0, 2 },  { -2, -1 }, { -2, 1 }, { 2, -1 },
+                                     { 2, 1 },   { -1, -2 }, { 1, -2 }, { -1, 2 }, { 1, 2 } };
+  for(int j = 0; j < 6; j++)
+    for(int i = 0; i < 6; i++)
+    {
+      if(filters != 9u)
+      {
+        memcpy(offsets[j][i], bayer, sizeof(bayer));
+        continue;
+      }
+      const uint8_t c = FCxtrans(j, i, roi_out, xtrans);
+      for(int s = 0, found = 0; s < 20 && found < 4; s++)
+        if(c == FCxtrans(j + search[s][1], i + search[s][0], roi_out, xtrans))
+        {
+          offsets[j][i][found][0] = search[s][0];
+          offsets[j][i][found][1] = search[s][1];
+          found++;
+        }
+    }
+}
+
+// replaces pixels of row j brighter than all (or all but one) of their neighbours of the same color by the
+// brightest of those, like process_bayer() and process_xtrans() of the hot pixels module, and copies the rest.
+// near holds the neighbours of row j as offsets into in, by column modulo 6.
+static inline float _rawstage_hotpixel(const dt_dev_pixelpipe_rawstage_t *const stage, const float *const in,
+                                       const ptrdiff_t *const near)
+{
+  const float mid = in[0] * stage->multiplier;
+  int count = 0;
+  float maxin = 0.0f;
+  for(int n = 0; n < 4; n++)
+  {
+    const float other = in[near[n]];
+    const int hit = mid > other;
+    count += hit;
+    // maxin stays >= 0, so this is the same as raising it to other on a hit, without the branch
+    maxin = fmaxf(maxin, hit ? other : 0.0f);
+  }
+  return (in[0] > stage->threshold && count >= stage->min_neighbours) ? maxin : in[0];
+}
+
+static void _rawstage_hotpixels_row(const dt_dev_pixelpipe_rawstage_t *const stage, const float *const in,
+                                    float *const out, const int width, const int j, int offsets[6][6][4][2],
+                                    const uint32_t filters)
+{
+  ptrdiff_t near[6][4];
+  for(int i = 0; i < 6; i++)
+    for(int n = 0; n < 4; n++)
+      near[i][n] = offsets[j % 6][i][n][0] + (ptrdiff_t)offsets[j % 6][i][n][1] * width;
+
+  out[0] = in[0];
+  out[1] = in[1];
+  if(filters != 9u)
+  {
+    // the same neighbours everywhere, which lets the compiler vectorize this
+#ifdef _OPENMP
+#pragma omp SIMD()
+#endif
+    for(int col = 2; col < width - 2; col++) out[col] = _rawstage_hotpixel(stage, in + col, near[0]);
+  }
+  else
+  {
+    for(int col = 2; col < width - 2; col++) out[col] = _rawstage_hotpixel(stage, in + col, near[col % 6]);
+  }
+  out[width - 2] = in[width - 2];
+  out[width - 1] = in[width - 1];
+}
+
+int dt_dev_pixelpipe_rawstage_process(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_rawstage_t *stage,
+                                      const void *const ivoid, const int in_uint16, float *const out,
+                                      const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const uint32_t filters = pipe->dsc.filters;
+  const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])pipe->dsc.xtrans;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  if(!stage->hotpixels)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(stage) schedule(static)
+#endif
+    for(int j = 0; j < height; j++)
+      _rawstage_row(stage, ivoid, in_uint16, out + (size_t)width * j, j, roi_in, roi_out, filters, xtrans);
+    return 0;
+  }
+
+  // hot pixels are found on the prepared data, which each band keeps in its own buffer, with two more rows
+  // on either side for the neighbours.
+  const size_t band_size = (size_t)(DT_RAWSTAGE_BAND + 4) * width;
+  float *const scratch
+      = dt_dev_pixelpipe_scratch_alloc(pipe, sizeof(float) * band_size * dt_get_num_threads());
+  if(!scratch) return 1;
+
+  int offsets[6][6][4][2];
+  _rawstage_hotpixel_offsets(offsets, roi_out, filters, xtrans);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(stage, offsets) schedule(static)
+#endif
+  for(int top = 0; top < height; top += DT_RAWSTAGE_BAND)
+  {
+    float *const band = scratch + band_size * dt_get_thread_num();
+    const int first = MAX(top - 2, 0);
+    const int last = MIN(top + DT_RAWSTAGE_BAND + 2, height);
+    for(int j = first; j < last; j++)
+      _rawstage_row(stage, ivoid, in_uint16, band + (size_t)width * (j - first), j, roi_in, roi_out, filters,
+                    xtrans);
+
+    for(int j = top; j < MIN(top + DT_RAWSTAGE_BAND, height); j++)
+    {
+      const float *const in = band + (size_t)width * (j - first);
+      float *const outrow = out + (size_t)width * j;
+      if(j >= 2 && j < height - 2 && width > 4)
+        _rawstage_hotpixels_row(stage, in, outrow, width, j, offsets, filters);
+      else
+        memcpy(outrow, in, sizeof(float) * width);
+    }
+  }
+
+  dt_dev_pixelpipe_scratch_free(pipe, scratch);
+  return 0;
+}
+
+#undef DT_RAWSTAGE_BAND
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
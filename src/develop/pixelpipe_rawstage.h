@@ -0,0 +1,64 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+struct dt_dev_pixelpipe_t;
+struct dt_iop_roi_t;
+
+/**
+ * the modules in front of demosaic (raw black/white point, white balance, highlight clipping and hot pixels)
+ * each make a full pass over the sensor data. in their simple modes all they need is a handful of numbers,
+ * so the pixelpipe runs a chain of them as a single pass over the mosaic, a band of rows at a time.
+ *
+ * a module takes part by setting piece->rawstage_ready in commit_params() and implementing rawstage(),
+ * which is called in place of process(): it fills in its step below and updates pipe->dsc the same way
+ * process() would. the steps are applied in the order of the fields, which is the order of the modules
+ * in the pipe. a step left at its initial value does nothing.
+ */
+typedef struct dt_dev_pixelpipe_rawstage_t
+{
+  // black/white point: out = (in - sub) / div, by position in the 2x2 block offset by bx, by.
+  // csx, csy is where roi_out starts in the input.
+  int csx, csy;
+  int bx, by;
+  float sub[4], div[4];
+  // white balance, by cfa color
+  float coeffs[4];
+  // highlights: out = MIN(clip, out)
+  float clip;
+  // hot pixels, see iop/hotpixels.c
+  int hotpixels;
+  float threshold, multiplier;
+  int min_neighbours;
+} dt_dev_pixelpipe_rawstage_t;
+
+void dt_dev_pixelpipe_rawstage_init(dt_dev_pixelpipe_rawstage_t *stage);
+
+/** runs stage on the float or uint16 mosaic in, of size roi_in, into the float mosaic out of size roi_out.
+ *  the cfa is the one of pipe->dsc. returns non-zero if it couldn't get its working memory. */
+int dt_dev_pixelpipe_rawstage_process(struct dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_rawstage_t *stage,
+                                      const void *const in, const int in_uint16, float *const out,
+                                      const struct dt_iop_roi_t *const roi_in,
+                                      const struct dt_iop_roi_t *const roi_out);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,214 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_scratch.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// how many idle buffers we keep around at most
+#define DT_SCRATCH_MAX_IDLE 16
+// buffers from this size on are candidates for huge pages
+#define DT_SCRATCH_HUGEPAGE_SIZE ((size_t)2 << 20)
+
+typedef struct dt_dev_pixelpipe_scratch_block_t
+{
+  void *ptr;
+  size_t size;
+} dt_dev_pixelpipe_scratch_block_t;
+
+// round up to the next quarter step of the leading power of two, this wastes at most 25%
+// but keeps the number of distinct sizes small enough for buffers to be reused.
+static size_t _size_class(const size_t size)
+{
+  if(size <= 4096) return 4096;
+  size_t p = 4096;
+  while((p << 1) <= size) p <<= 1;
+  const size_t step = p / 4;
+  return (size + step - 1) / step * step;
+}
+
+static void _free_block(dt_dev_pixelpipe_scratch_block_t *block)
+{
+  dt_free_align(block->ptr);
+  free(block);
+}
+
+void dt_dev_pixelpipe_scratch_init(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  dt_pthread_mutex_init(&scratch->lock, NULL);
+  scratch->free = NULL;
+  scratch->used = g_hash_table_new(g_direct_hash, g_direct_equal);
+  scratch->hugepages = dt_conf_get_bool("pixelpipe_scratch_hugepages");
+  scratch->in_use = scratch->pooled = scratch->peak = 0;
+  scratch->allocs = scratch->hits = 0;
+  // a quarter of what we may use for processing, the pipe needs the rest for its own buffers
+  scratch->max_pooled = (size_t)MAX(dt_conf_get_int("host_memory_limit"), 0) * 1024 * 1024 / 4;
+}
+
+void dt_dev_pixelpipe_scratch_cleanup(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  dt_dev_pixelpipe_scratch_trim(scratch);
+
+  // buffers still handed out at this point are not going to be used any more.
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, scratch->used);
+  while(g_hash_table_iter_next(&iter, &key, &value)) _free_block((dt_dev_pixelpipe_scratch_block_t *)value);
+  g_hash_table_destroy(scratch->used);
+  scratch->used = NULL;
+  scratch->in_use = 0;
+
+  dt_pthread_mutex_destroy(&scratch->lock);
+}
+
+void *dt_dev_pixelpipe_scratch_alloc(struct dt_dev_pixelpipe_t *pipe, size_t size)
+{
+  if(!pipe || !pipe->scratch.used) return dt_alloc_align(64, size);
+
+  dt_dev_pixelpipe_scratch_t *scratch = &pipe->scratch;
+  const size_t csize = _size_class(size);
+  dt_dev_pixelpipe_scratch_block_t *block = NULL;
+
+  dt_pthread_mutex_lock(&scratch->lock);
+  scratch->allocs++;
+  for(GList *l = scratch->free; l; l = g_list_next(l))
+  {
+    dt_dev_pixelpipe_scratch_block_t *b = (dt_dev_pixelpipe_scratch_block_t *)l->data;
+    if(b->size == csize)
+    {
+      block = b;
+      scratch->free = g_list_delete_link(scratch->free, l);
+      scratch->pooled -= csize;
+      scratch->hits++;
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&scratch->lock);
+
+  if(!block)
+  {
+    const int huge = scratch->hugepages && csize >= DT_SCRATCH_HUGEPAGE_SIZE;
+    void *ptr = dt_alloc_align(huge ? DT_SCRATCH_HUGEPAGE_SIZE : 64, csize);
+    if(!ptr) return NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if(huge) madvise(ptr, csize, MADV_HUGEPAGE);
+#endif
+    block = (dt_dev_pixelpipe_scratch_block_t *)malloc(sizeof(dt_dev_pixelpipe_scratch_block_t));
+    if(!block)
+    {
+      dt_free_align(ptr);
+      return NULL;
+    }
+    block->ptr = ptr;
+    block->size = csize;
+  }
+
+  dt_pthread_mutex_lock(&scratch->lock);
+  g_hash_table_insert(scratch->used, block->ptr, block);
+  scratch->in_use += csize;
+  scratch->peak = MAX(scratch->peak, scratch->in_use);
+  dt_pthread_mutex_unlock(&scratch->lock);
+
+  return block->ptr;
+}
+
+void dt_dev_pixelpipe_scratch_free(struct dt_dev_pixelpipe_t *pipe, void *mem)
+{
+  if(!mem) return;
+  if(!pipe || !pipe->scratch.used)
+  {
+    dt_free_align(mem);
+    return;
+  }
+
+  dt_dev_pixelpipe_scratch_t *scratch = &pipe->scratch;
+  GList *evict = NULL;
+
+  dt_pthread_mutex_lock(&scratch->lock);
+  dt_dev_pixelpipe_scratch_block_t *block
+      = (dt_dev_pixelpipe_scratch_block_t *)g_hash_table_lookup(scratch->used, mem);
+  if(block)
+  {
+    g_hash_table_remove(scratch->used, mem);
+    scratch->in_use -= block->size;
+    scratch->free = g_list_prepend(scratch->free, block);
+    scratch->pooled += block->size;
+
+    // drop the least recently returned buffers while we hold too many or too large ones
+    guint count = g_list_length(scratch->free);
+    while(count > DT_SCRATCH_MAX_IDLE || (scratch->max_pooled && scratch->pooled > scratch->max_pooled))
+    {
+      GList *last = g_list_last(scratch->free);
+      scratch->free = g_list_remove_link(scratch->free, last);
+      scratch->pooled -= ((dt_dev_pixelpipe_scratch_block_t *)last->data)->size;
+      evict = g_list_concat(last, evict);
+      count--;
+    }
+  }
+  dt_pthread_mutex_unlock(&scratch->lock);
+
+  if(!block)
+    dt_free_align(mem); // not one of ours
+  else
+    g_list_free_full(evict, (GDestroyNotify)_free_block);
+}
+
+size_t dt_dev_pixelpipe_scratch_pooled(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  if(!scratch->used) return 0;
+  dt_pthread_mutex_lock(&scratch->lock);
+  const size_t pooled = scratch->pooled;
+  dt_pthread_mutex_unlock(&scratch->lock);
+  return pooled;
+}
+
+void dt_dev_pixelpipe_scratch_trim(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  dt_pthread_mutex_lock(&scratch->lock);
+  GList *blocks = scratch->free;
+  scratch->free = NULL;
+  scratch->pooled = 0;
+  dt_pthread_mutex_unlock(&scratch->lock);
+
+  g_list_free_full(blocks, (GDestroyNotify)_free_block);
+}
+
+void dt_dev_pixelpipe_scratch_print(dt_dev_pixelpipe_scratch_t *scratch, const char *name)
+{
+  dt_pthread_mutex_lock(&scratch->lock);
+  fprintf(stderr,
+          "[pixelpipe_scratch] [%s] %" PRIu64 " allocations, %.1f%% reused, in use %.1f MB, pooled %.1f MB, "
+          "peak %.1f MB\n",
+          name, scratch->allocs, scratch->allocs ? 100.0 * scratch->hits / scratch->allocs : 0.0,
+          scratch->in_use / (1024.0 * 1024.0), scratch->pooled / (1024.0 * 1024.0),
+          scratch->peak / (1024.0 * 1024.0));
+  dt_pthread_mutex_unlock(&scratch->lock);
+}
+
+#undef DT_SCRATCH_MAX_IDLE
+#undef DT_SCRATCH_HUGEPAGE_SIZE
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,74 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+
+/**
+ * a small pool of temporary buffers owned by one pixelpipe.
+ * modules and blending need large scratch buffers on every run, and with the
+ * same roi they ask for the very same sizes again and again. instead of going
+ * through malloc/free and page faults each time, freed buffers are kept around
+ * in size classes and handed out again on the next request of the same class.
+ */
+
+typedef struct dt_dev_pixelpipe_scratch_t
+{
+  dt_pthread_mutex_t lock;
+  // idle buffers, dt_dev_pixelpipe_scratch_block_t
+  GList *free;
+  // buffers handed out, pointer -> dt_dev_pixelpipe_scratch_block_t
+  GHashTable *used;
+  // use transparent huge pages for large buffers, if available
+  int hugepages;
+  // statistics in bytes
+  size_t in_use, pooled, peak;
+  // at most that many bytes are kept idle, 0 for no limit
+  size_t max_pooled;
+  // profiling:
+  uint64_t allocs;
+  uint64_t hits;
+} dt_dev_pixelpipe_scratch_t;
+
+void dt_dev_pixelpipe_scratch_init(dt_dev_pixelpipe_scratch_t *scratch);
+void dt_dev_pixelpipe_scratch_cleanup(dt_dev_pixelpipe_scratch_t *scratch);
+
+/** returns a 64 byte aligned buffer of at least size bytes. falls back to dt_alloc_align() if pipe is NULL. */
+void *dt_dev_pixelpipe_scratch_alloc(struct dt_dev_pixelpipe_t *pipe, size_t size);
+/** hands a buffer obtained by dt_dev_pixelpipe_scratch_alloc() back to the pool. */
+void dt_dev_pixelpipe_scratch_free(struct dt_dev_pixelpipe_t *pipe, void *mem);
+
+/** returns the bytes held by idle buffers, which are not available to the rest of the pipe. */
+size_t dt_dev_pixelpipe_scratch_pooled(dt_dev_pixelpipe_scratch_t *scratch);
+
+/** releases all idle buffers. */
+void dt_dev_pixelpipe_scratch_trim(dt_dev_pixelpipe_scratch_t *scratch);
+
+/** print out pool statistics (debug). */
+void dt_dev_pixelpipe_scratch_print(dt_dev_pixelpipe_scratch_t *scratch, const char *name);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,161 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/thumbnail.h"
+#include "common/darktable.h"
+#include "common/debug.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int dt_dev_thumbnail_high_quality(const int width, const int height)
+{
+  char *min = dt_conf_get_string("plugins/lighttable/thumbnail_hq_min_level");
+
+  int level = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, width, height);
+  int res = 0;
+  if (strcmp(min, "always")==0) res = 1;
+  else if (strcmp(min, "small")==0) res = ( level >= 1 );
+  else if (strcmp(min, "VGA")==0) res = ( level >= 2 );
+  else if (strcmp(min, "720p")==0) res = ( level >= 3 );
+  else if (strcmp(min, "1080p")==0) res = ( level >= 4 );
+  else if (strcmp(min, "WQXGA")==0) res = ( level >= 5 );
+  else if (strcmp(min, "4k")==0) res = ( level >= 6 );
+  else if (strcmp(min, "5K")==0) res = ( level >= 7 );
+
+  g_free(min);
+  return res;
+}
+
+int dt_dev_thumbnail_process(const uint32_t imgid, uint8_t *buf, const int max_width, const int max_height,
+                             int *width, int *height)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  dt_dev_pixelpipe_t *pipe = dt_dev_pixelpipe_pool_get(DT_DEV_PIXELPIPE_THUMBNAIL);
+  if(!pipe)
+  {
+    dt_control_log(_("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
+                   C_("noun", "thumbnail export"));
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+
+  // the half size mosaic of mip f has all the pixels the small thumbnails need, and demosaic runs on a
+  // quarter of the data. larger ones and those the user wants in high quality need the full buffer.
+  const dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  const gboolean low_quality = dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails");
+  gboolean downscaled = low_quality
+                        || (max_width <= cache->max_width[DT_MIPMAP_F] && max_height <= cache->max_height[DT_MIPMAP_F]
+                            && !dt_dev_thumbnail_high_quality(max_width, max_height));
+
+  dt_mipmap_buffer_t mbuf;
+  while(TRUE)
+  {
+    dt_mipmap_cache_get(darktable.mipmap_cache, &mbuf, imgid, downscaled ? DT_MIPMAP_F : DT_MIPMAP_FULL,
+                        DT_MIPMAP_BLOCKING, 'r');
+    if(!mbuf.buf || !mbuf.width || !mbuf.height)
+    {
+      dt_control_log(_("image `%s' is not available!"), dev.image_storage.filename);
+      dt_mipmap_cache_release(darktable.mipmap_cache, &mbuf);
+      dt_dev_pixelpipe_pool_put(pipe, downscaled);
+      dt_dev_cleanup(&dev);
+      return 1;
+    }
+
+    dt_dev_pixelpipe_set_icc(pipe, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST);
+    dt_dev_pixelpipe_set_input(pipe, &dev, (float *)mbuf.buf, mbuf.width, mbuf.height, mbuf.iscale);
+    dt_dev_pixelpipe_create_nodes(pipe, &dev);
+    dt_dev_pixelpipe_synch_all(pipe, &dev);
+    dt_dev_pixelpipe_get_dimensions(pipe, &dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
+                                    &pipe->processed_height);
+
+    // heavy crops (and x-trans, which mip f holds at a third) might not leave enough pixels, start over
+    if(downscaled && !low_quality && pipe->processed_width < max_width && pipe->processed_height < max_height)
+    {
+      dt_dev_pixelpipe_cleanup_nodes(pipe);
+      dt_mipmap_cache_release(darktable.mipmap_cache, &mbuf);
+      downscaled = FALSE;
+      continue;
+    }
+    break;
+  }
+
+  const double scale = fmin(fmin(max_width / (double)pipe->processed_width,
+                                 max_height / (double)pipe->processed_height), 1.0);
+  const int processed_width = scale * pipe->processed_width + .5f;
+  const int processed_height = scale * pipe->processed_height + .5f;
+
+  // downsampling happens right after demosaic. at a quarter of the image size or less sharpening and denoising
+  // don't make a visible difference any more, screen-sized previews of 24 MP images (a third) still keep them.
+  const gboolean skip = scale / mbuf.iscale <= 0.25;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!strcmp(piece->module->op, "finalscale")
+       || (skip && (piece->module->flags() & IOP_FLAGS_SKIP_IN_THUMBNAILS)))
+      piece->enabled = 0;
+  }
+
+  dt_show_times(&start, "[dev_process_thumbnail] creating pixelpipe", NULL);
+
+  dt_get_times(&start);
+  int res = dt_dev_pixelpipe_process(pipe, &dev, 0, 0, processed_width, processed_height, scale);
+  dt_show_times(&start, "[dev_process_thumbnail] pixel pipeline processing", NULL);
+
+  if(!res && pipe->backbuf)
+  {
+    // the pipe delivers bgra
+    const uint8_t *const in = pipe->backbuf;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+    {
+      buf[4 * k + 0] = in[4 * k + 2];
+      buf[4 * k + 1] = in[4 * k + 1];
+      buf[4 * k + 2] = in[4 * k + 0];
+      buf[4 * k + 3] = in[4 * k + 3];
+    }
+    *width = processed_width;
+    *height = processed_height;
+  }
+  else
+    res = 1;
+
+  dt_mipmap_cache_release(darktable.mipmap_cache, &mbuf);
+  dt_dev_pixelpipe_pool_put(pipe, downscaled);
+  dt_dev_cleanup(&dev);
+  return res;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,38 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// the development of lighttable thumbnails that have no usable embedded jpeg. unlike a regular export this
+// starts from the half size mosaic of mip f whenever that has enough pixels for the requested size, leaves
+// out modules which don't show at that scale and takes its pixelpipes from a pool shared by all worker threads,
+// so they don't get set up again for each image.
+
+/** renders imgid into buf as 8-bit rgba of at most max_width x max_height, in the colorspace of the mipmap
+ *  cache. returns 0 on success and the actual size in width and height. */
+int dt_dev_thumbnail_process(const uint32_t imgid, uint8_t *buf, const int max_width, const int max_height,
+                             int *width, int *height);
+
+/** whether the user wants thumbnails of this size to be demosaiced at full resolution. */
+int dt_dev_thumbnail_high_quality(const int width, const int height);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
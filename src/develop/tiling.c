@@ -612,9 +612,11 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   /* calculate optimal size of tiles */
   float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
   assert(available >= 500.0f * 1024.0f * 1024.0f);
-  /* correct for size of ivoid and ovoid which are needed on top of tiling */
+  /* correct for size of ivoid and ovoid which are needed on top of tiling, and for the idle scratch buffers
+     the pipe holds on to */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
-                   - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead,
+                   - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead
+                   - dt_dev_pixelpipe_scratch_pooled(&piece->pipe->scratch),
                    0);
 
   /* we ignore the above value if singlebuffer_limit (is defined and) is higher than available/tiling.factor.
@@ -873,9 +875,11 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   /* calculate optimal size of tiles */
   float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
   assert(available >= 500.0f * 1024.0f * 1024.0f);
-  /* correct for size of ivoid and ovoid which are needed on top of tiling */
+  /* correct for size of ivoid and ovoid which are needed on top of tiling, and for the idle scratch buffers
+     the pipe holds on to */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
-                   - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead,
+                   - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead
+                   - dt_dev_pixelpipe_scratch_pooled(&piece->pipe->scratch),
                    0);
 
   /* we ignore the above value if singlebuffer_limit (is defined and) is higher than available/tiling.factor.
@@ -1206,6 +1210,7 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   /* get tiling requirements of module */
   dt_develop_tiling_t tiling = { 0 };
   self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+  dt_tiling_use_cl_requirements(&tiling);
 
   /* shall we use pinned memory transfers? */
   int use_pinned_memory = dt_conf_get_bool("opencl_use_pinned_memory");
@@ -1570,6 +1575,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   /* get tiling requirements of module */
   dt_develop_tiling_t tiling = { 0 };
   self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+  dt_tiling_use_cl_requirements(&tiling);
 
   /* shall we use pinned memory transfers? */
   int use_pinned_memory = dt_conf_get_bool("opencl_use_pinned_memory");
@@ -2009,6 +2015,15 @@ static inline void _get_iop_priorities(const dt_iop_module_t *module)
   }
 }
 
+void dt_tiling_use_cl_requirements(dt_develop_tiling_t *tiling)
+{
+  if(tiling->factor_cl <= 0.0f) return;
+
+  tiling->factor = tiling->factor_cl;
+  tiling->maxbuf = fmax(tiling->maxbuf_cl, 1.0f);
+  tiling->overhead = tiling->overhead_cl;
+}
+
 /* If a module does not implement tiling_callback() by itself, this function is called instead.
    Default is an image size factor of 2 (i.e. input + output buffer needed), no overhead (1),
    no overlap between tiles, and an pixel alignment of 1 in x and y direction, i.e. no special
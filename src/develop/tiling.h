@@ -37,6 +37,11 @@ typedef struct dt_develop_tiling_t
       Bayer pattern. */
   unsigned xalign;
   unsigned yalign;
+  /** the same three requirements for the opencl code path, for modules which need full size buffers
+      there but get by with small per thread ones on the cpu. leave at 0 if they don't differ. */
+  float factor_cl;
+  float maxbuf_cl;
+  unsigned overhead_cl;
 } dt_develop_tiling_t;
 
 int default_process_tiling_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
@@ -67,6 +72,9 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
                      const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
                      struct dt_develop_tiling_t *tiling);
 
+/** replaces the requirements in tiling by the ones for opencl, if the module gave any. */
+void dt_tiling_use_cl_requirements(struct dt_develop_tiling_t *tiling);
+
 int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
                                      const float factor, const size_t overhead);
 
@@ -34,13 +34,94 @@
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
 #include "common/mipmap_cache.h" // for dt_mipmap_size_t, etc
 #include "config.h"              // for GETTEXT_PACKAGE, etc
-#include "control/conf.h"        // for dt_conf_get_bool
+#include "control/conf.h"        // for dt_conf_get_bool, dt_conf_get_int
 
 #ifdef _WIN32
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+typedef struct _generate_state_t
+{
+  dt_pthread_mutex_t mutex;
+  GArray *imgids;
+  size_t next;
+  size_t counter;
+  size_t skipped;
+  double start;
+  dt_mipmap_size_t min_mip, max_mip;
+} _generate_state_t;
+
+static inline gboolean _thumbnail_on_disk(const dt_mipmap_size_t k, const int32_t imgid)
+{
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  return !access(filename, R_OK);
+}
+
+// returns FALSE if all requested thumbnails were on disc already
+static gboolean _generate_image(const _generate_state_t *state, const int32_t imgid)
+{
+  gboolean generated = FALSE;
+
+  for(int k = state->max_mip; k >= state->min_mip && k >= 0; k--)
+  {
+    // if the thumbnail is already on disc - do nothing, unless the next smaller one is missing:
+    // then load it anyway, so that one gets downsampled from it instead of being rendered again.
+    if(_thumbnail_on_disk(k, imgid)
+       && (k == state->min_mip || k == 0 || _thumbnail_on_disk(k - 1, imgid)))
+      continue;
+
+    // else, generate thumbnail and store in mipmap cache. smaller sizes are
+    // downsampled from the largest one as long as it stays in the cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    generated = TRUE;
+  }
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  if(generated) dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+
+  return generated;
+}
+
+static void *_generate_worker(void *arg)
+{
+  _generate_state_t *state = (_generate_state_t *)arg;
+  const size_t image_count = state->imgids->len;
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&state->mutex);
+    if(state->next >= image_count)
+    {
+      dt_pthread_mutex_unlock(&state->mutex);
+      break;
+    }
+    const int32_t imgid = g_array_index(state->imgids, int32_t, state->next);
+    state->next++;
+    dt_pthread_mutex_unlock(&state->mutex);
+
+    const gboolean generated = _generate_image(state, imgid);
+
+    dt_pthread_mutex_lock(&state->mutex);
+    state->counter++;
+    if(!generated) state->skipped++;
+    const size_t done = state->counter - state->skipped;
+    const double elapsed = dt_get_wtime() - state->start;
+    const double rate = elapsed > 0.0 ? done / elapsed : 0.0;
+    const double eta = rate > 0.0 ? (image_count - state->counter) / rate : 0.0;
+    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d) %s %.2f images/s, eta %dh%02dm\n", state->counter,
+            image_count, 100.0 * state->counter / (float)image_count, imgid, generated ? "done" : "skipped",
+            rate, (int)(eta / 3600.0), (int)(eta / 60.0) % 60);
+    dt_pthread_mutex_unlock(&state->mutex);
+  }
+
+  return NULL;
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    const int32_t min_imgid, const int32_t max_imgid, const int num_threads)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -56,24 +137,26 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
+  // collect all images up front, the workers just pick the next one from the list
+  _generate_state_t state = { 0 };
+  state.min_mip = min_mip;
+  state.max_mip = max_mip;
+  state.imgids = g_array_new(FALSE, FALSE, sizeof(int32_t));
+
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id", -1, &stmt,
+                              0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-  }
-  else
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    return 1;
+    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(state.imgids, imgid);
   }
+  sqlite3_finalize(stmt);
 
-  if(!image_count)
+  if(!state.imgids->len)
   {
     fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
     if(min_imgid > max_imgid)
@@ -82,38 +165,29 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid);
+  // go through all images, with a bounded number of them in flight. thumbnails already
+  // on disc are skipped, so an interrupted run just picks up where it stopped.
+  const int threads = MIN(MAX(num_threads, 1), MAX((int)state.imgids->len, 1));
+  pthread_t *workers = (pthread_t *)calloc(threads, sizeof(pthread_t));
+  dt_pthread_mutex_init(&state.mutex, NULL);
+  state.start = dt_get_wtime();
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  int started = 0;
+  for(; started < threads; started++)
+    if(dt_pthread_create(&workers[started], _generate_worker, &state)) break;
 
-      // if the thumbnail is already on disc - do nothing
-      if(!access(filename, R_OK)) continue;
+  // could not start any thread? do the work in this one
+  if(!started) _generate_worker(&state);
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
+  for(int t = 0; t < started; t++) pthread_join(workers[t], NULL);
 
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-  }
+  const double elapsed = dt_get_wtime() - state.start;
+  fprintf(stderr, "done, %zu images (%zu skipped) in %.1fs using %d threads\n", state.counter, state.skipped,
+          elapsed, MAX(started, 1));
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  dt_pthread_mutex_destroy(&state.mutex);
+  free(workers);
+  g_array_free(state.imgids, TRUE);
 
   return 0;
 }
@@ -125,13 +199,18 @@ static void usage(const char *progname)
       "usage: %s [-h, --help; --version]\n"
       "  [--min-mip <0-7> (default = 0)] [-m, --max-mip <0-7> (default = 2)]\n"
       "  [--min-imgid <N>] [--max-imgid <N>]\n"
+      "  [-j, --jobs <N> (default = worker_threads)]\n"
       "  [--core <darktable options>]\n"
       "\n"
       "When multiple mipmap sizes are requested, the biggest one is computed\n"
       "while the rest are quickly downsampled.\n"
       "\n"
       "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-      "numbers to work on.\n",
+      "numbers to work on.\n"
+      "\n"
+      "--jobs sets how many images are processed at the same time, each of them\n"
+      "needs the memory of a full thumbnail export. Thumbnails which are already\n"
+      "on disc are skipped, so an interrupted run can simply be restarted.\n",
       progname);
 }
 
@@ -148,6 +227,7 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int num_threads = 0;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -182,6 +262,11 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      num_threads = MAX(atoi(arg[k]), 1);
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -225,7 +310,14 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  // the largest size is rendered first, the smaller ones are downsampled from it
+  darktable.mipmap_cache->prefer_larger_mip = TRUE;
+
+  // by default run as many images at once as darktable has background workers, which
+  // is what it has deemed safe for the memory of this machine.
+  if(!num_threads) num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
+
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, num_threads))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
@@ -100,10 +100,14 @@ public:
   int lookupOffset(const short *key, size_t h, bool create = true)
   {
 
-    // Double hash table size if necessary
-    if(filled >= (capacity / 2) - 1)
+    // Double hash table size if necessary. pure lookups never change the table, so
+    // they can safely run in parallel.
+    if(create && filled >= (capacity / 2) - 1)
     {
       grow();
+      // the bucket depends on the capacity, without rehashing the key it would be missed
+      // and created a second time.
+      h = hash(key) & capacity_bits;
     }
 
     // Find the entry with the given key
@@ -160,13 +164,27 @@ public:
     return k;
   }
 
+  /* Makes room for n entries in total, so that inserting them does not have to grow the table again. */
+  void reserve(size_t n)
+  {
+    size_t newCapacity = capacity;
+    while(n >= (newCapacity / 2) - 1) newCapacity *= 2;
+    if(newCapacity > capacity) resize(newCapacity);
+  }
+
 private:
   /* Grows the size of the hash table */
   void grow()
+  {
+    resize(capacity * 2);
+  }
+
+  /* Rehashes the table into newCapacity (a larger power of two) buckets */
+  void resize(size_t newCapacity)
   {
     size_t oldCapacity = capacity;
-    capacity *= 2;
-    capacity_bits = (capacity_bits << 1) | 1;
+    capacity = newCapacity;
+    capacity_bits = capacity - 1;
 
     // Migrate the value vectors.
     float *newValues = new float[VD * capacity / 2];
@@ -230,7 +248,13 @@ public:
    *    vd_ : dimensionality of value vectors
    * nData_ : number of points in the input
    */
-  PermutohedralLattice(size_t nData_, int nThreads_ = 1) : nData(nData_), nThreads(nThreads_)
+  /* Constructor
+   *         nData_ : number of points in the input
+   *      nThreads_ : number of threads splatting into their own hash tables
+   * expectedSize_ : estimated number of lattice points each thread will create, 0 if unknown
+   */
+  PermutohedralLattice(size_t nData_, int nThreads_ = 1, size_t expectedSize_ = 0)
+      : nData(nData_), nThreads(nThreads_)
   {
 
     // Allocate storage for various arrays
@@ -272,6 +296,8 @@ public:
     scaleFactor = scaleFactorTmp;
 
     hashTables = new HashTablePermutohedral<D, VD>[nThreads];
+    if(expectedSize_)
+      for(int i = 0; i < nThreads; i++) hashTables[i].reserve(expectedSize_);
   }
 
 
@@ -395,25 +421,52 @@ public:
   {
     if(nThreads <= 1) return;
 
-    /* Merge the multiple hash tables into one, creating an offset remap table. */
+    // the merged table holds at most all points of all tables, make room for them once
+    size_t total = 0;
+    for(int i = 0; i < nThreads; i++) total += hashTables[i].size();
+    hashTables[0].reserve(total);
+
+    /* Merge the multiple hash tables into one, creating an offset remap table.
+     * tables are merged one after the other, so every point sums up its values in the same
+     * order as a serial merge would. only creating new points has to be done serially. */
     int **offset_remap = new int *[nThreads];
     for(int i = 1; i < nThreads; i++)
     {
       const short *oldKeys = hashTables[i].getKeys();
       const float *oldVals = hashTables[i].getValues();
       const int filled = hashTables[i].size();
-      offset_remap[i] = new int[filled];
+      int *remap = offset_remap[i] = new int[filled];
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
       for(int j = 0; j < filled; j++)
       {
-        float *val = hashTables[0].lookup(oldKeys + j * D, true);
+        const float *val = hashTables[0].lookup(oldKeys + j * D, false);
+        remap[j] = val ? val - hashTables[0].getValues() : -1;
+      }
+
+      for(int j = 0; j < filled; j++)
+        if(remap[j] < 0) remap[j] = hashTables[0].lookup(oldKeys + j * D, true) - hashTables[0].getValues();
+
+      float *const base = hashTables[0].getValues();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for(int j = 0; j < filled; j++)
+      {
+        float *val = base + remap[j];
         const float *oldVal = oldVals + j * VD;
         for(int k = 0; k < VD; k++) val[k] += oldVal[k];
-        offset_remap[i][j] = val - hashTables[0].getValues();
       }
     }
 
     /* Rewrite the offsets in the replay structure from the above generated table. */
-    for(int i = 0; i < nData * (D + 1); i++)
+    const size_t nReplay = (size_t)nData * (D + 1);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(size_t i = 0; i < nReplay; i++)
       if(replay[i].table > 0) replay[i].offset = offset_remap[replay[i].table][replay[i].offset / VD];
 
     for(int i = 1; i < nThreads; i++) delete[] offset_remap[i];
@@ -25,6 +25,7 @@
 extern "C" {
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_scratch.h"
 
 // otherwise the name will be mangled and the linker won't be able to see the function ...
 void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
@@ -35,6 +36,7 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
@@ -403,16 +405,28 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
     float v;
   } s_hv;
 
+  constexpr int cldf = 2; // factor to multiply cache line distance. 1 = 64 bytes, 2 = 128 bytes ...
+  // assign working space of all threads. it has the same size on every run, so it comes back from the pipe's
+  // scratch pool instead of fresh pages.
+  const size_t buffersize = 14 * sizeof(float) * ts * ts + sizeof(char) * ts * tsh + 18 * cldf * 64 + 63;
+  char *const all_buffers = (char *)dt_dev_pixelpipe_scratch_alloc(piece->pipe, dt_get_num_threads() * buffersize);
+  if(!all_buffers)
+  {
+    printf("[demosaic] not able to allocate AMaZE buffers\n");
+    // leave a defined (black) image rather than whatever was in out
+    memset(out, 0, sizeof(float) * 4 * width * height);
+    return;
+  }
+
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
   {
     //     int progresscounter = 0;
 
-    constexpr int cldf = 2; // factor to multiply cache line distance. 1 = 64 bytes, 2 = 128 bytes ...
-    // assign working space
-    char *buffer
-        = (char *)calloc(14 * sizeof(float) * ts * ts + sizeof(char) * ts * tsh + 18 * cldf * 64 + 63, 1);
+    char *const buffer = all_buffers + dt_get_thread_num() * buffersize;
+    // the pool hands out dirty memory, start from zeros like a calloc would
+    memset(buffer, 0, buffersize);
     // aligned to 64 byte boundary
     char *data = (char *)((uintptr_t(buffer) + uintptr_t(63)) / 64 * 64);
 
@@ -466,9 +480,11 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
     float *nyqutest = (float(*))((char *)nyquist + sizeof(unsigned char) * ts * tsh + cldf * 64); // 1
 
 // Main algorithm: Tile loop
-// use collapse(2) to collapse the 2 loops to one large loop, so there is better scaling
+// use collapse(2) to collapse the 2 loops to one large loop, so there is better scaling. tiles at the right
+// and bottom edge are smaller and nyquist texture makes some much more expensive than others, so threads take
+// the next tile as they get done instead of a fixed share.
 #ifdef _OPENMP
-#pragma omp for SIMD() schedule(static) collapse(2) nowait
+#pragma omp for SIMD() schedule(dynamic) collapse(2) nowait
 #endif
 
     for(int top = winy - 16; top < winy + height; top += ts - 32)
@@ -490,6 +506,9 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
         int ccmin = left < winx ? 16 : 0;
         int rrmax = bottom > (winy + height) ? winy + height - top : rr1;
         int ccmax = right > (winx + width) ? winx + width - left : cc1;
+        // tiles at the right and bottom edge are smaller, and some stages read past the part they write. with
+        // tiles handed out dynamically that would be whatever full tile this thread did before, so clear those.
+        if(rr1 < ts || cc1 < ts) memset(buffer, 0, buffersize);
 
 // rgb from input CFA data
 // rgb values should be floating point number between 0 and 1
@@ -1394,8 +1413,48 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 
 
         // populate G at R/B sites
+#ifdef __SSE2__
+        vfloat zd25v = F2V(0.25f);
+#endif
+
         for(int rr = 8; rr < rr1 - 8; rr++)
-          for(int indx = rr * ts + 8 + (FC(rr, 2, filters) & 1); indx < rr * ts + cc1 - 8; indx += 2)
+        {
+          int indx = rr * ts + 8 + (FC(rr, 2, filters) & 1);
+
+#ifdef __SSE2__
+
+          // hvwt of the row above has already been updated, the one below not yet, so this runs across a row
+          // only. the scalar loop takes care of the rest of it.
+          for(; indx < rr * ts + cc1 - 14; indx += 8)
+          {
+            vfloat hvwtaltv = zd25v * (LVFU(hvwt[(indx - m1) >> 1]) + LVFU(hvwt[(indx + p1) >> 1])
+                                       + LVFU(hvwt[(indx - p1) >> 1]) + LVFU(hvwt[(indx + m1) >> 1]));
+            vfloat hvwtv = LVFU(hvwt[indx >> 1]);
+            hvwtv = vself(vmaskf_lt(vabsf(zd5v - hvwtv), vabsf(zd5v - hvwtaltv)), hvwtaltv, hvwtv);
+            STVFU(hvwt[indx >> 1], hvwtv);
+
+            vfloat Dgrbv = vintpf(hvwtv, LC2VFU(vcd[indx]), LC2VFU(hcd[indx]));
+            STVFU(Dgrb[0][indx >> 1], Dgrbv);
+            vfloat greenv = LC2VFU(cfa[indx]) + Dgrbv;
+            STC2VFU(rgbgreen[indx], greenv);
+
+            // local curvature in G, only where there is nyquist texture
+            int nyq;
+            memcpy(&nyq, &nyquist2[indx >> 1], sizeof(int));
+            vint nyqv = _mm_cvtsi32_si128(nyq);
+            nyqv = _mm_unpacklo_epi16(_mm_unpacklo_epi8(nyqv, _mm_setzero_si128()), _mm_setzero_si128());
+            vmask nyqmask = vnotm(_mm_cmpeq_epi32(nyqv, _mm_setzero_si128()));
+            vfloat Dgrb2hv = (vfloat)vandm(
+                nyqmask, (vmask)SQRV(greenv - zd5v * (LC2VFU(rgbgreen[indx - 1]) + LC2VFU(rgbgreen[indx + 1]))));
+            vfloat Dgrb2vv = (vfloat)vandm(
+                nyqmask, (vmask)SQRV(greenv - zd5v * (LC2VFU(rgbgreen[indx - v1]) + LC2VFU(rgbgreen[indx + v1]))));
+            STVFU(Dgrb2[indx >> 1].h, _mm_unpacklo_ps(Dgrb2hv, Dgrb2vv));
+            STVFU(Dgrb2[(indx >> 1) + 2].h, _mm_unpackhi_ps(Dgrb2hv, Dgrb2vv));
+          }
+
+#endif
+
+          for(; indx < rr * ts + cc1 - 8; indx += 2)
           {
 
             // first ask if one gets more directional discrimination from nearby B/R sites
@@ -1419,6 +1478,7 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
                                      ? SQR(rgbgreen[indx] - xdiv2f(rgbgreen[indx - v1] + rgbgreen[indx + v1]))
                                      : 0.f;
           }
+        }
 
 
         // end of standard interpolation
@@ -1748,10 +1808,6 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 #endif
         }
 
-#ifdef __SSE2__
-        vfloat zd25v = F2V(0.25f);
-#endif
-
         for(int rr = 10; rr < rr1 - 10; rr++)
 #ifdef __SSE2__
           for(int indx = rr * ts + 10 + (FC(rr, 2, filters) & 1), indx1 = indx >> 1;
@@ -2394,11 +2450,11 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
         //         }
       }
     } // end of main loop
-
-    // clean up
-    free(buffer);
   }
 
+  // clean up
+  dt_dev_pixelpipe_scratch_free(piece->pipe, all_buffers);
+
   //   if(plistener)
   //   {
   //     plistener->setProgress(1.0);
@@ -1217,7 +1217,7 @@ static int detail_enhance(const float *in, float *out, const int width, const in
   }
 
   // bilateral grid detail enhancement
-  dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+  dt_bilateral_t *b = dt_bilateral_init(NULL, width, height, sigma_s, sigma_r);
 
   if(b != NULL)
   {
@@ -835,7 +835,7 @@ static inline void apply_ev_and_curve(
       const float f = inp[i] * mul;
       // use base curve for values < 1, else use extrapolation.
       if(f < 1.0f)
-        outp[i] = table[CLAMP((int)(f * 0x10000ul), 0, 0xffff)];
+        outp[i] = dt_lut_lookup(table, f);
       else if(unbounded_coeffs)
         outp[i] = dt_iop_eval_exp(unbounded_coeffs, f);
       else outp[i] = 1.0f;
@@ -1132,27 +1132,25 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 void process_lut(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  const float *const in = (const float *)ivoid;
-  float *const out = (float *)ovoid;
+  const float *in = (const float *)ivoid;
+  float *out = (float *)ovoid;
   const int ch = piece->colors;
   dt_iop_basecurve_data_t *const d = (dt_iop_basecurve_data_t *)(piece->data);
 
+  // use base curve for values < 1, else use extrapolation.
+  dt_lut_curve_t curves[3] = { { d->table, d->unbounded_coeffs, 1.0f },
+                               { d->table, d->unbounded_coeffs, 1.0f },
+                               { d->table, d->unbounded_coeffs, 1.0f } };
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
+#pragma omp parallel for default(none) shared(in, out, curves) schedule(static)
 #endif
-  for(size_t k = 0; k < (size_t)roi_out->width * roi_out->height; k++)
+  for(int j = 0; j < height; j++)
   {
-    const float *inp = in + ch * k;
-    float *outp = out + ch * k;
-    for(int i = 0; i < 3; i++)
-    {
-      // use base curve for values < 1, else use extrapolation.
-      if(inp[i] < 1.0f)
-        outp[i] = d->table[CLAMP((int)(inp[i] * 0x10000ul), 0, 0xffff)];
-      else
-        outp[i] = dt_iop_eval_exp(d->unbounded_coeffs, inp[i]);
-    }
-    outp[3] = inp[3];
+    const size_t offs = (size_t)ch * width * j;
+    dt_lut_apply_rgb(in + offs, out + offs, width, ch, curves);
   }
 }
 
@@ -1203,10 +1201,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   // now the extrapolation stuff:
   const float xm = p->basecurve[0][p->basecurve_nodes[0] - 1].x;
   const float x[4] = { 0.7f * xm, 0.8f * xm, 0.9f * xm, 1.0f * xm };
-  const float y[4] = { d->table[CLAMP((int)(x[0] * 0x10000ul), 0, 0xffff)],
-                       d->table[CLAMP((int)(x[1] * 0x10000ul), 0, 0xffff)],
-                       d->table[CLAMP((int)(x[2] * 0x10000ul), 0, 0xffff)],
-                       d->table[CLAMP((int)(x[3] * 0x10000ul), 0, 0xffff)] };
+  const float y[4] = { dt_lut_lookup(d->table, x[0]), dt_lut_lookup(d->table, x[1]),
+                       dt_lut_lookup(d->table, x[2]), dt_lut_lookup(d->table, x[3]) };
   dt_iop_estimate_exp(x, y, 4, d->unbounded_coeffs);
 }
 
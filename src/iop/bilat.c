@@ -276,7 +276,7 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 
   if(d->mode == s_mode_bilateral)
   {
-    dt_bilateral_t *b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
+    dt_bilateral_t *b = dt_bilateral_init(piece->pipe, roi_in->width, roi_in->height, sigma_s, sigma_r);
     dt_bilateral_splat(b, (float *)i);
     dt_bilateral_blur(b);
     dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
@@ -363,7 +363,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   if(d->mode == s_mode_bilateral)
   {
-    dt_bilateral_t *b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
+    dt_bilateral_t *b = dt_bilateral_init(piece->pipe, roi_in->width, roi_in->height, sigma_s, sigma_r);
     dt_bilateral_splat(b, (float *)i);
     dt_bilateral_blur(b);
     dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
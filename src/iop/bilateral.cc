@@ -76,7 +76,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_SKIP_IN_THUMBNAILS;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
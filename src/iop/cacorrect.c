@@ -69,7 +69,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_SKIP_IN_THUMBNAILS;
 }
 
 /** modify regions of interest (optional, per pixel ops don't need this) */
@@ -24,6 +24,7 @@
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/tiling.h"
 #include "dtgtk/resetlabel.h"
 #include "gui/gtk.h"
 #include "iop/iop_api.h"
@@ -73,7 +74,132 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_DEPRECATED;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_DEPRECATED | IOP_FLAGS_ALLOW_TILING;
+}
+
+#define BINS (256)
+
+// above this window height, sliding per-column histograms down the image is cheaper
+// than adding and removing a full column of pixels for every output pixel.
+#define COLUMN_HISTOGRAM_MIN_HEIGHT (BINS + 1)
+
+static inline int _bin(const float *const luminance, const size_t k)
+{
+  return ROUND_POSISTIVE(luminance[k] * (float)BINS);
+}
+
+/* clip histogram, redistribute clipped entries and map v through the cdf */
+static float _clahe_value(const int *const hist, int *const clippedhist, const int v, const int limit)
+{
+  memcpy(clippedhist, hist, (BINS + 1) * sizeof(int));
+  int ce = 0, ceb = 0;
+  do
+  {
+    ceb = ce;
+    ce = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      int d = clippedhist[b] - limit;
+      if(d > 0)
+      {
+        ce += d;
+        clippedhist[b] = limit;
+      }
+    }
+
+    int d = (ce / (float)(BINS + 1));
+    int m = ce % (BINS + 1);
+    for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
+
+    if(m != 0)
+    {
+      int s = BINS / (float)m;
+      for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
+    }
+  } while(ce != ceb);
+
+  /* build cdf of clipped histogram */
+  unsigned int hMin = BINS;
+  for(int b = 0; b < hMin; b++)
+    if(clippedhist[b] != 0) hMin = b;
+
+  int cdf = 0;
+  for(int b = hMin; b <= v; b++) cdf += clippedhist[b];
+
+  int cdfMax = cdf;
+  for(int b = v + 1; b <= BINS; b++) cdfMax += clippedhist[b];
+
+  int cdfMin = clippedhist[hMin];
+
+  return (cdf - cdfMin) / (float)(cdfMax - cdfMin);
+}
+
+/* equalize one row. colhist, if given, holds per-column histograms of rows [yMin, yMax) */
+static void _clahe_row(const float *const luminance, const int *const colhist, float *const dest, const int j,
+                       const int width, const int height, const int rad, const float slope)
+{
+  const int yMin = fmax(0, j - rad);
+  const int yMax = fmin(height, j + rad + 1);
+  const int h = yMax - yMin;
+
+  const int xMin0 = fmax(0, 0 - rad);
+  const int xMax0 = fmin(width - 1, rad);
+
+  int hist[BINS + 1];
+  int clippedhist[BINS + 1];
+
+  /* initially fill histogram */
+  memset(hist, 0, (BINS + 1) * sizeof(int));
+  if(colhist)
+  {
+    for(int xi = xMin0; xi < xMax0; ++xi)
+      for(int b = 0; b <= BINS; b++) hist[b] += colhist[(size_t)xi * (BINS + 1) + b];
+  }
+  else
+  {
+    for(int yi = yMin; yi < yMax; ++yi)
+      for(int xi = xMin0; xi < xMax0; ++xi) ++hist[_bin(luminance, (size_t)yi * width + xi)];
+  }
+
+  for(int i = 0; i < width; i++)
+  {
+    const int v = _bin(luminance, (size_t)j * width + i);
+
+    const int xMin = fmax(0, i - rad);
+    const int xMax = i + rad + 1;
+    const int w = fmin(width, xMax) - xMin;
+    const int n = h * w;
+
+    const int limit = (int)(slope * n / BINS + 0.5f);
+
+    /* remove left behind values from histogram */
+    if(xMin > 0)
+    {
+      const int xMin1 = xMin - 1;
+      if(colhist)
+      {
+        const int *const c = colhist + (size_t)xMin1 * (BINS + 1);
+        for(int b = 0; b <= BINS; b++) hist[b] -= c[b];
+      }
+      else
+        for(int yi = yMin; yi < yMax; ++yi) --hist[_bin(luminance, (size_t)yi * width + xMin1)];
+    }
+
+    /* add newly included values to histogram */
+    if(xMax <= width)
+    {
+      const int xMax1 = xMax - 1;
+      if(colhist)
+      {
+        const int *const c = colhist + (size_t)xMax1 * (BINS + 1);
+        for(int b = 0; b <= BINS; b++) hist[b] += c[b];
+      }
+      else
+        for(int yi = yMin; yi < yMax; ++yi) ++hist[_bin(luminance, (size_t)yi * width + xMax1)];
+    }
+
+    dest[i] = _clahe_value(hist, clippedhist, v, limit);
+  }
 }
 
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -84,6 +210,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   // PASS1: Get a luminance map of image...
   float *luminance = (float *)malloc(((size_t)roi_out->width * roi_out->height) * sizeof(float));
+  if(!luminance)
+  {
+    fprintf(stderr, "[clahe] not able to allocate the luminance map\n");
+    memcpy(ovoid, ivoid, sizeof(float) * ch * roi_out->width * roi_out->height);
+    return;
+  }
 // double lsmax=0.0,lsmin=1.0;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) schedule(static) shared(luminance)
@@ -105,139 +237,113 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   // Params
   const int rad = data->radius * roi_in->scale / piece->iscale;
-
-#define BINS (256)
-
   const float slope = data->slope;
+  const int width = roi_in->width;
+  const int height = roi_in->height;
 
-  const size_t destbuf_size = roi_out->width;
-  float *const dest_buf = malloc(destbuf_size * sizeof(float) * dt_get_num_threads());
+  // every thread works on its own band of rows. for large radii it walks down the band
+  // keeping one histogram per column of the window's rows up to date.
+  const int nbands = MIN(dt_get_num_threads(), roi_out->height);
+  const int band_height = (roi_out->height + nbands - 1) / nbands;
+
+  float *const dests = malloc(sizeof(float) * roi_out->width * nbands);
+  if(!dests)
+  {
+    fprintf(stderr, "[clahe] not able to allocate row buffers\n");
+    memcpy(ovoid, ivoid, sizeof(float) * ch * roi_out->width * roi_out->height);
+    free(luminance);
+    return;
+  }
+  // without the column histograms every pixel updates the histogram by itself, same result, only slower
+  int *colhists = NULL;
+  if((2 * rad + 1) >= COLUMN_HISTOGRAM_MIN_HEIGHT)
+  {
+    colhists = malloc(sizeof(int) * (size_t)width * (BINS + 1) * nbands);
+    if(!colhists) fprintf(stderr, "[clahe] not able to allocate column histograms, falling back to the slow path\n");
+  }
 
 // CLAHE
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static) shared(luminance)
+#pragma omp parallel for default(none) schedule(static) shared(luminance, colhists)
 #endif
-  for(int j = 0; j < roi_out->height; j++)
+  for(int band = 0; band < nbands; band++)
   {
-    int yMin = fmax(0, j - rad);
-    int yMax = fmin(roi_in->height, j + rad + 1);
-    int h = yMax - yMin;
-
-    int xMin0 = fmax(0, 0 - rad);
-    int xMax0 = fmin(roi_in->width - 1, rad);
-
-    int hist[BINS + 1];
-    int clippedhist[BINS + 1];
-
-    float *dest = dest_buf + destbuf_size * dt_get_thread_num();
-
-    /* initially fill histogram */
-    memset(hist, 0, (BINS + 1) * sizeof(int));
-    for(int yi = yMin; yi < yMax; ++yi)
-      for(int xi = xMin0; xi < xMax0; ++xi)
-        ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xi] * (float)BINS)];
-
-    // Destination row
-    memset(dest, 0, roi_out->width * sizeof(float));
-    float *ld = dest;
+    const int j0 = band * band_height;
+    const int j1 = MIN(roi_out->height, j0 + band_height);
 
-    for(int i = 0; i < roi_out->width; i++)
+    float *const dest = dests + (size_t)roi_out->width * band;
+    int *const colhist = colhists ? colhists + (size_t)width * (BINS + 1) * band : NULL;
+    int yMin = 0, yMax = 0;
+    if(colhist)
     {
+      memset(colhist, 0, sizeof(int) * (size_t)width * (BINS + 1));
+      yMin = fmax(0, j0 - rad);
+      yMax = fmin(height, j0 + rad + 1);
+      for(int yi = yMin; yi < yMax; ++yi)
+        for(int xi = 0; xi < width; ++xi)
+          ++colhist[(size_t)xi * (BINS + 1) + _bin(luminance, (size_t)yi * width + xi)];
+    }
 
-      int v = ROUND_POSISTIVE(luminance[(size_t)j * roi_in->width + i] * (float)BINS);
-
-      int xMin = fmax(0, i - rad);
-      int xMax = i + rad + 1;
-      int w = fmin(roi_in->width, xMax) - xMin;
-      int n = h * w;
-
-      int limit = (int)(slope * n / BINS + 0.5f);
-
-      /* remove left behind values from histogram */
-      if(xMin > 0)
+    for(int j = j0; j < j1; j++)
+    {
+      if(colhist)
       {
-        int xMin1 = xMin - 1;
-        for(int yi = yMin; yi < yMax; ++yi)
-          --hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMin1] * (float)BINS)];
+        // slide the column histograms down to rows [j - rad, j + rad]
+        const int yMinj = fmax(0, j - rad);
+        const int yMaxj = fmin(height, j + rad + 1);
+        for(; yMin < yMinj; yMin++)
+          for(int xi = 0; xi < width; ++xi)
+            --colhist[(size_t)xi * (BINS + 1) + _bin(luminance, (size_t)yMin * width + xi)];
+        for(; yMax < yMaxj; yMax++)
+          for(int xi = 0; xi < width; ++xi)
+            ++colhist[(size_t)xi * (BINS + 1) + _bin(luminance, (size_t)yMax * width + xi)];
       }
 
-      /* add newly included values to histogram */
-      if(xMax <= roi_in->width)
-      {
-        int xMax1 = xMax - 1;
-        for(int yi = yMin; yi < yMax; ++yi)
-          ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMax1] * (float)BINS)];
-      }
+      _clahe_row(luminance, colhist, dest, j, width, height, rad, slope);
 
-      /* clip histogram and redistribute clipped entries */
-      memcpy(clippedhist, hist, (BINS + 1) * sizeof(int));
-      int ce = 0, ceb = 0;
-      do
+      // Apply row
+      float *in = ((float *)ivoid) + (size_t)j * roi_out->width * ch;
+      float *out = ((float *)ovoid) + (size_t)j * roi_out->width * ch;
+      for(int r = 0; r < roi_out->width; r++)
       {
-        ceb = ce;
-        ce = 0;
-        for(int b = 0; b <= BINS; b++)
-        {
-          int d = clippedhist[b] - limit;
-          if(d > 0)
-          {
-            ce += d;
-            clippedhist[b] = limit;
-          }
-        }
-
-        int d = (ce / (float)(BINS + 1));
-        int m = ce % (BINS + 1);
-        for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
-
-        if(m != 0)
-        {
-          int s = BINS / (float)m;
-          for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
-        }
-      } while(ce != ceb);
-
-      /* build cdf of clipped histogram */
-      unsigned int hMin = BINS;
-      for(int b = 0; b < hMin; b++)
-        if(clippedhist[b] != 0) hMin = b;
-
-      int cdf = 0;
-      for(int b = hMin; b <= v; b++) cdf += clippedhist[b];
-
-      int cdfMax = cdf;
-      for(int b = v + 1; b <= BINS; b++) cdfMax += clippedhist[b];
-
-      int cdfMin = clippedhist[hMin];
-
-      *ld = (cdf - cdfMin) / (float)(cdfMax - cdfMin);
-
-      ld++;
-    }
-
-    // Apply row
-    float *in = ((float *)ivoid) + (size_t)j * roi_out->width * ch;
-    float *out = ((float *)ovoid) + (size_t)j * roi_out->width * ch;
-    for(int r = 0; r < roi_out->width; r++)
-    {
-      float H, S, L;
-      rgb2hsl(in, &H, &S, &L);
-      // hsl2rgb(out,H,S,( L / dest[r] ) * (L-lsmin) + lsmin );
-      hsl2rgb(out, H, S, dest[r]);
-      out += ch;
-      in += ch;
-      ld++;
+        float H, S, L;
+        rgb2hsl(in, &H, &S, &L);
+        // hsl2rgb(out,H,S,( L / dest[r] ) * (L-lsmin) + lsmin );
+        hsl2rgb(out, H, S, dest[r]);
+        out += ch;
+        in += ch;
+      }
     }
   }
 
-  free(dest_buf);
-
   // Cleanup
+  free(colhists);
+  free(dests);
   free(luminance);
+}
 
-#undef BINS
+void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                     const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
+                     struct dt_develop_tiling_t *tiling)
+{
+  dt_iop_rlce_data_t *d = (dt_iop_rlce_data_t *)piece->data;
+  const int rad = d->radius * roi_in->scale / piece->iscale;
+
+  tiling->factor = 2.0f + 1.0f / piece->colors; // in + out + luminance
+  tiling->maxbuf = 1.0f;
+  // per-thread column histograms for large radii
+  tiling->overhead = ((2 * rad + 1) >= COLUMN_HISTOGRAM_MIN_HEIGHT)
+                         ? (size_t)roi_in->width * (BINS + 1) * sizeof(int) * dt_get_num_threads()
+                         : 0;
+  tiling->overlap = rad;
+  tiling->xalign = 1;
+  tiling->yalign = 1;
+  return;
 }
 
+#undef COLUMN_HISTOGRAM_MIN_HEIGHT
+#undef BINS
+
 static void radius_callback(GtkWidget *slider, gpointer user_data)
 {
   dt_iop_module_t *self = (dt_iop_module_t *)user_data;
@@ -24,6 +24,7 @@
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/image_cache.h"
+#include "common/lut3d.h"
 #include "common/opencl.h"
 #include "control/control.h"
 #include "develop/develop.h"
@@ -51,7 +52,7 @@
 // max iccprofile file name length
 #define DT_IOP_COLOR_ICC_LEN 100
 
-#define LUT_SAMPLES 0x10000
+#define LUT_SAMPLES DT_LUT_SIZE
 
 DT_MODULE_INTROSPECTION(4, dt_iop_colorin_params_t)
 
@@ -96,6 +97,7 @@ typedef struct dt_iop_colorin_data_t
   cmsHTRANSFORM *xform_cam_Lab;
   cmsHTRANSFORM *xform_cam_nrgb;
   cmsHTRANSFORM *xform_nrgb_Lab;
+  dt_lut3d_t *clut; // the lcms2 transforms baked into a 3d lut
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   float nmatrix[9];
@@ -353,17 +355,6 @@ static void normalize_changed(GtkWidget *widget, gpointer user_data)
 }
 
 
-static float lerp_lut(const float *const lut, const float v)
-{
-  // TODO: check if optimization is worthwhile!
-  const float ft = CLAMPS(v * (LUT_SAMPLES - 1), 0, LUT_SAMPLES - 1);
-  const int t = ft < LUT_SAMPLES - 2 ? ft : LUT_SAMPLES - 2;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -496,7 +487,7 @@ static void process_cmatrix_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? lerp_lut(d->lut[c], in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? dt_lut_lookup_linear(d->lut[c], in[c])
                                                           : dt_iop_eval_exp(d->unbounded_coeffs[c], in[c]))
                                         : in[c];
 
@@ -672,7 +663,7 @@ static void process_cmatrix_proper(struct dt_iop_module_t *self, dt_dev_pixelpip
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? lerp_lut(d->lut[c], in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? dt_lut_lookup_linear(d->lut[c], in[c])
                                                           : dt_iop_eval_exp(d->unbounded_coeffs[c], in[c]))
                                         : in[c];
 
@@ -745,6 +736,41 @@ static void process_cmatrix(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t
   }
 }
 
+// the general lcms2 fallback, as a dt_lut3d_eval_t
+static void transform_lcms2(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)data;
+
+  if(!d->nrgb)
+  {
+    cmsDoTransform(d->xform_cam_Lab, in, out, npixels);
+  }
+  else
+  {
+    cmsDoTransform(d->xform_cam_nrgb, in, out, npixels);
+
+    float *rgbptr = (float *)out;
+    for(size_t j = 0; j < npixels; j++, rgbptr += 4)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        rgbptr[c] = CLAMP(rgbptr[c], 0.0f, 1.0f);
+      }
+    }
+
+    cmsDoTransform(d->xform_nrgb_Lab, out, out, npixels);
+  }
+}
+
+static void transform_lcms2_row(const dt_iop_colorin_data_t *const d, const float *const in, float *const out,
+                                const int width)
+{
+  if(d->clut)
+    dt_lut3d_apply(d->clut, in, out, width, transform_lcms2, (void *)d);
+  else
+    transform_lcms2(in, out, width, (void *)d);
+}
+
 static void process_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                              void *const ovoid, const dt_iop_roi_t *const roi_in,
                              const dt_iop_roi_t *const roi_out)
@@ -768,25 +794,7 @@ static void process_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     }
 
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
-    if(!d->nrgb)
-    {
-      cmsDoTransform(d->xform_cam_Lab, out, out, roi_out->width);
-    }
-    else
-    {
-      cmsDoTransform(d->xform_cam_nrgb, out, out, roi_out->width);
-
-      float *rgbptr = (float *)out;
-      for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          rgbptr[c] = CLAMP(rgbptr[c], 0.0f, 1.0f);
-        }
-      }
-
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
-    }
+    transform_lcms2_row(d, out, out, roi_out->width);
   }
 }
 
@@ -807,25 +815,7 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
     float *out = (float *)ovoid + (size_t)ch * k * roi_out->width;
 
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
-    if(!d->nrgb)
-    {
-      cmsDoTransform(d->xform_cam_Lab, in, out, roi_out->width);
-    }
-    else
-    {
-      cmsDoTransform(d->xform_cam_nrgb, in, out, roi_out->width);
-
-      float *rgbptr = (float *)out;
-      for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          rgbptr[c] = CLAMP(rgbptr[c], 0.0f, 1.0f);
-        }
-      }
-
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
-    }
+    transform_lcms2_row(d, in, out, roi_out->width);
   }
 }
 
@@ -910,7 +900,7 @@ static void process_sse2_cmatrix_bm(struct dt_iop_module_t *self, dt_dev_pixelpi
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? lerp_lut(d->lut[c], buf_in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? dt_lut_lookup_linear(d->lut[c], buf_in[c])
                                                               : dt_iop_eval_exp(d->unbounded_coeffs[c], buf_in[c]))
                                         : buf_in[c];
 
@@ -1073,7 +1063,7 @@ static void process_sse2_cmatrix_proper(struct dt_iop_module_t *self, dt_dev_pix
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? lerp_lut(d->lut[c], buf_in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? dt_lut_lookup_linear(d->lut[c], buf_in[c])
                                                               : dt_iop_eval_exp(d->unbounded_coeffs[c], buf_in[c]))
                                         : buf_in[c];
 
@@ -1144,27 +1134,7 @@ static void process_sse2_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe
     }
 
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
-    if(!d->nrgb)
-    {
-      cmsDoTransform(d->xform_cam_Lab, out, out, roi_out->width);
-    }
-    else
-    {
-      cmsDoTransform(d->xform_cam_nrgb, out, out, roi_out->width);
-
-      float *rgbptr = (float *)out;
-      for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
-      {
-        const __m128 min = _mm_setzero_ps();
-        const __m128 max = _mm_set1_ps(1.0f);
-        const __m128 val = _mm_load_ps(rgbptr);
-        const __m128 result = _mm_max_ps(_mm_min_ps(val, max), min);
-        _mm_store_ps(rgbptr, result);
-      }
-      _mm_sfence();
-
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
-    }
+    transform_lcms2_row(d, out, out, roi_out->width);
   }
 }
 
@@ -1186,27 +1156,7 @@ static void process_sse2_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixel
     float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
-    if(!d->nrgb)
-    {
-      cmsDoTransform(d->xform_cam_Lab, in, out, roi_out->width);
-    }
-    else
-    {
-      cmsDoTransform(d->xform_cam_nrgb, in, out, roi_out->width);
-
-      float *rgbptr = (float *)out;
-      for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
-      {
-        const __m128 min = _mm_setzero_ps();
-        const __m128 max = _mm_set1_ps(1.0f);
-        const __m128 val = _mm_load_ps(rgbptr);
-        const __m128 result = _mm_max_ps(_mm_min_ps(val, max), min);
-        _mm_store_ps(rgbptr, result);
-      }
-      _mm_sfence();
-
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
-    }
+    transform_lcms2_row(d, in, out, roi_out->width);
   }
 }
 
@@ -1314,6 +1264,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_lut3d_release(d->clut);
+  d->clut = NULL;
 
   d->cmatrix[0] = d->nmatrix[0] = d->lmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
@@ -1517,6 +1469,20 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // the same profiles come up for every image of a film roll or an export job, bake the transforms into a
+  // shared 3d lut once. it approximates them to within 0.05 in Lab and uses lcms2 for the rest.
+  if(d->xform_cam_Lab)
+  {
+    uint64_t key = dt_lut3d_hash_profile(0, d->input);
+    if(key && d->nrgb) key = dt_lut3d_hash_profile(key, d->nrgb);
+    if(key)
+    {
+      const int xform[3] = { p->intent, input_format, d->nrgb != NULL };
+      key = dt_lut3d_hash(key, xform, sizeof(xform));
+      d->clut = dt_lut3d_get(key, DT_LUT3D_DOMAIN_RGB, 0.05f, transform_lcms2, d);
+    }
+  }
+
   d->nonlinearlut = 0;
 
   // now try to initialize unbounded mode:
@@ -1531,8 +1497,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       d->nonlinearlut++;
 
       const float x[4] = { 0.7f, 0.8f, 0.9f, 1.0f };
-      const float y[4] = { lerp_lut(d->lut[k], x[0]), lerp_lut(d->lut[k], x[1]), lerp_lut(d->lut[k], x[2]),
-                           lerp_lut(d->lut[k], x[3]) };
+      const float y[4] = { dt_lut_lookup_linear(d->lut[k], x[0]), dt_lut_lookup_linear(d->lut[k], x[1]),
+                           dt_lut_lookup_linear(d->lut[k], x[2]), dt_lut_lookup_linear(d->lut[k], x[3]) };
       dt_iop_estimate_exp(x, y, 4, d->unbounded_coeffs[k]);
     }
     else
@@ -1549,6 +1515,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   d->xform_cam_Lab = NULL;
   d->xform_cam_nrgb = NULL;
   d->xform_nrgb_Lab = NULL;
+  d->clut = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1571,6 +1538,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_lut3d_release(d->clut);
+  d->clut = NULL;
 
   free(piece->data);
   piece->data = NULL;
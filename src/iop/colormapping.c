@@ -511,7 +511,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     if(equalization > 0.001f)
     {
       // bilateral blur of delta L to avoid artifacts caused by limited histogram resolution
-      dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+      dt_bilateral_t *b = dt_bilateral_init(piece->pipe, width, height, sigma_s, sigma_r);
       if(!b)
       {
         free(var_ratio);
@@ -22,6 +22,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
+#include "common/lut3d.h"
 #include "common/opencl.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -53,6 +54,7 @@ typedef struct dt_iop_colorout_data_t
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   cmsHTRANSFORM *xform;
+  dt_lut3d_t *clut; // xform baked into a 3d lut
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
@@ -86,7 +88,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_CACHE_FP16;
 }
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
@@ -210,6 +212,13 @@ static float lerp_lut(const float *const lut, const float v)
 }
 #endif
 
+// the lcms2 transform, as a dt_lut3d_eval_t
+static void transform_lcms2(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  const dt_iop_colorout_data_t *const d = (dt_iop_colorout_data_t *)data;
+  cmsDoTransform(d->xform, in, out, npixels);
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -372,7 +381,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      if(d->clut)
+        dt_lut3d_apply(d->clut, in, out, roi_out->width, transform_lcms2, (void *)d);
+      else
+        cmsDoTransform(d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -447,7 +459,10 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      if(d->clut)
+        dt_lut3d_apply(d->clut, in, out, roi_out->width, transform_lcms2, (void *)d);
+      else
+        cmsDoTransform(d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -518,6 +533,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_lut3d_release(d->clut);
+  d->clut = NULL;
   d->cmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -652,6 +669,19 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // without softproofing the transform only depends on the output profile, which stays the same for a whole
+  // export job. bake it into a shared 3d lut, accurate to 1/1024 and using lcms2 where it can't be.
+  if(d->xform && d->mode == DT_PROFILE_NORMAL && !force_lcms2)
+  {
+    uint64_t key = dt_lut3d_hash_profile(0, output);
+    if(key)
+    {
+      const int xform[2] = { out_intent, output_format };
+      key = dt_lut3d_hash(key, xform, sizeof(xform));
+      d->clut = dt_lut3d_get(key, DT_LUT3D_DOMAIN_LAB, 1.0f / 1024.0f, transform_lcms2, d);
+    }
+  }
+
   if(out_type == DT_COLORSPACE_DISPLAY) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
   // now try to initialize unbounded mode:
@@ -682,6 +712,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   piece->data = calloc(1, sizeof(dt_iop_colorout_data_t));
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   d->xform = NULL;
+  d->clut = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -693,6 +724,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_lut3d_release(d->clut);
+  d->clut = NULL;
 
   free(piece->data);
   piece->data = NULL;
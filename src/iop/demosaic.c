@@ -27,6 +27,8 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_scratch.h"
+#include "develop/thumbnail.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -156,6 +158,12 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
                        float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                        const uint32_t filters);
 
+// markesteijn_homogeneity.c, on tiles of the TS of xtrans_markesteijn_interpolate()
+void markesteijn_homogeneity(uint8_t *const homo_buf, uint8_t *const homosum_buf, const float *const drv_buf,
+                             const int ndir, const int pad_homo, const int pad_tile, const int mrow, const int mcol);
+void markesteijn_select_row(float *const orow, const uint8_t *const homosum_buf, const float *const rgb_buf,
+                            const int ndir, const int row, const int pad_tile, const int mcol);
+
 
 const char *name()
 {
@@ -525,10 +533,20 @@ static inline const short *const hexmap(const int row, const int col,
   return allhex[irow % 3][icol % 3];
 }
 
+/** size of the working space of one thread of xtrans_markesteijn_interpolate(): ~1.1 MB for 1 pass, ~2.1 MB for
+    3, which is more than the L2 cache of most cpus. it is not cut down: all ndir rgb tiles are read by the final
+    average and all ndir derivative tiles by the homogeneity maps, so neither can take the place of the other,
+    and a smaller tile would recompute more of its 12 or 17 pixel overlap. */
+static size_t markesteijn_buffer_size(const int passes)
+{
+  const int ndir = 4 << (passes > 1);
+  return (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
+}
+
 /*
    Frank Markesteijn's algorithm for Fuji X-Trans sensors
  */
-static void xtrans_markesteijn_interpolate(float *out, const float *const in,
+static void xtrans_markesteijn_interpolate(dt_dev_pixelpipe_iop_t *piece, float *out, const float *const in,
                                            const dt_iop_roi_t *const roi_out,
                                            const dt_iop_roi_t *const roi_in,
                                            const uint8_t (*const xtrans)[6], const int passes)
@@ -547,8 +565,10 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
   const int height = roi_out->height;
   const int ndir = 4 << (passes > 1);
 
-  const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
-  char *const all_buffers = (char *)dt_alloc_align(16, dt_get_num_threads() * buffer_size);
+  // the tiles of all threads, the same size on every run, so they come back from the scratch pool of the pipe
+  const size_t buffer_size = markesteijn_buffer_size(passes);
+  char *const all_buffers
+      = (char *)dt_dev_pixelpipe_scratch_alloc(piece->pipe, dt_get_num_threads() * buffer_size);
   if(!all_buffers)
   {
     printf("[demosaic] not able to allocate Markesteijn buffers\n");
@@ -924,76 +944,30 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
           }
       }
 
-      /* Build homogeneity maps from the derivatives:                   */
-      memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
+      /* Build homogeneity maps from the derivatives and their 5x5 sums: */
       const int pad_homo = (passes == 1) ? 10 : 15;
-      for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
-        {
-          float tr = FLT_MAX;
-          for(int d = 0; d < ndir; d++)
-            if(tr > drv[d][row][col]) tr = drv[d][row][col];
-          tr *= 8;
-          for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
-        }
-
-      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(int d = 0; d < ndir; d++)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
-        {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile-5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
-          {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
-          }
-        }
+      markesteijn_homogeneity((uint8_t *)homo, (uint8_t *)homosum, (const float *)drv, ndir, pad_homo,
+                              pad_tile, mrow, mcol);
 
       /* Average the most homogenous pixels for the final result:       */
       for(int row = pad_tile; row < mrow - pad_tile; row++)
-        for(int col = pad_tile; col < mcol - pad_tile; col++)
-        {
-          uint8_t hm[8] = { 0 };
-          uint8_t maxval = 0;
-          for(int d = 0; d < ndir; d++)
-          {
-            hm[d] = homosum[d][row][col];
-            maxval = (maxval < hm[d] ? hm[d] : maxval);
-          }
-          maxval -= maxval >> 3;
-          for(int d = 0; d < ndir - 4; d++)
-            if(hm[d] < hm[d + 4])
-              hm[d] = 0;
-            else if(hm[d] > hm[d + 4])
-              hm[d + 4] = 0;
-          float avg[4] = { 0.0f };
-          for(int d = 0; d < ndir; d++)
-            if(hm[d] >= maxval)
-            {
-              for(int c = 0; c < 3; c++) avg[c] += rgb[d][row][col][c];
-              avg[3]++;
-            }
-          for(int c = 0; c < 3; c++)
-            out[4 * (width * (row + top) + col + left) + c] =
-              avg[c]/avg[3];
-        }
+        markesteijn_select_row(out + 4 * (width * (row + top) + left), (const uint8_t *)homosum,
+                               (const float *)rgb, ndir, row, pad_tile, mcol);
     }
   }
-  dt_free_align(all_buffers);
+  dt_dev_pixelpipe_scratch_free(piece->pipe, all_buffers);
 }
 
 #undef TS
 
 #define TS 122
+/** size of the working space of one thread of xtrans_fdc_interpolate() */
+static size_t fdc_buffer_size(void)
+{
+  const int ndir = 4;
+  return (size_t)TS * TS * (ndir * 4 + 7) * sizeof(float);
+}
+
 static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, const float *const in,
                                    const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in,
                                    const uint8_t (*const xtrans)[6])
@@ -1540,7 +1514,7 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
               1.246697e-03f - 3.053526e-19f * _Complex_I, -1.773498e-03f + 6.515727e-19f * _Complex_I,
               1.221201e-03f - 5.982162e-19f * _Complex_I } } };
 
-  const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 7) * sizeof(float);
+  const size_t buffer_size = fdc_buffer_size();
   char *const all_buffers = (char *)dt_alloc_align(16, dt_get_num_threads() * buffer_size);
   if(!all_buffers)
   {
@@ -2700,26 +2674,6 @@ static int get_quality()
   return qual;
 }
 
-static int get_thumb_quality(int width, int height)
-{
-  // we check if we need ultra-high quality thumbnail for this size
-  char *min = dt_conf_get_string("plugins/lighttable/thumbnail_hq_min_level");
-
-  int level = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, width, height);
-  int res = 0;
-  if (strcmp(min, "always")==0) res = 1;
-  else if (strcmp(min, "small")==0) res = ( level >= 1 );
-  else if (strcmp(min, "VGA")==0) res = ( level >= 2 );
-  else if (strcmp(min, "720p")==0) res = ( level >= 3 );
-  else if (strcmp(min, "1080p")==0) res = ( level >= 4 );
-  else if (strcmp(min, "WQXGA")==0) res = ( level >= 5 );
-  else if (strcmp(min, "4k")==0) res = ( level >= 6 );
-  else if (strcmp(min, "5K")==0) res = ( level >= 7 );
-
-  g_free(min);
-  return res;
-}
-
 // set flags for demosaic quality based on factors besides demosaic
 // method (e.g. config, scale, pixelpipe type)
 static int demosaic_qual_flags(const dt_dev_pixelpipe_iop_t *const piece,
@@ -2743,7 +2697,7 @@ static int demosaic_qual_flags(const dt_dev_pixelpipe_iop_t *const piece,
       break;
     case DT_DEV_PIXELPIPE_THUMBNAIL:
       // we check if we need ultra-high quality thumbnail for this size
-      if (get_thumb_quality(roi_out->width, roi_out->height))
+      if (dt_dev_thumbnail_high_quality(roi_out->width, roi_out->height))
       {
         flags |= DEMOSAIC_FULL_SCALE | DEMOSAIC_XTRANS_FULL;
       }
@@ -2830,7 +2784,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       if(demosaicing_method == DT_IOP_DEMOSAIC_FDC && (qual_flags & DEMOSAIC_XTRANS_FULL))
         xtrans_fdc_interpolate(self, tmp, pixels, &roo, &roi, xtrans);
       else if(demosaicing_method >= DT_IOP_DEMOSAIC_MARKESTEIJN && (qual_flags & DEMOSAIC_XTRANS_FULL))
-        xtrans_markesteijn_interpolate(tmp, pixels, &roo, &roi, xtrans,
+        xtrans_markesteijn_interpolate(piece, tmp, pixels, &roo, &roi, xtrans,
                                        1 + (demosaicing_method - DT_IOP_DEMOSAIC_MARKESTEIJN) * 2);
       else
         vng_interpolate(tmp, pixels, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR);
@@ -4625,10 +4579,6 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     const int overlap = (demosaicing_method == DT_IOP_DEMOSAIC_MARKESTEIJN_3) ? 17 : 12;
 
     tiling->factor = 1.0f + ioratio;
-    tiling->factor += ndir * 1.0f      // rgb
-                      + ndir * 0.25f   // drv
-                      + ndir * 0.125f  // homo + homosum
-                      + 1.0f;          // aux
 
     if(full_scale_demosaicing && unscaled)
       tiling->factor += fmax(1.0f + greeneq, smooth);
@@ -4637,8 +4587,21 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     else
       tiling->factor += smooth;
 
+    // on the cpu all the directional data lives in fixed size tiles, one per thread. the opencl code keeps
+    // full size buffers of it instead.
+    const size_t thread_buffer = (demosaicing_method == DT_IOP_DEMOSAIC_FDC)
+                                     ? fdc_buffer_size()
+                                     : markesteijn_buffer_size(ndir == 8 ? 3 : 1);
     tiling->maxbuf = 1.0f;
-    tiling->overhead = 0;
+    tiling->overhead = dt_get_num_threads() * thread_buffer;
+
+    tiling->factor_cl = tiling->factor
+                        + ndir * 1.0f      // rgb
+                        + ndir * 0.25f     // drv
+                        + ndir * 0.125f    // homo + homosum
+                        + 1.0f;            // aux
+    tiling->maxbuf_cl = 1.0f;
+    tiling->overhead_cl = 0;
     tiling->xalign = 3;
     tiling->yalign = 3;
     tiling->overlap = overlap;
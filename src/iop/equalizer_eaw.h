@@ -35,6 +35,9 @@ static void dt_iop_equalizer_wtf(float *buf, float **weight_a, const int l, cons
   int ch = 0;
   // store weights for luma channel only, chroma uses same basis.
   memset(weight_a[l], 0, (size_t)sizeof(float) * wd * ht);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) firstprivate(ch) schedule(static)
+#endif
   for(int j = 0; j < ht - 1; j++)
     for(int i = 0; i < wd - 1; i++) weight_a[l][(size_t)j * wd + i] = gbuf(buf, i << (l - 1), j << (l - 1));
 
@@ -71,35 +74,54 @@ static void dt_iop_equalizer_wtf(float *buf, float **weight_a, const int l, cons
 
   free((void *)tmp_width_buf);
 
-  float *const tmp_height_buf = (float *)malloc(height * dt_get_num_threads() * sizeof(float));
+  // cols, processed a whole row at a time so that consecutive pixels are touched.
+  // predict, get detail
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(weight_a, buf) private(ch) schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int j = st; j < height; j += step)
   {
-    // cols
-    // precompute weights:
-    float *tmp = tmp_height_buf + height * dt_get_thread_num();
-    for(int j = 0; j < height - st; j += st) tmp[j] = gweight(i, j, i, j + st);
-    int j = st;
-    // predict, get detail
-    for(; j < height - st; j += step)
-      for(ch = 0; ch < 3; ch++)
-        gbuf(buf, i, j) -= (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
-                           / (tmp[j - st] + tmp[j]);
-    if(j < height)
-      for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i, j - st);
-    // update
-    for(ch = 0; ch < 3; ch++) gbuf(buf, i, 0) += gbuf(buf, i, st) * 0.5;
-    for(j = step; j < height - st; j += step)
-      for(ch = 0; ch < 3; ch++)
-        gbuf(buf, i, j) += (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
-                           / (2.0 * (tmp[j - st] + tmp[j]));
-    if(j < height)
-      for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i, j - st) * .5f;
+    if(j < height - st)
+    {
+      for(int i = 0; i < width; i++)
+      {
+        const float wa = gweight(i, j - st, i, j), wb = gweight(i, j, i, j + st);
+        for(ch = 0; ch < 3; ch++)
+          gbuf(buf, i, j) -= (wa * gbuf(buf, i, j - st) + wb * gbuf(buf, i, j + st)) / (wa + wb);
+      }
+    }
+    else
+    {
+      for(int i = 0; i < width; i++)
+        for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i, j - st);
+    }
+  }
+  // update coarse
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) private(ch) schedule(static)
+#endif
+  for(int j = 0; j < height; j += step)
+  {
+    if(j == 0)
+    {
+      for(int i = 0; i < width; i++)
+        for(ch = 0; ch < 3; ch++) gbuf(buf, i, 0) += gbuf(buf, i, st) * 0.5;
+    }
+    else if(j < height - st)
+    {
+      for(int i = 0; i < width; i++)
+      {
+        const float wa = gweight(i, j - st, i, j), wb = gweight(i, j, i, j + st);
+        for(ch = 0; ch < 3; ch++)
+          gbuf(buf, i, j) += (wa * gbuf(buf, i, j - st) + wb * gbuf(buf, i, j + st)) / (2.0 * (wa + wb));
+      }
+    }
+    else
+    {
+      for(int i = 0; i < width; i++)
+        for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i, j - st) * .5f;
+    }
   }
-
-  free((void *)tmp_height_buf);
 }
 
 static void dt_iop_equalizer_iwtf(float *buf, float **weight_a, const int l, const int width, const int height)
@@ -108,34 +130,54 @@ static void dt_iop_equalizer_iwtf(float *buf, float **weight_a, const int l, con
   const int st = step / 2;
   const int wd = (int)(1 + (width >> (l - 1)));
 
-  float *const tmp_height_buf = (float *)malloc(height * dt_get_num_threads() * sizeof(float));
+  // cols, processed a whole row at a time so that consecutive pixels are touched.
+  // update coarse
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(weight_a, buf) schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int j = 0; j < height; j += step)
   {
-    // cols
-    float *tmp = tmp_height_buf + height * dt_get_thread_num();
-    int j;
-    for(j = 0; j < height - st; j += st) tmp[j] = gweight(i, j, i, j + st);
-    // update coarse
-    for(int ch = 0; ch < 3; ch++) gbuf(buf, i, 0) -= gbuf(buf, i, st) * 0.5f;
-    for(j = step; j < height - st; j += step)
-      for(int ch = 0; ch < 3; ch++)
-        gbuf(buf, i, j) -= (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
-                           / (2.0 * (tmp[j - st] + tmp[j]));
-    if(j < height)
-      for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i, j - st) * .5f;
-    // predict
-    for(j = st; j < height - st; j += step)
-      for(int ch = 0; ch < 3; ch++)
-        gbuf(buf, i, j) += (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
-                           / (tmp[j - st] + tmp[j]);
-    if(j < height)
-      for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i, j - st);
+    if(j == 0)
+    {
+      for(int i = 0; i < width; i++)
+        for(int ch = 0; ch < 3; ch++) gbuf(buf, i, 0) -= gbuf(buf, i, st) * 0.5f;
+    }
+    else if(j < height - st)
+    {
+      for(int i = 0; i < width; i++)
+      {
+        const float wa = gweight(i, j - st, i, j), wb = gweight(i, j, i, j + st);
+        for(int ch = 0; ch < 3; ch++)
+          gbuf(buf, i, j) -= (wa * gbuf(buf, i, j - st) + wb * gbuf(buf, i, j + st)) / (2.0 * (wa + wb));
+      }
+    }
+    else
+    {
+      for(int i = 0; i < width; i++)
+        for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i, j - st) * .5f;
+    }
+  }
+  // predict
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) schedule(static)
+#endif
+  for(int j = st; j < height; j += step)
+  {
+    if(j < height - st)
+    {
+      for(int i = 0; i < width; i++)
+      {
+        const float wa = gweight(i, j - st, i, j), wb = gweight(i, j, i, j + st);
+        for(int ch = 0; ch < 3; ch++)
+          gbuf(buf, i, j) += (wa * gbuf(buf, i, j - st) + wb * gbuf(buf, i, j + st)) / (wa + wb);
+      }
+    }
+    else
+    {
+      for(int i = 0; i < width; i++)
+        for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i, j - st);
+    }
   }
-
-  free((void *)tmp_height_buf);
 
   float *const tmp_width_buf = (float *)malloc(width * dt_get_num_threads() * sizeof(float));
 #ifdef _OPENMP
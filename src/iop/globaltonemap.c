@@ -265,7 +265,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   dt_bilateral_t *b = NULL;
   if(data->detail != 0.0f)
   {
-    b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
+    b = dt_bilateral_init(piece->pipe, roi_in->width, roi_in->height, sigma_s, sigma_r);
     // get detail from unchanged input buffer
     dt_bilateral_splat(b, (float *)ivoid);
   }
@@ -37,8 +37,10 @@
 
 #include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
+#include "common/guided_filter.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/tiling.h"
 #include "gui/gtk.h"
 #include "iop/iop_api.h"
 
@@ -62,9 +64,15 @@ typedef struct dt_iop_hazeremoval_params_t
   float distance;
 } dt_iop_hazeremoval_params_t;
 
-// types  dt_iop_hazeremoval_params_t and dt_iop_hazeremoval_data_t are
-// equal, thus no commit_params function needs to be implemented
-typedef dt_iop_hazeremoval_params_t dt_iop_hazeremoval_data_t;
+typedef struct dt_iop_hazeremoval_data_t
+{
+  float strength;
+  float distance;
+  // ambient light and depth as estimated on the whole input of a tiled run, shared by all its
+  // tiles such that they are dehazed as if the image was processed in one go
+  rgb_pixel tile_A0;
+  float tile_distance_max;
+} dt_iop_hazeremoval_data_t;
 
 typedef struct dt_iop_hazeremoval_gui_data_t
 {
@@ -88,7 +96,7 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
 }
 
 int default_group()
@@ -96,6 +104,17 @@ int default_group()
   return IOP_GROUP_CORRECT;
 }
 
+void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
+                   dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_hazeremoval_params_t *p = (dt_iop_hazeremoval_params_t *)p1;
+  dt_iop_hazeremoval_data_t *d = (dt_iop_hazeremoval_data_t *)piece->data;
+
+  d->strength = p->strength;
+  d->distance = p->distance;
+  d->tile_distance_max = NAN;
+}
+
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = calloc(1, sizeof(dt_iop_hazeremoval_data_t));
@@ -209,11 +228,6 @@ void gui_cleanup(dt_iop_module_t *self)
 // module local functions and structures required by process function
 //----------------------------------------------------------------------
 
-typedef struct tile
-{
-  int left, right, lower, upper;
-} tile;
-
 typedef struct rgb_image
 {
   float *data;
@@ -251,18 +265,6 @@ static inline void copy_gray_image(gray_image img1, gray_image img2)
   memcpy(img2.data, img1.data, sizeof(float) * img1.width * img1.height);
 }
 
-// minimum of two integers
-static inline int min_i(int a, int b)
-{
-  return a < b ? a : b;
-}
-
-// maximum of two integers
-static inline int max_i(int a, int b)
-{
-  return a > b ? a : b;
-}
-
 // swap two floats
 static inline void swap_f(float a, float b)
 {
@@ -287,408 +289,185 @@ static inline void swap_pointer_f(float *a, float *b)
   b = t;
 }
 
-// calculate the one-dimensional moving average over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_mean_1d(int N, const float *x, float *y, size_t stride_y, int w)
+// size of the scratch buffer needed by box_max_1d and box_min_1d
+static inline size_t box_1d_bufsize(int N, int w)
 {
-  float m = 0, n_box = 0;
-  for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++)
-  {
-    m += x[i];
-    n_box++;
-  }
-  for(int i = 0; i < N; i++)
-  {
-    y[i * stride_y] = m / n_box;
-    if(i - w >= 0)
-    {
-      m -= x[i - w];
-      n_box--;
-    }
-    if(i + w + 1 < N)
-    {
-      m += x[i + w + 1];
-      n_box++;
-    }
-  }
+  return 2 * ((size_t)N + 4 * w + 1);
 }
 
-// calculate the two-dimensional moving average over a box of size (2*w+1) x (2*w+1)
-// does the calculation in-place if input and output images are identical
-// this function is always called from a OpenMP thread, thus no parallelization
-static void box_mean(gray_image img1, gray_image img2, int w)
-{
-  gray_image img2_bak;
-  if(img1.data == img2.data)
-  {
-    img2_bak = new_gray_image(max_i(img2.width, img2.height), 1);
-    for(int i1 = 0; i1 < img2.height; i1++)
-    {
-      memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
-      box_mean_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
-    }
-  }
-  else
-  {
-    for(int i1 = 0; i1 < img1.height; i1++)
-      box_mean_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
-    img2_bak = new_gray_image(1, img2.height);
-  }
-  for(int i0 = 0; i0 < img1.width; i0++)
+// calculate the one-dimensional moving maximum over a window of size 2*w+1
+// input array x has stride 1, output array y has stride stride_y
+// uses the van Herk/Gil-Werman algorithm: the input, padded by w on both sides, is cut into blocks of
+// size 2*w+1, such that every window spans exactly two blocks and its maximum is the maximum of a suffix
+// of the first and a prefix of the second block, i.e., O(1) operations per pixel independent of w and
+// of the image content
+static inline void box_max_1d(int N, const float *x, float *y, size_t stride_y, int w, float *buf)
+{
+  const int k = 2 * w + 1;
+  const int P = (N + 2 * w + k - 1) / k * k;
+  float *const g = buf;     // maxima of block prefixes
+  float *const h = buf + P; // maxima of block suffixes
+  for(int j = 0; j < w; j++) g[j] = h[j] = -(INFINITY);
+  for(int j = 0; j < N; j++) g[j + w] = h[j + w] = x[j];
+  for(int j = N + w; j < P; j++) g[j] = h[j] = -(INFINITY);
+  for(int b = 0; b < P; b += k)
   {
-    for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-    box_mean_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
+    for(int j = b + 1; j < b + k; j++) g[j] = fmaxf(g[j - 1], g[j]);
+    for(int j = b + k - 2; j >= b; j--) h[j] = fmaxf(h[j + 1], h[j]);
   }
-  free_gray_image(&img2_bak);
+  for(int i = 0; i < N; i++) y[i * stride_y] = fmaxf(h[i], g[i + 2 * w]);
 }
 
-// calculate the one-dimensional moving maximum over a window of size 2*w+1
+// calculate the one-dimensional moving minimum over a window of size 2*w+1
 // input array x has stride 1, output array y has stride stride_y
-static inline void box_max_1d(int N, const float *x, float *y, size_t stride_y, int w)
-{
-  float m = -(INFINITY);
-  for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++) m = fmaxf(x[i], m);
-  for(int i = 0; i < N; i++)
+// see box_max_1d for the algorithm
+static inline void box_min_1d(int N, const float *x, float *y, size_t stride_y, int w, float *buf)
+{
+  const int k = 2 * w + 1;
+  const int P = (N + 2 * w + k - 1) / k * k;
+  float *const g = buf;     // minima of block prefixes
+  float *const h = buf + P; // minima of block suffixes
+  for(int j = 0; j < w; j++) g[j] = h[j] = INFINITY;
+  for(int j = 0; j < N; j++) g[j + w] = h[j + w] = x[j];
+  for(int j = N + w; j < P; j++) g[j] = h[j] = INFINITY;
+  for(int b = 0; b < P; b += k)
   {
-    y[i * stride_y] = m;
-    if(i - w >= 0 && x[i - w] == m)
-    {
-      m = -(INFINITY);
-      for(int j = max_i(i - w + 1, 0), j_end = min_i(i + w + 2, N); j < j_end; j++) m = fmaxf(x[j], m);
-    }
-    if(i + w + 1 < N) m = fmaxf(x[i + w + 1], m);
+    for(int j = b + 1; j < b + k; j++) g[j] = fminf(g[j - 1], g[j]);
+    for(int j = b + k - 2; j >= b; j--) h[j] = fminf(h[j + 1], h[j]);
   }
+  for(int i = 0; i < N; i++) y[i * stride_y] = fminf(h[i], g[i + 2 * w]);
 }
 
-// calculate the two-dimensional moving maximum over a box of size (2*w+1) x (2*w+1)
-// does the calculation in-place if input and output images are identical
-static void box_max(const gray_image img1, const gray_image img2, const int w)
+// calculate the moving maximum over a window of size 2*w+1 along the columns of img, in-place
+static void box_max_columns(const gray_image img, const int w)
 {
-  gray_image img2_bak;
-  if(img1.data == img2.data)
-  {
 #ifdef _OPENMP
-#pragma omp parallel default(none) private(img2_bak)
+#pragma omp parallel
 #endif
-    {
-      img2_bak = new_gray_image(img2.width, 1);
-#ifdef _OPENMP
-#pragma omp for
-#endif
-      for(int i1 = 0; i1 < img2.height; i1++)
-      {
-        memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
-        box_max_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
-      }
-      free_gray_image(&img2_bak);
-    }
-  }
-  else
   {
+    gray_image column = new_gray_image(1, img.height);
+    gray_image buf = new_gray_image(box_1d_bufsize(img.height, w), 1);
 #ifdef _OPENMP
-#pragma omp parallel default(none) private(img2_bak)
-#endif
-    {
-#ifdef _OPENMP
-#pragma omp for
-#endif
-      for(int i1 = 0; i1 < img1.height; i1++)
-        box_max_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
-    }
-  }
-#ifdef _OPENMP
-#pragma omp parallel default(none) private(img2_bak)
-#endif
-  {
-    img2_bak = new_gray_image(1, img2.height);
-#ifdef _OPENMP
-#pragma omp for
+#pragma omp for schedule(static)
 #endif
-    for(int i0 = 0; i0 < img1.width; i0++)
+    for(int i0 = 0; i0 < img.width; i0++)
     {
-      for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-      box_max_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
+      for(int i1 = 0; i1 < img.height; i1++) column.data[i1] = img.data[i0 + (size_t)i1 * img.width];
+      box_max_1d(img.height, column.data, img.data + i0, img.width, w, buf.data);
     }
-    free_gray_image(&img2_bak);
+    free_gray_image(&buf);
+    free_gray_image(&column);
   }
 }
 
-// calculate the one-dimensional moving minimum over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_min_1d(int N, const float *x, float *y, size_t stride_y, int w)
+// calculate the moving minimum over a window of size 2*w+1 along the columns of img, in-place
+static void box_min_columns(const gray_image img, const int w)
 {
-  float m = INFINITY;
-  for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++) m = fminf(x[i], m);
-  for(int i = 0; i < N; i++)
-  {
-    y[i * stride_y] = m;
-    if(i - w >= 0 && x[i - w] == m)
-    {
-      m = INFINITY;
-      for(int j = max_i(i - w + 1, 0), j_end = min_i(i + w + 2, N); j < j_end; j++) m = fminf(x[j], m);
-    }
-    if(i + w + 1 < N) m = fminf(x[i + w + 1], m);
-  }
-}
-
-// calculate the two-dimensional moving minimum over a box of size (2*w+1) x (2*w+1)
-// does the calculation in-place if input and output images are identical
-static void box_min(const gray_image img1, const gray_image img2, const int w)
-{
-  gray_image img2_bak;
-  if(img1.data == img2.data)
-  {
-#ifdef _OPENMP
-#pragma omp parallel default(none) private(img2_bak)
-#endif
-    {
-      img2_bak = new_gray_image(img2.width, 1);
 #ifdef _OPENMP
-#pragma omp for
+#pragma omp parallel
 #endif
-      for(int i1 = 0; i1 < img2.height; i1++)
-      {
-        memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
-        box_min_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
-      }
-      free_gray_image(&img2_bak);
-    }
-  }
-  else
   {
+    gray_image column = new_gray_image(1, img.height);
+    gray_image buf = new_gray_image(box_1d_bufsize(img.height, w), 1);
 #ifdef _OPENMP
-#pragma omp parallel default(none) private(img2_bak)
+#pragma omp for schedule(static)
 #endif
+    for(int i0 = 0; i0 < img.width; i0++)
     {
-#ifdef _OPENMP
-#pragma omp for
-#endif
-      for(int i1 = 0; i1 < img1.height; i1++)
-        box_min_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
+      for(int i1 = 0; i1 < img.height; i1++) column.data[i1] = img.data[i0 + (size_t)i1 * img.width];
+      box_min_1d(img.height, column.data, img.data + i0, img.width, w, buf.data);
     }
+    free_gray_image(&buf);
+    free_gray_image(&column);
   }
+}
+
+// calculate the moving minimum over a window of size 2*w+1 along the rows of img, in-place
+static void box_min_rows(const gray_image img, const int w)
+{
 #ifdef _OPENMP
-#pragma omp parallel default(none) private(img2_bak)
+#pragma omp parallel
 #endif
   {
-    img2_bak = new_gray_image(1, img2.height);
+    gray_image row = new_gray_image(img.width, 1);
+    gray_image buf = new_gray_image(box_1d_bufsize(img.width, w), 1);
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
-    for(int i0 = 0; i0 < img1.width; i0++)
+    for(int i1 = 0; i1 < img.height; i1++)
     {
-      for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-      box_min_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
+      memcpy(row.data, img.data + (size_t)i1 * img.width, sizeof(float) * img.width);
+      box_min_1d(img.width, row.data, img.data + (size_t)i1 * img.width, 1, w, buf.data);
     }
-    free_gray_image(&img2_bak);
+    free_gray_image(&buf);
+    free_gray_image(&row);
   }
 }
 
 // calculate the dark channel (minimal color component over a box of size (2*w+1) x (2*w+1) )
+// the minimum over the color components is taken row by row right before the horizontal pass
 static void dark_channel(const const_rgb_image img1, const gray_image img2, const int w)
 {
-  const size_t size = (size_t)img1.height * img1.width;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
+#pragma omp parallel
 #endif
-  for(size_t i = 0; i < size; i++)
   {
-    const float *pixel = img1.data + i * img1.stride;
-    float m = pixel[0];
-    m = fminf(pixel[1], m);
-    m = fminf(pixel[2], m);
-    img2.data[i] = m;
+    gray_image row = new_gray_image(img1.width, 1);
+    gray_image buf = new_gray_image(box_1d_bufsize(img1.width, w), 1);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int i1 = 0; i1 < img1.height; i1++)
+    {
+      const float *pixel = img1.data + (size_t)i1 * img1.width * img1.stride;
+      for(int i0 = 0; i0 < img1.width; i0++, pixel += img1.stride)
+      {
+        float m = pixel[0];
+        m = fminf(pixel[1], m);
+        m = fminf(pixel[2], m);
+        row.data[i0] = m;
+      }
+      box_min_1d(img1.width, row.data, img2.data + (size_t)i1 * img2.width, 1, w, buf.data);
+    }
+    free_gray_image(&buf);
+    free_gray_image(&row);
   }
-  box_min(img2, img2, w);
+  box_min_columns(img2, w);
 }
 
-// calculate the transition map
+// calculate the transition map and refine it by a morphological closing, i.e., a moving maximum
+// followed by a moving minimum over boxes of size (2*w+1) x (2*w+1)
+// the transition estimate of every row goes straight into the horizontal pass of the maximum
 static void transition_map(const const_rgb_image img1, const gray_image img2, const int w, const float *const A0,
                            const float strength)
 {
-  const size_t size = (size_t)img1.height * img1.width;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
+#pragma omp parallel
 #endif
-  for(size_t i = 0; i < size; i++)
-  {
-    const float *pixel = img1.data + i * img1.stride;
-    float m = pixel[0] / A0[0];
-    m = fminf(pixel[1] / A0[1], m);
-    m = fminf(pixel[2] / A0[2], m);
-    img2.data[i] = 1.f - m * strength;
-  }
-  box_max(img2, img2, w);
-}
-
-// apply guided filter to single-component image img using the 3-components
-// image imgg as a guide
-static void guided_filter_tiling(const_rgb_image imgg, gray_image img, gray_image img_out, tile target, int w,
-                                 float eps)
-{
-  // to process the current tile also input data from the borders
-  // (of size 2*w) of the neighbouring tiles is required
-  const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
-                        max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
-  const int width = source.right - source.left;
-  const int height = source.upper - source.lower;
-  const size_t size = (size_t)width * height;
-  gray_image imgg_mean_r = new_gray_image(width, height);
-  gray_image imgg_mean_g = new_gray_image(width, height);
-  gray_image imgg_mean_b = new_gray_image(width, height);
-  gray_image img_mean = new_gray_image(width, height);
-  for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
-  {
-    size_t k = (size_t)(j_imgg - source.lower) * width;
-    size_t l = source.left + (size_t)j_imgg * imgg.width;
-    for(int i_imgg = source.left; i_imgg < source.right; i_imgg++, k++, l++)
-    {
-      const float *pixel = imgg.data + l * imgg.stride;
-      imgg_mean_r.data[k] = pixel[0];
-      imgg_mean_g.data[k] = pixel[1];
-      imgg_mean_b.data[k] = pixel[2];
-      img_mean.data[k] = img.data[l];
-    }
-  }
-  box_mean(imgg_mean_r, imgg_mean_r, w);
-  box_mean(imgg_mean_g, imgg_mean_g, w);
-  box_mean(imgg_mean_b, imgg_mean_b, w);
-  box_mean(img_mean, img_mean, w);
-  gray_image cov_imgg_img_r = new_gray_image(width, height);
-  gray_image cov_imgg_img_g = new_gray_image(width, height);
-  gray_image cov_imgg_img_b = new_gray_image(width, height);
-  gray_image var_imgg_rr = new_gray_image(width, height);
-  gray_image var_imgg_gg = new_gray_image(width, height);
-  gray_image var_imgg_bb = new_gray_image(width, height);
-  gray_image var_imgg_rg = new_gray_image(width, height);
-  gray_image var_imgg_rb = new_gray_image(width, height);
-  gray_image var_imgg_gb = new_gray_image(width, height);
-  for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
-  {
-    size_t k = (size_t)(j_imgg - source.lower) * width;
-    size_t l = source.left + (size_t)j_imgg * imgg.width;
-    for(int i_imgg = source.left; i_imgg < source.right; i_imgg++, k++, l++)
-    {
-      const float *pixel = imgg.data + l * imgg.stride;
-      cov_imgg_img_r.data[k] = pixel[0] * img.data[l];
-      cov_imgg_img_g.data[k] = pixel[1] * img.data[l];
-      cov_imgg_img_b.data[k] = pixel[2] * img.data[l];
-      var_imgg_rr.data[k] = pixel[0] * pixel[0];
-      var_imgg_rg.data[k] = pixel[0] * pixel[1];
-      var_imgg_rb.data[k] = pixel[0] * pixel[2];
-      var_imgg_gg.data[k] = pixel[1] * pixel[1];
-      var_imgg_gb.data[k] = pixel[1] * pixel[2];
-      var_imgg_bb.data[k] = pixel[2] * pixel[2];
-    }
-  }
-  box_mean(cov_imgg_img_r, cov_imgg_img_r, w);
-  box_mean(cov_imgg_img_g, cov_imgg_img_g, w);
-  box_mean(cov_imgg_img_b, cov_imgg_img_b, w);
-  box_mean(var_imgg_rr, var_imgg_rr, w);
-  box_mean(var_imgg_rg, var_imgg_rg, w);
-  box_mean(var_imgg_rb, var_imgg_rb, w);
-  box_mean(var_imgg_gg, var_imgg_gg, w);
-  box_mean(var_imgg_gb, var_imgg_gb, w);
-  box_mean(var_imgg_bb, var_imgg_bb, w);
-  for(size_t i = 0; i < size; i++)
   {
-    cov_imgg_img_r.data[i] -= imgg_mean_r.data[i] * img_mean.data[i];
-    cov_imgg_img_g.data[i] -= imgg_mean_g.data[i] * img_mean.data[i];
-    cov_imgg_img_b.data[i] -= imgg_mean_b.data[i] * img_mean.data[i];
-    var_imgg_rr.data[i] -= imgg_mean_r.data[i] * imgg_mean_r.data[i] - eps;
-    var_imgg_rg.data[i] -= imgg_mean_r.data[i] * imgg_mean_g.data[i];
-    var_imgg_rb.data[i] -= imgg_mean_r.data[i] * imgg_mean_b.data[i];
-    var_imgg_gg.data[i] -= imgg_mean_g.data[i] * imgg_mean_g.data[i] - eps;
-    var_imgg_gb.data[i] -= imgg_mean_g.data[i] * imgg_mean_b.data[i];
-    var_imgg_bb.data[i] -= imgg_mean_b.data[i] * imgg_mean_b.data[i] - eps;
-  }
-  gray_image a_r = new_gray_image(width, height);
-  gray_image a_g = new_gray_image(width, height);
-  gray_image a_b = new_gray_image(width, height);
-  gray_image b = img_mean;
-  for(int i1 = 0; i1 < height; i1++)
-  {
-    size_t i = (size_t)i1 * width;
-    for(int i0 = 0; i0 < width; i0++)
+    gray_image row = new_gray_image(img1.width, 1);
+    gray_image buf = new_gray_image(box_1d_bufsize(img1.width, w), 1);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int i1 = 0; i1 < img1.height; i1++)
     {
-      // solve linear system of equations of size 3x3 via Cramer's rule
-      float Sigma[3][3]; // symmetric coefficient matrix
-      Sigma[0][0] = var_imgg_rr.data[i];
-      Sigma[0][1] = var_imgg_rg.data[i];
-      Sigma[0][2] = var_imgg_rb.data[i];
-      Sigma[1][1] = var_imgg_gg.data[i];
-      Sigma[1][2] = var_imgg_gb.data[i];
-      Sigma[2][2] = var_imgg_bb.data[i];
-      rgb_pixel cov_imgg_img;
-      cov_imgg_img[0] = cov_imgg_img_r.data[i];
-      cov_imgg_img[1] = cov_imgg_img_g.data[i];
-      cov_imgg_img[2] = cov_imgg_img_b.data[i];
-      float det0 = Sigma[0][0] * (Sigma[1][1] * Sigma[2][2] - Sigma[1][2] * Sigma[1][2])
-                   - Sigma[0][1] * (Sigma[0][1] * Sigma[2][2] - Sigma[0][2] * Sigma[1][2])
-                   + Sigma[0][2] * (Sigma[0][1] * Sigma[1][2] - Sigma[0][2] * Sigma[1][1]);
-      if(fabsf(det0) > 4.f * FLT_EPSILON)
-      {
-        float det1 = cov_imgg_img[0] * (Sigma[1][1] * Sigma[2][2] - Sigma[1][2] * Sigma[1][2])
-                     - Sigma[0][1] * (cov_imgg_img[1] * Sigma[2][2] - cov_imgg_img[2] * Sigma[1][2])
-                     + Sigma[0][2] * (cov_imgg_img[1] * Sigma[1][2] - cov_imgg_img[2] * Sigma[1][1]);
-        float det2 = Sigma[0][0] * (cov_imgg_img[1] * Sigma[2][2] - cov_imgg_img[2] * Sigma[1][2])
-                     - cov_imgg_img[0] * (Sigma[0][1] * Sigma[2][2] - Sigma[0][2] * Sigma[1][2])
-                     + Sigma[0][2] * (Sigma[0][1] * cov_imgg_img[2] - Sigma[0][2] * cov_imgg_img[1]);
-        float det3 = Sigma[0][0] * (Sigma[1][1] * cov_imgg_img[2] - Sigma[1][2] * cov_imgg_img[1])
-                     - Sigma[0][1] * (Sigma[0][1] * cov_imgg_img[2] - Sigma[0][2] * cov_imgg_img[1])
-                     + cov_imgg_img[0] * (Sigma[0][1] * Sigma[1][2] - Sigma[0][2] * Sigma[1][1]);
-        a_r.data[i] = det1 / det0;
-        a_g.data[i] = det2 / det0;
-        a_b.data[i] = det3 / det0;
-      }
-      else
+      const float *pixel = img1.data + (size_t)i1 * img1.width * img1.stride;
+      for(int i0 = 0; i0 < img1.width; i0++, pixel += img1.stride)
       {
-        // linear system is singular
-        a_r.data[i] = 0;
-        a_g.data[i] = 0;
-        a_b.data[i] = 0;
+        float m = pixel[0] / A0[0];
+        m = fminf(pixel[1] / A0[1], m);
+        m = fminf(pixel[2] / A0[2], m);
+        row.data[i0] = 1.f - m * strength;
       }
-      b.data[i] -= a_r.data[i] * imgg_mean_r.data[i];
-      b.data[i] -= a_g.data[i] * imgg_mean_g.data[i];
-      b.data[i] -= a_b.data[i] * imgg_mean_b.data[i];
-      ++i;
-    }
-  }
-  box_mean(a_r, a_r, w);
-  box_mean(a_g, a_g, w);
-  box_mean(a_b, a_b, w);
-  box_mean(b, b, w);
-  // finally calculate results for the curent tile
-  for(int j_imgg = target.lower; j_imgg < target.upper; j_imgg++)
-  {
-    // index of the left most target pixel in the current row
-    size_t l = target.left + (size_t)j_imgg * imgg.width;
-    // index of the left most source pixel in the curent row of the
-    // smaller auxiliary gray-scale images a_r, a_g, a_b, and b
-    // excluding boundary data from neighboring tiles
-    size_t k = (target.left - source.left) + (size_t)(j_imgg - source.lower) * width;
-    for(int i_imgg = target.left; i_imgg < target.right; i_imgg++, k++, l++)
-    {
-      const float *pixel = imgg.data + l * imgg.stride;
-      img_out.data[l] = a_r.data[k] * pixel[0] + a_g.data[k] * pixel[1] + a_b.data[k] * pixel[2] + b.data[k];
+      box_max_1d(img1.width, row.data, img2.data + (size_t)i1 * img2.width, 1, w, buf.data);
     }
+    free_gray_image(&buf);
+    free_gray_image(&row);
   }
-  free_gray_image(&a_r);
-  free_gray_image(&a_g);
-  free_gray_image(&a_b);
-  free_gray_image(&var_imgg_rr);
-  free_gray_image(&var_imgg_rg);
-  free_gray_image(&var_imgg_rb);
-  free_gray_image(&var_imgg_gg);
-  free_gray_image(&var_imgg_gb);
-  free_gray_image(&var_imgg_bb);
-  free_gray_image(&cov_imgg_img_r);
-  free_gray_image(&cov_imgg_img_g);
-  free_gray_image(&cov_imgg_img_b);
-  free_gray_image(&img_mean);
-  free_gray_image(&imgg_mean_r);
-  free_gray_image(&imgg_mean_g);
-  free_gray_image(&imgg_mean_b);
+  box_max_columns(img2, w);
+  box_min_rows(img2, w);
+  box_min_columns(img2, w);
 }
 
 // partition the array [first, last) using the pivot value val, i.e.,
@@ -817,7 +596,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   dt_iop_hazeremoval_gui_data_t *g = (dt_iop_hazeremoval_gui_data_t *)self->gui_data;
-  dt_iop_hazeremoval_params_t *d = (dt_iop_hazeremoval_params_t *)piece->data;
+  dt_iop_hazeremoval_data_t *d = (dt_iop_hazeremoval_data_t *)piece->data;
 
   const int ch = piece->colors;
   const int width = roi_in->width;
@@ -867,11 +646,18 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     distance_max = g->distance_max;
     dt_pthread_mutex_unlock(&g->lock);
   }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max))
+  // When processing tiles, process_tiling() has estimated distance_max
+  // and A0 on the whole input already, otherwise every tile would be
+  // dehazed differently.
+  if(isnan(distance_max) && piece->pipe->tiling && !isnan(d->tile_distance_max))
   {
-    distance_max = ambient_light(img_in, w1, &A0);
+    A0[0] = d->tile_A0[0];
+    A0[1] = d->tile_A0[1];
+    A0[2] = d->tile_A0[2];
+    distance_max = d->tile_distance_max;
   }
+  // In all other cases we calculate distance_max and A0 here.
+  if(isnan(distance_max)) distance_max = ambient_light(img_in, w1, &A0);
   // PREVIEW pixelpipe stores values.
   if(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -885,28 +671,15 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_pthread_mutex_unlock(&g->lock);
   }
 
-  // calculate the transition map
+  // calculate the transition map, closed by box maximum and box minimum
   gray_image trans_map = new_gray_image(width, height);
   transition_map(img_in, trans_map, w1, A0, strength);
 
   // refine the transition map
   gray_image trans_map_filtered = new_gray_image(width, height);
-  box_min(trans_map, trans_map, w1);
-  const int tile_width = 512 - 4 * w2;
-  const gray_image c_trans_map = trans_map;
+  guided_filter(piece->pipe, img_in.data, trans_map.data, trans_map_filtered.data, width, height, ch, w2,
+                sqrtf(eps), 1.f, -FLT_MAX, FLT_MAX);
   const gray_image c_trans_map_filtered = trans_map_filtered;
-#ifdef _OPENMP
-// use dynamic load ballancing as tiles may have varying size
-#pragma omp parallel for default(none) schedule(dynamic) collapse(2)
-#endif
-  for(int j = 0; j < height; j += tile_width)
-  {
-    for(int i = 0; i < width; i += tile_width)
-    {
-      tile target = { i, min_i(i + tile_width, width), j, min_i(j + tile_width, height) };
-      guided_filter_tiling(img_in, c_trans_map, c_trans_map_filtered, target, w2, eps);
-    }
-  }
 
   // finally, calculate the haze-free image
   const float t_min
@@ -932,6 +705,48 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
+void process_tiling(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                    void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                    const int bpp)
+{
+  dt_iop_hazeremoval_gui_data_t *g = (dt_iop_hazeremoval_gui_data_t *)self->gui_data;
+  dt_iop_hazeremoval_data_t *d = (dt_iop_hazeremoval_data_t *)piece->data;
+
+  // the tiles only get to see part of the image, so estimate ambient light and depth on the whole input
+  // before splitting it up.  this needs two gray images of the input size, still much less than the
+  // untiled process() would.  the full pixelpipe in the darkroom gets them from the preview instead.
+  d->tile_distance_max = NAN;
+  if(!(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_FULL))
+  {
+    const int w1 = 6; // same window size as in process()
+    const const_rgb_image img_in = (const_rgb_image){ ivoid, roi_in->width, roi_in->height, piece->colors };
+    d->tile_distance_max = ambient_light(img_in, w1, &d->tile_A0);
+  }
+
+  default_process_tiling(self, piece, ivoid, ovoid, roi_in, roi_out, bpp);
+
+  d->tile_distance_max = NAN;
+}
+
+void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                     const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
+                     struct dt_develop_tiling_t *tiling)
+{
+  // same window sizes as in process()
+  const int w1 = 6;
+  const int w2 = 9;
+  // the guided filter works on tiles of its own, 16 gray images of that size per thread at most
+  const size_t gf_tile = 512 + 4 * w2;
+
+  tiling->factor = 2.0f + 2.0f / piece->colors; // in + out + transition map + filtered transition map
+  tiling->maxbuf = 1.0f;
+  tiling->overhead = gf_tile * gf_tile * 16 * sizeof(float) * dt_get_num_threads();
+  tiling->overlap = 2 * w1 + 2 * w2; // closing of the transition map and guided filter
+  tiling->xalign = 1;
+  tiling->yalign = 1;
+  return;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
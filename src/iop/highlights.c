@@ -31,6 +31,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_rawstage.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -926,6 +927,19 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
+void rawstage(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+              struct dt_dev_pixelpipe_rawstage_t *stage, const dt_iop_roi_t *const roi_in,
+              const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_highlights_data_t *const data = (dt_iop_highlights_data_t *)piece->data;
+  float *const processed_maximum = piece->pipe->dsc.processed_maximum;
+
+  stage->clip = data->clip * fminf(processed_maximum[0], fminf(processed_maximum[1], processed_maximum[2]));
+
+  const float m = fmaxf(fmaxf(processed_maximum[0], processed_maximum[1]), processed_maximum[2]);
+  for(int k = 0; k < 3; k++) processed_maximum[k] = m;
+}
+
 static void clip_callback(GtkWidget *slider, dt_iop_module_t *self)
 {
   if(self->dt->gui->reset) return;
@@ -953,6 +967,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   // no OpenCL for DT_IOP_HIGHLIGHTS_INPAINT yet.
   if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT) piece->process_cl_ready = 0;
+
+  // clipping the raw data is all the fused raw stage does
+  piece->rawstage_ready = d->mode == DT_IOP_HIGHLIGHTS_CLIP;
 }
 
 void init_global(dt_iop_module_so_t *module)
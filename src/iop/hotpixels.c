@@ -27,6 +27,7 @@
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_rawstage.h"
 #include "dtgtk/resetlabel.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -78,7 +79,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_SKIP_IN_THUMBNAILS;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
@@ -293,6 +294,18 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+void rawstage(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+              struct dt_dev_pixelpipe_rawstage_t *stage, const dt_iop_roi_t *const roi_in,
+              const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_hotpixels_data_t *data = (dt_iop_hotpixels_data_t *)piece->data;
+
+  stage->hotpixels = 1;
+  stage->threshold = data->threshold;
+  stage->multiplier = data->multiplier;
+  stage->min_neighbours = data->permissive ? 3 : 4;
+}
+
 void reload_defaults(dt_iop_module_t *module)
 {
   const dt_iop_hotpixels_params_t tmp
@@ -343,6 +356,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
   d->markfixed = p->markfixed && (pipe->type != DT_DEV_PIXELPIPE_EXPORT)
                  && (pipe->type != DT_DEV_PIXELPIPE_THUMBNAIL);
   if(!(pipe->image.flags & DT_IMAGE_RAW) || p->strength == 0.0) piece->enabled = 0;
+
+  // the fused raw stage neither marks the fixed pixels nor counts them for the gui
+  piece->rawstage_ready = !d->markfixed && pipe->type != DT_DEV_PIXELPIPE_FULL;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
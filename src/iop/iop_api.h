@@ -41,6 +41,7 @@ struct dt_dev_pixelpipe_t;
 struct dt_dev_pixelpipe_iop_t;
 struct dt_iop_roi_t;
 struct dt_develop_tiling_t;
+struct dt_dev_pixelpipe_rawstage_t;
 struct dt_iop_buffer_dsc_t;
 
 #ifndef DT_IOP_PARAMS_T
@@ -182,6 +183,12 @@ int process_tiling_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_
                       const struct dt_iop_roi_t *const roi_out, const int bpp);
 #endif
 
+/** instead of process(), describe the step of the module in the fused pass over the raw data and update
+ *  pipe->dsc like process() does. only called if commit_params() set piece->rawstage_ready. */
+void rawstage(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+              struct dt_dev_pixelpipe_rawstage_t *stage, const struct dt_iop_roi_t *const roi_in,
+              const struct dt_iop_roi_t *const roi_out);
+
 /** this functions are used for distort iop
  * points is an array of float {x1,y1,x2,y2,...}
  * size is 2*points_count */
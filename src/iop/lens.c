@@ -22,6 +22,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/interpolation.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -67,6 +68,21 @@ typedef struct dt_iop_lensfun_modifier_t
   int modflag;
 } dt_iop_lensfun_modifier_t;
 
+// number of initialized lensfun modifiers kept per pipe piece
+#define LENSFUN_MODIFIER_CACHE 4
+// largest distortion map (in bytes) kept per pipe piece if there is no host_memory_limit to size it from
+#define LENSFUN_MAP_CACHE_DEFAULT ((size_t)128 << 20)
+
+typedef struct dt_iop_lensfun_cached_modifier_t
+{
+  lfModifier *modifier;
+  int modflags;
+  float width, height;
+  int inverse;
+  int users;
+  int stale; // left over from earlier parameters, destroyed by the last _modifier_release()
+} dt_iop_lensfun_cached_modifier_t;
+
 typedef struct dt_iop_lensfun_params_t
 {
   int modify_flags;
@@ -125,8 +141,154 @@ typedef struct dt_iop_lensfun_data_t
   float distance;
   lfLensType target_geom;
   gboolean do_nan_checks;
+
+  // initialized modifiers and the last distortion map, both stay valid until the next commit_params()
+  dt_pthread_mutex_t lock;
+  pthread_cond_t released; // signalled when a cached modifier loses its last user
+  dt_iop_lensfun_cached_modifier_t modifiers[LENSFUN_MODIFIER_CACHE];
+  int modifier_next;
+  float *map;
+  dt_iop_roi_t map_roi;
+  float map_w, map_h;
 } dt_iop_lensfun_data_t;
 
+// lf_modifier_new() + lf_modifier_initialize() are expensive compared to the per-point
+// work done by distort_transform() and friends, so we keep a few of them per piece.
+// slot is the cache slot to pass on to _modifier_release(), -1 for a private modifier.
+static lfModifier *_modifier_get(dt_iop_lensfun_data_t *d, const float orig_w, const float orig_h,
+                                 const int inverse, int *modflags, int *slot)
+{
+  dt_pthread_mutex_lock(&d->lock);
+  for(int k = 0; k < LENSFUN_MODIFIER_CACHE; k++)
+  {
+    dt_iop_lensfun_cached_modifier_t *m = d->modifiers + k;
+    if(m->modifier && !m->stale && m->width == orig_w && m->height == orig_h && m->inverse == inverse)
+    {
+      m->users++;
+      *modflags = m->modflags;
+      *slot = k;
+      dt_pthread_mutex_unlock(&d->lock);
+      return m->modifier;
+    }
+  }
+
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+  lfModifier *modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
+  *modflags = lf_modifier_initialize(modifier, d->lens, LF_PF_F32, d->focal, d->aperture, d->distance,
+                                     d->scale, d->target_geom, d->modify_flags, inverse);
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+
+  // replace the oldest slot nobody is using right now. if they are all busy the
+  // caller gets a private modifier which _modifier_release() destroys again.
+  *slot = -1;
+  for(int i = 0; i < LENSFUN_MODIFIER_CACHE; i++)
+  {
+    const int k = (d->modifier_next + i) % LENSFUN_MODIFIER_CACHE;
+    dt_iop_lensfun_cached_modifier_t *m = d->modifiers + k;
+    if(m->users) continue;
+    if(m->modifier) lf_modifier_destroy(m->modifier);
+    m->modifier = modifier;
+    m->modflags = *modflags;
+    m->width = orig_w;
+    m->height = orig_h;
+    m->inverse = inverse;
+    m->users = 1;
+    d->modifier_next = (k + 1) % LENSFUN_MODIFIER_CACHE;
+    *slot = k;
+    break;
+  }
+  dt_pthread_mutex_unlock(&d->lock);
+  return modifier;
+}
+
+static void _modifier_release(dt_iop_lensfun_data_t *d, lfModifier *modifier, const int slot)
+{
+  // a private modifier belongs to the caller alone, don't touch d for it: cleanup_pipe() doesn't wait for those
+  if(slot < 0)
+  {
+    lf_modifier_destroy(modifier);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&d->lock);
+  dt_iop_lensfun_cached_modifier_t *m = d->modifiers + slot;
+  if(--m->users == 0)
+  {
+    if(m->stale)
+    {
+      lf_modifier_destroy(m->modifier);
+      m->modifier = NULL;
+      m->stale = 0;
+    }
+    pthread_cond_broadcast(&d->released);
+  }
+  dt_pthread_mutex_unlock(&d->lock);
+}
+
+// drops all cached modifiers. the ones still in use, by distort_transform() on the gui thread for example,
+// are only marked stale and go with their last release.
+static void _modifier_cache_clear(dt_iop_lensfun_data_t *d)
+{
+  dt_pthread_mutex_lock(&d->lock);
+  for(int k = 0; k < LENSFUN_MODIFIER_CACHE; k++)
+  {
+    dt_iop_lensfun_cached_modifier_t *m = d->modifiers + k;
+    if(!m->modifier) continue;
+    if(m->users)
+    {
+      m->stale = 1;
+      continue;
+    }
+    lf_modifier_destroy(m->modifier);
+    m->modifier = NULL;
+  }
+  dt_pthread_mutex_unlock(&d->lock);
+
+  dt_free_align(d->map);
+  d->map = NULL;
+}
+
+// the distortion map may take up to half of what tiling is allowed to use, enough for full size exports of
+// common sensors (6 floats per pixel, 550 MB at 24 MP). larger ones get tiled or computed row by row.
+static size_t _map_cache_max(void)
+{
+  const int limit = dt_conf_get_int("host_memory_limit");
+  return limit > 0 ? (size_t)limit * 1024 * 1024 / 2 : LENSFUN_MAP_CACHE_DEFAULT;
+}
+
+// the subpixel distortion coordinates (6 floats per pixel) for roi_out, computed once and
+// reused as long as lens, geometry and roi stay the same. returns NULL if roi_out is too
+// large to be worth keeping around, the caller has to compute them row by row then.
+static const float *_distortion_map(dt_iop_lensfun_data_t *d, lfModifier *modifier,
+                                    const dt_iop_roi_t *const roi_out, const float orig_w, const float orig_h)
+{
+  if(d->map && d->map_w == orig_w && d->map_h == orig_h && d->map_roi.x == roi_out->x
+     && d->map_roi.y == roi_out->y && d->map_roi.width == roi_out->width
+     && d->map_roi.height == roi_out->height && d->map_roi.scale == roi_out->scale)
+    return d->map;
+
+  const size_t mapwidth = (size_t)roi_out->width * 2 * 3;
+  const size_t mapsize = mapwidth * roi_out->height * sizeof(float);
+  if(mapsize > _map_cache_max()) return NULL;
+
+  dt_free_align(d->map);
+  d->map = dt_alloc_align(16, mapsize);
+  if(!d->map) return NULL;
+
+  float *const map = d->map;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int y = 0; y < roi_out->height; y++)
+    lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width, 1,
+                                                   map + (size_t)y * mapwidth);
+
+  d->map_roi = *roi_out;
+  d->map_w = orig_w;
+  d->map_h = orig_h;
+  return d->map;
+}
+
 
 const char *name()
 {
@@ -349,13 +511,8 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   }
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  lfModifier *modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
-
-  const int modflags
-      = lf_modifier_initialize(modifier, d->lens, LF_PF_F32, d->focal, d->aperture, d->distance, d->scale,
-                               d->target_geom, d->modify_flags, d->inverse);
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  int modflags, modifier_slot;
+  lfModifier *modifier = _modifier_get(piece->data, orig_w, orig_h, d->inverse, &modflags, &modifier_slot);
 
   const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
 
@@ -364,18 +521,26 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     // reverse direction (useful for renderings)
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
-      // acquire temp memory for distorted pixel coords
+      // distorted pixel coords, either cached for the whole roi or computed row by row into temp memory
       const size_t bufsize = (size_t)roi_out->width * 2 * 3;
-      void *buf = dt_alloc_align(16, bufsize * dt_get_num_threads() * sizeof(float));
+      const float *const map = _distortion_map(piece->data, modifier, roi_out, orig_w, orig_h);
+      void *buf = map ? NULL : dt_alloc_align(16, bufsize * dt_get_num_threads() * sizeof(float));
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(buf, modifier) schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
-        float *bufptr = ((float *)buf) + (size_t)bufsize * dt_get_thread_num();
-        lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
-                                                       1, bufptr);
+        const float *bufptr;
+        if(map)
+          bufptr = map + (size_t)bufsize * y;
+        else
+        {
+          float *rowbuf = ((float *)buf) + (size_t)bufsize * dt_get_thread_num();
+          lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
+                                                         1, rowbuf);
+          bufptr = rowbuf;
+        }
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -459,18 +624,26 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
-      // acquire temp memory for distorted pixel coords
+      // distorted pixel coords, either cached for the whole roi or computed row by row into temp memory
       const size_t buf2size = (size_t)roi_out->width * 2 * 3;
-      void *buf2 = dt_alloc_align(16, buf2size * sizeof(float) * dt_get_num_threads());
+      const float *const map = _distortion_map(piece->data, modifier, roi_out, orig_w, orig_h);
+      void *buf2 = map ? NULL : dt_alloc_align(16, buf2size * sizeof(float) * dt_get_num_threads());
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(buf2, buf, modifier) schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
-        float *buf2ptr = ((float *)buf2) + (size_t)buf2size * dt_get_thread_num();
-        lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
-                                                       1, buf2ptr);
+        const float *buf2ptr;
+        if(map)
+          buf2ptr = map + (size_t)buf2size * y;
+        else
+        {
+          float *rowbuf = ((float *)buf2) + (size_t)buf2size * dt_get_thread_num();
+          lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
+                                                         1, rowbuf);
+          buf2ptr = rowbuf;
+        }
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -515,7 +688,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     }
     dt_free_align(buf);
   }
-  lf_modifier_destroy(modifier);
+  _modifier_release(piece->data, modifier, modifier_slot);
 
   if(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -539,6 +712,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   float *tmpbuf = NULL;
   lfModifier *modifier = NULL;
+  int modifier_slot = -1;
 
   const int devid = piece->pipe->devid;
   const int iwidth = roi_in->width;
@@ -602,30 +776,31 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dev_tmpbuf = dt_opencl_alloc_device_buffer(devid, tmpbuflen);
   if(dev_tmpbuf == NULL) goto error;
 
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
-
-  int modflags = lf_modifier_initialize(modifier, d->lens, LF_PF_F32, d->focal, d->aperture, d->distance,
-                                        d->scale, d->target_geom, d->modify_flags, d->inverse);
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  int modflags;
+  modifier = _modifier_get(d, orig_w, orig_h, d->inverse, &modflags, &modifier_slot);
 
   if(d->inverse)
   {
     // reverse direction (useful for renderings)
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      const float *map = _distortion_map(d, modifier, roi_out, orig_w, orig_h);
+      if(!map)
+      {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(tmpbuf, d, modifier) schedule(static)
 #endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
-                                                       1, pi);
+        for(int y = 0; y < roi_out->height; y++)
+        {
+          float *pi = tmpbuf + (size_t)y * tmpbufwidth;
+          lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
+                                                         1, pi);
+        }
+        map = tmpbuf;
       }
 
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
+      /* _blocking_ memory transfer: host distortion map -> opencl dev_tmpbuf */
+      err = dt_opencl_write_buffer_to_device(devid, (void *)map, dev_tmpbuf, 0,
                                              (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
       if(err != CL_SUCCESS) goto error;
 
@@ -723,18 +898,23 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      const float *map = _distortion_map(d, modifier, roi_out, orig_w, orig_h);
+      if(!map)
+      {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(tmpbuf, d, modifier) schedule(static)
 #endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
-                                                       1, pi);
+        for(int y = 0; y < roi_out->height; y++)
+        {
+          float *pi = tmpbuf + (size_t)y * tmpbufwidth;
+          lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y + y, roi_out->width,
+                                                         1, pi);
+        }
+        map = tmpbuf;
       }
 
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
+      /* _blocking_ memory transfer: host distortion map -> opencl dev_tmpbuf */
+      err = dt_opencl_write_buffer_to_device(devid, (void *)map, dev_tmpbuf, 0,
                                              (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
       if(err != CL_SUCCESS) goto error;
 
@@ -768,14 +948,14 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_opencl_release_mem_object(dev_tmpbuf);
   dt_opencl_release_mem_object(dev_tmp);
   if(tmpbuf != NULL) dt_free_align(tmpbuf);
-  if(modifier != NULL) lf_modifier_destroy(modifier);
+  if(modifier != NULL) _modifier_release(d, modifier, modifier_slot);
   return TRUE;
 
 error:
   dt_opencl_release_mem_object(dev_tmp);
   dt_opencl_release_mem_object(dev_tmpbuf);
   if(tmpbuf != NULL) dt_free_align(tmpbuf);
-  if(modifier != NULL) lf_modifier_destroy(modifier);
+  if(modifier != NULL) _modifier_release(d, modifier, modifier_slot);
   dt_print(DT_DEBUG_OPENCL, "[opencl_lens] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
@@ -785,7 +965,7 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
                      const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
                      struct dt_develop_tiling_t *tiling)
 {
-  tiling->factor = 4.5f; // in + out + tmp + tmpbuf
+  tiling->factor = 6.0f; // in + out + tmp + tmpbuf + distortion map (6 floats per pixel)
   tiling->maxbuf = 1.5f;
   tiling->overhead = 0;
   tiling->overlap = 4;
@@ -801,23 +981,20 @@ int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, floa
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  lfModifier *modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
-
-  int modflags = lf_modifier_initialize(modifier, d->lens, LF_PF_F32, d->focal, d->aperture, d->distance,
-                                        d->scale, d->target_geom, d->modify_flags, !d->inverse);
-  float *buf = malloc(2 * 3 * sizeof(float));
+  int modflags, modifier_slot;
+  lfModifier *modifier = _modifier_get(d, orig_w, orig_h, !d->inverse, &modflags, &modifier_slot);
 
-  for(size_t i = 0; i < points_count * 2; i += 2)
+  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
-    if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+    float buf[2 * 3];
+    for(size_t i = 0; i < points_count * 2; i += 2)
     {
       lf_modifier_apply_subpixel_geometry_distortion(modifier, points[i], points[i + 1], 1, 1, buf);
       points[i] = buf[0];
       points[i + 1] = buf[3];
     }
   }
-  free(buf);
-  lf_modifier_destroy(modifier);
+  _modifier_release(d, modifier, modifier_slot);
 
   return 1;
 }
@@ -828,23 +1005,20 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  lfModifier *modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
+  int modflags, modifier_slot;
+  lfModifier *modifier = _modifier_get(d, orig_w, orig_h, d->inverse, &modflags, &modifier_slot);
 
-  int modflags = lf_modifier_initialize(modifier, d->lens, LF_PF_F32, d->focal, d->aperture, d->distance,
-                                        d->scale, d->target_geom, d->modify_flags, d->inverse);
-  float *buf = malloc(2 * 3 * sizeof(float));
-
-  for(size_t i = 0; i < points_count * 2; i += 2)
+  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
-    if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+    float buf[2 * 3];
+    for(size_t i = 0; i < points_count * 2; i += 2)
     {
       lf_modifier_apply_subpixel_geometry_distortion(modifier, points[i], points[i + 1], 1, 1, buf);
       points[i] = buf[0];
       points[i + 1] = buf[3];
     }
   }
-  free(buf);
-  lf_modifier_destroy(modifier);
+  _modifier_release(d, modifier, modifier_slot);
   return 1;
 }
 
@@ -865,10 +1039,8 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
 
-  lfModifier *modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
-
-  int modflags = lf_modifier_initialize(modifier, d->lens, LF_PF_F32, d->focal, d->aperture, d->distance,
-                                        d->scale, d->target_geom, d->modify_flags, d->inverse);
+  int modflags, modifier_slot;
+  lfModifier *modifier = _modifier_get(d, orig_w, orig_h, d->inverse, &modflags, &modifier_slot);
 
   if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
@@ -952,7 +1124,7 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
     roi_in->width = CLAMP(roi_in->width, 1, (int)ceilf(orig_w) - roi_in->x);
     roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(orig_h) - roi_in->y);
   }
-  lf_modifier_destroy(modifier);
+  _modifier_release(d, modifier, modifier_slot);
 }
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
@@ -971,6 +1143,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
 
+  // everything cached depends on the lens and the parameters below
+  _modifier_cache_clear(d);
+
   dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->data;
   lfDatabase *dt_iop_lensfun_db = (lfDatabase *)gd->db;
   const lfCamera *camera = NULL;
@@ -1045,6 +1220,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = calloc(1, sizeof(dt_iop_lensfun_data_t));
+  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->released, NULL);
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1052,6 +1230,14 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
 {
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
 
+  // the cached modifiers still in use go with their release, which needs d: wait for those
+  dt_pthread_mutex_lock(&d->lock);
+  for(int k = 0; k < LENSFUN_MODIFIER_CACHE; k++)
+    while(d->modifiers[k].users) dt_pthread_cond_wait(&d->released, &d->lock);
+  dt_pthread_mutex_unlock(&d->lock);
+  _modifier_cache_clear(d);
+  pthread_cond_destroy(&d->released);
+  dt_pthread_mutex_destroy(&d->lock);
   if(d->lens)
   {
     lf_lens_destroy(d->lens);
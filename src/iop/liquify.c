@@ -49,6 +49,8 @@ DT_MODULE_INTROSPECTION(1, dt_iop_liquify_params_t)
 const int   LOOKUP_OVERSAMPLE = 10;
 const int   INTERPOLATION_POINTS = 100; // when interpolating bezier
 const float STAMP_RELOCATION = 0.1;     // how many radii to move stamp forward when following a path
+const size_t STAMP_CACHE_MAX = 64 << 20; // bytes of stamps kept per pipe piece
+const size_t MAP_CACHE_MAX = 64 << 20;   // larger distortion maps are built anew for each run
 
 #define CONF_RADIUS "plugins/darkroom/liquify/radius"
 #define CONF_ANGLE "plugins/darkroom/liquify/angle"
@@ -259,6 +261,44 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+// everything a stamp depends on, see build_round_stamp(). a stamp is relative to the warp point, so
+// warps which only got moved share their stamp.
+typedef struct
+{
+  float complex strength; ///< strength vector (strength - point)
+  float control1;
+  float control2;
+  int iradius;
+  dt_liquify_warp_type_enum_t type;
+  int interpolated;
+} dt_liquify_stamp_key_t;
+
+typedef struct
+{
+  dt_liquify_stamp_key_t key;
+  float complex *stamp;
+  cairo_rectangle_int_t extent;
+  size_t size;      ///< bytes
+  uint64_t used;    ///< generation of the map this stamp was last used for
+} dt_liquify_stamp_t;
+
+typedef struct
+{
+  dt_iop_liquify_params_t params; // must stay first, piece->data doubles as the params
+  dt_pthread_mutex_t lock;        // distort_(back)transform run concurrently to process
+
+  // stamps of all recently used warps, so that editing one path does not re-stamp all the others
+  GHashTable *stamps;
+  size_t stamps_size;
+  uint64_t generation;
+
+  // the last distortion map built for process(), with the warps and the extent it was built for
+  float complex *map;
+  cairo_rectangle_int_t map_extent;
+  dt_liquify_warp_t *map_warps;
+  int map_warps_count;
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_pthread_mutex_t lock;
@@ -787,12 +827,18 @@ static float *
 build_lookup_table (const int distance, const float control1, const float control2)
 {
   float complex *clookup = dt_alloc_align (16, (distance + 2) * sizeof (float complex));
+  float *lookup = dt_alloc_align(16, (distance + 2) * sizeof(float));
+  if (!clookup || !lookup)
+  {
+    dt_free_align (clookup);
+    dt_free_align (lookup);
+    return NULL;
+  }
 
   interpolate_cubic_bezier (I, control1 + I, control2, 1.0, clookup, distance + 2);
 
   // reparameterize bezier by x and keep only y values
 
-  float *lookup = dt_alloc_align(16, (distance + 2) * sizeof(float));
   float *ptr = lookup;
   float complex *cptr = clookup + 1;
   const float complex *cptr_end = cptr + distance;
@@ -865,8 +911,10 @@ static void build_round_stamp (float complex **pstamp,
     (strength * STAMP_RELOCATION) : strength;
   const float abs_strength = cabs (strength);
 
+  *pstamp = NULL;
   float complex *stamp = malloc (sizeof (float complex)
                                  * stamp_extent->width * stamp_extent->height);
+  if (!stamp) return;
 
   // clear memory
   #ifdef _OPENMP
@@ -882,6 +930,11 @@ static void build_round_stamp (float complex **pstamp,
   // lookup table: map of distance from center point => warp
   const int table_size = iradius * LOOKUP_OVERSAMPLE;
   const float *lookup_table = build_lookup_table (table_size, warp->control1, warp->control2);
+  if (!lookup_table)
+  {
+    free (stamp);
+    return;
+  }
 
   // points into buffer at the center of the circle
   float complex *center = stamp + 2 * iradius * iradius + 2 * iradius;
@@ -1082,29 +1135,133 @@ static void _get_map_extent (const dt_iop_roi_t *roi_out,
   cairo_region_destroy (roi_out_region);
 }
 
-static float complex *create_global_distortion_map (const cairo_rectangle_int_t *map_extent,
+static guint _stamp_key_hash (gconstpointer key)
+{
+  // FNV-1a over the key bytes, the key is always cleared before it gets filled in
+  const unsigned char *c = (const unsigned char *) key;
+  guint h = 2166136261u;
+  for (size_t k = 0; k < sizeof (dt_liquify_stamp_key_t); k++)
+    h = (h ^ c[k]) * 16777619u;
+  return h;
+}
+
+static gboolean _stamp_key_equal (gconstpointer a, gconstpointer b)
+{
+  return !memcmp (a, b, sizeof (dt_liquify_stamp_key_t));
+}
+
+static void _stamp_free (gpointer data)
+{
+  dt_liquify_stamp_t *s = (dt_liquify_stamp_t *) data;
+  free (s->stamp);
+  free (s);
+}
+
+static gboolean _stamp_unused (gpointer key, gpointer value, gpointer user_data)
+{
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) user_data;
+  dt_liquify_stamp_t *s = (dt_liquify_stamp_t *) value;
+  if (s->used == d->generation) return FALSE;
+  d->stamps_size -= s->size;
+  return TRUE;
+}
+
+// get the stamp of a warp from the cache of the pipe piece, building it if needed. the stamp stays owned
+// by the cache. returns NULL if the stamp does not fit into the cache, the caller has to build it then.
+// call with d->lock held.
+static const dt_liquify_stamp_t *_get_stamp (dt_iop_liquify_data_t *d, const dt_liquify_warp_t *warp)
+{
+  dt_liquify_stamp_key_t key;
+  memset (&key, 0, sizeof (key));
+  key.strength = warp->strength - warp->point;
+  key.control1 = warp->control1;
+  key.control2 = warp->control2;
+  key.iradius = round (cabs (warp->radius - warp->point));
+  key.type = warp->type;
+  key.interpolated = (warp->status & DT_LIQUIFY_STATUS_INTERPOLATED) != 0;
+
+  dt_liquify_stamp_t *s = (dt_liquify_stamp_t *) g_hash_table_lookup (d->stamps, &key);
+  if (!s)
+  {
+    // make room by dropping the stamps not needed for the current map
+    const size_t size = sizeof (float complex) * (2 * key.iradius + 1) * (2 * key.iradius + 1);
+    if (d->stamps_size + size > STAMP_CACHE_MAX)
+      g_hash_table_foreach_remove (d->stamps, _stamp_unused, d);
+    if (d->stamps_size + size > STAMP_CACHE_MAX)
+      return NULL;
+
+    s = (dt_liquify_stamp_t *) malloc (sizeof (dt_liquify_stamp_t));
+    if (!s) return NULL;
+    s->key = key;
+    build_round_stamp (&s->stamp, &s->extent, warp);
+    if (!s->stamp)
+    {
+      free (s);
+      return NULL;
+    }
+    s->size = sizeof (float complex) * s->extent.width * s->extent.height;
+    d->stamps_size += s->size;
+    g_hash_table_insert (d->stamps, &s->key, s);
+  }
+  s->used = d->generation;
+  return s;
+}
+
+// drop all cached stamps and the cached map.
+static void _clear_cache (dt_iop_liquify_data_t *d)
+{
+  g_hash_table_remove_all (d->stamps);
+  d->stamps_size = 0;
+  dt_free_align (d->map);
+  d->map = NULL;
+  free (d->map_warps);
+  d->map_warps = NULL;
+  d->map_warps_count = 0;
+}
+
+// returns NULL if out of memory. call with d->lock held.
+static float complex *create_global_distortion_map (dt_iop_liquify_data_t *d,
+                                                    const cairo_rectangle_int_t *map_extent,
                                                     GList *interpolated,
                                                     gboolean inverted)
 {
   // allocate distortion map big enough to contain all paths
   const int mapsize = map_extent->width * map_extent->height;
   float complex * map = dt_alloc_align (16, mapsize * sizeof (float complex));
+  if (!map) return NULL;
   memset (map, 0, mapsize * sizeof (float complex));
 
   // build map
+  d->generation++;
   for (GList *i = interpolated; i != NULL; i = i->next)
   {
     const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
-    float complex *stamp = NULL;
-    cairo_rectangle_int_t r;
-    build_round_stamp (&stamp, &r, warp);
-    add_to_global_distortion_map (map, map_extent, warp, stamp, &r);
-    free ((void *) stamp);
+    const dt_liquify_stamp_t *cached = _get_stamp (d, warp);
+    if (cached)
+      add_to_global_distortion_map (map, map_extent, warp, cached->stamp, &cached->extent);
+    else
+    {
+      float complex *stamp = NULL;
+      cairo_rectangle_int_t r;
+      build_round_stamp (&stamp, &r, warp);
+      if (!stamp)
+      {
+        dt_free_align ((void *) map);
+        return NULL;
+      }
+      add_to_global_distortion_map (map, map_extent, warp, stamp, &r);
+      free ((void *) stamp);
+    }
   }
 
   if (inverted)
   {
     float complex * const imap = dt_alloc_align (16, mapsize * sizeof (float complex));
+    if (!imap)
+    {
+      dt_free_align ((void *) map);
+      return NULL;
+    }
     memset (imap, 0, mapsize * sizeof (float complex));
 
     // copy map into imap (inverted map).
@@ -1163,15 +1320,22 @@ static float complex *create_global_distortion_map (const cairo_rectangle_int_t
   return map;
 }
 
-static float complex *build_global_distortion_map (struct dt_iop_module_t *module,
-                                                   const dt_dev_pixelpipe_iop_t *piece,
-                                                   const dt_iop_roi_t *roi_in,
-                                                   const dt_iop_roi_t *roi_out,
-                                                   cairo_rectangle_int_t *map_extent)
+// the distortion map for process(). up to MAP_CACHE_MAX it is kept in the pipe piece and reused as long
+// as the warps and the extent stay the same, e.g. when only modules before liquify changed. such a map is
+// owned by the piece data and only replaced by the next call for the same piece, *cached tells whether
+// that's the case or the caller has to dt_free_align() the map. returns NULL if out of memory.
+static const float complex *build_global_distortion_map (struct dt_iop_module_t *module,
+                                                         const dt_dev_pixelpipe_iop_t *piece,
+                                                         const dt_iop_roi_t *roi_in,
+                                                         const dt_iop_roi_t *roi_out,
+                                                         cairo_rectangle_int_t *map_extent,
+                                                         gboolean *cached)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece (module, piece->pipe, roi_in->scale, &copy_params);
 
@@ -1179,8 +1343,52 @@ static float complex *build_global_distortion_map (struct dt_iop_module_t *modul
 
   _get_map_extent (roi_out, interpolated, map_extent);
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated, FALSE);
+  const float complex *map = NULL;
+  *cached = FALSE;
+
+  // too large to be kept around, drop whatever we had and build it for this run only
+  if ((size_t)map_extent->width * map_extent->height * sizeof (float complex) > MAP_CACHE_MAX)
+  {
+    dt_pthread_mutex_lock (&d->lock);
+    dt_free_align (d->map);
+    d->map = NULL;
+    free (d->map_warps);
+    d->map_warps = NULL;
+    d->map_warps_count = 0;
+    map = create_global_distortion_map (d, map_extent, interpolated, FALSE);
+    dt_pthread_mutex_unlock (&d->lock);
+    g_list_free_full (interpolated, free);
+    return map;
+  }
+
+  const int count = g_list_length (interpolated);
+  dt_liquify_warp_t *warps = malloc (sizeof (dt_liquify_warp_t) * MAX (count, 1));
+  if (!warps)
+  {
+    g_list_free_full (interpolated, free);
+    return NULL;
+  }
+  int k = 0;
+  for (GList *i = interpolated; i != NULL; i = i->next) warps[k++] = *((dt_liquify_warp_t *) i->data);
+
+  dt_pthread_mutex_lock (&d->lock);
+  if (!(d->map && d->map_warps_count == count
+        && !memcmp (&d->map_extent, map_extent, sizeof (cairo_rectangle_int_t))
+        && !memcmp (d->map_warps, warps, sizeof (dt_liquify_warp_t) * count)))
+  {
+    dt_free_align (d->map);
+    free (d->map_warps);
+    d->map = create_global_distortion_map (d, map_extent, interpolated, FALSE);
+    d->map_extent = *map_extent;
+    d->map_warps = d->map ? warps : NULL;
+    d->map_warps_count = d->map ? count : 0;
+    if (d->map) warps = NULL;
+  }
+  map = d->map;
+  *cached = TRUE;
+  dt_pthread_mutex_unlock (&d->lock);
 
+  free (warps);
   g_list_free_full (interpolated, free);
   return map;
 }
@@ -1210,7 +1418,7 @@ void modify_roi_in (struct dt_iop_module_t *module,
 
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t*)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &((dt_iop_liquify_data_t *)piece->data)->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece (module, piece->pipe, roi_in->scale, &copy_params);
 
@@ -1277,7 +1485,8 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
   {
     // create the distortion map for this extent
 
-    GList *interpolated = interpolate_paths ((dt_iop_liquify_params_t *)piece->data);
+    dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+    GList *interpolated = interpolate_paths (&d->params);
 
     // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
     // the warps that are in (possibly partly) in this same region.
@@ -1285,7 +1494,9 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
     dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
     _get_map_extent (&roi_in, interpolated, &extent);
 
-    float complex *map = create_global_distortion_map (&extent, interpolated, inverted);
+    dt_pthread_mutex_lock (&d->lock);
+    float complex *map = create_global_distortion_map (d, &extent, interpolated, inverted);
+    dt_pthread_mutex_unlock (&d->lock);
     g_list_free_full (interpolated, free);
 
     if (map == NULL) return 0;
@@ -1350,7 +1561,8 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
   // 2. build the distortion map
 
   cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent);
+  gboolean cached;
+  const float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent, &cached);
   if (map == NULL)
     return;
 
@@ -1359,7 +1571,7 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
   if (map_extent.width != 0 && map_extent.height != 0)
     apply_global_distortion_map (module, piece, in, out, roi_in, roi_out, map, &map_extent);
 
-  dt_free_align ((void *) map);
+  if (!cached) dt_free_align ((void *) map);
 }
 
 #ifdef HAVE_OPENCL
@@ -1521,7 +1733,8 @@ int process_cl (struct dt_iop_module_t *module,
   // 2. build the distortion map
 
   cairo_rectangle_int_t map_extent;
-  const float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent);
+  gboolean cached;
+  const float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent, &cached);
   if (map == NULL)
     return TRUE;
 
@@ -1530,7 +1743,7 @@ int process_cl (struct dt_iop_module_t *module,
   if (map_extent.width != 0 && map_extent.height != 0)
     err = apply_global_distortion_map_cl (module, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
 
-  dt_free_align ((void *) map);
+  if (!cached) dt_free_align ((void *) map);
   if (err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1581,12 +1794,19 @@ void cleanup (dt_iop_module_t *module)
 
 void init_pipe (struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc (module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) calloc (1, sizeof (dt_iop_liquify_data_t));
+  dt_pthread_mutex_init (&d->lock, NULL);
+  d->stamps = g_hash_table_new_full (_stamp_key_hash, _stamp_key_equal, NULL, _stamp_free);
+  piece->data = d;
   module->commit_params (module, module->default_params, pipe, piece);
 }
 
 void cleanup_pipe (struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+  _clear_cache (d);
+  g_hash_table_destroy (d->stamps);
+  dt_pthread_mutex_destroy (&d->lock);
   free (piece->data);
   piece->data = NULL;
 }
@@ -1598,7 +1818,9 @@ void commit_params (struct dt_iop_module_t *module,
                     dt_dev_pixelpipe_t *pipe,
                     dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy (piece->data, params, module->params_size);
+  // the cached stamps and map are keyed by the warps themselves, so they stay valid across edits
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+  memcpy (&d->params, params, module->params_size);
 }
 
 // calculate the dot product of 2 vectors.
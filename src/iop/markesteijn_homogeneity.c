@@ -0,0 +1,138 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// homogeneity maps and the choice of directions of the x-trans markesteijn demosaic, on one TSxTS tile of the
+// per-thread working space of xtrans_markesteijn_interpolate() in demosaic.c. they live in a file of their own so
+// that src/tests/markesteijn.c can hold them against the per pixel loops they replace.
+
+#include "common/darktable.h"
+
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+
+// tile size, has to be the one of xtrans_markesteijn_interpolate()
+#define TS 122
+
+/** build the homogeneity maps homo from the derivatives drv and their 5x5 sums homosum, ndir tiles each.
+    homosum may overlap drv, which is not read any more once homo is done. */
+void markesteijn_homogeneity(uint8_t *const homo_buf, uint8_t *const homosum_buf, const float *const drv_buf,
+                             const int ndir, const int pad_homo, const int pad_tile, const int mrow, const int mcol)
+{
+  uint8_t(*const homo)[TS][TS] = (uint8_t(*)[TS][TS])homo_buf;
+  uint8_t(*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])homosum_buf;
+  const float(*const drv)[TS][TS] = (const float(*)[TS][TS])drv_buf;
+
+  // row by row and direction by direction, so that the inner loops run along the columns
+  memset(homo_buf, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
+  for(int row = pad_homo; row < mrow - pad_homo; row++)
+  {
+    // eight times the smallest derivative of each pixel in any direction
+    float tr[TS];
+    for(int col = pad_homo; col < mcol - pad_homo; col++) tr[col] = FLT_MAX;
+    for(int d = 0; d < ndir; d++)
+      for(int col = pad_homo; col < mcol - pad_homo; col++)
+        tr[col] = tr[col] > drv[d][row][col] ? drv[d][row][col] : tr[col];
+    for(int col = pad_homo; col < mcol - pad_homo; col++) tr[col] *= 8;
+
+    for(int d = 0; d < ndir; d++)
+    {
+      const float(*const drow)[TS] = drv[d] + row;
+#ifdef _OPENMP
+#pragma omp SIMD()
+#endif
+      for(int col = pad_homo; col < mcol - pad_homo; col++)
+      {
+        uint8_t count = 0;
+        for(int v = -1; v <= 1; v++)
+          for(int h = -1; h <= 1; h++) count += (drow[v][col + h] <= tr[col]) ? 1 : 0;
+        homo[d][row][col] = count;
+      }
+    }
+  }
+
+  for(int d = 0; d < ndir; d++)
+    for(int row = pad_tile; row < mrow - pad_tile; row++)
+    {
+      // start before first column where homo[d][row][col+2] != 0,
+      // so can know v5sum and homosum[d][row][col] will be 0
+      int col = pad_tile - 5;
+      uint8_t v5sum[5] = { 0 };
+      homosum[d][row][col] = 0;
+      // calculate by rolling through column sums
+      for(col++; col < mcol - pad_tile; col++)
+      {
+        uint8_t colsum = 0;
+        for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
+        homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
+        v5sum[col % 5] = colsum;
+      }
+    }
+}
+
+/** average the rgb tiles of the most homogeneous directions of one row into orow, 4 floats per pixel, of which
+    the columns pad_tile to mcol - pad_tile are written. */
+void markesteijn_select_row(float *const orow, const uint8_t *const homosum_buf, const float *const rgb_buf,
+                            const int ndir, const int row, const int pad_tile, const int mcol)
+{
+  const uint8_t(*const homosum)[TS][TS] = (const uint8_t(*)[TS][TS])homosum_buf;
+  const float(*const rgb)[TS][TS][3] = (const float(*)[TS][TS][3])rgb_buf;
+
+  // the choice of directions as selects instead of branches
+  uint8_t hm[8][TS];
+  uint8_t maxval[TS];
+  for(int col = pad_tile; col < mcol - pad_tile; col++) maxval[col] = 0;
+  for(int d = 0; d < ndir; d++)
+    for(int col = pad_tile; col < mcol - pad_tile; col++)
+    {
+      hm[d][col] = homosum[d][row][col];
+      maxval[col] = maxval[col] < hm[d][col] ? hm[d][col] : maxval[col];
+    }
+  for(int col = pad_tile; col < mcol - pad_tile; col++) maxval[col] -= maxval[col] >> 3;
+  // of two opposite passes, only keep the more homogeneous one
+  for(int d = 0; d < ndir - 4; d++)
+    for(int col = pad_tile; col < mcol - pad_tile; col++)
+    {
+      const uint8_t a = hm[d][col], b = hm[d + 4][col];
+      hm[d][col] = a < b ? 0 : a;
+      hm[d + 4][col] = a > b ? 0 : b;
+    }
+
+  float avg[4][TS];
+  for(int c = 0; c < 4; c++)
+    for(int col = pad_tile; col < mcol - pad_tile; col++) avg[c][col] = 0.0f;
+  for(int d = 0; d < ndir; d++)
+  {
+    const float(*const rrow)[3] = rgb[d][row];
+#ifdef _OPENMP
+#pragma omp SIMD()
+#endif
+    for(int col = pad_tile; col < mcol - pad_tile; col++)
+    {
+      const int use = hm[d][col] >= maxval[col];
+      for(int c = 0; c < 3; c++) avg[c][col] += use ? rrow[col][c] : 0.0f;
+      avg[3][col] += use ? 1.0f : 0.0f;
+    }
+  }
+  for(int col = pad_tile; col < mcol - pad_tile; col++)
+    for(int c = 0; c < 3; c++) orow[4 * col + c] = avg[c][col] / avg[3][col];
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
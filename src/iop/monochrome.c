@@ -172,7 +172,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float sigma_s = 20.0f / scale;
   const float detail = -1.0f; // bilateral base layer
 
-  dt_bilateral_t *b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
+  dt_bilateral_t *b = dt_bilateral_init(piece->pipe, roi_in->width, roi_in->height, sigma_s, sigma_r);
   dt_bilateral_splat(b, (float *)o);
   dt_bilateral_blur(b);
   dt_bilateral_slice(b, (float *)o, (float *)o, detail);
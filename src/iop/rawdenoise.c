@@ -125,7 +125,7 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_SKIP_IN_THUMBNAILS;
 }
 
 int default_group()
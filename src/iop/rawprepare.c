@@ -24,6 +24,7 @@
 #include "common/imageio_rawspeed.h" // for dt_rawspeed_crop_dcraw_filters
 #include "common/opencl.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_rawstage.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -372,6 +373,28 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = 1.0f;
 }
 
+void rawstage(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, struct dt_dev_pixelpipe_rawstage_t *stage,
+              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_rawprepare_data_t *const d = (dt_iop_rawprepare_data_t *)piece->data;
+
+  stage->csx = compute_proper_crop(piece, roi_in, d->x);
+  stage->csy = compute_proper_crop(piece, roi_in, d->y);
+  stage->bx = roi_out->x + d->x;
+  stage->by = roi_out->y + d->y;
+  for(int k = 0; k < 4; k++)
+  {
+    stage->sub[k] = d->sub[k];
+    stage->div[k] = d->div[k];
+  }
+
+  piece->pipe->dsc.filters
+      = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, stage->csx, stage->csy);
+  adjust_xtrans_filters(piece->pipe, stage->csx, stage->csy);
+
+  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = 1.0f;
+}
+
 #if defined(__SSE2__)
 void process_sse2(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                   void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -658,6 +681,9 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *params, dt_dev_pixelp
   d->rawprepare.raw_black_level = (uint16_t)(black / 4.0f);
   d->rawprepare.raw_white_point = p->raw_white_point;
 
+  // only the raw mosaic goes through the fused raw stage
+  piece->rawstage_ready = piece->pipe->dsc.filters != 0;
+
   if(!dt_image_is_raw(&piece->pipe->image) || image_is_normalized(&piece->pipe->image)) piece->enabled = 0;
 }
 
@@ -3975,8 +3975,8 @@ static void retouch_blur(float *const in, dt_iop_roi_t *const roi_in, const int
     float Labmax[] = { INFINITY, INFINITY, INFINITY, INFINITY };
     float Labmin[] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
 
-    dt_gaussian_t *g = dt_gaussian_init(roi_mask_scaled->width, roi_mask_scaled->height, ch, Labmax, Labmin, sigma,
-                                        DT_IOP_GAUSSIAN_ZERO);
+    dt_gaussian_t *g = dt_gaussian_init(piece->pipe, roi_mask_scaled->width, roi_mask_scaled->height, ch, Labmax,
+                                        Labmin, sigma, DT_IOP_GAUSSIAN_ZERO);
     if(g)
     {
       if(ch == 4)
@@ -3992,7 +3992,8 @@ static void retouch_blur(float *const in, dt_iop_roi_t *const roi_in, const int
     const float sigma_s = sigma;
     const float detail = -1.0f; // we want the bilateral base layer
 
-    dt_bilateral_t *b = dt_bilateral_init(roi_mask_scaled->width, roi_mask_scaled->height, sigma_s, sigma_r);
+    dt_bilateral_t *b
+        = dt_bilateral_init(piece->pipe, roi_mask_scaled->width, roi_mask_scaled->height, sigma_s, sigma_r);
     if(b)
     {
       image_rgb2lab(img_dest, roi_mask_scaled->width, roi_mask_scaled->height, ch, use_sse);
@@ -4260,7 +4261,7 @@ static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   usr_data.display_scale = p->curr_scale;
 
   // init the decompose routine
-  dwt_p = dt_dwt_init(in_retouch, roi_rt->width, roi_rt->height, ch, p->num_scales,
+  dwt_p = dt_dwt_init(piece->pipe, in_retouch, roi_rt->width, roi_rt->height, ch, p->num_scales,
                       (!display_wavelet_scale) ? 0 : p->curr_scale, p->merge_from_scale, &usr_data,
                       roi_in->scale / piece->iscale, use_sse);
   if(dwt_p == NULL) goto cleanup;
@@ -351,7 +351,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       for(int k = 0; k < 4; k++) Labmin[k] = -INFINITY;
     }
 
-    dt_gaussian_t *g = dt_gaussian_init(width, height, ch, Labmax, Labmin, sigma, order);
+    dt_gaussian_t *g = dt_gaussian_init(piece->pipe, width, height, ch, Labmax, Labmin, sigma, order);
     if(!g) return;
     dt_gaussian_blur_4c(g, in, out);
     dt_gaussian_free(g);
@@ -362,7 +362,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     const float sigma_s = sigma;
     const float detail = -1.0f; // we want the bilateral base layer
 
-    dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+    dt_bilateral_t *b = dt_bilateral_init(piece->pipe, width, height, sigma_s, sigma_r);
     if(!b) return;
     dt_bilateral_splat(b, in);
     dt_bilateral_blur(b);
@@ -36,6 +36,7 @@
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_rawstage.h"
 #include "develop/tiling.h"
 #include "external/wb_presets.c"
 #include "gui/accelerators.h"
@@ -504,6 +505,21 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+void rawstage(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+              struct dt_dev_pixelpipe_rawstage_t *stage, const dt_iop_roi_t *const roi_in,
+              const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_temperature_data_t *const d = (dt_iop_temperature_data_t *)piece->data;
+
+  piece->pipe->dsc.temperature.enabled = 1;
+  for(int k = 0; k < 4; k++)
+  {
+    stage->coeffs[k] = d->coeffs[k];
+    piece->pipe->dsc.temperature.coeffs[k] = d->coeffs[k];
+    piece->pipe->dsc.processed_maximum[k] = d->coeffs[k] * piece->pipe->dsc.processed_maximum[k];
+  }
+}
+
 #if defined(__SSE__)
 void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                   void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -710,6 +726,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   for(int k = 0; k < 4; k++) d->coeffs[k] = p->coeffs[k];
 
+  piece->rawstage_ready = 1;
+
   // 4Bayer images not implemented in OpenCL yet
   if(self->dev->image_storage.flags & DT_IMAGE_4BAYER) piece->process_cl_ready = 0;
 }
@@ -316,8 +316,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     {
       const float L_in = in[0] / 100.0f;
 
-      out[0] = (L_in < xm_L) ? d->table[ch_L][CLAMP((int)(L_in * 0x10000ul), 0, 0xffff)]
-                             : dt_iop_eval_exp(d->unbounded_coeffs_L, L_in);
+      out[0] = dt_lut_lookup_unbounded(d->table[ch_L], d->unbounded_coeffs_L, xm_L, L_in);
 
       if(autoscale_ab == DT_S_SCALE_MANUAL)
       {
@@ -327,8 +326,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
         if(unbound_ab == 0)
         {
           // old style handling of a/b curves: only lut lookup with clamping
-          out[1] = d->table[ch_a][CLAMP((int)(a_in * 0x10000ul), 0, 0xffff)];
-          out[2] = d->table[ch_b][CLAMP((int)(b_in * 0x10000ul), 0, 0xffff)];
+          out[1] = dt_lut_lookup(d->table[ch_a], a_in);
+          out[2] = dt_lut_lookup(d->table[ch_b], b_in);
         }
         else
         {
@@ -337,11 +336,11 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
           out[1] = (a_in > xm_ar)
                        ? dt_iop_eval_exp(d->unbounded_coeffs_ab, a_in)
                        : ((a_in < xm_al) ? dt_iop_eval_exp(d->unbounded_coeffs_ab + 3, 1.0f - a_in)
-                                         : d->table[ch_a][CLAMP((int)(a_in * 0x10000ul), 0, 0xffff)]);
+                                         : dt_lut_lookup(d->table[ch_a], a_in));
           out[2] = (b_in > xm_br)
                        ? dt_iop_eval_exp(d->unbounded_coeffs_ab + 6, b_in)
                        : ((b_in < xm_bl) ? dt_iop_eval_exp(d->unbounded_coeffs_ab + 9, 1.0f - b_in)
-                                         : d->table[ch_b][CLAMP((int)(b_in * 0x10000ul), 0, 0xffff)]);
+                                         : dt_lut_lookup(d->table[ch_b], b_in));
         }
       }
       else if(autoscale_ab == DT_S_SCALE_AUTOMATIC)
@@ -363,8 +362,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
         float XYZ[3];
         dt_Lab_to_XYZ(in, XYZ);
         for(int c=0;c<3;c++)
-          XYZ[c] = (XYZ[c] < xm_L) ? d->table[ch_L][CLAMP((int)(XYZ[c] * 0x10000ul), 0, 0xffff)]
-                                   : dt_iop_eval_exp(d->unbounded_coeffs_L, XYZ[c]);
+          XYZ[c] = dt_lut_lookup_unbounded(d->table[ch_L], d->unbounded_coeffs_L, xm_L, XYZ[c]);
         dt_XYZ_to_Lab(XYZ, out);
       }
       else if(autoscale_ab == DT_S_SCALE_AUTOMATIC_RGB)
@@ -372,8 +370,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
         float rgb[3] = {0, 0, 0};
         dt_Lab_to_prophotorgb(in, rgb);
         for(int c=0;c<3;c++)
-          rgb[c] = (rgb[c] < xm_L) ? d->table[ch_L][CLAMP((int)(rgb[c] * 0x10000ul), 0, 0xffff)]
-                                   : dt_iop_eval_exp(d->unbounded_coeffs_L, rgb[c]);
+          rgb[c] = dt_lut_lookup_unbounded(d->table[ch_L], d->unbounded_coeffs_L, xm_L, rgb[c]);
         dt_prophotorgb_to_Lab(rgb, out);
       }
 
@@ -582,7 +579,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       float XYZ[3] = {k/(float)0x10000, k/(float)0x10000, k/(float)0x10000};
       float Lab[3] = {0.0};
       dt_XYZ_to_Lab(XYZ, Lab);
-      Lab[0] = d->table[ch_L][CLAMP((int)(Lab[0]/100.0f * 0x10000), 0, 0xffff)];
+      Lab[0] = dt_lut_lookup(d->table[ch_L], Lab[0] / 100.0f);
       dt_Lab_to_XYZ(Lab, XYZ);
       d->table[ch_L][k] = XYZ[1]; // now mapping Y_in to Y_out
     }
@@ -595,7 +592,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       float rgb[3] = {k/(float)0x10000, k/(float)0x10000, k/(float)0x10000};
       float Lab[3] = {0.0};
       dt_prophotorgb_to_Lab(rgb, Lab);
-      Lab[0] = d->table[ch_L][CLAMP((int)(Lab[0]/100.0f * 0x10000), 0, 0xffff)];
+      Lab[0] = dt_lut_lookup(d->table[ch_L], Lab[0] / 100.0f);
       dt_Lab_to_prophotorgb(Lab, rgb);
       d->table[ch_L][k] = rgb[1]; // now mapping G_in to G_out
     }
@@ -607,46 +604,46 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   // extrapolation for L-curve (right hand side only):
   const float xm_L = p->tonecurve[ch_L][p->tonecurve_nodes[ch_L] - 1].x;
   const float x_L[4] = { 0.7f * xm_L, 0.8f * xm_L, 0.9f * xm_L, 1.0f * xm_L };
-  const float y_L[4] = { d->table[ch_L][CLAMP((int)(x_L[0] * 0x10000ul), 0, 0xffff)],
-                         d->table[ch_L][CLAMP((int)(x_L[1] * 0x10000ul), 0, 0xffff)],
-                         d->table[ch_L][CLAMP((int)(x_L[2] * 0x10000ul), 0, 0xffff)],
-                         d->table[ch_L][CLAMP((int)(x_L[3] * 0x10000ul), 0, 0xffff)] };
+  const float y_L[4] = { dt_lut_lookup(d->table[ch_L], x_L[0]),
+                         dt_lut_lookup(d->table[ch_L], x_L[1]),
+                         dt_lut_lookup(d->table[ch_L], x_L[2]),
+                         dt_lut_lookup(d->table[ch_L], x_L[3]) };
   dt_iop_estimate_exp(x_L, y_L, 4, d->unbounded_coeffs_L);
 
   // extrapolation for a-curve right side:
   const float xm_ar = p->tonecurve[ch_a][p->tonecurve_nodes[ch_a] - 1].x;
   const float x_ar[4] = { 0.7f * xm_ar, 0.8f * xm_ar, 0.9f * xm_ar, 1.0f * xm_ar };
-  const float y_ar[4] = { d->table[ch_a][CLAMP((int)(x_ar[0] * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_a][CLAMP((int)(x_ar[1] * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_a][CLAMP((int)(x_ar[2] * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_a][CLAMP((int)(x_ar[3] * 0x10000ul), 0, 0xffff)] };
+  const float y_ar[4] = { dt_lut_lookup(d->table[ch_a], x_ar[0]),
+                          dt_lut_lookup(d->table[ch_a], x_ar[1]),
+                          dt_lut_lookup(d->table[ch_a], x_ar[2]),
+                          dt_lut_lookup(d->table[ch_a], x_ar[3]) };
   dt_iop_estimate_exp(x_ar, y_ar, 4, d->unbounded_coeffs_ab);
 
   // extrapolation for a-curve left side (we need to mirror the x-axis):
   const float xm_al = 1.0f - p->tonecurve[ch_a][0].x;
   const float x_al[4] = { 0.7f * xm_al, 0.8f * xm_al, 0.9f * xm_al, 1.0f * xm_al };
-  const float y_al[4] = { d->table[ch_a][CLAMP((int)((1.0f - x_al[0]) * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_a][CLAMP((int)((1.0f - x_al[1]) * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_a][CLAMP((int)((1.0f - x_al[2]) * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_a][CLAMP((int)((1.0f - x_al[3]) * 0x10000ul), 0, 0xffff)] };
+  const float y_al[4] = { dt_lut_lookup(d->table[ch_a], 1.0f - x_al[0]),
+                          dt_lut_lookup(d->table[ch_a], 1.0f - x_al[1]),
+                          dt_lut_lookup(d->table[ch_a], 1.0f - x_al[2]),
+                          dt_lut_lookup(d->table[ch_a], 1.0f - x_al[3]) };
   dt_iop_estimate_exp(x_al, y_al, 4, d->unbounded_coeffs_ab + 3);
 
   // extrapolation for b-curve right side:
   const float xm_br = p->tonecurve[ch_b][p->tonecurve_nodes[ch_b] - 1].x;
   const float x_br[4] = { 0.7f * xm_br, 0.8f * xm_br, 0.9f * xm_br, 1.0f * xm_br };
-  const float y_br[4] = { d->table[ch_b][CLAMP((int)(x_br[0] * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_b][CLAMP((int)(x_br[1] * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_b][CLAMP((int)(x_br[2] * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_b][CLAMP((int)(x_br[3] * 0x10000ul), 0, 0xffff)] };
+  const float y_br[4] = { dt_lut_lookup(d->table[ch_b], x_br[0]),
+                          dt_lut_lookup(d->table[ch_b], x_br[1]),
+                          dt_lut_lookup(d->table[ch_b], x_br[2]),
+                          dt_lut_lookup(d->table[ch_b], x_br[3]) };
   dt_iop_estimate_exp(x_br, y_br, 4, d->unbounded_coeffs_ab + 6);
 
   // extrapolation for b-curve left side (we need to mirror the x-axis):
   const float xm_bl = 1.0f - p->tonecurve[ch_b][0].x;
   const float x_bl[4] = { 0.7f * xm_bl, 0.8f * xm_bl, 0.9f * xm_bl, 1.0f * xm_bl };
-  const float y_bl[4] = { d->table[ch_b][CLAMP((int)((1.0f - x_bl[0]) * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_b][CLAMP((int)((1.0f - x_bl[1]) * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_b][CLAMP((int)((1.0f - x_bl[2]) * 0x10000ul), 0, 0xffff)],
-                          d->table[ch_b][CLAMP((int)((1.0f - x_bl[3]) * 0x10000ul), 0, 0xffff)] };
+  const float y_bl[4] = { dt_lut_lookup(d->table[ch_b], 1.0f - x_bl[0]),
+                          dt_lut_lookup(d->table[ch_b], 1.0f - x_bl[1]),
+                          dt_lut_lookup(d->table[ch_b], 1.0f - x_bl[2]),
+                          dt_lut_lookup(d->table[ch_b], 1.0f - x_bl[3]) };
   dt_iop_estimate_exp(x_bl, y_bl, 4, d->unbounded_coeffs_ab + 9);
 }
 
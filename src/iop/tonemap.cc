@@ -118,10 +118,44 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(inv_sigma_s < 3.0) inv_sigma_s = 3.0;
   inv_sigma_s = 1.0 / inv_sigma_s;
 
-  PermutohedralLattice<3, 2> lattice(size, omp_get_max_threads());
+  // Build I=log(L) once, it's needed again for slicing.
+  // its range tells us how large the lattice will get.
+  float *const logL = (float *)dt_alloc_align(64, size * sizeof(float));
+  if(!logL)
+  {
+    fprintf(stderr, "[tonemap] could not allocate log luminance buffer\n");
+    // pass the image through untouched
+    memcpy(ovoid, ivoid, sizeof(float) * ch * size);
+    return;
+  }
+  float Lmin = INFINITY, Lmax = -INFINITY;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(min : Lmin) reduction(max : Lmax)
+#endif
+  for(size_t k = 0; k < size; k++)
+  {
+    const float *in = (const float *)ivoid + k * ch;
+    float L = 0.2126 * in[0] + 0.7152 * in[1] + 0.0722 * in[2];
+    if(L <= 0.0) L = 1e-6;
+    L = logf(L);
+    logL[k] = L;
+    Lmin = fminf(Lmin, L);
+    Lmax = fmaxf(Lmax, L);
+  }
+
+  // Estimate the lattice points every thread will create from the extent of the grid its rows
+  // span, so the hash tables get sized once instead of being grown and rehashed during splatting.
+  // Real images only fill a fraction of the grid, and there can't be more points than simplex
+  // corners of the splatted pixels.
+  const int nthreads = omp_get_max_threads();
+  const float gx = width * inv_sigma_s + 2.0f;
+  const float gy = (float)height / nthreads * inv_sigma_s + 2.0f;
+  const float gz = (size ? (Lmax - Lmin) * inv_sigma_r : 0.0f) + 2.0f;
+  const size_t expected = MIN(0.25f * gx * gy * gz, (float)(size / nthreads + width) * 4);
+
+  PermutohedralLattice<3, 2> lattice(size, nthreads, MIN(expected, ((size_t)1 << 22) / nthreads));
 
-// Build I=log(L)
-// and splat into the lattice
+// splat into the lattice
 #ifdef _OPENMP
 #pragma omp parallel for shared(lattice)
 #endif
@@ -129,12 +163,9 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   {
     size_t index = (size_t)j * width;
     const int thread = omp_get_thread_num();
-    const float *in = (const float *)ivoid + (size_t)j * width * ch;
-    for(int i = 0; i < width; i++, index++, in += ch)
+    for(int i = 0; i < width; i++, index++)
     {
-      float L = 0.2126 * in[0] + 0.7152 * in[1] + 0.0722 * in[2];
-      if(L <= 0.0) L = 1e-6;
-      L = logf(L);
+      const float L = logL[index];
       float pos[3] = { i * inv_sigma_s, j * inv_sigma_s, L * inv_sigma_r };
       float val[2] = { L, 1.0 };
       lattice.splat(pos, val, index, thread);
@@ -179,9 +210,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     {
       float val[2];
       lattice.slice(val, index);
-      float L = 0.2126 * in[0] + 0.7152 * in[1] + 0.0722 * in[2];
-      if(L <= 0.0) L = 1e-6;
-      L = logf(L);
+      const float L = logL[index];
       const float B = val[0] / val[1];
       const float detail = L - B;
       const float Ln = expf(B * (contr - 1.0f) + detail - 1.0f);
@@ -192,6 +221,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       out[3] = in[3];
     }
   }
+  dt_free_align(logL);
+
   // also process the clipping point, as good as we can without knowing
   // the local environment (i.e. assuming detail == 0)
   float *pmax = piece->pipe->dsc.processed_maximum;
@@ -156,7 +156,7 @@ const char *name()
 int flags()
 {
   return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
-         | IOP_FLAGS_TILING_FULL_ROI;
+         | IOP_FLAGS_TILING_FULL_ROI | IOP_FLAGS_CACHE_FP16;
 }
 
 int default_group()
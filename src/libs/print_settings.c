@@ -30,6 +30,7 @@
 #include "common/tags.h"
 #include "common/variables.h"
 #include "control/jobs.h"
+#include "develop/pixelpipe.h"
 #include "dtgtk/resetlabel.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -247,6 +248,9 @@ static int _print_job_run(dt_job_t *job)
   dt_imageio_export_with_flags(params->imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, 1, 0, high_quality, upscale, 0,
                                NULL, FALSE, params->buf_icc_type, params->buf_icc_profile, params->buf_icc_intent,  NULL, NULL, 1, 1);
 
+  // printing is a one-off, don't keep the full size pipe around
+  dt_dev_pixelpipe_pool_cleanup(DT_DEV_PIXELPIPE_EXPORT);
+
   // after exporting we know the real size of the image, compute the layout
 
   // compute print-area (in inches)
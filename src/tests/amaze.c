@@ -0,0 +1,134 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// regression test for the amaze demosaic: it has to reconstruct a smooth rgb field from its bayer mosaic, and
+// its output must not depend on the number of threads or on which thread got which tile.
+
+#include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                       float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                       const int filters);
+
+static const uint32_t filters = 0x94949494; // rggb
+
+static void truth(const int i, const int j, float *rgb)
+{
+  rgb[0] = 0.3f + 0.1f * sinf(i * 0.011f);
+  rgb[1] = 0.4f + 0.1f * cosf(j * 0.007f + i * 0.003f);
+  rgb[2] = 0.25f + 0.1f * sinf((i + j) * 0.005f);
+}
+
+static float *demosaic(dt_dev_pixelpipe_iop_t *piece, const float *const in, const int width, const int height,
+                       const int threads)
+{
+  const dt_iop_roi_t roi = { 0, 0, width, height, 1.0f };
+  float *out = calloc((size_t)4 * width * height, sizeof(float));
+#ifdef _OPENMP
+  const int max_threads = omp_get_max_threads();
+  omp_set_num_threads(threads);
+#endif
+  amaze_demosaic_RT(NULL, piece, in, out, &roi, &roi, filters);
+#ifdef _OPENMP
+  omp_set_num_threads(max_threads);
+#endif
+  return out;
+}
+
+static int run(const char *name, const int width, const int height, const int texture)
+{
+  float *in = malloc(sizeof(float) * width * height);
+  srand(0);
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      float rgb[3];
+      truth(i, j, rgb);
+      float v = rgb[FC(j, i, filters)];
+      // fine stripes to trigger the nyquist texture handling, and some noise
+      if(texture)
+        v += 0.15f * ((i + j) & 1 ? 1.0f : -1.0f) * (i > width / 2 && j < height / 2) + 0.02f * rand() / RAND_MAX;
+      in[(size_t)j * width + i] = v;
+    }
+
+  dt_dev_pixelpipe_t *pipe = calloc(1, sizeof(dt_dev_pixelpipe_t));
+  for(int c = 0; c < 3; c++) pipe->dsc.processed_maximum[c] = 1.0f;
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.pipe = pipe;
+
+  float *single = demosaic(&piece, in, width, height, 1);
+  float *multi = demosaic(&piece, in, width, height, 7);
+  float *again = demosaic(&piece, in, width, height, 7);
+
+  const size_t n = (size_t)4 * width * height;
+  int ok = !memcmp(single, multi, sizeof(float) * n) && !memcmp(multi, again, sizeof(float) * n);
+  printf("  [%s] %s %dx%d: same output with 1 and 7 threads and on a second run\n", ok ? "OK" : "FAIL", name,
+         width, height);
+
+  if(!texture)
+  {
+    double sum = 0.0, max = 0.0;
+    for(int j = 0; j < height; j++)
+      for(int i = 0; i < width; i++)
+      {
+        float rgb[3];
+        truth(i, j, rgb);
+        for(int c = 0; c < 3; c++)
+        {
+          const double err = fabs(single[4 * ((size_t)j * width + i) + c] - rgb[c]);
+          sum += err;
+          max = fmax(max, err);
+        }
+      }
+    const double mean = sum / (3.0 * width * height);
+    const int accurate = mean < 1e-4 && max < 5e-3;
+    printf("  [%s] %s %dx%d: error mean %g, max %g\n", accurate ? "OK" : "FAIL", name, width, height, mean, max);
+    ok &= accurate;
+  }
+
+  free(single);
+  free(multi);
+  free(again);
+  free(pipe);
+  free(in);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char *arg[])
+{
+  int failed = 0;
+  // sizes that leave partial tiles at the right and bottom edge
+  failed += run("smooth", 1203, 777, 0);
+  failed += run("textured", 1203, 777, 1);
+  failed += run("textured", 4001, 2999, 1);
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
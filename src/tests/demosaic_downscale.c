@@ -0,0 +1,152 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// throughput of the downsampling demosaic used for previews and thumbnails (bayer half size and x-trans third
+// size), plain against sse2 code path, on the sensor sizes of common cameras. both have to agree.
+
+#include "common/darktable.h"
+#include "develop/imageop_math.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// not in the header, only the dispatchers are
+void dt_iop_clip_and_zoom_demosaic_half_size_f_plain(float *out, const float *const in,
+                                                     const dt_iop_roi_t *const roi_out,
+                                                     const dt_iop_roi_t *const roi_in, const int32_t out_stride,
+                                                     const int32_t in_stride, const uint32_t filters);
+void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_plain(float *out, const float *const in,
+                                                             const dt_iop_roi_t *const roi_out,
+                                                             const dt_iop_roi_t *const roi_in,
+                                                             const int32_t out_stride, const int32_t in_stride,
+                                                             const uint8_t (*const xtrans)[6]);
+#if defined(__SSE__)
+void dt_iop_clip_and_zoom_demosaic_half_size_f_sse2(float *out, const float *const in,
+                                                    const dt_iop_roi_t *const roi_out,
+                                                    const dt_iop_roi_t *const roi_in, const int32_t out_stride,
+                                                    const int32_t in_stride, const uint32_t filters);
+void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_sse2(float *out, const float *const in,
+                                                            const dt_iop_roi_t *const roi_out,
+                                                            const dt_iop_roi_t *const roi_in,
+                                                            const int32_t out_stride, const int32_t in_stride,
+                                                            const uint8_t (*const xtrans)[6]);
+#endif
+
+typedef struct sensor_t
+{
+  const char *name;
+  int width, height;
+  int xtrans;
+} sensor_t;
+
+static const sensor_t sensors[] = {
+  { "16 MP bayer", 4928, 3264, 0 },
+  { "24 MP bayer", 6016, 4016, 0 },
+  { "42 MP bayer", 7952, 5304, 0 },
+  { "16 MP x-trans", 4896, 3264, 1 },
+  { "24 MP x-trans", 6032, 4032, 1 },
+  { NULL, 0, 0, 0 }
+};
+
+// the size of the previews and thumbnails, as longer edge
+static const int sizes[] = { 1920, 720, 250, 0 };
+
+static const uint32_t filters = 0x94949494; // rggb
+static const uint8_t xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                      { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+#define RUNS 5
+
+static double run(const sensor_t *const sensor, const int sse2, float *out, const float *const in,
+                  const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in)
+{
+  gint64 best = G_MAXINT64;
+  for(int k = 0; k < RUNS; k++)
+  {
+    const gint64 start = g_get_monotonic_time();
+#if defined(__SSE__)
+    if(sse2)
+    {
+      if(sensor->xtrans)
+        dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_sse2(out, in, roi_out, roi_in, roi_out->width,
+                                                               roi_in->width, xtrans);
+      else
+        dt_iop_clip_and_zoom_demosaic_half_size_f_sse2(out, in, roi_out, roi_in, roi_out->width, roi_in->width,
+                                                       filters);
+    }
+    else
+#endif
+    {
+      if(sensor->xtrans)
+        dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f_plain(out, in, roi_out, roi_in, roi_out->width,
+                                                                roi_in->width, xtrans);
+      else
+        dt_iop_clip_and_zoom_demosaic_half_size_f_plain(out, in, roi_out, roi_in, roi_out->width, roi_in->width,
+                                                        filters);
+    }
+    best = MIN(best, g_get_monotonic_time() - start);
+  }
+  return best / 1000.0;
+}
+
+int main(int argc, char *arg[])
+{
+  int failed = 0;
+  for(const sensor_t *sensor = sensors; sensor->name; sensor++)
+  {
+    const size_t npixels = (size_t)sensor->width * sensor->height;
+    float *in = dt_alloc_align(64, sizeof(float) * npixels);
+    srand(0);
+    for(size_t k = 0; k < npixels; k++) in[k] = rand() / (float)RAND_MAX;
+
+    for(const int *size = sizes; *size; size++)
+    {
+      const dt_iop_roi_t roi_in = { 0, 0, sensor->width, sensor->height, 1.0f };
+      const float scale = *size / (float)sensor->width;
+      const dt_iop_roi_t roi_out = { 0, 0, scale * sensor->width, scale * sensor->height, scale };
+      const size_t nout = (size_t)roi_out.width * roi_out.height;
+      float *plain = dt_alloc_align(64, sizeof(float) * 4 * nout);
+      float *sse2 = dt_alloc_align(64, sizeof(float) * 4 * nout);
+
+      const double plain_time = run(sensor, 0, plain, in, &roi_out, &roi_in);
+#if defined(__SSE__)
+      const double sse2_time = run(sensor, 1, sse2, in, &roi_out, &roi_in);
+      float err = 0.0f;
+      for(size_t k = 0; k < nout; k++)
+        for(int c = 0; c < 3; c++) err = MAX(err, fabsf(plain[4 * k + c] - sse2[4 * k + c]));
+      const int ok = err < 1e-5f;
+      failed += !ok;
+      printf("  [%s] %s -> %d px: plain %.1f ms, sse2 %.1f ms, max difference %g\n", ok ? "OK" : "FAIL",
+             sensor->name, *size, plain_time, sse2_time, err);
+#else
+      printf("  [OK] %s -> %d px: plain %.1f ms\n", sensor->name, *size, plain_time);
+#endif
+
+      dt_free_align(plain);
+      dt_free_align(sse2);
+    }
+    dt_free_align(in);
+  }
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,325 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the edge-avoiding wavelet transform of the equalizer, with the column passes a row at a time as in
+// iop/equalizer_eaw.h, against the column at a time passes it used to have: forward and inverse over all levels
+// have to give the same coefficients, weights and image, and the time of both is printed. the image size is odd
+// in both directions, so that the last row and column of every level take the border branches. without
+// -ffast-math both are bit exact. with it, as in release builds, the divisions by the sum of the weights may go
+// through a reciprocal in one and not in the other, and the coarser levels carry that on, so the errors are held
+// relative to the range of the data instead.
+
+#include "common/darktable.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iop/equalizer_eaw.h"
+
+#define WIDTH 3001
+#define HEIGHT 2003
+#define RUNS 5
+
+static int check(const char *what, const int ok)
+{
+  printf("  [%s] %s\n", ok ? "OK" : "FAIL", what);
+  return !ok;
+}
+
+// equalizer_eaw.h undefines them at its end
+#define gweight(i, j, ii, jj)                                                                                \
+  1.0 / (fabsf(weight_a[l][(size_t)wd * ((j) >> (l - 1)) + ((i) >> (l - 1))]                                 \
+               - weight_a[l][(size_t)wd * ((jj) >> (l - 1)) + ((ii) >> (l - 1))]) + 1.e-5)
+#define gbuf(BUF, A, B) ((BUF)[4 * ((size_t)width * ((B)) + ((A))) + ch])
+
+// dt_iop_equalizer_wtf() and dt_iop_equalizer_iwtf() as they were, walking the columns one by one
+static void old_wtf(float *buf, float **weight_a, const int l, const int width, const int height)
+{
+  const int wd = (int)(1 + (width >> (l - 1))), ht = (int)(1 + (height >> (l - 1)));
+  int ch = 0;
+  // store weights for luma channel only, chroma uses same basis.
+  memset(weight_a[l], 0, (size_t)sizeof(float) * wd * ht);
+  for(int j = 0; j < ht - 1; j++)
+    for(int i = 0; i < wd - 1; i++) weight_a[l][(size_t)j * wd + i] = gbuf(buf, i << (l - 1), j << (l - 1));
+
+  const int step = 1 << l;
+  const int st = step / 2;
+
+  float *const tmp_width_buf = (float *)malloc(width * dt_get_num_threads() * sizeof(float));
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) private(ch) schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    // rows
+    // precompute weights:
+    float *tmp = tmp_width_buf + width * dt_get_thread_num();
+    for(int i = 0; i < width - st; i += st) tmp[i] = gweight(i, j, i + st, j);
+    // predict, get detail
+    int i = st;
+    for(; i < width - st; i += step)
+      for(ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) -= (tmp[i - st] * gbuf(buf, i - st, j) + tmp[i] * gbuf(buf, i + st, j))
+                           / (tmp[i - st] + tmp[i]);
+    if(i < width)
+      for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i - st, j);
+    // update coarse
+    for(ch = 0; ch < 3; ch++) gbuf(buf, 0, j) += gbuf(buf, st, j) * 0.5f;
+    for(i = step; i < width - st; i += step)
+      for(ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) += (tmp[i - st] * gbuf(buf, i - st, j) + tmp[i] * gbuf(buf, i + st, j))
+                           / (2.0 * (tmp[i - st] + tmp[i]));
+    if(i < width)
+      for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i - st, j) * .5f;
+  }
+
+  free((void *)tmp_width_buf);
+
+  float *const tmp_height_buf = (float *)malloc(height * dt_get_num_threads() * sizeof(float));
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) private(ch) schedule(static)
+#endif
+  for(int i = 0; i < width; i++)
+  {
+    // cols
+    // precompute weights:
+    float *tmp = tmp_height_buf + height * dt_get_thread_num();
+    for(int j = 0; j < height - st; j += st) tmp[j] = gweight(i, j, i, j + st);
+    int j = st;
+    // predict, get detail
+    for(; j < height - st; j += step)
+      for(ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) -= (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
+                           / (tmp[j - st] + tmp[j]);
+    if(j < height)
+      for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i, j - st);
+    // update
+    for(ch = 0; ch < 3; ch++) gbuf(buf, i, 0) += gbuf(buf, i, st) * 0.5;
+    for(j = step; j < height - st; j += step)
+      for(ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) += (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
+                           / (2.0 * (tmp[j - st] + tmp[j]));
+    if(j < height)
+      for(ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i, j - st) * .5f;
+  }
+
+  free((void *)tmp_height_buf);
+}
+
+static void old_iwtf(float *buf, float **weight_a, const int l, const int width, const int height)
+{
+  const int step = 1 << l;
+  const int st = step / 2;
+  const int wd = (int)(1 + (width >> (l - 1)));
+
+  float *const tmp_height_buf = (float *)malloc(height * dt_get_num_threads() * sizeof(float));
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) schedule(static)
+#endif
+  for(int i = 0; i < width; i++)
+  {
+    // cols
+    float *tmp = tmp_height_buf + height * dt_get_thread_num();
+    int j;
+    for(j = 0; j < height - st; j += st) tmp[j] = gweight(i, j, i, j + st);
+    // update coarse
+    for(int ch = 0; ch < 3; ch++) gbuf(buf, i, 0) -= gbuf(buf, i, st) * 0.5f;
+    for(j = step; j < height - st; j += step)
+      for(int ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) -= (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
+                           / (2.0 * (tmp[j - st] + tmp[j]));
+    if(j < height)
+      for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i, j - st) * .5f;
+    // predict
+    for(j = st; j < height - st; j += step)
+      for(int ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) += (tmp[j - st] * gbuf(buf, i, j - st) + tmp[j] * gbuf(buf, i, j + st))
+                           / (tmp[j - st] + tmp[j]);
+    if(j < height)
+      for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i, j - st);
+  }
+
+  free((void *)tmp_height_buf);
+
+  float *const tmp_width_buf = (float *)malloc(width * dt_get_num_threads() * sizeof(float));
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(weight_a, buf) schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    // rows
+    float *tmp = tmp_width_buf + width * dt_get_thread_num();
+    for(int i = 0; i < width - st; i += st) tmp[i] = gweight(i, j, i + st, j);
+    // update
+    for(int ch = 0; ch < 3; ch++) gbuf(buf, 0, j) -= gbuf(buf, st, j) * 0.5f;
+    int i;
+    for(i = step; i < width - st; i += step)
+      for(int ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) -= (tmp[i - st] * gbuf(buf, i - st, j) + tmp[i] * gbuf(buf, i + st, j))
+                           / (2.0 * (tmp[i - st] + tmp[i]));
+    if(i < width)
+      for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) -= gbuf(buf, i - st, j) * 0.5f;
+    // predict
+    for(i = st; i < width - st; i += step)
+      for(int ch = 0; ch < 3; ch++)
+        gbuf(buf, i, j) += (tmp[i - st] * gbuf(buf, i - st, j) + tmp[i] * gbuf(buf, i + st, j))
+                           / (tmp[i - st] + tmp[i]);
+    if(i < width)
+      for(int ch = 0; ch < 3; ch++) gbuf(buf, i, j) += gbuf(buf, i - st, j);
+  }
+
+  free((void *)tmp_width_buf);
+}
+
+#undef gbuf
+#undef gweight
+
+// numl_cap of process() at full resolution, as its DT_IOP_EQUALIZER_MAX_LEVEL is 6
+static int levels(void)
+{
+  int numl = 0;
+  for(int k = MIN(WIDTH, HEIGHT); k; k >>= 1) numl++;
+  return MIN(6, numl);
+}
+
+// largest difference of a and b, relative to the largest magnitude in a
+static float error(const float *const a, const float *const b, const size_t n)
+{
+  float err = 0.0f, range = 0.0f;
+  for(size_t k = 0; k < n; k++)
+  {
+    err = fmaxf(err, fabsf(a[k] - b[k]));
+    range = fmaxf(range, fabsf(a[k]));
+  }
+  return range > 0.0f ? err / range : err;
+}
+
+static float **alloc_weights(const int numl)
+{
+  float **weight_a = calloc(numl, sizeof(float *));
+  for(int l = 1; l < numl; l++)
+    weight_a[l] = malloc(sizeof(float) * (1 + (WIDTH >> (l - 1))) * (1 + (HEIGHT >> (l - 1))));
+  return weight_a;
+}
+
+static void free_weights(float **weight_a, const int numl)
+{
+  for(int l = 1; l < numl; l++) free(weight_a[l]);
+  free(weight_a);
+}
+
+static void forward(float *buf, float **weight_a, const int numl, const int old)
+{
+  for(int l = 1; l < numl; l++)
+    if(old)
+      old_wtf(buf, weight_a, l, WIDTH, HEIGHT);
+    else
+      dt_iop_equalizer_wtf(buf, weight_a, l, WIDTH, HEIGHT);
+}
+
+static void inverse(float *buf, float **weight_a, const int numl, const int old)
+{
+  for(int l = numl - 1; l > 0; l--)
+    if(old)
+      old_iwtf(buf, weight_a, l, WIDTH, HEIGHT);
+    else
+      dt_iop_equalizer_iwtf(buf, weight_a, l, WIDTH, HEIGHT);
+}
+
+// best time of RUNS forward and inverse transforms of in, the last of which is left in coeff and out
+static double run(const float *const in, float *const coeff, float *const out, float **weight_a, const int numl,
+                  const int old)
+{
+  const size_t size = sizeof(float) * 4 * WIDTH * HEIGHT;
+  gint64 best = G_MAXINT64;
+  for(int r = 0; r < RUNS; r++)
+  {
+    memcpy(out, in, size);
+    const gint64 start = g_get_monotonic_time();
+    forward(out, weight_a, numl, old);
+    memcpy(coeff, out, size);
+    inverse(out, weight_a, numl, old);
+    best = MIN(best, g_get_monotonic_time() - start);
+  }
+  return best / 1000.0;
+}
+
+int main(int argc, char *arg[])
+{
+  const int numl = levels();
+  const size_t size = sizeof(float) * 4 * WIDTH * HEIGHT;
+  float *in = dt_alloc_align(64, size);
+  float *coeff_old = dt_alloc_align(64, size), *coeff_new = dt_alloc_align(64, size);
+  float *out_old = dt_alloc_align(64, size), *out_new = dt_alloc_align(64, size);
+  float **weight_old = alloc_weights(numl), **weight_new = alloc_weights(numl);
+
+  // smooth gradients with edges and some noise, in lab like the equalizer gets it
+  srand(0);
+  for(int j = 0; j < HEIGHT; j++)
+    for(int i = 0; i < WIDTH; i++)
+    {
+      float *px = in + 4 * ((size_t)WIDTH * j + i);
+      const float noise = rand() / (float)RAND_MAX - 0.5f;
+      px[0] = 50.0f + 30.0f * sinf(i * 0.01f) * cosf(j * 0.013f) + ((i / 97 + j / 61) & 1 ? 10.0f : 0.0f) + noise;
+      px[1] = 20.0f * sinf((i + j) * 0.004f) + noise;
+      px[2] = -15.0f * cosf((i - j) * 0.006f) + noise;
+      px[3] = 0.0f;
+    }
+
+  const double new_time = run(in, coeff_new, out_new, weight_new, numl, 0);
+  const double old_time = run(in, coeff_old, out_old, weight_old, numl, 1);
+
+  float weight_err = 0.0f;
+  for(int l = 1; l < numl; l++)
+    weight_err = fmaxf(weight_err, error(weight_old[l], weight_new[l],
+                                         (size_t)(1 + (WIDTH >> (l - 1))) * (1 + (HEIGHT >> (l - 1)))));
+  const float coeff_err = error(coeff_old, coeff_new, (size_t)4 * WIDTH * HEIGHT);
+  const float out_err = error(out_old, out_new, (size_t)4 * WIDTH * HEIGHT);
+
+  int failed = 0;
+  char what[256];
+  snprintf(what, sizeof(what), "%dx%d, %d levels: row-ordered %.1f ms, column by column %.1f ms", WIDTH, HEIGHT,
+           numl - 1, new_time, old_time);
+  failed += check(what, TRUE);
+  snprintf(what, sizeof(what), "edge weights of all levels, relative error %g", weight_err);
+  failed += check(what, weight_err <= 1e-4f);
+  snprintf(what, sizeof(what), "wavelet coefficients, relative error %g", coeff_err);
+  failed += check(what, coeff_err <= 1e-4f);
+  snprintf(what, sizeof(what), "image after the inverse transform, relative error %g", out_err);
+  failed += check(what, out_err <= 1e-5f);
+
+  free_weights(weight_old, numl);
+  free_weights(weight_new, numl);
+  dt_free_align(in);
+  dt_free_align(coeff_old);
+  dt_free_align(coeff_new);
+  dt_free_align(out_old);
+  dt_free_align(out_new);
+  return failed ? 1 : 0;
+}
+
+#undef RUNS
+#undef HEIGHT
+#undef WIDTH
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
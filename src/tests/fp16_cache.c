@@ -0,0 +1,200 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// precision and throughput of the half float second level of the pixelpipe cache: round trip error on
+// display- and scene-referred data, special values, and the time to park and restore a cache line against
+// a plain float copy of the same line.
+
+#include "common/darktable.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// not in the header, only the cache uses them
+void dt_dev_pixelpipe_cache_to_half(const float *const in, uint16_t *const out, const size_t n);
+void dt_dev_pixelpipe_cache_from_half(const uint16_t *const in, float *const out, const size_t n);
+
+// cache line sizes of the darkroom full pipe, 4 floats per pixel
+typedef struct line_t
+{
+  const char *name;
+  int width, height;
+} line_t;
+
+static const line_t lines[] = {
+  { "1920x1080", 1920, 1080 },
+  { "2560x1440", 2560, 1440 },
+  { "3840x2160", 3840, 2160 },
+  { NULL, 0, 0 }
+};
+
+#define RUNS 5
+
+// smallest normal half
+#define HALF_MIN 6.103515625e-05f
+// round to nearest: half an ulp of the 10 bit mantissa, relative to the value
+#define HALF_REL_ERR 4.8828125e-04f
+// in the denormal range the step is fixed
+#define HALF_ABS_ERR 2.98023224e-08f
+
+static int check(const char *what, const int ok)
+{
+  printf("  [%s] %s\n", ok ? "OK" : "FAIL", what);
+  return !ok;
+}
+
+// every half has to come back bit exact, nan has to stay nan
+static int test_halves(void)
+{
+  uint16_t *h = malloc(sizeof(uint16_t) * 65536);
+  uint16_t *back = malloc(sizeof(uint16_t) * 65536);
+  float *f = malloc(sizeof(float) * 65536);
+  for(int k = 0; k < 65536; k++) h[k] = k;
+  dt_dev_pixelpipe_cache_from_half(h, f, 65536);
+  dt_dev_pixelpipe_cache_to_half(f, back, 65536);
+  int bad = 0;
+  for(int k = 0; k < 65536; k++)
+  {
+    const int nan = (k & 0x7c00) == 0x7c00 && (k & 0x3ff);
+    if(nan ? !isnan(f[k]) || (back[k] & 0x7fff) <= 0x7c00 : back[k] != h[k]) bad++;
+  }
+  free(h);
+  free(back);
+  free(f);
+  return check("all 65536 halves survive float and back", bad == 0);
+}
+
+static int test_specials(void)
+{
+  const float in[] = { 0.0f, -0.0f, INFINITY, -INFINITY, NAN, 1e6f, -1e6f, 65504.0f, 65520.0f, 1e-10f,
+                       HALF_MIN, HALF_MIN * 0.5f, 1.0f, -1.0f };
+  const size_t n = sizeof(in) / sizeof(in[0]);
+  uint16_t h[sizeof(in) / sizeof(in[0])];
+  float out[sizeof(in) / sizeof(in[0])];
+  dt_dev_pixelpipe_cache_to_half(in, h, n);
+  dt_dev_pixelpipe_cache_from_half(h, out, n);
+  int ok = out[0] == 0.0f && !signbit(out[0]) && out[1] == 0.0f && signbit(out[1]);
+  ok &= isinf(out[2]) && out[2] > 0.0f && isinf(out[3]) && out[3] < 0.0f && isnan(out[4]);
+  // out of range saturates to inf, 65504 is the largest half, 65520 rounds up
+  ok &= isinf(out[5]) && out[5] > 0.0f && isinf(out[6]) && out[6] < 0.0f;
+  ok &= out[7] == 65504.0f && isinf(out[8]);
+  ok &= out[9] == 0.0f && out[10] == HALF_MIN && out[11] == HALF_MIN * 0.5f && out[12] == 1.0f
+        && out[13] == -1.0f;
+  return check("zero, inf, nan, overflow and denormals", ok);
+}
+
+// random data in (-range, range), biased towards small values. checks the relative error of normals, the
+// absolute error of denormals and, for display-referred data, the error in 8 bit steps.
+static int test_range(const char *name, const float range, const size_t n)
+{
+  float *in = dt_alloc_align(64, sizeof(float) * n);
+  float *out = dt_alloc_align(64, sizeof(float) * n);
+  uint16_t *h = dt_alloc_align(64, sizeof(uint16_t) * n);
+  srand(0);
+  // spread over the exponents too, not only the top octave
+  for(size_t k = 0; k < n; k++)
+    in[k] = range * powf(rand() / (float)RAND_MAX, 4.0f) * (k & 1 ? 1.0f : -1.0f);
+  dt_dev_pixelpipe_cache_to_half(in, h, n);
+  dt_dev_pixelpipe_cache_from_half(h, out, n);
+
+  float rel = 0.0f, abs_err = 0.0f, display = 0.0f;
+  for(size_t k = 0; k < n; k++)
+  {
+    const float err = fabsf(out[k] - in[k]);
+    if(fabsf(in[k]) >= HALF_MIN)
+      rel = MAX(rel, err / fabsf(in[k]));
+    else
+      abs_err = MAX(abs_err, err);
+    display = MAX(display, err * 255.0f);
+  }
+  dt_free_align(in);
+  dt_free_align(out);
+  dt_free_align(h);
+
+  const int display_referred = range <= 1.0f;
+  char what[256];
+  int len = snprintf(what, sizeof(what), "%s: max relative error %g, max denormal error %g", name, rel, abs_err);
+  if(display_referred) snprintf(what + len, sizeof(what) - len, ", max error %g of 8 bit steps", display);
+  return check(what, rel <= HALF_REL_ERR && abs_err <= HALF_ABS_ERR && (!display_referred || display < 0.5f));
+}
+
+static double run(void (*f)(const void *, void *, size_t), const void *in, void *out, const size_t n)
+{
+  gint64 best = G_MAXINT64;
+  for(int k = 0; k < RUNS; k++)
+  {
+    const gint64 start = g_get_monotonic_time();
+    f(in, out, n);
+    best = MIN(best, g_get_monotonic_time() - start);
+  }
+  return best / 1000.0;
+}
+
+static void park(const void *in, void *out, size_t n)
+{
+  dt_dev_pixelpipe_cache_to_half(in, out, n);
+}
+
+static void restore(const void *in, void *out, size_t n)
+{
+  dt_dev_pixelpipe_cache_from_half(in, out, n);
+}
+
+static void copy(const void *in, void *out, size_t n)
+{
+  memcpy(out, in, sizeof(float) * n);
+}
+
+int main(int argc, char *arg[])
+{
+  int failed = 0;
+  failed += test_halves();
+  failed += test_specials();
+  failed += test_range("display-referred, |x| < 1", 1.0f, (size_t)1 << 22);
+  failed += test_range("scene-referred, |x| < 64", 64.0f, (size_t)1 << 22);
+
+  for(const line_t *line = lines; line->name; line++)
+  {
+    const size_t n = (size_t)4 * line->width * line->height;
+    float *in = dt_alloc_align(64, sizeof(float) * n);
+    float *out = dt_alloc_align(64, sizeof(float) * n);
+    uint16_t *h = dt_alloc_align(64, sizeof(uint16_t) * n);
+    for(size_t k = 0; k < n; k++) in[k] = (k % 1021) / 1021.0f;
+    memset(out, 0, sizeof(float) * n);
+    memset(h, 0, sizeof(uint16_t) * n);
+
+    const double park_time = run(park, in, h, n);
+    const double restore_time = run(restore, h, out, n);
+    const double copy_time = run(copy, in, out, n);
+    printf("  [OK] %s line (%.0f MB float, %.0f MB half): park %.1f ms, restore %.1f ms, float copy %.1f ms\n",
+           line->name, sizeof(float) * n / 1048576.0, sizeof(uint16_t) * n / 1048576.0, park_time, restore_time,
+           copy_time);
+
+    dt_free_align(in);
+    dt_free_align(out);
+    dt_free_align(h);
+  }
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
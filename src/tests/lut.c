@@ -0,0 +1,129 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// correctness and throughput of dt_lut_apply_rgb() in common/lut.h against the per pixel loop basecurve used
+// to have: bit exact results, also in place, once on display-referred data which only needs the tables and
+// once on data of which a part is beyond 1 and has to be extrapolated.
+
+#include "common/lut.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH 6000
+#define HEIGHT 4000
+#define RUNS 5
+
+static int check(const char *what, const int ok)
+{
+  printf("  [%s] %s\n", ok ? "OK" : "FAIL", what);
+  return !ok;
+}
+
+static void reference(const float *const in, float *const out, const size_t npixels, float *const table[3],
+                      const float *const coeff)
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      const float x = in[4 * k + c];
+      out[4 * k + c] = x < 1.0f ? table[c][CLAMP((int)(x * 0x10000ul), 0, 0xffff)]
+                                : coeff[1] * powf(x * coeff[0], coeff[2]);
+    }
+    out[4 * k + 3] = in[4 * k + 3];
+  }
+}
+
+static void apply(const float *const in, float *const out, const dt_lut_curve_t curves[3])
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int j = 0; j < HEIGHT; j++)
+  {
+    const size_t offs = (size_t)4 * WIDTH * j;
+    dt_lut_apply_rgb(in + offs, out + offs, WIDTH, 4, curves);
+  }
+}
+
+static int test_data(const char *name, const float lo, const float hi, float *const table[3],
+                     const float *const coeff, const dt_lut_curve_t curves[3])
+{
+  const size_t npixels = (size_t)WIDTH * HEIGHT;
+  float *in = malloc(sizeof(float) * 4 * npixels);
+  float *out_ref = malloc(sizeof(float) * 4 * npixels);
+  float *out = malloc(sizeof(float) * 4 * npixels);
+  srand(0);
+  for(size_t k = 0; k < 4 * npixels; k++) in[k] = lo + (hi - lo) * rand() / (float)RAND_MAX;
+
+  gint64 ref_time = G_MAXINT64, lut_time = G_MAXINT64;
+  for(int r = 0; r < RUNS; r++)
+  {
+    gint64 start = g_get_monotonic_time();
+    reference(in, out_ref, npixels, table, coeff);
+    ref_time = MIN(ref_time, g_get_monotonic_time() - start);
+    start = g_get_monotonic_time();
+    apply(in, out, curves);
+    lut_time = MIN(lut_time, g_get_monotonic_time() - start);
+  }
+  char what[256];
+  snprintf(what, sizeof(what), "%s: dt_lut_apply_rgb %.1f ms, per pixel loop %.1f ms", name, lut_time / 1000.0,
+           ref_time / 1000.0);
+  int failed = check(what, !memcmp(out, out_ref, sizeof(float) * 4 * npixels));
+
+  // in and out may be the same buffer
+  apply(in, in, curves);
+  snprintf(what, sizeof(what), "%s: in place", name);
+  failed += check(what, !memcmp(in, out_ref, sizeof(float) * 4 * npixels));
+
+  free(in);
+  free(out);
+  free(out_ref);
+  return failed;
+}
+
+int main(int argc, char *arg[])
+{
+  float *table[3];
+  for(int c = 0; c < 3; c++)
+  {
+    table[c] = malloc(sizeof(float) * DT_LUT_SIZE);
+    for(int k = 0; k < DT_LUT_SIZE; k++) table[c][k] = powf(k / (float)DT_LUT_SIZE, 1.0f / (2.0f + c));
+  }
+  const float coeff[3] = { 1.0f, 1.0f, 0.4f };
+  const dt_lut_curve_t curves[3]
+      = { { table[0], coeff, 1.0f }, { table[1], coeff, 1.0f }, { table[2], coeff, 1.0f } };
+
+  int failed = 0;
+  failed += test_data("[0, 1)", 0.0f, 0.999f, table, coeff, curves);
+  failed += test_data("[-0.1, 1.1)", -0.1f, 1.1f, table, coeff, curves);
+
+  for(int c = 0; c < 3; c++) free(table[c]);
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
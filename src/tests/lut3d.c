@@ -0,0 +1,173 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// accuracy and throughput of the 3d luts in common/lut3d.c against the lcms2 transforms they stand in for,
+// the way colorin (rgb -> Lab) and colorout (Lab -> rgb) use them, and pipes asking for the same table at once.
+#include "common/darktable.h"
+#include "common/lut3d.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static void transform(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  cmsDoTransform((cmsHTRANSFORM)data, in, out, npixels);
+}
+
+// rows of the grid evaluated so far, a table has DT_LUT3D_SIZE^2 of them
+static int grid_rows = 0;
+
+static void counting_transform(const float *const in, float *const out, const size_t npixels, void *data)
+{
+  if(npixels == DT_LUT3D_SIZE)
+  {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    grid_rows++;
+  }
+  transform(in, out, npixels, data);
+}
+
+// every thread asks for the same new table at once, it has to be baked once and shared
+static int concurrent(cmsHTRANSFORM xform)
+{
+  const char *name = "concurrent";
+  const uint64_t key = dt_lut3d_hash(0, name, strlen(name));
+  const int nthreads = 8;
+  dt_lut3d_t *luts[8] = { NULL };
+  grid_rows = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+#endif
+  for(int k = 0; k < nthreads; k++)
+    luts[k] = dt_lut3d_get(key, DT_LUT3D_DOMAIN_RGB, 0.05f, counting_transform, xform);
+
+  int ok = luts[0] && luts[0]->refs == nthreads && !luts[0]->baking;
+  for(int k = 1; k < nthreads; k++) ok &= luts[k] == luts[0];
+  const int bakes = grid_rows / (DT_LUT3D_SIZE * DT_LUT3D_SIZE);
+  ok &= bakes == 1;
+  fprintf(stderr, "%d threads asking for one table: %d bake(s), %s\n", nthreads, bakes,
+          ok ? "shared" : "NOT shared");
+  for(int k = 0; k < nthreads; k++) dt_lut3d_release(luts[k]);
+  return !ok;
+}
+
+static double get_time()
+{
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return 0.0;
+#endif
+}
+
+static void run(const char *name, cmsHTRANSFORM xform, const dt_lut3d_domain_t domain, const float tolerance,
+                const float *const in, const size_t width, const size_t height)
+{
+  const size_t npixels = width * height;
+  float *out_lcms = calloc(4 * npixels, sizeof(float));
+  float *out_lut = calloc(4 * npixels, sizeof(float));
+
+  double start = get_time();
+  dt_lut3d_t *lut = dt_lut3d_get(dt_lut3d_hash(0, name, strlen(name)), domain, tolerance, transform, xform);
+  const double bake_time = get_time() - start;
+  assert(lut);
+
+  start = get_time();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t j = 0; j < height; j++) cmsDoTransform(xform, in + 4 * width * j, out_lcms + 4 * width * j, width);
+  const double lcms_time = get_time() - start;
+
+  start = get_time();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t j = 0; j < height; j++)
+    dt_lut3d_apply(lut, in + 4 * width * j, out_lut + 4 * width * j, width, transform, xform);
+  const double lut_time = get_time() - start;
+
+  double max_err = 0.0, sum_err = 0.0;
+  for(size_t k = 0; k < npixels; k++)
+  {
+    double err = 0.0;
+    for(int c = 0; c < 3; c++) err = fmax(err, fabs(out_lcms[4 * k + c] - out_lut[4 * k + c]));
+    max_err = fmax(max_err, err);
+    sum_err += err;
+  }
+  int exact = 0;
+  for(int k = 0; k < (DT_LUT3D_SIZE - 1) * (DT_LUT3D_SIZE - 1) * (DT_LUT3D_SIZE - 1); k++) exact += lut->exact[k];
+
+  fprintf(stderr, "%s: tolerance %g, error mean %g max %g, %d cells left to lcms2\n", name, tolerance,
+          sum_err / npixels, max_err, exact);
+  fprintf(stderr, "  bake %.1f ms, lcms2 %.1f ms, lut %.1f ms\n", 1e3 * bake_time, 1e3 * lcms_time, 1e3 * lut_time);
+
+  // the second request has to come from the cache
+  dt_lut3d_t *again = dt_lut3d_get(lut->key, domain, tolerance, transform, xform);
+  assert(again == lut && lut->refs == 2);
+  dt_lut3d_release(again);
+  dt_lut3d_release(lut);
+
+  free(out_lcms);
+  free(out_lut);
+}
+
+int main(int argc, char *arg[])
+{
+  const size_t width = 4000, height = 1000;
+  float *in = malloc(sizeof(float) * 4 * width * height);
+
+  cmsHPROFILE srgb = cmsCreate_sRGBProfile();
+  cmsHPROFILE lab = cmsCreateLab4Profile(NULL);
+
+  // camera like data: linear rgb, some of it beyond 1
+  srand(0);
+  for(size_t k = 0; k < 4 * width * height; k++) in[k] = powf(rand() / (float)RAND_MAX, 2.2f) * 1.1f;
+  cmsHTRANSFORM rgb_lab = cmsCreateTransform(srgb, TYPE_RGBA_FLT, lab, TYPE_LabA_FLT, INTENT_PERCEPTUAL, 0);
+  run("sRGB -> Lab", rgb_lab, DT_LUT3D_DOMAIN_RGB, 0.05f, in, width, height);
+
+  for(size_t k = 0; k < width * height; k++)
+  {
+    in[4 * k + 0] = 100.0f * rand() / (float)RAND_MAX;
+    in[4 * k + 1] = 200.0f * rand() / (float)RAND_MAX - 100.0f;
+    in[4 * k + 2] = 200.0f * rand() / (float)RAND_MAX - 100.0f;
+  }
+  cmsHTRANSFORM lab_rgb = cmsCreateTransform(lab, TYPE_LabA_FLT, srgb, TYPE_RGBA_FLT, INTENT_PERCEPTUAL, 0);
+  run("Lab -> sRGB", lab_rgb, DT_LUT3D_DOMAIN_LAB, 1.0f / 1024.0f, in, width, height);
+
+  const int failed = concurrent(rgb_lab);
+
+  cmsDeleteTransform(rgb_lab);
+  cmsDeleteTransform(lab_rgb);
+  cmsCloseProfile(srgb);
+  cmsCloseProfile(lab);
+  dt_lut3d_cleanup();
+  free(in);
+  exit(failed ? 1 : 0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
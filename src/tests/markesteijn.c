@@ -0,0 +1,247 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// homogeneity maps and choice of directions of the x-trans markesteijn demosaic, row-wise as in
+// iop/markesteijn_homogeneity.c against the per pixel loops demosaic.c used to have: the 5x5 homogeneity sums
+// and the output have to be bit exact, for 1 and 3 passes, on whole and on cut tiles at the right and bottom of
+// the image. derivatives are quantized so that there are plenty of ties between directions. the average is only
+// held to one ulp: with -ffast-math, as in release builds, either version may divide by the number of chosen
+// directions through a reciprocal.
+
+#include "common/darktable.h"
+
+#include <float.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// markesteijn_homogeneity.c, only demosaic.c declares them
+void markesteijn_homogeneity(uint8_t *const homo_buf, uint8_t *const homosum_buf, const float *const drv_buf,
+                             const int ndir, const int pad_homo, const int pad_tile, const int mrow, const int mcol);
+void markesteijn_select_row(float *const orow, const uint8_t *const homosum_buf, const float *const rgb_buf,
+                            const int ndir, const int row, const int pad_tile, const int mcol);
+
+// same tile size and layout of the working space as demosaic.c
+#define TS 122
+#define TILES 200
+#define RUNS 5
+
+static int check(const char *what, const int ok)
+{
+  printf("  [%s] %s\n", ok ? "OK" : "FAIL", what);
+  return !ok;
+}
+
+// distance in units of the last place, of positive floats
+static int ulps(const float a, const float b)
+{
+  int32_t ia, ib;
+  memcpy(&ia, &a, sizeof(ia));
+  memcpy(&ib, &b, sizeof(ib));
+  return abs(ia - ib);
+}
+
+typedef struct tile_t
+{
+  char *buffer;
+  float (*rgb)[TS][TS][3];
+  float (*drv)[TS][TS];
+  uint8_t (*homo)[TS][TS];
+  uint8_t (*homosum)[TS][TS];
+} tile_t;
+
+static size_t buffer_size(const int ndir)
+{
+  return (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
+}
+
+static void tile_init(tile_t *t, const int ndir)
+{
+  t->buffer = dt_alloc_align(16, buffer_size(ndir));
+  t->rgb = (float(*)[TS][TS][3])t->buffer;
+  t->drv = (float(*)[TS][TS])(t->buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
+  // homo and homosum share the space of yuv, homosum runs into drv[0]
+  t->homo = (uint8_t(*)[TS][TS])(t->buffer + TS * TS * (ndir * 3) * sizeof(float));
+  t->homosum = (uint8_t(*)[TS][TS])(t->buffer + TS * TS * (ndir * 3) * sizeof(float) + TS * TS * ndir);
+}
+
+static void fill(tile_t *t, const int ndir)
+{
+  for(int d = 0; d < ndir; d++)
+    for(int row = 0; row < TS; row++)
+      for(int col = 0; col < TS; col++)
+      {
+        // few levels, so that directions tie and the threshold hits exactly
+        t->drv[d][row][col] = (rand() % 12) * 0.125f;
+        for(int c = 0; c < 3; c++) t->rgb[d][row][col][c] = rand() / (float)RAND_MAX;
+      }
+}
+
+// the loops of demosaic.c before they went row-wise
+static void reference(tile_t *t, float *out, const int width, const int ndir, const int pad_homo,
+                      const int pad_tile, const int mrow, const int mcol)
+{
+  float(*const drv)[TS][TS] = t->drv;
+  uint8_t(*const homo)[TS][TS] = t->homo;
+  uint8_t(*const homosum)[TS][TS] = t->homosum;
+  float(*const rgb)[TS][TS][3] = t->rgb;
+
+  memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
+  for(int row = pad_homo; row < mrow - pad_homo; row++)
+    for(int col = pad_homo; col < mcol - pad_homo; col++)
+    {
+      float tr = FLT_MAX;
+      for(int d = 0; d < ndir; d++)
+        if(tr > drv[d][row][col]) tr = drv[d][row][col];
+      tr *= 8;
+      for(int d = 0; d < ndir; d++)
+        for(int v = -1; v <= 1; v++)
+          for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+    }
+
+  for(int d = 0; d < ndir; d++)
+    for(int row = pad_tile; row < mrow - pad_tile; row++)
+    {
+      int col = pad_tile - 5;
+      uint8_t v5sum[5] = { 0 };
+      homosum[d][row][col] = 0;
+      for(col++; col < mcol - pad_tile; col++)
+      {
+        uint8_t colsum = 0;
+        for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
+        homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
+        v5sum[col % 5] = colsum;
+      }
+    }
+
+  for(int row = pad_tile; row < mrow - pad_tile; row++)
+    for(int col = pad_tile; col < mcol - pad_tile; col++)
+    {
+      uint8_t hm[8] = { 0 };
+      uint8_t maxval = 0;
+      for(int d = 0; d < ndir; d++)
+      {
+        hm[d] = homosum[d][row][col];
+        maxval = (maxval < hm[d] ? hm[d] : maxval);
+      }
+      maxval -= maxval >> 3;
+      for(int d = 0; d < ndir - 4; d++)
+        if(hm[d] < hm[d + 4])
+          hm[d] = 0;
+        else if(hm[d] > hm[d + 4])
+          hm[d + 4] = 0;
+      float avg[4] = { 0.0f };
+      for(int d = 0; d < ndir; d++)
+        if(hm[d] >= maxval)
+        {
+          for(int c = 0; c < 3; c++) avg[c] += rgb[d][row][col][c];
+          avg[3]++;
+        }
+      for(int c = 0; c < 3; c++) out[4 * (width * row + col) + c] = avg[c] / avg[3];
+    }
+}
+
+static void rowwise(tile_t *t, float *out, const int width, const int ndir, const int pad_homo,
+                    const int pad_tile, const int mrow, const int mcol)
+{
+  markesteijn_homogeneity((uint8_t *)t->homo, (uint8_t *)t->homosum, (const float *)t->drv, ndir, pad_homo,
+                          pad_tile, mrow, mcol);
+  for(int row = pad_tile; row < mrow - pad_tile; row++)
+    markesteijn_select_row(out + 4 * width * row, (const uint8_t *)t->homosum, (const float *)t->rgb, ndir,
+                           row, pad_tile, mcol);
+}
+
+static int test_passes(const int passes)
+{
+  const int ndir = 4 << (passes > 1);
+  const int pad_homo = (passes == 1) ? 10 : 15;
+  const int pad_tile = (passes == 1) ? 12 : 17;
+  // a whole tile, and one cut at the right and bottom border of the image
+  const int sizes[2][2] = { { TS, TS }, { 2 * pad_tile + 9, 2 * pad_tile + 30 } };
+
+  tile_t ref, new;
+  tile_init(&ref, ndir);
+  tile_init(&new, ndir);
+  const size_t out_size = sizeof(float) * 4 * TS * TS;
+  float *out_ref = dt_alloc_align(16, out_size);
+  float *out_new = dt_alloc_align(16, out_size);
+
+  int failed = 0;
+  srand(passes);
+  for(int s = 0; s < 2; s++)
+  {
+    const int mrow = sizes[s][0], mcol = sizes[s][1];
+    int bad_sum = 0, max_ulps = 0;
+    for(int k = 0; k < TILES; k++)
+    {
+      fill(&ref, ndir);
+      memcpy(new.buffer, ref.buffer, buffer_size(ndir));
+      memset(out_ref, 0, out_size);
+      memset(out_new, 0, out_size);
+      reference(&ref, out_ref, TS, ndir, pad_homo, pad_tile, mrow, mcol);
+      rowwise(&new, out_new, TS, ndir, pad_homo, pad_tile, mrow, mcol);
+      for(int d = 0; d < ndir; d++)
+        for(int row = pad_tile; row < mrow - pad_tile; row++)
+          bad_sum += memcmp(&ref.homosum[d][row][pad_tile], &new.homosum[d][row][pad_tile], mcol - 2 * pad_tile)
+                     != 0;
+      for(size_t i = 0; i < out_size / sizeof(float); i++)
+        max_ulps = MAX(max_ulps, ulps(out_ref[i], out_new[i]));
+    }
+    char what[256];
+    snprintf(what, sizeof(what), "%d pass%s, %dx%d tiles: homogeneity sums", passes, passes > 1 ? "es" : "",
+             mcol, mrow);
+    failed += check(what, bad_sum == 0);
+    snprintf(what, sizeof(what), "%d pass%s, %dx%d tiles: selected average, %d ulp off", passes,
+             passes > 1 ? "es" : "", mcol, mrow, max_ulps);
+    failed += check(what, max_ulps <= 1);
+  }
+
+  // throughput on whole tiles, the data set stays the same
+  fill(&ref, ndir);
+  gint64 ref_time = G_MAXINT64, new_time = G_MAXINT64;
+  for(int r = 0; r < RUNS; r++)
+  {
+    gint64 start = g_get_monotonic_time();
+    for(int k = 0; k < TILES; k++) reference(&ref, out_ref, TS, ndir, pad_homo, pad_tile, TS, TS);
+    ref_time = MIN(ref_time, g_get_monotonic_time() - start);
+    start = g_get_monotonic_time();
+    for(int k = 0; k < TILES; k++) rowwise(&ref, out_new, TS, ndir, pad_homo, pad_tile, TS, TS);
+    new_time = MIN(new_time, g_get_monotonic_time() - start);
+  }
+  printf("  [OK] %d pass%s, %d tiles: row-wise %.1f ms, per pixel %.1f ms\n", passes, passes > 1 ? "es" : "",
+         TILES, new_time / 1000.0, ref_time / 1000.0);
+
+  dt_free_align(ref.buffer);
+  dt_free_align(new.buffer);
+  dt_free_align(out_ref);
+  dt_free_align(out_new);
+  return failed;
+}
+
+int main(int argc, char *arg[])
+{
+  int failed = 0;
+  failed += test_passes(1);
+  failed += test_passes(3);
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
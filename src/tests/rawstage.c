@@ -0,0 +1,283 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the fused raw stage has to give the same result as rawprepare, temperature, highlights and hotpixels run one
+// after the other. both ways go through the modules themselves, loaded from the build tree like darktable loads
+// them: once calling their process() in turn, once collecting their rawstage() steps into a single pass. this
+// is done on a 24 MP bayer and x-trans mosaic, cropped by rawprepare and with a region of interest not at the
+// origin of the image.
+
+#include "common/darktable.h"
+#include "common/introspection.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe.h"
+#include "develop/pixelpipe_rawstage.h"
+
+#include <glib.h>
+#include <gmodule.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t bayer = 0x94949494; // rggb
+static const uint8_t xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                      { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+#define RUNS 5
+#define MODULES 4
+
+// in pipe order
+static const char *const ops[MODULES] = { "rawprepare", "temperature", "highlights", "hotpixels" };
+
+// the parts of dt_iop_load_module_so() and dt_iop_load_module_by_so() we need
+static int load(dt_iop_module_t *module, const char *op, dt_develop_t *dev)
+{
+  gchar *libname = g_module_build_path(DT_TEST_IOP_DIR, op);
+  module->module = g_module_open(libname, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+  g_free(libname);
+  if(!module->module)
+  {
+    fprintf(stderr, "[rawstage] could not open %s: %s\n", op, g_module_error());
+    return 1;
+  }
+  if(!g_module_symbol(module->module, "init_pipe", (gpointer) & (module->init_pipe))
+     || !g_module_symbol(module->module, "commit_params", (gpointer) & (module->commit_params))
+     || !g_module_symbol(module->module, "cleanup_pipe", (gpointer) & (module->cleanup_pipe))
+     || !g_module_symbol(module->module, "process", (gpointer) & (module->process_plain))
+     || !g_module_symbol(module->module, "rawstage", (gpointer) & (module->rawstage))
+     || !g_module_symbol(module->module, "get_p", (gpointer) & (module->get_p))
+     || !g_module_symbol(module->module, "get_introspection", (gpointer) & (module->get_introspection)))
+  {
+    fprintf(stderr, "[rawstage] %s lacks a symbol: %s\n", op, g_module_error());
+    return 1;
+  }
+  g_strlcpy(module->op, op, sizeof(module->op));
+  module->dev = dev;
+  module->params_size = module->get_introspection()->size;
+  module->params = calloc(1, module->params_size);
+  module->default_params = module->params;
+  return 0;
+}
+
+static void set_int(dt_iop_module_t *module, const char *name, const int value)
+{
+  *(int *)module->get_p(module->params, name) = value;
+}
+
+static void set_float(dt_iop_module_t *module, const char *name, const float value)
+{
+  *(float *)module->get_p(module->params, name) = value;
+}
+
+// what the pipe starts with, see dt_dev_pixelpipe_process_rec()
+static void reset_dsc(dt_dev_pixelpipe_t *pipe)
+{
+  pipe->dsc = pipe->image.buf_dsc;
+}
+
+// the pipe runs the modules one after the other
+static void separate(dt_iop_module_t *modules, dt_dev_pixelpipe_iop_t *pieces, const uint16_t *const in,
+                     float *const tmp, float *const out, const dt_iop_roi_t *const roi_in,
+                     const dt_iop_roi_t *const roi_out)
+{
+  const float *input = NULL;
+  int last = MODULES - 1;
+  while(!pieces[last].enabled) last--;
+  for(int k = 0; k < MODULES; k++)
+  {
+    if(!pieces[k].enabled) continue;
+    // everything up to the last module ping-pongs between tmp and out such that it ends up in out
+    float *const output = ((last - k) & 1) ? tmp : out;
+    if(k == 0)
+      modules[k].process_plain(&modules[k], &pieces[k], in, output, roi_in, roi_out);
+    else
+      modules[k].process_plain(&modules[k], &pieces[k], input, output, roi_out, roi_out);
+    input = output;
+  }
+}
+
+// and with a raw stage, the modules only say what they would do, see _process_rawstage()
+static int fused(dt_iop_module_t *modules, dt_dev_pixelpipe_iop_t *pieces, dt_dev_pixelpipe_t *pipe,
+                 const uint16_t *const in, float *const out, const dt_iop_roi_t *const roi_in,
+                 const dt_iop_roi_t *const roi_out)
+{
+  dt_dev_pixelpipe_rawstage_t stage;
+  dt_dev_pixelpipe_rawstage_init(&stage);
+  for(int k = 0; k < MODULES; k++)
+    if(pieces[k].enabled) modules[k].rawstage(&modules[k], &pieces[k], &stage, k == 0 ? roi_in : roi_out, roi_out);
+  return dt_dev_pixelpipe_rawstage_process(pipe, &stage, in, 1, out, roi_in, roi_out);
+}
+
+static int run(const char *name, const uint32_t filters, const int hotpixels)
+{
+  dt_develop_t *dev = calloc(1, sizeof(dt_develop_t));
+  dt_dev_pixelpipe_t *pipe = calloc(1, sizeof(dt_dev_pixelpipe_t));
+  dt_iop_module_t *modules = calloc(MODULES, sizeof(dt_iop_module_t));
+  dt_dev_pixelpipe_iop_t *pieces = calloc(MODULES, sizeof(dt_dev_pixelpipe_iop_t));
+
+  pipe->type = DT_DEV_PIXELPIPE_EXPORT;
+  pipe->image.flags = DT_IMAGE_RAW;
+  pipe->image.buf_dsc.channels = 1;
+  pipe->image.buf_dsc.datatype = TYPE_UINT16;
+  pipe->image.buf_dsc.filters = filters;
+  memcpy(pipe->image.buf_dsc.xtrans, xtrans, sizeof(xtrans));
+  for(int k = 0; k < 4; k++) pipe->image.buf_dsc.processed_maximum[k] = 1.0f;
+  dev->image_storage = pipe->image;
+  reset_dsc(pipe);
+
+  int failed = 0;
+  for(int k = 0; k < MODULES; k++) failed |= load(&modules[k], ops[k], dev);
+  if(failed)
+  {
+    free(pieces);
+    free(modules);
+    free(pipe);
+    free(dev);
+    return 1;
+  }
+
+  // a sensor with a few masked pixels on the left and top and some more on the right and bottom
+  set_int(&modules[0], "crop.named.x", 13);
+  set_int(&modules[0], "crop.named.y", 7);
+  set_int(&modules[0], "crop.named.width", 6);
+  set_int(&modules[0], "crop.named.height", 4);
+  uint16_t *const black = (uint16_t *)modules[0].get_p(modules[0].params, "raw_black_level_separate");
+  for(int k = 0; k < 4; k++) black[k] = 512 + k;
+  *(uint16_t *)modules[0].get_p(modules[0].params, "raw_white_point") = 16383;
+
+  // green is not 1, or the highlights clip would not depend on how the sensor maximum was passed on
+  float *const coeffs = (float *)modules[1].get_p(modules[1].params, "coeffs");
+  coeffs[0] = 2.1f;
+  coeffs[1] = 1.2f;
+  coeffs[2] = 1.6f;
+  coeffs[3] = 1.2f;
+
+  set_int(&modules[2], "mode", 0); // DT_IOP_HIGHLIGHTS_CLIP
+  set_float(&modules[2], "clip", 0.9f);
+
+  // not a power of two, or rounding differences could break the many exact ties of the quantized input
+  set_float(&modules[3], "strength", 0.26f);
+  set_float(&modules[3], "threshold", 0.05f);
+  set_int(&modules[3], "permissive", TRUE);
+
+  for(int k = 0; k < MODULES; k++)
+  {
+    pieces[k].pipe = pipe;
+    pieces[k].module = &modules[k];
+    pieces[k].iscale = 1.0f;
+    pieces[k].colors = 1;
+    pieces[k].enabled = 1;
+    modules[k].init_pipe(&modules[k], pipe, &pieces[k]);
+    pieces[k].dsc_in = pieces[k].dsc_out = pipe->dsc;
+    pieces[k].dsc_in.datatype = k == 0 ? TYPE_UINT16 : TYPE_FLOAT;
+    pieces[k].dsc_out.datatype = TYPE_FLOAT;
+  }
+  pieces[3].enabled = hotpixels;
+
+  // a region of interest at an odd offset, the input is what rawprepare asks for
+  const dt_iop_roi_t roi_out = { 101, 53, 6048 - 19 - 2 * 101, 4044 - 11 - 2 * 53, 1.0f };
+  const dt_iop_roi_t roi_in = { roi_out.x, roi_out.y, roi_out.width + 19, roi_out.height + 11, 1.0f };
+  const size_t npixels = (size_t)roi_out.width * roi_out.height;
+
+  uint16_t *in = dt_alloc_align(64, sizeof(uint16_t) * roi_in.width * roi_in.height);
+  srand(0);
+  for(size_t k = 0; k < (size_t)roi_in.width * roi_in.height; k++)
+    // mostly dark and noisy, with some bright hot pixels and some clipped ones
+    in[k] = rand() % 1000 ? 512 + rand() % 4000 : 16383 - rand() % 64;
+
+  float *tmp = dt_alloc_align(64, sizeof(float) * npixels);
+  float *expected = dt_alloc_align(64, sizeof(float) * npixels);
+  float *result = dt_alloc_align(64, sizeof(float) * npixels);
+
+  gint64 separate_time = G_MAXINT64, fused_time = G_MAXINT64;
+  dt_iop_buffer_dsc_t separate_dsc, fused_dsc;
+  for(int k = 0; k < RUNS; k++)
+  {
+    reset_dsc(pipe);
+    gint64 start = g_get_monotonic_time();
+    separate(modules, pieces, in, tmp, expected, &roi_in, &roi_out);
+    separate_time = MIN(separate_time, g_get_monotonic_time() - start);
+    separate_dsc = pipe->dsc;
+
+    reset_dsc(pipe);
+    start = g_get_monotonic_time();
+    failed |= fused(modules, pieces, pipe, in, result, &roi_in, &roi_out);
+    fused_time = MIN(fused_time, g_get_monotonic_time() - start);
+    fused_dsc = pipe->dsc;
+  }
+
+  // the buffer description the next modules get has to be the same too
+  failed |= separate_dsc.filters != fused_dsc.filters
+            || memcmp(separate_dsc.xtrans, fused_dsc.xtrans, sizeof(fused_dsc.xtrans))
+            || memcmp(separate_dsc.processed_maximum, fused_dsc.processed_maximum,
+                      sizeof(fused_dsc.processed_maximum))
+            || memcmp(separate_dsc.temperature.coeffs, fused_dsc.temperature.coeffs,
+                      sizeof(fused_dsc.temperature.coeffs));
+
+  // with -ffast-math the compiler may round the two differently, but not by more than that. hot pixels show up
+  // as the pixels hotpixels changed compared to what highlights left in tmp.
+  size_t fixed = 0;
+  float err = 0.0f;
+  for(size_t k = 0; k < npixels; k++)
+  {
+    fixed += hotpixels && expected[k] != tmp[k];
+    err = MAX(err, fabsf(expected[k] - result[k]));
+  }
+  const int ok = !failed && err < 1e-6f && (!hotpixels || fixed);
+  printf("  [%s] %s%s: separate %.1f ms, fused %.1f ms, max difference %g, %zu hot pixels\n", ok ? "OK" : "FAIL",
+         name, hotpixels ? " with hot pixels" : "", separate_time / 1000.0, fused_time / 1000.0, err, fixed);
+
+  dt_free_align(result);
+  dt_free_align(expected);
+  dt_free_align(tmp);
+  dt_free_align(in);
+  for(int k = 0; k < MODULES; k++)
+  {
+    modules[k].cleanup_pipe(&modules[k], pipe, &pieces[k]);
+    free(modules[k].params);
+    g_module_close(modules[k].module);
+  }
+  free(pieces);
+  free(modules);
+  free(pipe);
+  free(dev);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char *arg[])
+{
+  // the plain code paths of the modules, as dt_codepaths_init() picks them without sse
+  darktable.codepath.OPENMP_SIMD = 1;
+
+  int failed = 0;
+  failed += run("bayer", bayer, 0);
+  failed += run("bayer", bayer, 1);
+  failed += run("x-trans", 9u, 0);
+  failed += run("x-trans", 9u, 1);
+  return failed ? 1 : 0;
+}
+
+#undef MODULES
+#undef RUNS
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,186 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the fused raw stage in a real pipe: the raw file given on the command line goes through an export pipe with its
+// default history and dt_dev_pixelpipe_process_no_gamma(), like dt_imageio_export_with_flags() does it. once as
+// is, so that _process_rawstage() takes rawprepare, temperature and highlights in one pass, and once with
+// rawstage_ready cleared on all pieces, so that each of them runs its own process(). the modules are the installed
+// ones, on the sse2 code paths, on the cpu. with -d perf on the command line the log shows the fused pass.
+//
+//   darktable-test-rawstage-pipe [-d perf] <raw file>
+
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/mipmap_cache.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUNS 5
+
+static int check(const char *what, const int ok)
+{
+  printf("  [%s] %s\n", ok ? "OK" : "FAIL", what);
+  return !ok;
+}
+
+typedef struct result_t
+{
+  float *buf;
+  int width, height;
+  int ready;
+  double time;
+} result_t;
+
+// processes the full image, with or without the fused raw stage. returns 0 on success.
+static int process(dt_develop_t *dev, dt_mipmap_buffer_t *buf, const int fused, result_t *res)
+{
+  dt_dev_pixelpipe_t pipe;
+  memset(&pipe, 0, sizeof(pipe));
+  if(!dt_dev_pixelpipe_init_export(&pipe, buf->width, buf->height, IMAGEIO_RGB | IMAGEIO_FLOAT)) return 1;
+  dt_dev_pixelpipe_set_input(&pipe, dev, (float *)buf->buf, buf->width, buf->height, buf->iscale);
+  dt_dev_pixelpipe_create_nodes(&pipe, dev);
+  dt_dev_pixelpipe_synch_all(&pipe, dev);
+  dt_dev_pixelpipe_get_dimensions(&pipe, dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                  &pipe.processed_height);
+
+  // commit_params() has set rawstage_ready, without it _process_rawstage() leaves the modules alone
+  res->ready = 0;
+  for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && piece->rawstage_ready) res->ready++;
+    if(!fused) piece->rawstage_ready = 0;
+  }
+
+  int err = 0;
+  gint64 best = G_MAXINT64;
+  for(int r = 0; r < RUNS && !err; r++)
+  {
+    // or all but the first run would come from the cache
+    dt_dev_pixelpipe_cache_flush(&pipe.cache);
+    const gint64 start = g_get_monotonic_time();
+    err = dt_dev_pixelpipe_process_no_gamma(&pipe, dev, 0, 0, pipe.processed_width, pipe.processed_height, 1.0f);
+    best = MIN(best, g_get_monotonic_time() - start);
+  }
+  res->time = best / 1000.0;
+
+  if(!err)
+  {
+    res->width = pipe.backbuf_width;
+    res->height = pipe.backbuf_height;
+    const size_t size = sizeof(float) * 4 * res->width * res->height;
+    res->buf = dt_alloc_align(64, size);
+    if(res->buf)
+      memcpy(res->buf, pipe.backbuf, size);
+    else
+      err = 1;
+  }
+  dt_dev_pixelpipe_cleanup(&pipe);
+  return err;
+}
+
+static int test_image(const uint32_t imgid)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+
+  result_t fused = { 0 }, separate = { 0 };
+  int failed = 0;
+  if(!buf.buf || !buf.width || !buf.height)
+    failed = check("load the image", FALSE);
+  else if(!(dev.image_storage.flags & DT_IMAGE_RAW) || !dev.image_storage.buf_dsc.filters)
+    failed = check("the image has to be a bayer or x-trans raw", FALSE);
+  else
+  {
+    failed += check("process with the fused raw stage", !process(&dev, &buf, 1, &fused));
+    failed += check("process each module on its own", !process(&dev, &buf, 0, &separate));
+  }
+  if(!failed)
+  {
+    // the raw stage runs the plain steps, the modules their sse2 process(). that may round differently in the
+    // last place, which is what the rest of the pipe gets to see.
+    float err = 0.0f;
+    const int same_size = fused.width == separate.width && fused.height == separate.height;
+    for(size_t k = 0; same_size && k < (size_t)fused.width * fused.height; k++)
+      for(int c = 0; c < 3; c++) err = MAX(err, fabsf(fused.buf[4 * k + c] - separate.buf[4 * k + c]));
+
+    char what[256];
+    snprintf(what, sizeof(what), "%dx%d, %d modules could go into the raw stage: fused %.1f ms, separate %.1f ms, "
+                                 "max difference %g",
+             fused.width, fused.height, fused.ready, fused.time, separate.time, err);
+    failed += check(what, same_size && fused.ready >= 2 && err < 1e-5f);
+  }
+  dt_free_align(fused.buf);
+  dt_free_align(separate.buf);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_dev_cleanup(&dev);
+  return failed;
+}
+
+int main(int argc, char *arg[])
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s [-d perf] <raw file>\n", arg[0]);
+    return 1;
+  }
+  const char *const filename = arg[argc - 1];
+  const int perf = argc > 3 && !strcmp(arg[1], "-d") && !strcmp(arg[2], "perf");
+
+  // no gui, an in-memory library and no opencl: _process_rawstage() leaves the gpu to the kernels of the modules
+  char *argv[] = { "darktable-test-rawstage-pipe", "--library", ":memory:", "--conf", "write_sidecar_files=FALSE",
+                   "--conf", "codepaths/sse2=TRUE", "--disable-opencl", "-d", "perf", NULL };
+  const int dt_argc = sizeof(argv) / sizeof(*argv) - (perf ? 1 : 3);
+  if(dt_init(dt_argc, argv, FALSE, TRUE, NULL)) return 1;
+
+  int failed = 0;
+  if(!darktable.codepath.SSE2)
+    printf("  [OK] no sse2 on this cpu, the modules run their plain code\n");
+
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(filename);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  const uint32_t imgid = filmid ? dt_image_import(filmid, filename, TRUE) : 0;
+  if(imgid)
+    failed += test_image(imgid);
+  else
+    failed += check("import the image", FALSE);
+
+  dt_cleanup();
+  return failed ? 1 : 0;
+}
+
+#undef RUNS
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -290,9 +290,11 @@ static void _update_collected_images(dt_view_t *self)
   sqlite3_stmt *stmt;
   int32_t min_before = 0, min_after = 0;
 
-  /* check if we can get a query from collection */
-  gchar *query = g_strdup(dt_collection_get_query(darktable.collection));
-  if(!query) return;
+  /* check if we can get a query from collection. the statement is kept by the collection, a sort flip or
+   * new filter values don't parse sql again */
+  sqlite3_stmt *ins_stmt
+      = dt_collection_get_stmt(darktable.collection, "INSERT INTO memory.collected_images (imgid)", NULL, FALSE);
+  if(!ins_stmt) return;
 
   // we have a new query for the collection of images to display. For speed reason we collect all images into
   // a temporary (in-memory) table (collected_images).
@@ -309,7 +311,8 @@ static void _update_collected_images(dt_view_t *self)
     sqlite3_finalize(stmt);
   }
 
-  // 1. drop previous data
+  // 1. drop previous data. make sure the main query doesn't hold a pending read on the table.
+  if(lib->statements.main_query) sqlite3_reset(lib->statements.main_query);
 
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.collected_images", NULL, NULL,
                         NULL);
@@ -319,17 +322,10 @@ static void _update_collected_images(dt_view_t *self)
 
   // 2. insert collected images into the temporary table
 
-  gchar *ins_query = NULL;
-  ins_query = dt_util_dstrcat(ins_query, "INSERT INTO memory.collected_images (imgid) %s", query);
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), ins_query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  g_free(query);
-  g_free(ins_query);
+  DT_DEBUG_SQLITE3_BIND_INT(ins_stmt, 1, 0);
+  DT_DEBUG_SQLITE3_BIND_INT(ins_stmt, 2, -1);
+  sqlite3_step(ins_stmt);
+  sqlite3_reset(ins_stmt);
 
   // 3. get new low-bound, then update the full preview rowid accordingly
   if (lib->full_preview_id != -1)
@@ -362,13 +358,11 @@ static void _update_collected_images(dt_view_t *self)
     sqlite3_finalize(stmt);
   }
 
-  /* if we have a statement lets clean it */
-  if(lib->statements.main_query) sqlite3_finalize(lib->statements.main_query);
-
-  /* prepare a new main query statement for collection */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT imgid FROM memory.collected_images ORDER BY rowid LIMIT ?1, ?2", -1,
-                              &lib->statements.main_query, NULL);
+  /* the main query only reads back the temporary table, so it is prepared once and reused */
+  if(!lib->statements.main_query)
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT imgid FROM memory.collected_images ORDER BY rowid LIMIT ?1, ?2", -1,
+                                &lib->statements.main_query, NULL);
 
   dt_control_queue_redraw_center();
 }
@@ -455,6 +449,7 @@ void cleanup(dt_view_t *self)
   dt_conf_set_float("lighttable/ui/zoom_x", lib->zoom_x);
   dt_conf_set_float("lighttable/ui/zoom_y", lib->zoom_y);
   if(lib->audio_player_id != -1) _stop_audio(lib);
+  if(lib->statements.main_query) sqlite3_finalize(lib->statements.main_query);
   free(lib->full_res_thumb);
   free(self->data);
 }
@@ -24,6 +24,7 @@
 #include "common/imageio_module.h"
 #include "control/conf.h"
 #include "control/control.h"
+#include "develop/pixelpipe.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
 #include "views/view.h"
@@ -404,6 +405,7 @@ void leave(dt_view_t *self)
   dt_free_align(d->buf2);
   d->buf1 = d->buf2 = d->front = d->back = 0;
   dt_pthread_mutex_unlock(&d->lock);
+  dt_dev_pixelpipe_pool_cleanup(DT_DEV_PIXELPIPE_EXPORT);
 }
 
 void reset(dt_view_t *self)